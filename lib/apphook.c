@@ -198,4 +198,5 @@ app_thread_stop(void)
   dns_cache_thread_deinit();
   scratch_buffers_free();
   main_loop_call_thread_deinit();
+  log_msg_pool_thread_deinit();
 }
@@ -237,11 +237,13 @@ extern struct _StatsOptions *last_stats_options;
 %token KW_FRAC_DIGITS                 10152
 
 %token KW_LOG_FIFO_SIZE               10160
+%token KW_LOG_FIFO_MEMORY_LIMIT       10161
 %token KW_LOG_FETCH_LIMIT             10162
 %token KW_LOG_IW_SIZE                 10163
 %token KW_LOG_PREFIX                  10164
 %token KW_PROGRAM_OVERRIDE            10165
 %token KW_HOST_OVERRIDE               10166
+%token KW_LOG_FIFO_LOCKLESS           10167
 
 %token KW_THROTTLE                    10170
 %token KW_THREADED                    10171
@@ -347,6 +349,10 @@ extern struct _StatsOptions *last_stats_options;
 %token KW_ON_ERROR                    10510
 
 %token KW_RETRIES                     10511
+%token KW_BATCH_LINES                 10512
+%token KW_BATCH_TIMEOUT               10513
+%token KW_WORKERS                     10514
+%token KW_WORKER_PARTITION_KEY        10515
 
 /* END_DECLS */
 
@@ -922,6 +928,7 @@ options_item
 	| KW_USE_RCPTID '(' yesno ')'		{ cfg_set_use_uniqid($3); }
 	| KW_USE_UNIQID '(' yesno ')'		{ cfg_set_use_uniqid($3); }
 	| KW_LOG_FIFO_SIZE '(' LL_NUMBER ')'	{ configuration->log_fifo_size = $3; }
+	| KW_LOG_FIFO_MEMORY_LIMIT '(' LL_NUMBER ')' { configuration->log_fifo_memory_limit = $3; }
 	| KW_LOG_IW_SIZE '(' LL_NUMBER ')'	{ msg_error("Using a global log-iw-size() option was removed, please use a per-source log-iw-size()", NULL); }
 	| KW_LOG_FETCH_LIMIT '(' LL_NUMBER ')'	{ msg_error("Using a global log-fetch-limit() option was removed, please use a per-source log-fetch-limit()", NULL); }
 	| KW_LOG_MSG_SIZE '(' LL_NUMBER ')'	{ configuration->log_msg_size = $3; }
@@ -1109,11 +1116,30 @@ threaded_dest_driver_option
         {
           log_threaded_dest_driver_set_max_retries(last_driver, $3);
         }
+	| KW_BATCH_LINES '(' LL_NUMBER ')'
+        {
+          log_threaded_dest_driver_set_batch_lines(last_driver, $3);
+        }
+	| KW_BATCH_TIMEOUT '(' LL_NUMBER ')'
+        {
+          log_threaded_dest_driver_set_batch_timeout(last_driver, $3);
+        }
+	| KW_WORKERS '(' LL_NUMBER ')'
+        {
+          log_threaded_dest_driver_set_num_workers(last_driver, $3);
+        }
+	| KW_WORKER_PARTITION_KEY '(' template_content ')'
+        {
+          log_threaded_dest_driver_set_worker_partition_key(last_driver, $3);
+          log_template_unref($3);
+        }
 
 dest_driver_option
         /* NOTE: plugins need to set "last_driver" in order to incorporate this rule in their grammar */
 
 	: KW_LOG_FIFO_SIZE '(' LL_NUMBER ')'	{ ((LogDestDriver *) last_driver)->log_fifo_size = $3; }
+	| KW_LOG_FIFO_MEMORY_LIMIT '(' LL_NUMBER ')' { ((LogDestDriver *) last_driver)->log_fifo_memory_limit = $3; }
+	| KW_LOG_FIFO_LOCKLESS '(' yesno ')'	{ ((LogDestDriver *) last_driver)->log_fifo_lockless = $3; }
 	| KW_THROTTLE '(' LL_NUMBER ')'         { ((LogDestDriver *) last_driver)->throttle = $3; }
         | LL_IDENTIFIER
           {
@@ -120,6 +120,8 @@ static CfgLexerKeyword main_keywords[] = {
   { "values",             KW_VALUES },
 
   { "log_fifo_size",      KW_LOG_FIFO_SIZE },
+  { "log_fifo_memory_limit", KW_LOG_FIFO_MEMORY_LIMIT },
+  { "log_fifo_lockless",  KW_LOG_FIFO_LOCKLESS },
   { "log_fetch_limit",    KW_LOG_FETCH_LIMIT },
   { "log_iw_size",        KW_LOG_IW_SIZE },
   { "log_msg_size",       KW_LOG_MSG_SIZE },
@@ -150,6 +152,10 @@ static CfgLexerKeyword main_keywords[] = {
   { "pass_unix_credentials", KW_PASS_UNIX_CREDENTIALS },
 
   { "retries",            KW_RETRIES, 0x0303 },
+  { "batch_lines",        KW_BATCH_LINES, 0x0303 },
+  { "batch_timeout",      KW_BATCH_TIMEOUT, 0x0303 },
+  { "workers",            KW_WORKERS, 0x0303 },
+  { "worker_partition_key", KW_WORKER_PARTITION_KEY, 0x0303 },
 
   /* filter items */
   { "type",               KW_TYPE, 0x0300 },
@@ -354,6 +354,7 @@ cfg_new(gint version)
   self->time_reap = 60;
 
   self->log_fifo_size = 10000;
+  self->log_fifo_memory_limit = 0;
   self->log_msg_size = 8192;
 
   self->file_uid = 0;
@@ -90,6 +90,8 @@ struct _GlobalConfig
   gint type_cast_strictness;
 
   gint log_fifo_size;
+  /* in bytes, 0 means unlimited */
+  gint64 log_fifo_memory_limit;
   gint log_msg_size;
 
   gboolean create_dirs;
@@ -203,6 +203,8 @@ log_dest_driver_acquire_queue_method(LogDestDriver *self, gchar *persist_name, g
   if (!queue)
     {
       queue = log_queue_fifo_new(self->log_fifo_size < 0 ? cfg->log_fifo_size : self->log_fifo_size, persist_name);
+      log_queue_fifo_set_memory_limit(queue, self->log_fifo_memory_limit < 0 ? cfg->log_fifo_memory_limit : self->log_fifo_memory_limit);
+      log_queue_fifo_set_lockless(queue, self->log_fifo_lockless);
       log_queue_set_throttle(queue, self->throttle);
     }
   return queue;
@@ -297,7 +299,9 @@ log_dest_driver_init_instance(LogDestDriver *self, GlobalConfig *cfg)
   self->acquire_queue = log_dest_driver_acquire_queue_method;
   self->release_queue = log_dest_driver_release_queue_method;
   self->log_fifo_size = -1;
+  self->log_fifo_memory_limit = -1;
   self->throttle = 0;
+  self->log_fifo_lockless = FALSE;
 }
 
 void
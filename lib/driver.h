@@ -160,6 +160,8 @@ struct _LogDestDriver
   GList *queues;
 
   gint log_fifo_size;
+  gint64 log_fifo_memory_limit;
+  gboolean log_fifo_lockless;
   gint throttle;
   StatsCounterItem *queued_global_messages;
 };
@@ -113,8 +113,12 @@
  * stuff, but that shouldn't have that much of an overhead.
  */
 
+typedef struct _LogMessagePool LogMessagePool;
+
 TLS_BLOCK_START
 {
+  /* the pool LogMessage instances are allocated from in the current thread */
+  LogMessagePool *logmsg_pool;
   /* message that is being processed by the current thread. Its ack/ref changes are cached */
   LogMessage *logmsg_current;
   /* whether the consumer is flow-controlled, (the producer always is) */
@@ -130,6 +134,7 @@ TLS_BLOCK_START
 }
 TLS_BLOCK_END;
 
+#define logmsg_pool                 __tls_deref(logmsg_pool)
 #define logmsg_current              __tls_deref(logmsg_current)
 #define logmsg_cached_refs          __tls_deref(logmsg_cached_refs)
 #define logmsg_cached_acks          __tls_deref(logmsg_cached_acks)
@@ -203,6 +208,8 @@ gint logmsg_queue_node_max = 1;
 static StatsCounterItem *count_msg_clones;
 static StatsCounterItem *count_payload_reallocs;
 static StatsCounterItem *count_sdata_updates;
+static StatsCounterItem *count_msg_pool_hits;
+static StatsCounterItem *count_msg_pool_misses;
 static GStaticPrivate priv_macro_value = G_STATIC_PRIVATE_INIT;
 
 static inline gboolean
@@ -493,6 +500,29 @@ log_msg_free_queue_node(LogMessageQueueNode *node)
     g_slice_free(LogMessageQueueNode, node);
 }
 
+/*
+ * Returns an estimate of the memory used by this message: the LogMessage
+ * struct with its preallocated queue nodes, the payload and the
+ * separately allocated tags/sdata arrays.  Shared (COW) payloads are
+ * accounted to each message referencing them.
+ *
+ * NOTE: the result only remains stable while the message is
+ * write-protected, e.g. while it is in a LogQueue.
+ */
+gsize
+log_msg_get_size(LogMessage *self)
+{
+  gsize size;
+
+  size = sizeof(LogMessage) + self->num_nodes * sizeof(LogMessageQueueNode);
+  if (self->payload)
+    size += self->payload->size;
+  if (self->num_tags)
+    size += self->num_tags * sizeof(self->tags[0]);
+  size += self->alloc_sdata * sizeof(self->sdata[0]);
+  return size;
+}
+
 void
 log_msg_set_value(LogMessage *self, NVHandle handle, const gchar *value, gssize value_len)
 {
@@ -1051,11 +1081,296 @@ log_msg_clear(LogMessage *self)
   self->flags |= LF_STATE_OWN_MASK;
 }
 
+/*
+ * LogMessage pools
+ *
+ * LogMessage instances (along with their queue nodes and initial payload)
+ * are allocated in a few power-of-two size classes from per-thread pools,
+ * instead of going through the general purpose allocator for every
+ * message.
+ *
+ * A message freed by the thread that allocated it is put back to the
+ * free list of that thread.  Messages are usually freed by a different
+ * (destination) thread though, these are pushed to the lock-free return
+ * list of the owning pool, which the owner takes over as a whole once its
+ * free lists are exhausted.
+ *
+ * Pools are not freed when their thread exits, they are adopted by the
+ * next thread that needs a pool, as there may be messages in flight that
+ * point to them.  Chunks returned to a pool without an owner are freed
+ * right away though, as there may never be a thread to adopt it.
+ *
+ * The hit/miss statistics are counted in the pool and published to the
+ * global counters in batches, instead of an atomic operation for every
+ * allocation.
+ */
+
+#define LOGMSG_POOL_MIN_SHIFT     9
+#define LOGMSG_POOL_NUM_CLASSES   6
+/* maximum number of free chunks kept in each size class of a pool */
+#define LOGMSG_POOL_MAX_FREE      1024
+/* number of allocations after which the statistics of a pool are published */
+#define LOGMSG_POOL_STATS_BATCH   1024
+
+typedef struct _LogMessageChunk LogMessageChunk;
+struct _LogMessageChunk
+{
+  /* NULL if the chunk was allocated directly, being too large for a pool */
+  LogMessagePool *pool;
+  LogMessageChunk *next;
+  gint size_class;
+  /* LogMessage follows, keep it 8 byte aligned */
+  gint __pad;
+};
+
+struct _LogMessagePool
+{
+  LogMessageChunk *free_chunks[LOGMSG_POOL_NUM_CLASSES];
+  gint num_free_chunks[LOGMSG_POOL_NUM_CLASSES];
+  /* chunks freed by other threads, only updated using atomic operations */
+  LogMessageChunk *returned_chunks;
+  /* TRUE while the pool has no owner thread, only updated using atomic operations */
+  gint orphaned;
+  LogMessagePool *next_orphan;
+  /* not yet published to count_msg_pool_hits/misses */
+  gint hits;
+  gint misses;
+};
+
+static GStaticMutex logmsg_pools_lock = G_STATIC_MUTEX_INIT;
+/* all pools ever created, freed in log_msg_global_deinit() */
+static GList *logmsg_pools;
+/* pools whose thread has exited */
+static LogMessagePool *logmsg_orphan_pools;
+
+static LogMessagePool *
+log_msg_pool_get(void)
+{
+  LogMessagePool *pool = logmsg_pool;
+
+  if (G_LIKELY(pool))
+    return pool;
+
+  g_static_mutex_lock(&logmsg_pools_lock);
+  if (logmsg_orphan_pools)
+    {
+      pool = logmsg_orphan_pools;
+      logmsg_orphan_pools = pool->next_orphan;
+      pool->next_orphan = NULL;
+      g_atomic_int_set(&pool->orphaned, FALSE);
+    }
+  else
+    {
+      pool = g_new0(LogMessagePool, 1);
+      logmsg_pools = g_list_prepend(logmsg_pools, pool);
+    }
+  g_static_mutex_unlock(&logmsg_pools_lock);
+
+  logmsg_pool = pool;
+  return pool;
+}
+
+static inline void
+log_msg_pool_put_free_chunk(LogMessagePool *pool, LogMessageChunk *chunk)
+{
+  gint size_class = chunk->size_class;
+
+  if (pool->num_free_chunks[size_class] >= LOGMSG_POOL_MAX_FREE)
+    {
+      g_free(chunk);
+      return;
+    }
+  chunk->next = pool->free_chunks[size_class];
+  pool->free_chunks[size_class] = chunk;
+  pool->num_free_chunks[size_class]++;
+}
+
+static void
+log_msg_pool_free_chunks(LogMessageChunk *chunk)
+{
+  LogMessageChunk *next;
+
+  for (; chunk; chunk = next)
+    {
+      next = chunk->next;
+      g_free(chunk);
+    }
+}
+
+/* detach the list of chunks freed by other threads */
+static LogMessageChunk *
+log_msg_pool_steal_returned_chunks(LogMessagePool *pool)
+{
+  LogMessageChunk *chunk;
+
+  do
+    {
+      chunk = g_atomic_pointer_get((gpointer *) &pool->returned_chunks);
+    }
+  while (chunk && !g_atomic_pointer_compare_and_exchange((gpointer *) &pool->returned_chunks, chunk, NULL));
+  return chunk;
+}
+
+/* move the chunks freed by other threads to our free lists */
+static void
+log_msg_pool_take_returned_chunks(LogMessagePool *pool)
+{
+  LogMessageChunk *chunk, *next;
+
+  for (chunk = log_msg_pool_steal_returned_chunks(pool); chunk; chunk = next)
+    {
+      next = chunk->next;
+      log_msg_pool_put_free_chunk(pool, chunk);
+    }
+}
+
+static inline void
+log_msg_pool_return_chunk(LogMessagePool *pool, LogMessageChunk *chunk)
+{
+  LogMessageChunk *head;
+
+  do
+    {
+      head = g_atomic_pointer_get((gpointer *) &pool->returned_chunks);
+      chunk->next = head;
+    }
+  while (!g_atomic_pointer_compare_and_exchange((gpointer *) &pool->returned_chunks, head, chunk));
+
+  /* checked after the push: either we see the flag, or the exiting owner
+   * sees our chunk when it empties the list in log_msg_pool_thread_deinit() */
+  if (G_UNLIKELY(g_atomic_int_get(&pool->orphaned)))
+    log_msg_pool_free_chunks(log_msg_pool_steal_returned_chunks(pool));
+}
+
+static void
+log_msg_pool_publish_stats(LogMessagePool *pool)
+{
+  stats_counter_add(count_msg_pool_hits, pool->hits);
+  stats_counter_add(count_msg_pool_misses, pool->misses);
+  pool->hits = 0;
+  pool->misses = 0;
+}
+
+static inline void
+log_msg_pool_count(LogMessagePool *pool, gboolean hit)
+{
+  if (hit)
+    pool->hits++;
+  else
+    pool->misses++;
+  if (G_UNLIKELY(pool->hits + pool->misses >= LOGMSG_POOL_STATS_BATCH))
+    log_msg_pool_publish_stats(pool);
+}
+
+/*
+ * Allocates at least @size bytes for a LogMessage, the actual size of
+ * the usable area is returned in @alloc_size.
+ */
+static inline gpointer
+log_msg_pool_alloc(gsize size, gsize *alloc_size)
+{
+  LogMessagePool *pool;
+  LogMessageChunk *chunk;
+  gsize chunk_size = sizeof(LogMessageChunk) + size;
+  gint size_class = 0;
+
+  while (size_class < LOGMSG_POOL_NUM_CLASSES && (1 << (LOGMSG_POOL_MIN_SHIFT + size_class)) < chunk_size)
+    size_class++;
+
+  pool = log_msg_pool_get();
+  if (G_UNLIKELY(size_class == LOGMSG_POOL_NUM_CLASSES))
+    {
+      log_msg_pool_count(pool, FALSE);
+      chunk = g_malloc(chunk_size);
+      chunk->pool = NULL;
+      *alloc_size = size;
+      return chunk + 1;
+    }
+
+  if (!pool->free_chunks[size_class])
+    log_msg_pool_take_returned_chunks(pool);
+
+  chunk = pool->free_chunks[size_class];
+  log_msg_pool_count(pool, chunk != NULL);
+  if (chunk)
+    {
+      pool->free_chunks[size_class] = chunk->next;
+      pool->num_free_chunks[size_class]--;
+    }
+  else
+    {
+      chunk = g_malloc(1 << (LOGMSG_POOL_MIN_SHIFT + size_class));
+      chunk->pool = pool;
+      chunk->size_class = size_class;
+    }
+  *alloc_size = (1 << (LOGMSG_POOL_MIN_SHIFT + size_class)) - sizeof(LogMessageChunk);
+  return chunk + 1;
+}
+
+static inline void
+log_msg_pool_free(gpointer p)
+{
+  LogMessageChunk *chunk = ((LogMessageChunk *) p) - 1;
+
+  if (!chunk->pool)
+    g_free(chunk);
+  else if (chunk->pool == logmsg_pool)
+    log_msg_pool_put_free_chunk(chunk->pool, chunk);
+  else
+    log_msg_pool_return_chunk(chunk->pool, chunk);
+}
+
+/*
+ * Called when a thread exits, makes its pool available for other threads.
+ * The free lists are kept for the next owner, the chunks returned by
+ * other threads are freed, along with any returned while the pool is
+ * orphaned.
+ */
+void
+log_msg_pool_thread_deinit(void)
+{
+  LogMessagePool *pool = logmsg_pool;
+
+  if (!pool)
+    return;
+
+  logmsg_pool = NULL;
+  log_msg_pool_publish_stats(pool);
+  g_atomic_int_set(&pool->orphaned, TRUE);
+  log_msg_pool_free_chunks(log_msg_pool_steal_returned_chunks(pool));
+
+  g_static_mutex_lock(&logmsg_pools_lock);
+  pool->next_orphan = logmsg_orphan_pools;
+  logmsg_orphan_pools = pool;
+  g_static_mutex_unlock(&logmsg_pools_lock);
+}
+
+static void
+log_msg_pools_free(void)
+{
+  GList *l;
+  gint i;
+
+  for (l = logmsg_pools; l; l = l->next)
+    {
+      LogMessagePool *pool = (LogMessagePool *) l->data;
+
+      for (i = 0; i < LOGMSG_POOL_NUM_CLASSES; i++)
+        log_msg_pool_free_chunks(pool->free_chunks[i]);
+      log_msg_pool_free_chunks(pool->returned_chunks);
+      g_free(pool);
+    }
+  g_list_free(logmsg_pools);
+  logmsg_pools = NULL;
+  logmsg_orphan_pools = NULL;
+  logmsg_pool = NULL;
+}
+
 static inline LogMessage *
-log_msg_alloc(gsize payload_size)
+log_msg_alloc(gsize payload_size, gint num_dyn_entries)
 {
   LogMessage *msg;
-  gsize payload_space = payload_size ? nv_table_get_alloc_size(LM_V_MAX, 16, payload_size) : 0;
+  gsize payload_space = payload_size ? nv_table_get_alloc_size(LM_V_MAX, num_dyn_entries, payload_size) : 0;
   gsize alloc_size, payload_ofs = 0;
 
   /* NOTE: logmsg_node_max is updated from parallel threads without locking. */
@@ -1069,12 +1384,13 @@ log_msg_alloc(gsize payload_size)
       payload_ofs = alloc_size;
       alloc_size += payload_space;
     }
-  msg = g_malloc(alloc_size);
+  msg = log_msg_pool_alloc(alloc_size, &alloc_size);
 
   memset(msg, 0, sizeof(LogMessage));
 
+  /* the rounding up to the size class is given to the payload */
   if (payload_size)
-    msg->payload = nv_table_init_borrowed(((gchar *) msg) + payload_ofs, payload_space, LM_V_MAX);
+    msg->payload = nv_table_init_borrowed(((gchar *) msg) + payload_ofs, alloc_size - payload_ofs, LM_V_MAX);
 
   msg->num_nodes = nodes;
   return msg;
@@ -1103,21 +1419,331 @@ log_msg_merge_context(LogMessage *self, LogMessage **context, gsize context_len)
     }
 }
 
+/*
+ * Serialization of LogMessage instances
+ *
+ * The serialized format is intended to store messages in disk-based queues
+ * and is reread by the same syslog-ng version, it is not a stable
+ * interchange format.  NVHandles are process-local, thus name-value pairs
+ * are stored by name and are re-registered when the message is read back.
+ * Indirect values are resolved and stored as direct ones.
+ *
+ * SDATA values are written first, in the order they appear in the
+ * message, so that reading them back with initial_parse set reproduces
+ * the same SDATA ordering.
+ */
+
+#define LOGMSG_SERIALIZE_VERSION 1
+
+typedef struct _LogMessageSerializeState
+{
+  SerializeArchive *sa;
+  guint32 num_values;
+  gboolean counting;
+} LogMessageSerializeState;
+
+static gboolean
+_write_tag(const LogMessage *self, LogTagId tag_id, const gchar *name, gpointer user_data)
+{
+  gpointer *args = (gpointer *) user_data;
+  SerializeArchive *sa = (SerializeArchive *) args[0];
+  guint32 *num_tags = (guint32 *) args[1];
+
+  if (sa)
+    serialize_write_cstring(sa, name, -1);
+  else
+    (*num_tags)++;
+  return TRUE;
+}
+
+static gboolean
+_write_value(NVHandle handle, const gchar *name, const gchar *value, gssize value_len, gpointer user_data)
+{
+  LogMessageSerializeState *state = (LogMessageSerializeState *) user_data;
+  guint16 flags;
+
+  flags = nv_registry_get_handle_flags(logmsg_registry, handle);
+  if (flags & (LM_VF_SDATA | LM_VF_MACRO))
+    return FALSE;
+
+  if (state->counting)
+    state->num_values++;
+  else if (!(serialize_write_cstring(state->sa, name, -1) &&
+             serialize_write_cstring(state->sa, value, value_len)))
+    return TRUE;
+  return FALSE;
+}
+
+static gboolean
+log_msg_write_values(LogMessage *self, SerializeArchive *sa)
+{
+  LogMessageSerializeState state = { sa, 0, TRUE };
+  gint i;
+
+  log_msg_values_foreach(self, _write_value, &state);
+  if (!serialize_write_uint32(sa, state.num_values + self->num_sdata))
+    return FALSE;
+
+  for (i = 0; i < self->num_sdata; i++)
+    {
+      const gchar *name, *value;
+      gssize value_len;
+
+      name = log_msg_get_value_name(self->sdata[i], NULL);
+      value = log_msg_get_value(self, self->sdata[i], &value_len);
+      if (!serialize_write_cstring(sa, name, -1) ||
+          !serialize_write_cstring(sa, value, value_len))
+        return FALSE;
+    }
+
+  state.counting = FALSE;
+  if (log_msg_values_foreach(self, _write_value, &state))
+    return FALSE;
+  return TRUE;
+}
+
+static gboolean
+log_msg_write_saddr(LogMessage *self, SerializeArchive *sa)
+{
+  if (!self->saddr)
+    return serialize_write_uint16(sa, 0);
+
+  return serialize_write_uint16(sa, self->saddr->salen) &&
+         serialize_write_blob(sa, g_sockaddr_get_sa(self->saddr), self->saddr->salen);
+}
+
 /**
- * log_msg_new:
+ * log_msg_write:
+ * @self: LogMessage instance
+ * @sa: archive to write to
+ *
+ * Serializes @self into @sa, see log_msg_read() for the reverse operation.
+ **/
+gboolean
+log_msg_write(LogMessage *self, SerializeArchive *sa)
+{
+  guint32 num_tags = 0;
+  gpointer tag_args[2] = { NULL, &num_tags };
+  gint i;
+
+  if (!serialize_write_uint8(sa, LOGMSG_SERIALIZE_VERSION) ||
+      !serialize_write_uint32(sa, self->flags & ~LF_STATE_MASK) ||
+      !serialize_write_uint16(sa, self->pri) ||
+      !serialize_write_uint64(sa, self->rcptid) ||
+      !serialize_write_uint32(sa, self->host_id) ||
+      !serialize_write_uint8(sa, self->num_matches))
+    return FALSE;
+
+  for (i = 0; i < LM_TS_MAX; i++)
+    {
+      if (!serialize_write_uint64(sa, self->timestamps[i].tv_sec) ||
+          !serialize_write_uint32(sa, self->timestamps[i].tv_usec) ||
+          !serialize_write_uint32(sa, self->timestamps[i].zone_offset))
+        return FALSE;
+    }
+
+  if (!log_msg_write_saddr(self, sa))
+    return FALSE;
+
+  log_msg_tags_foreach(self, _write_tag, tag_args);
+  if (!serialize_write_uint32(sa, num_tags))
+    return FALSE;
+  tag_args[0] = sa;
+  log_msg_tags_foreach(self, _write_tag, tag_args);
+
+  return log_msg_write_values(self, sa);
+}
+
+static gboolean
+log_msg_read_saddr(LogMessage *self, SerializeArchive *sa)
+{
+  guint16 salen;
+  struct sockaddr_storage ss;
+
+  if (!serialize_read_uint16(sa, &salen))
+    return FALSE;
+  if (salen == 0)
+    return TRUE;
+  if (salen > sizeof(ss) || !serialize_read_blob(sa, &ss, salen))
+    return FALSE;
+
+  if (self->saddr)
+    g_sockaddr_unref(self->saddr);
+  self->saddr = g_sockaddr_new((struct sockaddr *) &ss, salen);
+  return TRUE;
+}
+
+static gboolean
+log_msg_read_values(LogMessage *self, SerializeArchive *sa)
+{
+  guint32 num_values, i;
+  gboolean success = TRUE;
+
+  if (!serialize_read_uint32(sa, &num_values))
+    return FALSE;
+
+  /* SDATA values come in their original order, append them as they are */
+  self->initial_parse = TRUE;
+  for (i = 0; i < num_values && success; i++)
+    {
+      gchar *name = NULL, *value = NULL;
+      gsize value_len;
+
+      success = serialize_read_cstring(sa, &name, NULL) &&
+                serialize_read_cstring(sa, &value, &value_len);
+      if (success)
+        log_msg_set_value_by_name(self, name, value, value_len);
+      g_free(name);
+      g_free(value);
+    }
+  self->initial_parse = FALSE;
+  return success;
+}
+
+/**
+ * log_msg_read:
+ * @self: LogMessage instance, usually created by log_msg_new_empty()
+ * @sa: archive to read from
+ *
+ * Reads a message serialized by log_msg_write() into @self.
+ **/
+gboolean
+log_msg_read(LogMessage *self, SerializeArchive *sa)
+{
+  guint8 version, num_matches;
+  guint32 flags, host_id, num_tags, i;
+  guint64 sec;
+  guint32 usec, zone_offset;
+
+  if (!serialize_read_uint8(sa, &version))
+    return FALSE;
+
+  if (version != LOGMSG_SERIALIZE_VERSION)
+    {
+      msg_error("Unsupported serialized LogMessage version",
+                evt_tag_int("version", version),
+                NULL);
+      return FALSE;
+    }
+
+  if (!serialize_read_uint32(sa, &flags) ||
+      !serialize_read_uint16(sa, &self->pri) ||
+      !serialize_read_uint64(sa, &self->rcptid) ||
+      !serialize_read_uint32(sa, &host_id) ||
+      !serialize_read_uint8(sa, &num_matches))
+    return FALSE;
+
+  self->flags = (self->flags & LF_STATE_MASK) | (flags & ~LF_STATE_MASK);
+  self->host_id = host_id;
+
+  for (i = 0; i < LM_TS_MAX; i++)
+    {
+      if (!serialize_read_uint64(sa, &sec) ||
+          !serialize_read_uint32(sa, &usec) ||
+          !serialize_read_uint32(sa, &zone_offset))
+        return FALSE;
+      self->timestamps[i].tv_sec = sec;
+      self->timestamps[i].tv_usec = usec;
+      self->timestamps[i].zone_offset = (gint32) zone_offset;
+    }
+
+  if (!log_msg_read_saddr(self, sa))
+    return FALSE;
+
+  if (!serialize_read_uint32(sa, &num_tags))
+    return FALSE;
+  for (i = 0; i < num_tags; i++)
+    {
+      gchar *tag_name;
+
+      if (!serialize_read_cstring(sa, &tag_name, NULL))
+        return FALSE;
+      log_msg_set_tag_by_name(self, tag_name);
+      g_free(tag_name);
+    }
+
+  if (!log_msg_read_values(self, sa))
+    return FALSE;
+  self->num_matches = num_matches;
+  return TRUE;
+}
+
+/*
+ * Messages coming from the same source tend to end up with a similar set
+ * of name-value pairs, so the final size of their payload is tracked in a
+ * LogMessageSizeHint, and the payload of new messages is allocated
+ * accordingly.  This way parsers adding a lot of values do not have to
+ * realloc and copy the payload over and over.
+ *
+ * NOTE: the hint is updated from several destination threads at once,
+ * thus its fields are only accessed atomically.
+ */
+
+/* the weight of a new sample in the moving average is 1/8 */
+#define LOGMSG_SIZE_HINT_WEIGHT 8
+/* messages larger than this do not grow the estimate any further */
+#define LOGMSG_SIZE_HINT_MAX_PAYLOAD 65536
+
+static void
+log_msg_size_hint_add_sample(gint *average, gint sample)
+{
+  gint old_value;
+
+  do
+    {
+      old_value = g_atomic_int_get(average);
+    }
+  while (!g_atomic_int_compare_and_exchange(average, old_value,
+                                            old_value + (sample - old_value) / LOGMSG_SIZE_HINT_WEIGHT));
+}
+
+void
+log_msg_size_hint_update(LogMessageSizeHint *hint, LogMessage *msg)
+{
+  gint payload_size, num_dyn_entries;
+
+  if (!msg->payload)
+    return;
+
+  payload_size = MIN(msg->payload->used, LOGMSG_SIZE_HINT_MAX_PAYLOAD);
+  num_dyn_entries = msg->payload->num_dyn_entries;
+
+  log_msg_size_hint_add_sample(&hint->payload_size, payload_size);
+  log_msg_size_hint_add_sample(&hint->num_dyn_entries, num_dyn_entries);
+}
+
+/**
+ * log_msg_new_with_size_hint:
  * @msg: message to parse
  * @length: length of @msg
  * @saddr: sender address
- * @flags: parse flags (LP_*)
+ * @parse_options: parse options
+ * @hint: estimated size of the payload, or NULL
  *
- * This function allocates, parses and returns a new LogMessage instance.
+ * Same as log_msg_new(), but the payload is allocated big enough to hold
+ * the values messages similar to this one usually end up with.
  **/
 LogMessage *
-log_msg_new(const gchar *msg, gint length,
-            GSockAddr *saddr,
-            MsgFormatOptions *parse_options)
+log_msg_new_with_size_hint(const gchar *msg, gint length,
+                           GSockAddr *saddr,
+                           MsgFormatOptions *parse_options,
+                           const LogMessageSizeHint *hint)
 {
-  LogMessage *self = log_msg_alloc(length == 0 ? 256 : length * 2);
+  LogMessage *self;
+  gsize payload_size = length == 0 ? 256 : length * 2;
+  gint num_dyn_entries = 16;
+
+  if (hint)
+    {
+      gint hint_payload_size = g_atomic_int_get((gint *) &hint->payload_size);
+      gint hint_num_dyn_entries = g_atomic_int_get((gint *) &hint->num_dyn_entries);
+
+      /* leave some room for the variance */
+      payload_size = MAX(payload_size, hint_payload_size + hint_payload_size / 4);
+      num_dyn_entries = MAX(num_dyn_entries, hint_num_dyn_entries + hint_num_dyn_entries / 4);
+    }
+
+  self = log_msg_alloc(payload_size, num_dyn_entries);
 
   log_msg_init(self, saddr);
 
@@ -1132,10 +1758,27 @@ log_msg_new(const gchar *msg, gint length,
   return self;
 }
 
+/**
+ * log_msg_new:
+ * @msg: message to parse
+ * @length: length of @msg
+ * @saddr: sender address
+ * @flags: parse flags (LP_*)
+ *
+ * This function allocates, parses and returns a new LogMessage instance.
+ **/
+LogMessage *
+log_msg_new(const gchar *msg, gint length,
+            GSockAddr *saddr,
+            MsgFormatOptions *parse_options)
+{
+  return log_msg_new_with_size_hint(msg, length, saddr, parse_options, NULL);
+}
+
 LogMessage *
 log_msg_new_empty(void)
 {
-  LogMessage *self = log_msg_alloc(256);
+  LogMessage *self = log_msg_alloc(256, 16);
   
   log_msg_init(self, NULL);
   return self;
@@ -1159,7 +1802,7 @@ log_msg_clone_ack(LogMessage *msg, gpointer user_data, AckType ack_type)
 LogMessage *
 log_msg_clone_cow(LogMessage *msg, const LogPathOptions *path_options)
 {
-  LogMessage *self = log_msg_alloc(0);
+  LogMessage *self = log_msg_alloc(0, 0);
 
   stats_counter_inc(count_msg_clones);
   if ((msg->flags & LF_STATE_OWN_MASK) == 0 || ((msg->flags & LF_STATE_OWN_MASK) == LF_STATE_OWN_TAGS && msg->num_tags == 0))
@@ -1265,7 +1908,7 @@ log_msg_free(LogMessage *self)
   if (self->original)
     log_msg_unref(self->original);
 
-  g_free(self);
+  log_msg_pool_free(self);
 }
 
 /**
@@ -1658,6 +2301,8 @@ log_msg_global_init(void)
   stats_register_counter(0, SCS_GLOBAL, "msg_clones", NULL, SC_TYPE_PROCESSED, &count_msg_clones);
   stats_register_counter(0, SCS_GLOBAL, "payload_reallocs", NULL, SC_TYPE_PROCESSED, &count_payload_reallocs);
   stats_register_counter(0, SCS_GLOBAL, "sdata_updates", NULL, SC_TYPE_PROCESSED, &count_sdata_updates);
+  stats_register_counter(0, SCS_GLOBAL, "msg_pool_hits", NULL, SC_TYPE_PROCESSED, &count_msg_pool_hits);
+  stats_register_counter(0, SCS_GLOBAL, "msg_pool_misses", NULL, SC_TYPE_PROCESSED, &count_msg_pool_misses);
   stats_unlock();
 }
 
@@ -1671,6 +2316,7 @@ void
 log_msg_global_deinit(void)
 {
   log_msg_registry_deinit();
+  log_msg_pools_free();
 }
 
 const gchar *
@@ -121,11 +121,21 @@ enum
   LF_LEGACY_MSGHDR    = 0x00020000,
 };
 
+/* moving average of the final payload size of the messages of a source,
+ * accessed atomically */
+typedef struct _LogMessageSizeHint
+{
+  gint payload_size;
+  gint num_dyn_entries;
+} LogMessageSizeHint;
+
 typedef struct _LogMessageQueueNode
 {
   struct iv_list_head list;
   LogMessage *msg;
   gboolean ack_needed:1, embedded:1;
+  /* log_msg_get_size() at the time the node was queued, maintained by the LogQueue */
+  guint32 size;
 } LogMessageQueueNode;
 
 
@@ -276,12 +286,19 @@ LogMessageQueueNode *log_msg_alloc_queue_node(LogMessage *msg, const LogPathOpti
 LogMessageQueueNode *log_msg_alloc_dynamic_queue_node(LogMessage *msg, const LogPathOptions *path_options);
 void log_msg_free_queue_node(LogMessageQueueNode *node);
 
+gsize log_msg_get_size(LogMessage *self);
+
 void log_msg_clear(LogMessage *self);
 void log_msg_merge_context(LogMessage *self, LogMessage **context, gsize context_len);
 
 LogMessage *log_msg_new(const gchar *msg, gint length,
                         GSockAddr *saddr,
                         MsgFormatOptions *parse_options);
+LogMessage *log_msg_new_with_size_hint(const gchar *msg, gint length,
+                                       GSockAddr *saddr,
+                                       MsgFormatOptions *parse_options,
+                                       const LogMessageSizeHint *hint);
+void log_msg_size_hint_update(LogMessageSizeHint *hint, LogMessage *msg);
 LogMessage *log_msg_new_mark(void);
 LogMessage *log_msg_new_internal(gint prio, const gchar *msg);
 LogMessage *log_msg_new_empty(void);
@@ -299,6 +316,7 @@ void log_msg_registry_init();
 void log_msg_registry_deinit();
 void log_msg_global_init();
 void log_msg_global_deinit(void);
+void log_msg_pool_thread_deinit(void);
 void log_msg_registry_foreach(GHFunc func, gpointer user_data);
 
 #endif
@@ -554,6 +554,10 @@ log_proto_buffered_server_prepare(LogProtoServer *s, GIOCondition *cond)
   if (*cond == 0)
     *cond = G_IO_IN;
 
+  /* the transport has data buffered, no need to wait for the fd */
+  if (log_transport_has_pending_data(self->super.transport))
+    return TRUE;
+
   return FALSE;
 }
 
@@ -21,6 +21,7 @@
  * COPYING for details.
  *
  */
+#include "logproto-dgram-client.h"
 #include "logproto-dgram-server.h"
 #include "logproto-text-client.h"
 #include "logproto-text-server.h"
@@ -34,6 +35,7 @@
  * plugins, so that modules may find them, dynamically based on their plugin
  * name */
 
+DEFINE_LOG_PROTO_CLIENT(log_proto_dgram);
 DEFINE_LOG_PROTO_SERVER(log_proto_dgram);
 DEFINE_LOG_PROTO_CLIENT(log_proto_text);
 DEFINE_LOG_PROTO_SERVER(log_proto_text);
@@ -43,8 +45,7 @@ DEFINE_LOG_PROTO_SERVER(log_proto_framed);
 
 static Plugin framed_server_plugins[] =
 {
-  /* there's no separate client side for the 'dgram' transport */
-  LOG_PROTO_CLIENT_PLUGIN(log_proto_text, "dgram"),
+  LOG_PROTO_CLIENT_PLUGIN(log_proto_dgram, "dgram"),
   LOG_PROTO_SERVER_PLUGIN(log_proto_dgram, "dgram"),
   LOG_PROTO_CLIENT_PLUGIN(log_proto_text, "text"),
   LOG_PROTO_SERVER_PLUGIN(log_proto_text, "text"),
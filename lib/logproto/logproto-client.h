@@ -27,6 +27,7 @@
 
 #include "logproto.h"
 #include "persist-state.h"
+#include "stats/stats-counter.h"
 
 typedef struct _LogProtoClient LogProtoClient;
 
@@ -69,8 +70,16 @@ struct _LogProtoClient
   gboolean (*validate_options)(LogProtoClient *s);
   void (*free_fn)(LogProtoClient *s);
   LogProtoClientFlowControlFuncs flow_control_funcs;
+  /* optional, incremented for each write syscall issued by the protocol */
+  StatsCounterItem *syscalls;
 };
 
+static inline void
+log_proto_client_set_syscalls_counter(LogProtoClient *self, StatsCounterItem *syscalls)
+{
+  self->syscalls = syscalls;
+}
+
 static inline void
 log_proto_client_set_client_flow_control(LogProtoClient *self, LogProtoClientFlowControlFuncs *flow_control_funcs)
 {
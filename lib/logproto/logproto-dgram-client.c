@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2002-2012 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2012 Balázs Scheidler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#include "logproto-dgram-client.h"
+#include "messages.h"
+
+#include <errno.h>
+#include <string.h>
+
+typedef struct _LogProtoDGramClient
+{
+  LogProtoClient super;
+  struct iovec batch[LOG_PROTO_DGRAM_CLIENT_BATCH_SIZE];
+  gint batch_len;
+} LogProtoDGramClient;
+
+static gboolean
+log_proto_dgram_client_prepare(LogProtoClient *s, gint *fd, GIOCondition *cond)
+{
+  LogProtoDGramClient *self = (LogProtoDGramClient *) s;
+
+  *fd = self->super.transport->fd;
+  *cond = self->super.transport->cond;
+
+  /* if there's no pending I/O in the transport layer, then we want to do a write */
+  if (*cond == 0)
+    *cond = G_IO_OUT;
+  return self->batch_len > 0;
+}
+
+/* fallback for transports without batched sending: one datagram per
+ * write(), stopping at the first one that couldn't be sent */
+static gint
+log_proto_dgram_client_send_one_by_one(LogProtoDGramClient *self)
+{
+  gint i, rc;
+
+  for (i = 0; i < self->batch_len; i++)
+    {
+      rc = log_transport_write(self->super.transport, self->batch[i].iov_base, self->batch[i].iov_len);
+      stats_counter_inc(self->super.syscalls);
+      if (rc < 0)
+        return i > 0 ? i : -1;
+    }
+  return i;
+}
+
+static LogProtoStatus
+log_proto_dgram_client_flush(LogProtoClient *s)
+{
+  LogProtoDGramClient *self = (LogProtoDGramClient *) s;
+  gint rc, i;
+
+  if (self->batch_len == 0)
+    return LPS_SUCCESS;
+
+  if (log_transport_has_send_batch(self->super.transport))
+    {
+      rc = log_transport_send_batch(self->super.transport, self->batch, self->batch_len);
+      stats_counter_inc(self->super.syscalls);
+    }
+  else
+    {
+      rc = log_proto_dgram_client_send_one_by_one(self);
+    }
+
+  if (rc < 0)
+    {
+      if (errno != EAGAIN && errno != EINTR)
+        {
+          msg_error("I/O error occurred while writing",
+                    evt_tag_int("fd", self->super.transport->fd),
+                    evt_tag_errno(EVT_TAG_OSERROR, errno),
+                    NULL);
+          return LPS_ERROR;
+        }
+      /* the batch is retried once the socket becomes writable */
+      return LPS_SUCCESS;
+    }
+
+  for (i = 0; i < rc; i++)
+    g_free(self->batch[i].iov_base);
+  self->batch_len -= rc;
+  memmove(&self->batch[0], &self->batch[rc], self->batch_len * sizeof(self->batch[0]));
+
+  if (rc > 0)
+    log_proto_client_msg_ack(&self->super, rc);
+  return LPS_SUCCESS;
+}
+
+static LogProtoStatus
+log_proto_dgram_client_post(LogProtoClient *s, guchar *msg, gsize msg_len, gboolean *consumed)
+{
+  LogProtoDGramClient *self = (LogProtoDGramClient *) s;
+  LogProtoStatus rc;
+
+  *consumed = FALSE;
+  if (self->batch_len == LOG_PROTO_DGRAM_CLIENT_BATCH_SIZE)
+    {
+      rc = log_proto_dgram_client_flush(s);
+      if (rc != LPS_SUCCESS || self->batch_len == LOG_PROTO_DGRAM_CLIENT_BATCH_SIZE)
+        return rc;
+    }
+
+  self->batch[self->batch_len].iov_base = msg;
+  self->batch[self->batch_len].iov_len = msg_len;
+  self->batch_len++;
+  *consumed = TRUE;
+
+  if (self->batch_len == LOG_PROTO_DGRAM_CLIENT_BATCH_SIZE)
+    return log_proto_dgram_client_flush(s);
+  return LPS_SUCCESS;
+}
+
+static void
+log_proto_dgram_client_free(LogProtoClient *s)
+{
+  LogProtoDGramClient *self = (LogProtoDGramClient *) s;
+  gint i;
+
+  for (i = 0; i < self->batch_len; i++)
+    g_free(self->batch[i].iov_base);
+  log_proto_client_free_method(s);
+}
+
+LogProtoClient *
+log_proto_dgram_client_new(LogTransport *transport, const LogProtoClientOptions *options)
+{
+  LogProtoDGramClient *self = g_new0(LogProtoDGramClient, 1);
+
+  log_proto_client_init(&self->super, transport, options);
+  self->super.prepare = log_proto_dgram_client_prepare;
+  self->super.flush = log_proto_dgram_client_flush;
+  self->super.post = log_proto_dgram_client_post;
+  self->super.free_fn = log_proto_dgram_client_free;
+  return &self->super;
+}
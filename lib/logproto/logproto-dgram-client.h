@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2002-2012 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2012 Balázs Scheidler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#ifndef LOGPROTO_DGRAM_CLIENT_H_INCLUDED
+#define LOGPROTO_DGRAM_CLIENT_H_INCLUDED
+
+#include "logproto-client.h"
+
+/* the number of datagrams collected before they are sent out, a partial
+ * batch is sent when LogWriter flushes the protocol */
+#define LOG_PROTO_DGRAM_CLIENT_BATCH_SIZE 64
+
+/* each message is sent as a separate datagram, batched into a single
+ * syscall if the transport supports it */
+LogProtoClient *log_proto_dgram_client_new(LogTransport *transport, const LogProtoClientOptions *options);
+
+#endif
@@ -25,21 +25,14 @@
 #include "logproto-text-client.h"
 #include "messages.h"
 
-#define LPFCS_FRAME_SEND    0
-#define LPFCS_MESSAGE_SEND  1
-
-typedef struct _LogProtoFramedClient
-{
-  LogProtoTextClient super;
-  guchar frame_hdr_buf[9];
-} LogProtoFramedClient;
+/* "9999999 " plus the terminating NUL */
+#define LPFC_FRAME_HDR_MAX 9
 
 static LogProtoStatus
 log_proto_framed_client_post(LogProtoClient *s, guchar *msg, gsize msg_len, gboolean *consumed)
 {
-  LogProtoFramedClient *self = (LogProtoFramedClient *) s;
+  guchar frame_hdr_buf[LPFC_FRAME_HDR_MAX];
   gint frame_hdr_len;
-  gint rc;
 
   if (msg_len > 9999999)
     {
@@ -55,34 +48,18 @@ log_proto_framed_client_post(LogProtoClient *s, guchar *msg, gsize msg_len, gboo
       msg_len = 9999999;
     }
 
-  rc = LPS_SUCCESS;
-  while (rc == LPS_SUCCESS && !(*consumed) && self->super.partial == NULL)
-    {
-      switch (self->super.state)
-        {
-        case LPFCS_FRAME_SEND:
-          frame_hdr_len = g_snprintf((gchar *) self->frame_hdr_buf, sizeof(self->frame_hdr_buf), "%" G_GSIZE_FORMAT" ", msg_len);
-          rc = log_proto_text_client_submit_write(s, self->frame_hdr_buf, frame_hdr_len, NULL, LPFCS_MESSAGE_SEND);
-          break;
-        case LPFCS_MESSAGE_SEND:
-          *consumed = TRUE;
-          rc = log_proto_text_client_submit_write(s, msg, msg_len, (GDestroyNotify) g_free, LPFCS_FRAME_SEND);
-          break;
-        default:
-          g_assert_not_reached();
-        }
-    }
-
-  return rc;
+  /* the frame header is buffered along with the message, so the two
+   * are always written out in order, even in case of partial writes */
+  frame_hdr_len = g_snprintf((gchar *) frame_hdr_buf, sizeof(frame_hdr_buf), "%" G_GSIZE_FORMAT " ", msg_len);
+  return log_proto_text_client_submit_message(s, frame_hdr_buf, frame_hdr_len, msg, msg_len, consumed);
 }
 
 LogProtoClient *
 log_proto_framed_client_new(LogTransport *transport, const LogProtoClientOptions *options)
 {
-  LogProtoFramedClient *self = g_new0(LogProtoFramedClient, 1);
+  LogProtoTextClient *self = g_new0(LogProtoTextClient, 1);
 
-  log_proto_text_client_init(&self->super, transport, options);
-  self->super.super.post = log_proto_framed_client_post;
-  self->super.state = LPFCS_FRAME_SEND;
-  return &self->super.super;
+  log_proto_text_client_init(self, transport, options);
+  self->super.post = log_proto_framed_client_post;
+  return &self->super;
 }
@@ -28,6 +28,12 @@
 #include "plugin.h"
 #include "plugin-types.h"
 
+#ifdef HAVE_AVX2_TARGET_ATTRIBUTE
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /**
  * Find the character terminating the buffer.
  *
@@ -36,12 +42,11 @@
  * sure that there's no NUL left in the message. This function iterates over
  * the input data and returns a pointer to the first occurence of NL or NUL.
  *
- * It uses an algorithm similar to what there's in libc memchr/strchr.
- *
- * NOTE: find_eom is not static as it is used by a unit test program.
+ * It uses an algorithm similar to what there's in libc memchr/strchr, and
+ * is used as the fallback where no vectorized implementation is available.
  **/
-const guchar *
-find_eom(const guchar *s, gsize n)
+static const guchar *
+_find_eom_scalar(const guchar *s, gsize n)
 {
   const guchar *char_ptr;
   const gulong *longword_ptr;
@@ -100,6 +105,159 @@ find_eom(const guchar *s, gsize n)
   return NULL;
 }
 
+static inline gint
+_find_eoms_bytewise(const guchar *s, gsize pos, gsize n, guint32 *eoms, gint found, gint max_eoms)
+{
+  for (; pos < n && found < max_eoms; pos++)
+    {
+      if (s[pos] == '\n' || s[pos] == '\0')
+        eoms[found++] = pos;
+    }
+  return found;
+}
+
+static gint
+_find_eoms_scalar(const guchar *s, gsize n, guint32 *eoms, gint max_eoms)
+{
+  const guchar *eom;
+  gsize pos = 0;
+  gint found = 0;
+
+  while (found < max_eoms && pos < n && (eom = _find_eom_scalar(s + pos, n - pos)))
+    {
+      eoms[found++] = eom - s;
+      pos = eom - s + 1;
+    }
+  return found;
+}
+
+#ifdef __SSE2__
+
+static gint
+_find_eoms_sse2(const guchar *s, gsize n, guint32 *eoms, gint max_eoms)
+{
+  const __m128i nl = _mm_set1_epi8('\n');
+  const __m128i nul = _mm_setzero_si128();
+  gsize pos;
+  gint found = 0;
+
+  for (pos = 0; pos + sizeof(__m128i) <= n; pos += sizeof(__m128i))
+    {
+      __m128i chunk = _mm_loadu_si128((const __m128i *) (s + pos));
+      guint32 mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, nl),
+                                                    _mm_cmpeq_epi8(chunk, nul)));
+
+      while (mask)
+        {
+          eoms[found++] = pos + __builtin_ctz(mask);
+          if (found == max_eoms)
+            return found;
+          mask &= mask - 1;
+        }
+    }
+  return _find_eoms_bytewise(s, pos, n, eoms, found, max_eoms);
+}
+
+#endif
+
+#ifdef HAVE_AVX2_TARGET_ATTRIBUTE
+
+__attribute__((target("avx2")))
+static gint
+_find_eoms_avx2(const guchar *s, gsize n, guint32 *eoms, gint max_eoms)
+{
+  const __m256i nl = _mm256_set1_epi8('\n');
+  const __m256i nul = _mm256_setzero_si256();
+  gsize pos;
+  gint found = 0;
+
+  for (pos = 0; pos + sizeof(__m256i) <= n; pos += sizeof(__m256i))
+    {
+      __m256i chunk = _mm256_loadu_si256((const __m256i *) (s + pos));
+      guint32 mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, nl),
+                                                          _mm256_cmpeq_epi8(chunk, nul)));
+
+      while (mask)
+        {
+          eoms[found++] = pos + __builtin_ctz(mask);
+          if (found == max_eoms)
+            return found;
+          mask &= mask - 1;
+        }
+    }
+  return _find_eoms_bytewise(s, pos, n, eoms, found, max_eoms);
+}
+
+#endif
+
+static FindEOMsImplementation find_eoms_implementations[] =
+{
+#ifdef HAVE_AVX2_TARGET_ATTRIBUTE
+  { "avx2", _find_eoms_avx2 },
+#endif
+#ifdef __SSE2__
+  { "sse2", _find_eoms_sse2 },
+#endif
+  { "scalar", _find_eoms_scalar },
+  { NULL, NULL }
+};
+
+static gint _find_eoms_detect(const guchar *s, gsize n, guint32 *eoms, gint max_eoms);
+static FindEOMsFunc find_eoms_impl = _find_eoms_detect;
+
+/*
+ * Returns the list of find_eoms() implementations usable on the current
+ * CPU, the preferred one first. The list is terminated by a NULL entry.
+ */
+const FindEOMsImplementation *
+find_eoms_get_implementations(void)
+{
+  const FindEOMsImplementation *impl = find_eoms_implementations;
+
+#ifdef HAVE_AVX2_TARGET_ATTRIBUTE
+  __builtin_cpu_init();
+  if (!__builtin_cpu_supports("avx2"))
+    impl++;
+#endif
+  return impl;
+}
+
+static gint
+_find_eoms_detect(const guchar *s, gsize n, guint32 *eoms, gint max_eoms)
+{
+  find_eoms_impl = find_eoms_get_implementations()->find_eoms;
+  return find_eoms_impl(s, n, eoms, max_eoms);
+}
+
+/**
+ * Find all the characters terminating messages (NL or NUL) in the buffer
+ * in a single pass.
+ *
+ * The offsets of the first @max_eoms terminators relative to @s are stored
+ * in @eoms, the return value is the number of terminators found. The best
+ * implementation supported by the CPU is selected on the first call.
+ **/
+gint
+find_eoms(const guchar *s, gsize n, guint32 *eoms, gint max_eoms)
+{
+  return find_eoms_impl(s, n, eoms, max_eoms);
+}
+
+/**
+ * Find the first character terminating the buffer, see find_eoms() above.
+ *
+ * NOTE: find_eom is not static as it is used by a unit test program.
+ **/
+const guchar *
+find_eom(const guchar *s, gsize n)
+{
+  guint32 eom;
+
+  if (find_eoms(s, n, &eom, 1) == 0)
+    return NULL;
+  return s + eom;
+}
+
 void
 log_proto_server_free_method(LogProtoServer *s)
 {
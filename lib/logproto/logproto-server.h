@@ -180,6 +180,16 @@ log_proto_server_factory_construct(LogProtoServerFactory *self, LogTransport *tr
 
 LogProtoServerFactory *log_proto_server_get_factory(GlobalConfig *cfg, const gchar *name);
 
+typedef gint (*FindEOMsFunc)(const guchar *s, gsize n, guint32 *eoms, gint max_eoms);
+
+typedef struct _FindEOMsImplementation
+{
+  const gchar *name;
+  FindEOMsFunc find_eoms;
+} FindEOMsImplementation;
+
+const FindEOMsImplementation *find_eoms_get_implementations(void);
+gint find_eoms(const guchar *s, gsize n, guint32 *eoms, gint max_eoms);
 const guchar *find_eom(const guchar *s, gsize n);
 
 #endif
@@ -24,6 +24,8 @@
 #include "logproto-text-client.h"
 #include "messages.h"
 
+#include <errno.h>
+
 static gboolean
 log_proto_text_client_prepare(LogProtoClient *s, gint *fd, GIOCondition *cond)
 {
@@ -35,128 +37,129 @@ log_proto_text_client_prepare(LogProtoClient *s, gint *fd, GIOCondition *cond)
   /* if there's no pending I/O in the transport layer, then we want to do a write */
   if (*cond == 0)
     *cond = G_IO_OUT;
-  return self->partial != NULL;
+  return self->buffer->len > 0;
+}
+
+static inline gboolean
+log_proto_text_client_buffer_full(LogProtoTextClient *self)
+{
+  return self->buffer->len >= LOG_PROTO_TEXT_CLIENT_BUFFER_SIZE ||
+         self->buffer_msgs >= LOG_PROTO_TEXT_CLIENT_BUFFER_MSGS;
+}
+
+static void
+log_proto_text_client_reset_buffer(LogProtoTextClient *self)
+{
+  /* don't keep a huge buffer around just because of a single large message */
+  if (self->buffer->allocated_len > 4 * LOG_PROTO_TEXT_CLIENT_BUFFER_SIZE)
+    {
+      g_string_free(self->buffer, TRUE);
+      self->buffer = g_string_sized_new(LOG_PROTO_TEXT_CLIENT_BUFFER_SIZE);
+    }
+  else
+    {
+      g_string_truncate(self->buffer, 0);
+    }
+  self->buffer_pos = 0;
+  self->buffer_msgs = 0;
 }
 
 static LogProtoStatus
 log_proto_text_client_flush(LogProtoClient *s)
 {
   LogProtoTextClient *self = (LogProtoTextClient *) s;
+  gint len = self->buffer->len - self->buffer_pos;
   gint rc;
 
-  /* attempt to flush previously buffered data */
-  if (self->partial)
-    {
-      gint len = self->partial_len - self->partial_pos;
+  if (len == 0)
+    return LPS_SUCCESS;
 
-      rc = log_transport_write(self->super.transport, &self->partial[self->partial_pos], len);
-      if (rc < 0)
-        {
-          if (errno != EAGAIN && errno != EINTR)
-            {
-              msg_error("I/O error occurred while writing",
-                        evt_tag_int("fd", self->super.transport->fd),
-                        evt_tag_errno(EVT_TAG_OSERROR, errno),
-                        NULL);
-              return LPS_ERROR;
-            }
-          return LPS_SUCCESS;
-        }
-      else if (rc != len)
-        {
-          self->partial_pos += rc;
-          return LPS_SUCCESS;
-        }
-      else
+  /* attempt to write out everything buffered so far with a single call,
+   * whatever remains is retried when the transport becomes writable again */
+  rc = log_transport_write(self->super.transport, &self->buffer->str[self->buffer_pos], len);
+  stats_counter_inc(self->super.syscalls);
+  if (rc < 0)
+    {
+      if (errno != EAGAIN && errno != EINTR)
         {
-          if (self->partial_free)
-            self->partial_free(self->partial);
-          self->partial = NULL;
-          if (self->next_state >= 0)
-            {
-              self->state = self->next_state;
-              self->next_state = -1;
-            }
-
-          log_proto_client_msg_ack(&self->super, 1);
-
-          /* NOTE: we return here to give a chance to the framed protocol to send the frame header. */
-          return LPS_SUCCESS;
+          msg_error("I/O error occurred while writing",
+                    evt_tag_int("fd", self->super.transport->fd),
+                    evt_tag_errno(EVT_TAG_OSERROR, errno),
+                    NULL);
+          return LPS_ERROR;
         }
+      return LPS_SUCCESS;
     }
-  return LPS_SUCCESS;
-}
 
-LogProtoStatus
-log_proto_text_client_submit_write(LogProtoClient *s, guchar *msg, gsize msg_len, GDestroyNotify msg_free, gint next_state)
-{
-  LogProtoTextClient *self = (LogProtoTextClient *) s;
+  self->buffer_pos += rc;
+  if (rc == len)
+    {
+      gint msgs = self->buffer_msgs;
 
-  g_assert(self->partial == NULL);
-  self->partial = msg;
-  self->partial_len = msg_len;
-  self->partial_pos = 0;
-  self->partial_free = msg_free;
-  self->next_state = next_state;
-  return log_proto_text_client_flush(s);
+      log_proto_text_client_reset_buffer(self);
+      if (msgs)
+        log_proto_client_msg_ack(&self->super, msgs);
+    }
+  return LPS_SUCCESS;
 }
 
-
 /*
- * log_proto_text_client_post:
+ * log_proto_text_client_submit_message:
+ * @hdr: protocol specific header to be sent in front of @msg, may be NULL
+ * @hdr_len: length of @hdr
  * @msg: formatted log message to send (this might be consumed by this function)
  * @msg_len: length of @msg
  * @consumed: pointer to a gboolean that gets set if the message was consumed by this function
- * @error: error information, if any
  *
- * This function posts a message to the log transport, performing buffering
- * of partially sent data if needed. The return value indicates whether we
- * successfully sent this message, or if it should be resent by the caller.
+ * Adds @hdr and @msg to the output buffer, which is written out once it
+ * fills up or when the protocol is flushed. If the buffer cannot accept
+ * more data as its earlier contents could not be written yet, the
+ * message is left for the caller to resend.
  **/
-static LogProtoStatus
-log_proto_text_client_post(LogProtoClient *s, guchar *msg, gsize msg_len, gboolean *consumed)
+LogProtoStatus
+log_proto_text_client_submit_message(LogProtoClient *s, const guchar *hdr, gsize hdr_len, guchar *msg, gsize msg_len, gboolean *consumed)
 {
   LogProtoTextClient *self = (LogProtoTextClient *) s;
-  gint rc;
+  LogProtoStatus rc;
 
-  /* try to flush already buffered data */
   *consumed = FALSE;
-  rc = log_proto_text_client_flush(s);
-  if (rc == LPS_ERROR)
+  if (log_proto_text_client_buffer_full(self))
     {
-      /* log_proto_flush() already logs in the case of an error */
-      return rc;
-    }
-
-  if (self->partial)
-    {
-      /* NOTE: the partial buffer has not been emptied yet even with the
-       * flush above, we shouldn't attempt to write again.
-       *
-       * Otherwise: with the framed protocol this could case the frame
-       * header to be split, and interleaved with message payload, as in:
-       *
-       *     First bytes of frame header || payload || tail of frame header.
-       *
-       * This obviously would cause the framing to break. Also libssl
-       * returns an error in this case, which is how this was discovered.
-       */
-      return rc;
+      rc = log_proto_text_client_flush(s);
+      if (rc != LPS_SUCCESS || log_proto_text_client_buffer_full(self))
+        {
+          /* don't consume a new message if flush failed or the buffer
+           * couldn't be written out completely */
+          return rc;
+        }
     }
 
+  if (hdr_len)
+    g_string_append_len(self->buffer, (const gchar *) hdr, hdr_len);
+  g_string_append_len(self->buffer, (const gchar *) msg, msg_len);
+  self->buffer_msgs++;
+  g_free(msg);
   *consumed = TRUE;
-  return log_proto_text_client_submit_write(s, msg, msg_len, (GDestroyNotify) g_free, -1);
+
+  if (log_proto_text_client_buffer_full(self))
+    return log_proto_text_client_flush(s);
+  return LPS_SUCCESS;
 }
 
-void
+static LogProtoStatus
+log_proto_text_client_post(LogProtoClient *s, guchar *msg, gsize msg_len, gboolean *consumed)
+{
+  return log_proto_text_client_submit_message(s, NULL, 0, msg, msg_len, consumed);
+}
+
+static void
 log_proto_text_client_free(LogProtoClient *s)
 {
   LogProtoTextClient *self = (LogProtoTextClient *)s;
-  if (self->partial_free)
-    self->partial_free(self->partial);
-  self->partial = NULL;
+
+  g_string_free(self->buffer, TRUE);
   log_proto_client_free_method(s);
-};
+}
 
 void
 log_proto_text_client_init(LogProtoTextClient *self, LogTransport *transport, const LogProtoClientOptions *options)
@@ -167,7 +170,7 @@ log_proto_text_client_init(LogProtoTextClient *self, LogTransport *transport, co
   self->super.post = log_proto_text_client_post;
   self->super.free_fn = log_proto_text_client_free;
   self->super.transport = transport;
-  self->next_state = -1;
+  self->buffer = g_string_sized_new(LOG_PROTO_TEXT_CLIENT_BUFFER_SIZE);
 }
 
 LogProtoClient *
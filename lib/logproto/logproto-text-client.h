@@ -26,16 +26,23 @@
 
 #include "logproto-client.h"
 
+/* formatted messages are collected into an output buffer, which is
+ * written out when either of these limits is reached or when LogWriter
+ * finishes its current batch and flushes the protocol */
+#define LOG_PROTO_TEXT_CLIENT_BUFFER_SIZE  (64 * 1024)
+#define LOG_PROTO_TEXT_CLIENT_BUFFER_MSGS  256
+
 typedef struct _LogProtoTextClient
 {
   LogProtoClient super;
-  gint state, next_state;
-  guchar *partial;
-  GDestroyNotify partial_free;
-  gsize partial_len, partial_pos;
+  GString *buffer;
+  /* the number of bytes at the start of buffer that were already written */
+  gsize buffer_pos;
+  /* the number of messages in buffer, these are acked once all of buffer is written */
+  gint buffer_msgs;
 } LogProtoTextClient;
 
-LogProtoStatus log_proto_text_client_submit_write(LogProtoClient *s, guchar *msg, gsize msg_len, GDestroyNotify msg_free, gint next_state);
+LogProtoStatus log_proto_text_client_submit_message(LogProtoClient *s, const guchar *hdr, gsize hdr_len, guchar *msg, gsize msg_len, gboolean *consumed);
 void log_proto_text_client_init(LogProtoTextClient *self, LogTransport *transport, const LogProtoClientOptions *options);
 LogProtoClient *log_proto_text_client_new(LogTransport *transport, const LogProtoClientOptions *options);
 
@@ -188,6 +188,59 @@ log_proto_text_server_accumulate_line_method(LogProtoTextServer *self, const guc
   return LPT_CONSUME_LINE | LPT_EXTRACTED;
 }
 
+static inline void
+log_proto_text_server_reset_eol_cache(LogProtoTextServer *self)
+{
+  self->eol_cache_pos = 0;
+  self->eol_cache_len = 0;
+}
+
+/*
+ * Looks up all EOLs between @pos and the end of the pending data in a
+ * single pass and stores them in the EOL cache, so that subsequent lines
+ * don't need to be scanned again.
+ */
+static gboolean
+log_proto_text_server_fill_eol_cache(LogProtoTextServer *self, LogProtoBufferedServerState *state, guint32 pos, guint32 *eol_pos)
+{
+  gint i;
+
+  self->eol_cache_pos = 0;
+  self->eol_cache_len = find_eoms(self->super.buffer + pos, state->pending_buffer_end - pos,
+                                  self->eol_cache, LOG_PROTO_TEXT_SERVER_EOL_CACHE_SIZE);
+  for (i = 0; i < self->eol_cache_len; i++)
+    self->eol_cache[i] += pos;
+
+  if (self->eol_cache_len == 0)
+    return FALSE;
+  *eol_pos = self->eol_cache[0];
+  return TRUE;
+}
+
+/*
+ * Returns the position of the first EOL at or after @pos, using the EOL
+ * cache if it covers @pos. Entries preceding @pos are dropped, as those
+ * belong to lines that were already consumed.
+ */
+static gboolean
+log_proto_text_server_lookup_eol(LogProtoTextServer *self, LogProtoBufferedServerState *state, guint32 pos, guint32 *eol_pos)
+{
+  while (self->eol_cache_pos < self->eol_cache_len)
+    {
+      guint32 cached = self->eol_cache[self->eol_cache_pos];
+
+      if (cached >= pos && cached < state->pending_buffer_end)
+        {
+          *eol_pos = cached;
+          return TRUE;
+        }
+      if (cached >= pos)
+        break;
+      self->eol_cache_pos++;
+    }
+  return log_proto_text_server_fill_eol_cache(self, state, pos, eol_pos);
+}
+
 static void
 log_proto_text_server_split_buffer(LogProtoTextServer *self, LogProtoBufferedServerState *state, const guchar *buffer_start, gsize buffer_bytes)
 {
@@ -198,6 +251,7 @@ log_proto_text_server_split_buffer(LogProtoTextServer *self, LogProtoBufferedSer
    */
 
   memmove(self->super.buffer, buffer_start, buffer_bytes);
+  log_proto_text_server_reset_eol_cache(self);
   state->pending_buffer_pos = 0;
   state->pending_buffer_end = buffer_bytes;
 
@@ -235,16 +289,16 @@ log_proto_text_server_try_extract(LogProtoTextServer *self, LogProtoBufferedServ
   next_line_pos = eol + 1 - self->super.buffer;
   if (state->pending_buffer_end != next_line_pos)
     {
-      const guchar *eom;
-
       /* we have some more data in the buffer, check if we have a
        * subsequent EOL there.  It indicates whether we need to
        * read further data, or the buffer already contains a
        * complete line */
 
-      eom = find_eom(self->super.buffer + next_line_pos, state->pending_buffer_end - next_line_pos);
-      if (eom)
-        next_eol_pos = eom - self->super.buffer;
+      log_proto_text_server_lookup_eol(self, state, next_line_pos, &next_eol_pos);
+    }
+  else
+    {
+      log_proto_text_server_reset_eol_cache(self);
     }
 
   *msg_len = eol - buffer_start;
@@ -335,13 +389,15 @@ log_proto_text_server_yield_whole_buffer_as_message(LogProtoTextServer *self, Lo
   *msg = buffer_start;
   *msg_len = buffer_bytes;
   self->consumed_len = -1;
+  log_proto_text_server_reset_eol_cache(self);
   state->pending_buffer_pos = (*msg) + (*msg_len) - self->super.buffer;
 }
 
 static inline const guchar *
 log_proto_text_server_locate_next_eol(LogProtoTextServer *self, LogProtoBufferedServerState *state, const guchar *buffer_start, gsize buffer_bytes)
 {
-  const guchar *eol;
+  const guchar *eol = NULL;
+  guint32 eol_pos;
 
   if (self->cached_eol_pos)
     {
@@ -351,9 +407,9 @@ log_proto_text_server_locate_next_eol(LogProtoTextServer *self, LogProtoBuffered
       eol = self->super.buffer + self->cached_eol_pos;
       self->cached_eol_pos = 0;
     }
-  else
+  else if (log_proto_text_server_fill_eol_cache(self, state, buffer_start + self->consumed_len + 1 - self->super.buffer, &eol_pos))
     {
-      eol = find_eom(buffer_start + self->consumed_len + 1, buffer_bytes - self->consumed_len - 1);
+      eol = self->super.buffer + eol_pos;
     }
   return eol;
 }
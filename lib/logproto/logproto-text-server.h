@@ -38,6 +38,9 @@ enum
 #define LPT_CONSUME_PARTIAL_AMOUNT_MASK      ~0xFF
 #define LPT_CONSUME_PARTIALLY(drop_length) (LPT_CONSUME_LINE | ((drop_length) << LPT_CONSUME_PARTIAL_AMOUNT_SHIFT))
 
+/* the number of EOL positions looked up in a single pass over the buffer */
+#define LOG_PROTO_TEXT_SERVER_EOL_CACHE_SIZE 64
+
 typedef struct _LogProtoTextServer LogProtoTextServer;
 struct _LogProtoTextServer
 {
@@ -55,6 +58,11 @@ struct _LogProtoTextServer
 
   gint32 consumed_len;
   gint32 cached_eol_pos;
+
+  /* EOL positions following cached_eol_pos, relative to the start of the buffer */
+  guint32 eol_cache[LOG_PROTO_TEXT_SERVER_EOL_CACHE_SIZE];
+  gint eol_cache_pos;
+  gint eol_cache_len;
 };
 
 /* LogProtoTextServer
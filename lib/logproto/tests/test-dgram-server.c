@@ -2,6 +2,11 @@
 #include "proto_lib.h"
 #include "msg_parse_lib.h"
 #include "logproto/logproto-dgram-server.h"
+#include "transport/transport-socket.h"
+#include "misc.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
 
 /****************************************************************************************
  * LogProtoDGramServer
@@ -136,6 +141,118 @@ test_log_proto_dgram_server_eof_handling(void)
   log_proto_server_free(proto);
 }
 
+static LogProtoServer *
+construct_batched_dgram_server(gint fds[2], gint batch_size)
+{
+  assert_gint(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds), 0, "socketpair() failed");
+  g_fd_set_nonblock(fds[0], TRUE);
+  return log_proto_dgram_server_new(log_transport_batched_dgram_socket_new(fds[0], batch_size),
+                                    get_inited_proto_server_options());
+}
+
+static void
+send_datagram(gint fd, const gchar *dgram)
+{
+  assert_gint(send(fd, dgram, strlen(dgram), 0), strlen(dgram), "send() failed");
+}
+
+static void
+test_log_proto_dgram_server_batched_transport(void)
+{
+  LogProtoServer *proto;
+  GIOCondition cond;
+  gint fds[2];
+
+  proto_server_options.max_msg_size = 32;
+  proto = construct_batched_dgram_server(fds, 4);
+
+  send_datagram(fds[1], "0123456789");
+  send_datagram(fds[1], "");
+  send_datagram(fds[1], "abcdefghij");
+  send_datagram(fds[1], "árvíztűrőtükörfúrógép");
+  send_datagram(fds[1], "0123456789ABCDEF0123456789ABCDEFtruncated");
+  send_datagram(fds[1], "last");
+
+  assert_false(log_proto_server_prepare(proto, &cond), "No datagrams should be pending before the first read");
+
+  /* the first read receives a batch of 4 datagrams, the empty one is skipped */
+  assert_proto_server_fetch(proto, "0123456789", -1);
+#ifdef HAVE_RECVMMSG
+  assert_true(log_proto_server_prepare(proto, &cond), "Received datagrams should be pending");
+#endif
+  assert_proto_server_fetch(proto, "abcdefghij", -1);
+  assert_proto_server_fetch(proto, "árvíztűrőtükörfúrógép", -1);
+  assert_false(log_proto_server_prepare(proto, &cond), "The batch should have been consumed");
+
+  assert_proto_server_fetch(proto, "0123456789ABCDEF0123456789ABCDEF", -1);
+  assert_proto_server_fetch(proto, "last", -1);
+
+  /* nothing more to read */
+  assert_proto_server_fetch_single_read(proto, NULL, 0);
+
+  log_proto_server_free(proto);
+  close(fds[1]);
+}
+
+/* stays below the default max_dgram_qlen of AF_UNIX sockets, so send() never blocks */
+#define DGRAM_ORDER_ROUND_SIZE  8
+#define DGRAM_ORDER_ROUNDS      32
+
+static void
+_assert_batched_dgrams_received_in_order(gint batch_size)
+{
+  LogProtoServer *proto;
+  gchar dgram[32];
+  gint fds[2];
+  gint round, sent, received;
+
+  proto = construct_batched_dgram_server(fds, batch_size);
+  g_fd_set_nonblock(fds[1], TRUE);
+
+  sent = received = 0;
+  for (round = 0; round < DGRAM_ORDER_ROUNDS; round++)
+    {
+      gint i;
+
+      for (i = 0; i < DGRAM_ORDER_ROUND_SIZE; i++)
+        {
+          g_snprintf(dgram, sizeof(dgram), "dgram-%d", sent++);
+          send_datagram(fds[1], dgram);
+        }
+
+      while (received < sent)
+        {
+          const guchar *msg = NULL;
+          gsize msg_len;
+          gboolean may_read = TRUE;
+          LogTransportAuxData aux;
+          Bookmark bookmark;
+
+          log_transport_aux_data_init(&aux);
+          assert_gint(log_proto_server_fetch(proto, &msg, &msg_len, &may_read, &aux, &bookmark), LPS_SUCCESS, "Fetch failed");
+          log_transport_aux_data_destroy(&aux);
+          if (!msg)
+            continue;
+
+          g_snprintf(dgram, sizeof(dgram), "dgram-%d", received++);
+          assert_nstring((const gchar *) msg, msg_len, dgram, -1,
+                         "Datagram received out of order, batch_size=%d", batch_size);
+        }
+    }
+
+  log_proto_server_free(proto);
+  close(fds[1]);
+}
+
+static void
+test_log_proto_dgram_server_batched_transport_keeps_order(void)
+{
+  proto_server_options.max_msg_size = 1024;
+  _assert_batched_dgrams_received_in_order(1);
+  _assert_batched_dgrams_received_in_order(4);
+  _assert_batched_dgrams_received_in_order(16);
+}
+
 void
 test_log_proto_dgram_server(void)
 {
@@ -144,4 +261,6 @@ test_log_proto_dgram_server(void)
   PROTO_TESTCASE(test_log_proto_dgram_server_invalid_ucs4);
   PROTO_TESTCASE(test_log_proto_dgram_server_iso_8859_2);
   PROTO_TESTCASE(test_log_proto_dgram_server_eof_handling);
+  PROTO_TESTCASE(test_log_proto_dgram_server_batched_transport);
+  PROTO_TESTCASE(test_log_proto_dgram_server_batched_transport_keeps_order);
 }
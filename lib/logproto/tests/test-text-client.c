@@ -0,0 +1,334 @@
+#include "proto_lib.h"
+#include "logproto/logproto-text-client.h"
+#include "logproto/logproto-framed-client.h"
+#include "logproto/logproto-dgram-client.h"
+
+#include <errno.h>
+#include <string.h>
+
+/****************************************************************************************
+ * Capturing transport: records what was written and how many write calls were made
+ ****************************************************************************************/
+
+typedef struct _LogTransportCapture
+{
+  LogTransport super;
+  GString *output;
+  gint write_calls;
+  gint send_batch_calls;
+  /* the maximum number of bytes accepted per write(), -1 if unlimited */
+  gssize write_limit;
+  /* the maximum number of datagrams accepted per send_batch() */
+  gint send_batch_limit;
+  gboolean eagain;
+} LogTransportCapture;
+
+static gssize
+log_transport_capture_write(LogTransport *s, const gpointer buf, gsize count)
+{
+  LogTransportCapture *self = (LogTransportCapture *) s;
+
+  self->write_calls++;
+  if (self->eagain)
+    {
+      errno = EAGAIN;
+      return -1;
+    }
+  if (self->write_limit >= 0 && count > self->write_limit)
+    count = self->write_limit;
+  g_string_append_len(self->output, buf, count);
+  return count;
+}
+
+static gint
+log_transport_capture_send_batch(LogTransport *s, const struct iovec *iov, gint count)
+{
+  LogTransportCapture *self = (LogTransportCapture *) s;
+  gint i;
+
+  self->send_batch_calls++;
+  if (self->eagain)
+    {
+      errno = EAGAIN;
+      return -1;
+    }
+  count = MIN(count, self->send_batch_limit);
+  for (i = 0; i < count; i++)
+    g_string_append_len(self->output, iov[i].iov_base, iov[i].iov_len);
+  return count;
+}
+
+static void
+log_transport_capture_free(LogTransport *s)
+{
+  LogTransportCapture *self = (LogTransportCapture *) s;
+
+  g_string_free(self->output, TRUE);
+  log_transport_free_method(s);
+}
+
+static LogTransportCapture *
+log_transport_capture_new(gssize write_limit)
+{
+  LogTransportCapture *self = g_new0(LogTransportCapture, 1);
+
+  log_transport_init_instance(&self->super, -1);
+  self->super.write = log_transport_capture_write;
+  self->super.free_fn = log_transport_capture_free;
+  self->output = g_string_new("");
+  self->write_limit = write_limit;
+  return self;
+}
+
+static LogTransportCapture *
+log_transport_capture_with_send_batch_new(gint send_batch_limit)
+{
+  LogTransportCapture *self = log_transport_capture_new(-1);
+
+  self->super.send_batch = log_transport_capture_send_batch;
+  self->send_batch_limit = send_batch_limit;
+  return self;
+}
+
+static LogProtoClientOptionsStorage proto_client_options;
+static StatsCounterItem syscalls;
+static gint acked_messages;
+
+static void
+count_acks(gint num_msg_acked, gpointer user_data)
+{
+  acked_messages += num_msg_acked;
+}
+
+static LogProtoClient *
+construct_client_proto(LogProtoClient *(*construct)(LogTransport *, const LogProtoClientOptions *), LogTransportCapture *transport)
+{
+  LogProtoClientFlowControlFuncs flow_control_funcs = { 0 };
+  LogProtoClient *proto;
+
+  log_proto_client_options_defaults(&proto_client_options.super);
+  proto = construct(&transport->super, &proto_client_options.super);
+  flow_control_funcs.ack_callback = count_acks;
+  log_proto_client_set_client_flow_control(proto, &flow_control_funcs);
+  log_proto_client_set_syscalls_counter(proto, &syscalls);
+  stats_counter_set(&syscalls, 0);
+  acked_messages = 0;
+  return proto;
+}
+
+static void
+assert_proto_client_post(LogProtoClient *proto, const gchar *msg)
+{
+  gboolean consumed = FALSE;
+
+  assert_gint(log_proto_client_post(proto, (guchar *) g_strdup(msg), strlen(msg), &consumed), LPS_SUCCESS,
+              "log_proto_client_post() failed");
+  assert_true(consumed, "message was not consumed by log_proto_client_post()");
+}
+
+static void
+assert_proto_client_post_not_consumed(LogProtoClient *proto, const gchar *msg)
+{
+  gboolean consumed = FALSE;
+  guchar *buf = (guchar *) g_strdup(msg);
+
+  assert_gint(log_proto_client_post(proto, buf, strlen(msg), &consumed), LPS_SUCCESS,
+              "log_proto_client_post() failed");
+  assert_false(consumed, "message was consumed by log_proto_client_post() unexpectedly");
+  g_free(buf);
+}
+
+static void
+assert_proto_client_flush(LogProtoClient *proto)
+{
+  assert_gint(log_proto_client_flush(proto), LPS_SUCCESS, "log_proto_client_flush() failed");
+}
+
+/****************************************************************************************
+ * LogProtoTextClient, LogProtoFramedClient, LogProtoDGramClient
+ ****************************************************************************************/
+
+static void
+test_log_proto_text_client_coalesces_messages_until_flush(void)
+{
+  LogTransportCapture *transport = log_transport_capture_new(-1);
+  LogProtoClient *proto = construct_client_proto(log_proto_text_client_new, transport);
+
+  assert_proto_client_post(proto, "foo\n");
+  assert_proto_client_post(proto, "bar\n");
+  assert_proto_client_post(proto, "baz\n");
+  assert_gint(transport->write_calls, 0, "messages were written before the flush");
+  assert_gint(acked_messages, 0, "messages were acked before being written");
+
+  assert_proto_client_flush(proto);
+  assert_gint(transport->write_calls, 1, "buffered messages were not written with a single write");
+  assert_string(transport->output->str, "foo\nbar\nbaz\n", "output mismatch");
+  assert_gint(acked_messages, 3, "written messages were not acked");
+  assert_gint(stats_counter_get(&syscalls), 1, "syscalls counter mismatch");
+
+  assert_proto_client_flush(proto);
+  assert_gint(transport->write_calls, 1, "flush of an empty buffer resulted in a write");
+  log_proto_client_free(proto);
+}
+
+static void
+test_log_proto_text_client_flushes_when_the_buffer_is_full(void)
+{
+  LogTransportCapture *transport = log_transport_capture_new(-1);
+  LogProtoClient *proto = construct_client_proto(log_proto_text_client_new, transport);
+  gint i;
+
+  for (i = 0; i < LOG_PROTO_TEXT_CLIENT_BUFFER_MSGS; i++)
+    assert_proto_client_post(proto, "0123456789\n");
+
+  assert_gint(transport->write_calls, 1, "full buffer was not written out");
+  assert_gint(transport->output->len, LOG_PROTO_TEXT_CLIENT_BUFFER_MSGS * 11, "output length mismatch");
+  assert_gint(acked_messages, LOG_PROTO_TEXT_CLIENT_BUFFER_MSGS, "written messages were not acked");
+  log_proto_client_free(proto);
+}
+
+static void
+test_log_proto_text_client_handles_partial_writes(void)
+{
+  LogTransportCapture *transport = log_transport_capture_new(5);
+  LogProtoClient *proto = construct_client_proto(log_proto_text_client_new, transport);
+
+  assert_proto_client_post(proto, "foo\n");
+  assert_proto_client_post(proto, "bar\n");
+  assert_proto_client_flush(proto);
+  assert_string(transport->output->str, "foo\nb", "partial output mismatch");
+  assert_gint(acked_messages, 0, "messages were acked before being completely written");
+
+  /* more messages can be queued while the earlier ones are partially written */
+  assert_proto_client_post(proto, "baz\n");
+  assert_proto_client_flush(proto);
+  assert_proto_client_flush(proto);
+  assert_string(transport->output->str, "foo\nbar\nbaz\n", "output mismatch after partial writes");
+  assert_gint(acked_messages, 3, "written messages were not acked");
+  log_proto_client_free(proto);
+}
+
+static void
+test_log_proto_text_client_does_not_consume_when_buffer_is_stuck(void)
+{
+  LogTransportCapture *transport = log_transport_capture_new(-1);
+  LogProtoClient *proto = construct_client_proto(log_proto_text_client_new, transport);
+  gint i;
+
+  transport->eagain = TRUE;
+  for (i = 0; i < LOG_PROTO_TEXT_CLIENT_BUFFER_MSGS; i++)
+    assert_proto_client_post(proto, "0123456789\n");
+  assert_proto_client_post_not_consumed(proto, "0123456789\n");
+  assert_gint(acked_messages, 0, "messages were acked without being written");
+
+  transport->eagain = FALSE;
+  assert_proto_client_post(proto, "0123456789\n");
+  assert_proto_client_flush(proto);
+  assert_gint(transport->output->len, (LOG_PROTO_TEXT_CLIENT_BUFFER_MSGS + 1) * 11, "output length mismatch");
+  assert_gint(acked_messages, LOG_PROTO_TEXT_CLIENT_BUFFER_MSGS + 1, "written messages were not acked");
+  log_proto_client_free(proto);
+}
+
+static void
+test_log_proto_framed_client_buffers_frame_headers_with_messages(void)
+{
+  LogTransportCapture *transport = log_transport_capture_new(3);
+  LogProtoClient *proto = construct_client_proto(log_proto_framed_client_new, transport);
+
+  assert_proto_client_post(proto, "foo");
+  assert_proto_client_post(proto, "foobar");
+  while (transport->output->len < strlen("3 foo6 foobar"))
+    assert_proto_client_flush(proto);
+
+  assert_string(transport->output->str, "3 foo6 foobar", "framed output mismatch");
+  assert_gint(acked_messages, 2, "each message should be acked exactly once");
+  log_proto_client_free(proto);
+}
+
+static void
+test_log_proto_dgram_client_batches_datagrams_until_flush(void)
+{
+  LogTransportCapture *transport = log_transport_capture_with_send_batch_new(LOG_PROTO_DGRAM_CLIENT_BATCH_SIZE);
+  LogProtoClient *proto = construct_client_proto(log_proto_dgram_client_new, transport);
+
+  assert_proto_client_post(proto, "foo");
+  assert_proto_client_post(proto, "bar");
+  assert_proto_client_post(proto, "baz");
+  assert_gint(transport->send_batch_calls, 0, "datagrams were sent before the flush");
+  assert_gint(acked_messages, 0, "datagrams were acked before being sent");
+
+  assert_proto_client_flush(proto);
+  assert_gint(transport->send_batch_calls, 1, "datagrams were not sent with a single call");
+  assert_gint(transport->write_calls, 0, "datagrams were sent with write() although send_batch() is available");
+  assert_string(transport->output->str, "foobarbaz", "output mismatch");
+  assert_gint(acked_messages, 3, "sent datagrams were not acked");
+  assert_gint(stats_counter_get(&syscalls), 1, "syscalls counter mismatch");
+  log_proto_client_free(proto);
+}
+
+static void
+test_log_proto_dgram_client_sends_full_batch_without_flush(void)
+{
+  LogTransportCapture *transport = log_transport_capture_with_send_batch_new(LOG_PROTO_DGRAM_CLIENT_BATCH_SIZE);
+  LogProtoClient *proto = construct_client_proto(log_proto_dgram_client_new, transport);
+  gint i;
+
+  for (i = 0; i < LOG_PROTO_DGRAM_CLIENT_BATCH_SIZE + 1; i++)
+    assert_proto_client_post(proto, "x");
+  assert_gint(transport->send_batch_calls, 1, "full batch was not sent");
+  assert_gint(acked_messages, LOG_PROTO_DGRAM_CLIENT_BATCH_SIZE, "sent datagrams were not acked");
+  log_proto_client_free(proto);
+}
+
+static void
+test_log_proto_dgram_client_handles_partially_sent_batches(void)
+{
+  LogTransportCapture *transport = log_transport_capture_with_send_batch_new(2);
+  LogProtoClient *proto = construct_client_proto(log_proto_dgram_client_new, transport);
+
+  assert_proto_client_post(proto, "foo");
+  assert_proto_client_post(proto, "bar");
+  assert_proto_client_post(proto, "baz");
+  assert_proto_client_flush(proto);
+  assert_string(transport->output->str, "foobar", "output mismatch after a partial batch");
+  assert_gint(acked_messages, 2, "sent datagrams were not acked");
+
+  transport->eagain = TRUE;
+  assert_proto_client_flush(proto);
+  assert_gint(acked_messages, 2, "unsent datagram was acked");
+
+  transport->eagain = FALSE;
+  assert_proto_client_flush(proto);
+  assert_string(transport->output->str, "foobarbaz", "output mismatch after sending the rest of the batch");
+  assert_gint(acked_messages, 3, "sent datagrams were not acked");
+  log_proto_client_free(proto);
+}
+
+static void
+test_log_proto_dgram_client_falls_back_to_separate_writes(void)
+{
+  LogTransportCapture *transport = log_transport_capture_new(-1);
+  LogProtoClient *proto = construct_client_proto(log_proto_dgram_client_new, transport);
+
+  assert_proto_client_post(proto, "foo");
+  assert_proto_client_post(proto, "bar");
+  assert_proto_client_flush(proto);
+  assert_gint(transport->write_calls, 2, "each datagram should be written separately");
+  assert_gint(stats_counter_get(&syscalls), 2, "syscalls counter mismatch");
+  assert_gint(acked_messages, 2, "sent datagrams were not acked");
+  log_proto_client_free(proto);
+}
+
+void
+test_log_proto_text_client(void)
+{
+  PROTO_TESTCASE(test_log_proto_text_client_coalesces_messages_until_flush);
+  PROTO_TESTCASE(test_log_proto_text_client_flushes_when_the_buffer_is_full);
+  PROTO_TESTCASE(test_log_proto_text_client_handles_partial_writes);
+  PROTO_TESTCASE(test_log_proto_text_client_does_not_consume_when_buffer_is_stuck);
+  PROTO_TESTCASE(test_log_proto_framed_client_buffers_frame_headers_with_messages);
+  PROTO_TESTCASE(test_log_proto_dgram_client_batches_datagrams_until_flush);
+  PROTO_TESTCASE(test_log_proto_dgram_client_sends_full_batch_without_flush);
+  PROTO_TESTCASE(test_log_proto_dgram_client_handles_partially_sent_batches);
+  PROTO_TESTCASE(test_log_proto_dgram_client_falls_back_to_separate_writes);
+}
@@ -1,6 +1,23 @@
 #include "logproto/logproto-server.h"
 #include "logmsg.h"
+#include "testutils.h"
 #include <stdlib.h>
+#include <string.h>
+
+#define TEST_BUFFER_SIZE  (64 * 1024)
+#define TEST_LINE_LENGTH  97
+
+static FindEOMsFunc find_eoms_under_test;
+
+static const guchar *
+find_eom_under_test(const guchar *s, gsize n)
+{
+  guint32 eom;
+
+  if (find_eoms_under_test(s, n, &eom, 1) == 0)
+    return NULL;
+  return s + eom;
+}
 
 static void
 testcase(const gchar *msg_, gsize msg_len, gint eom_ofs)
@@ -8,7 +25,7 @@ testcase(const gchar *msg_, gsize msg_len, gint eom_ofs)
   const guchar *eom;
   const guchar *msg = (const guchar *) msg_;
 
-  eom = find_eom((guchar *) msg, msg_len);
+  eom = find_eom_under_test((guchar *) msg, msg_len);
 
   if (eom_ofs == -1 && eom != NULL)
     {
@@ -25,8 +42,8 @@ testcase(const gchar *msg_, gsize msg_len, gint eom_ofs)
     }
 }
 
-int
-main()
+static void
+test_find_eom_single()
 {
   testcase("a\nb\nc\n",  6,  1);
   testcase("ab\nb\nc\n",  7,  2);
@@ -81,5 +98,78 @@ main()
   testcase("abcdefghijklmnopqrstuvwx", 24, -1);
   testcase("abcdefghijklmnopqrstuvwxy", 25, -1);
   testcase("abcdefghijklmnopqrstuvwxyz", 26, -1);
+}
+
+static void
+test_find_eom_stops_at_nul()
+{
+  testcase("abc\0def\n", 8, 3);
+  testcase("\0", 1, 0);
+  testcase("0123456789abcdef0123456789abcdef0123456789\0", 43, 42);
+  testcase("0123456789abcdef0123456789abcdef0123456789\n", 43, 42);
+}
+
+static void
+test_find_eoms_finds_all_terminators()
+{
+  static const gchar msg[] = "foo\nbar\n\nbaz\0 0123456789abcdef0123456789abcdef0123456789abcdef\nqux";
+  guint32 eoms[8];
+  gint count;
+
+  count = find_eoms_under_test((const guchar *) msg, sizeof(msg), eoms, 8);
+  assert_gint(count, 6, "number of EOMs mismatch");
+  assert_guint32(eoms[0], 3, "EOM #0 mismatch");
+  assert_guint32(eoms[1], 7, "EOM #1 mismatch");
+  assert_guint32(eoms[2], 8, "EOM #2 mismatch");
+  assert_guint32(eoms[3], 12, "EOM #3 mismatch");
+  assert_guint32(eoms[4], 62, "EOM #4 mismatch");
+  assert_guint32(eoms[5], 66, "EOM #5 mismatch");
+
+  count = find_eoms_under_test((const guchar *) msg, sizeof(msg) - 1, eoms, 3);
+  assert_gint(count, 3, "find_eoms returned more EOMs than requested");
+  assert_guint32(eoms[2], 8, "EOM #2 mismatch when limited");
+}
+
+/* the terminators fall at every alignment relative to the vector width */
+static void
+test_find_eoms_finds_every_line_in_a_large_buffer(void)
+{
+  guchar *buffer = g_malloc(TEST_BUFFER_SIZE);
+  guint32 eoms[64];
+  gsize pos;
+  gint i, count, lines = 0, found = 0;
+
+  memset(buffer, 'x', TEST_BUFFER_SIZE);
+  for (pos = TEST_LINE_LENGTH - 1; pos < TEST_BUFFER_SIZE; pos += TEST_LINE_LENGTH, lines++)
+    buffer[pos] = (lines % 2) ? '\0' : '\n';
+
+  pos = 0;
+  while ((count = find_eoms_under_test(buffer + pos, TEST_BUFFER_SIZE - pos, eoms, G_N_ELEMENTS(eoms))) > 0)
+    {
+      for (i = 0; i < count; i++)
+        assert_gint((pos + eoms[i]) % TEST_LINE_LENGTH, TEST_LINE_LENGTH - 1, "EOM at wrong location in a large buffer");
+      found += count;
+      pos += eoms[count - 1] + 1;
+    }
+  assert_gint(found, lines, "EOM count mismatch in a large buffer");
+  g_free(buffer);
+}
+
+int
+main()
+{
+  const FindEOMsImplementation *impl;
+
+  for (impl = find_eoms_get_implementations(); impl->name; impl++)
+    {
+      find_eoms_under_test = impl->find_eoms;
+      test_find_eom_single();
+      test_find_eom_stops_at_nul();
+      test_find_eoms_finds_all_terminators();
+      test_find_eoms_finds_every_line_in_a_large_buffer();
+    }
+
+  find_eoms_under_test = find_eoms;
+  test_find_eom_single();
   return 0;
 }
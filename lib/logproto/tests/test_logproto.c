@@ -58,9 +58,7 @@ test_log_proto(void)
    *    - queued
    *    - saddr caching
    *
-   * log_proto_text_client_new
    * log_proto_file_writer_new
-   * log_proto_framed_client_new
    */
   test_log_proto_server_options();
   test_log_proto_base();
@@ -70,6 +68,7 @@ test_log_proto(void)
   test_log_proto_regexp_multiline_server();
   test_log_proto_dgram_server();
   test_log_proto_framed_server();
+  test_log_proto_text_client();
 }
 
 int
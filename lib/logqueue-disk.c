@@ -0,0 +1,641 @@
+/*
+ * Copyright (c) 2002-2015 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2015 Balázs Scheidler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "logqueue-disk.h"
+#include "logpipe.h"
+#include "messages.h"
+#include "serialize.h"
+#include "scratch-buffers.h"
+#include "stats/stats-registry.h"
+
+#include <string.h>
+
+/* reading the disk is retried after this much time after an I/O error */
+#define LOG_QUEUE_DISK_READ_RETRY_MSEC 1000
+
+/*
+ * LogQueueDisk is a LogQueue implementation that stores messages in a
+ * QDisk, so that a destination can absorb outages much longer than the
+ * in-memory queue could, without holding the messages in RAM.
+ *
+ * Messages flow through these stages:
+ *
+ *    qoverflow (memory) -> qdisk (disk) -> qout (memory) -> qbacklog (memory)
+ *
+ *   - push_tail serializes the message and appends it to the QDisk.  Once
+ *     the message is on disk, it is acknowledged towards the source, so
+ *     flow-control doesn't stall the sources while the disk has space.
+ *
+ *   - qoverflow (the back cache) holds messages that didn't fit on the
+ *     disk (disk_buf_size reached), up to mem_buf_length entries.  These
+ *     are not acknowledged until they are moved to disk, thus
+ *     flow-controlled sources are throttled once the disk fills up.
+ *
+ *   - qout (the front cache) is filled from the disk in chunks of
+ *     qout_size messages by the output thread.
+ *
+ *   - qbacklog contains messages that were popped but not yet acked by
+ *     the destination.  Their disk space is only reclaimed once acked,
+ *     thus after a restart unacknowledged messages are sent again.
+ *
+ *   - without use_backlog, the disk record of the last popped message is
+ *     only acked when the next message is popped, as the destination
+ *     might still put the message back using push_head.
+ *
+ * Threading assumptions are the same as with LogQueueFifo: push_tail is
+ * called from the input threads, everything else from the output thread.
+ * The QDisk and qoverflow are protected by super.lock, qout and qbacklog
+ * are only touched by the output thread.
+ */
+
+typedef struct _LogQueueDiskItem
+{
+  LogMessage *msg;
+  /* end position of the record in the QDisk, -1 if the message is not stored on disk */
+  gint64 record_end;
+  /* number of unreadable records skipped right before this one */
+  gint skipped_records;
+  gboolean ack_needed;
+} LogQueueDiskItem;
+
+typedef struct _LogQueueDisk
+{
+  LogQueue super;
+  QDisk *qdisk;
+  QDiskOptions options;
+
+  GQueue qoverflow;
+  GQueue qout;
+  GQueue qbacklog;
+  /* unreadable records not yet accounted to a LogQueueDiskItem */
+  gint skipped_records;
+  /* disk records of the last message popped without use_backlog */
+  gint64 pending_record_end;
+  gint pending_records;
+  /* the disk is not read until then after an I/O error, zero if unset */
+  GTimeVal read_retry_time;
+
+  StatsCounterItem *disk_usage;
+} LogQueueDisk;
+
+static LogQueueDiskItem *
+log_queue_disk_item_new(LogMessage *msg, gint64 record_end, gboolean ack_needed)
+{
+  LogQueueDiskItem *item = g_slice_new(LogQueueDiskItem);
+
+  item->msg = msg;
+  item->record_end = record_end;
+  item->skipped_records = 0;
+  item->ack_needed = ack_needed;
+  return item;
+}
+
+static void
+log_queue_disk_item_free(LogQueueDiskItem *item, AckType ack_type)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+
+  if (item->ack_needed)
+    {
+      path_options.ack_needed = TRUE;
+      log_msg_ack(item->msg, &path_options, ack_type);
+    }
+  log_msg_unref(item->msg);
+  g_slice_free(LogQueueDiskItem, item);
+}
+
+static void
+log_queue_disk_update_disk_usage(LogQueueDisk *self)
+{
+  stats_counter_set(self->disk_usage, qdisk_get_usage(self->qdisk) / 1024);
+}
+
+static gboolean
+log_queue_disk_serialize_msg(LogMessage *msg, GString *serialized)
+{
+  SerializeArchive *sa;
+  gboolean success;
+
+  sa = serialize_string_archive_new(serialized);
+  success = log_msg_write(msg, sa);
+  serialize_archive_free(sa);
+  return success;
+}
+
+/* NOTE: super.lock must be held */
+static gint
+log_queue_disk_get_read_retry_delay(LogQueueDisk *self)
+{
+  GTimeVal now;
+  gint64 delay;
+
+  if (self->read_retry_time.tv_sec == 0)
+    return 0;
+
+  g_get_current_time(&now);
+  delay = g_time_val_diff(&self->read_retry_time, &now) / 1000;
+  if (delay <= 0)
+    {
+      self->read_retry_time.tv_sec = 0;
+      return 0;
+    }
+  return delay;
+}
+
+/*
+ * NOTE: returns FALSE only if nothing could be read from the disk, *pmsg
+ * is NULL if the record(s) read had to be dropped.  super.lock must be
+ * held.
+ */
+static gboolean
+log_queue_disk_read_msg(LogQueueDisk *self, LogMessage **pmsg, gint64 *record_end)
+{
+  SBGString *record = sb_gstring_acquire();
+  SerializeArchive *sa;
+  LogMessage *msg = NULL;
+  QDiskPopResult result;
+  gint64 lost;
+
+  result = qdisk_pop_head(self->qdisk, sb_gstring_string(record), record_end);
+  if (result == QDISK_POP_CORRUPT)
+    {
+      /* only the damaged segment is skipped, reading goes on after it */
+      lost = qdisk_skip_corrupt(self->qdisk);
+      if (lost >= 0)
+        {
+          msg_error("Damaged disk-queue segment, dropping the messages stored in it",
+                    evt_tag_str("persist_name", self->super.persist_name),
+                    evt_tag_int("lost", lost),
+                    NULL);
+          self->skipped_records += lost;
+          stats_counter_add(self->super.dropped_messages, lost);
+          stats_counter_add(self->super.stored_messages, -lost);
+          sb_gstring_release(record);
+          *pmsg = NULL;
+          return TRUE;
+        }
+      result = QDISK_POP_ERROR;
+    }
+
+  if (result == QDISK_POP_ERROR)
+    {
+      /* the error may go away (e.g. EMFILE), try again later instead
+       * of dropping anything or spinning on the same record */
+      g_get_current_time(&self->read_retry_time);
+      g_time_val_add(&self->read_retry_time, LOG_QUEUE_DISK_READ_RETRY_MSEC * 1000);
+    }
+  else if (result == QDISK_POP_OK)
+    {
+      msg = log_msg_new_empty();
+      sa = serialize_string_archive_new(sb_gstring_string(record));
+      if (!log_msg_read(msg, sa))
+        {
+          msg_error("Error deserializing message from the disk-queue, dropping it",
+                    evt_tag_str("persist_name", self->super.persist_name),
+                    NULL);
+          log_msg_unref(msg);
+          msg = NULL;
+          /* the record is acked together with the next one that can be read */
+          self->skipped_records++;
+          stats_counter_inc(self->super.dropped_messages);
+          stats_counter_dec(self->super.stored_messages);
+        }
+      serialize_archive_free(sa);
+    }
+  sb_gstring_release(record);
+  *pmsg = msg;
+  return result == QDISK_POP_OK;
+}
+
+/* NOTE: super.lock must be held */
+static gboolean
+log_queue_disk_write_msg(LogQueueDisk *self, LogMessage *msg)
+{
+  SBGString *record = sb_gstring_acquire();
+  gboolean success = FALSE;
+
+  if (log_queue_disk_serialize_msg(msg, sb_gstring_string(record)) &&
+      qdisk_is_space_avail(self->qdisk, sb_gstring_string(record)->len))
+    success = qdisk_push_tail(self->qdisk, sb_gstring_string(record));
+
+  sb_gstring_release(record);
+  return success;
+}
+
+/* NOTE: super.lock must be held */
+static void
+log_queue_disk_ack_records(LogQueueDisk *self, gint64 record_end, gint count)
+{
+  qdisk_ack_backlog(self->qdisk, record_end, count);
+  log_queue_disk_update_disk_usage(self);
+}
+
+/* move items from the back cache to the disk as long as there's space
+ * available.  NOTE: super.lock must be held */
+static void
+log_queue_disk_move_overflow_to_disk(LogQueueDisk *self)
+{
+  while (!g_queue_is_empty(&self->qoverflow))
+    {
+      LogQueueDiskItem *item = g_queue_peek_head(&self->qoverflow);
+
+      if (!log_queue_disk_write_msg(self, item->msg))
+        break;
+
+      g_queue_pop_head(&self->qoverflow);
+      log_queue_disk_item_free(item, AT_PROCESSED);
+    }
+}
+
+static gint64
+log_queue_disk_get_length(LogQueue *s)
+{
+  LogQueueDisk *self = (LogQueueDisk *) s;
+
+  return qdisk_get_length(self->qdisk) + self->qoverflow.length + self->qout.length;
+}
+
+/* after a read error only the items already in qout can be read */
+static gint
+log_queue_disk_get_read_delay(LogQueue *s)
+{
+  LogQueueDisk *self = (LogQueueDisk *) s;
+  gint delay = 0;
+
+  g_static_mutex_lock(&self->super.lock);
+  if (g_queue_is_empty(&self->qout))
+    delay = log_queue_disk_get_read_retry_delay(self);
+  g_static_mutex_unlock(&self->super.lock);
+  return delay;
+}
+
+/* the disk-queue is always kept, even if empty, as it owns the QDisk files */
+static gboolean
+log_queue_disk_keep_on_reload(LogQueue *s)
+{
+  return TRUE;
+}
+
+/*
+ * Called from the input threads.
+ *
+ * NOTE: It consumes the reference passed by the caller.
+ */
+static void
+log_queue_disk_push_tail(LogQueue *s, LogMessage *msg, const LogPathOptions *path_options)
+{
+  LogQueueDisk *self = (LogQueueDisk *) s;
+  SBGString *record = sb_gstring_acquire();
+  gboolean serialized;
+
+  serialized = log_queue_disk_serialize_msg(msg, sb_gstring_string(record));
+
+  g_static_mutex_lock(&self->super.lock);
+  log_queue_disk_move_overflow_to_disk(self);
+  if (serialized &&
+      g_queue_is_empty(&self->qoverflow) &&
+      qdisk_is_space_avail(self->qdisk, sb_gstring_string(record)->len) &&
+      qdisk_push_tail(self->qdisk, sb_gstring_string(record)))
+    {
+      stats_counter_inc(self->super.stored_messages);
+      log_queue_disk_update_disk_usage(self);
+      log_queue_push_notify(&self->super);
+      g_static_mutex_unlock(&self->super.lock);
+      sb_gstring_release(record);
+
+      /* the message is safe on disk, release flow-control */
+      log_msg_ack(msg, path_options, AT_PROCESSED);
+      log_msg_unref(msg);
+      return;
+    }
+  sb_gstring_release(record);
+
+  if (self->qoverflow.length < self->options.mem_buf_length)
+    {
+      g_queue_push_tail(&self->qoverflow, log_queue_disk_item_new(msg, -1, path_options->ack_needed));
+      stats_counter_inc(self->super.stored_messages);
+      log_queue_push_notify(&self->super);
+      g_static_mutex_unlock(&self->super.lock);
+      return;
+    }
+
+  stats_counter_inc(self->super.dropped_messages);
+  g_static_mutex_unlock(&self->super.lock);
+  log_msg_drop(msg, path_options);
+
+  msg_debug("Destination disk-queue full, dropping message",
+            evt_tag_int("disk_usage", qdisk_get_usage(self->qdisk)),
+            evt_tag_int("mem_buf_length", self->options.mem_buf_length),
+            evt_tag_str("persist_name", self->super.persist_name),
+            NULL);
+}
+
+/* the last message popped without use_backlog was not put back, it's done */
+static void
+log_queue_disk_ack_pending(LogQueueDisk *self)
+{
+  if (self->pending_records == 0)
+    return;
+
+  g_static_mutex_lock(&self->super.lock);
+  log_queue_disk_ack_records(self, self->pending_record_end, self->pending_records);
+  log_queue_disk_move_overflow_to_disk(self);
+  g_static_mutex_unlock(&self->super.lock);
+  self->pending_records = 0;
+}
+
+/*
+ * Put the last popped message back to the front of the queue, called from
+ * the output thread.  Its disk record was not acked yet, so it is kept
+ * on disk until the message is popped and processed again.
+ *
+ * NOTE: It consumes the reference passed by the caller.
+ */
+static void
+log_queue_disk_push_head(LogQueue *s, LogMessage *msg, const LogPathOptions *path_options)
+{
+  LogQueueDisk *self = (LogQueueDisk *) s;
+  LogQueueDiskItem *item;
+
+  if (self->pending_records > 0)
+    {
+      item = log_queue_disk_item_new(msg, self->pending_record_end, path_options->ack_needed);
+      item->skipped_records = self->pending_records - 1;
+      self->pending_records = 0;
+    }
+  else
+    {
+      item = log_queue_disk_item_new(msg, -1, path_options->ack_needed);
+    }
+  g_queue_push_head(&self->qout, item);
+  stats_counter_inc(self->super.stored_messages);
+}
+
+/* refill the front cache, only called from the output thread */
+static void
+log_queue_disk_fill_qout(LogQueueDisk *self)
+{
+  g_static_mutex_lock(&self->super.lock);
+
+  log_queue_disk_move_overflow_to_disk(self);
+  while (self->qout.length < self->options.qout_size && qdisk_get_length(self->qdisk) > 0 &&
+         log_queue_disk_get_read_retry_delay(self) == 0)
+    {
+      LogQueueDiskItem *item;
+      LogMessage *msg;
+      gint64 record_end;
+
+      if (!log_queue_disk_read_msg(self, &msg, &record_end))
+        break;
+      if (!msg)
+        continue;
+
+      item = log_queue_disk_item_new(msg, record_end, FALSE);
+      item->skipped_records = self->skipped_records;
+      self->skipped_records = 0;
+      g_queue_push_tail(&self->qout, item);
+    }
+
+  /* the disk is empty but messages couldn't be written to it, serve them from memory */
+  if (g_queue_is_empty(&self->qout) && qdisk_get_length(self->qdisk) == 0 && !g_queue_is_empty(&self->qoverflow))
+    g_queue_push_tail(&self->qout, g_queue_pop_head(&self->qoverflow));
+
+  g_static_mutex_unlock(&self->super.lock);
+}
+
+/*
+ * Can only run from the output thread.
+ *
+ * NOTE: this returns a reference which the caller must take care to free.
+ */
+static LogMessage *
+log_queue_disk_pop_head(LogQueue *s, LogPathOptions *path_options)
+{
+  LogQueueDisk *self = (LogQueueDisk *) s;
+  LogQueueDiskItem *item;
+  LogMessage *msg;
+
+  log_queue_disk_ack_pending(self);
+  if (g_queue_is_empty(&self->qout))
+    log_queue_disk_fill_qout(self);
+
+  item = g_queue_pop_head(&self->qout);
+  if (!item)
+    return NULL;
+
+  stats_counter_dec(self->super.stored_messages);
+  msg = item->msg;
+  path_options->ack_needed = item->ack_needed;
+
+  if (self->super.use_backlog)
+    {
+      log_msg_ref(msg);
+      g_queue_push_tail(&self->qbacklog, item);
+      return msg;
+    }
+
+  if (item->record_end >= 0)
+    {
+      self->pending_record_end = item->record_end;
+      self->pending_records = 1 + item->skipped_records;
+    }
+  g_slice_free(LogQueueDiskItem, item);
+  return msg;
+}
+
+/*
+ * Can only run from the output thread.
+ */
+static void
+log_queue_disk_ack_backlog(LogQueue *s, gint rewind_count)
+{
+  LogQueueDisk *self = (LogQueueDisk *) s;
+  gint64 record_end = -1;
+  gint disk_records = 0;
+  gint pos;
+
+  for (pos = 0; pos < rewind_count && !g_queue_is_empty(&self->qbacklog); pos++)
+    {
+      LogQueueDiskItem *item = g_queue_pop_head(&self->qbacklog);
+
+      if (item->record_end >= 0)
+        {
+          record_end = item->record_end;
+          disk_records += 1 + item->skipped_records;
+        }
+      log_queue_disk_item_free(item, AT_PROCESSED);
+    }
+
+  if (disk_records == 0)
+    return;
+
+  g_static_mutex_lock(&self->super.lock);
+  log_queue_disk_ack_records(self, record_end, disk_records);
+  log_queue_disk_move_overflow_to_disk(self);
+  g_static_mutex_unlock(&self->super.lock);
+}
+
+static void
+log_queue_disk_rewind_backlog(LogQueue *s, guint rewind_count)
+{
+  LogQueueDisk *self = (LogQueueDisk *) s;
+  guint pos;
+
+  for (pos = 0; pos < rewind_count && !g_queue_is_empty(&self->qbacklog); pos++)
+    {
+      LogQueueDiskItem *item = g_queue_pop_tail(&self->qbacklog);
+
+      /* pop_head took an extra reference when the item was put on the backlog */
+      log_msg_unref(item->msg);
+      g_queue_push_head(&self->qout, item);
+      stats_counter_inc(self->super.stored_messages);
+    }
+}
+
+static void
+log_queue_disk_rewind_backlog_all(LogQueue *s)
+{
+  LogQueueDisk *self = (LogQueueDisk *) s;
+
+  log_queue_disk_rewind_backlog(s, self->qbacklog.length);
+}
+
+static void
+log_queue_disk_register_stats_counters(LogQueue *s, gint stats_level, gint component, const gchar *id, const gchar *instance)
+{
+  LogQueueDisk *self = (LogQueueDisk *) s;
+
+  stats_register_counter(stats_level, component, id, instance, SC_TYPE_DISK_USAGE, &self->disk_usage);
+  log_queue_disk_update_disk_usage(self);
+}
+
+static void
+log_queue_disk_unregister_stats_counters(LogQueue *s, gint component, const gchar *id, const gchar *instance)
+{
+  LogQueueDisk *self = (LogQueueDisk *) s;
+
+  stats_unregister_counter(component, id, instance, SC_TYPE_DISK_USAGE, &self->disk_usage);
+}
+
+/* items backed by a disk record are left there, they are read again after a restart */
+static void
+log_queue_disk_free_queue(GQueue *q)
+{
+  LogQueueDiskItem *item;
+
+  while ((item = g_queue_pop_head(q)))
+    log_queue_disk_item_free(item, item->record_end >= 0 ? AT_PROCESSED : AT_ABORTED);
+}
+
+static void
+log_queue_disk_free(LogQueue *s)
+{
+  LogQueueDisk *self = (LogQueueDisk *) s;
+
+  if (qdisk_is_started(self->qdisk))
+    {
+      log_queue_disk_ack_pending(self);
+      log_queue_disk_rewind_backlog_all(s);
+      log_queue_disk_move_overflow_to_disk(self);
+      if (!g_queue_is_empty(&self->qoverflow))
+        msg_error("Disk-queue is full, messages in its memory buffer are lost",
+                  evt_tag_int("lost", self->qoverflow.length),
+                  evt_tag_str("persist_name", self->super.persist_name),
+                  NULL);
+    }
+  log_queue_disk_free_queue(&self->qout);
+  log_queue_disk_free_queue(&self->qoverflow);
+  qdisk_free(self->qdisk);
+  qdisk_options_destroy(&self->options);
+  log_queue_free_method(s);
+}
+
+gboolean
+log_queue_disk_start(LogQueue *s, PersistState *state)
+{
+  LogQueueDisk *self = (LogQueueDisk *) s;
+
+  g_assert(self->super.persist_name != NULL);
+  return qdisk_start(self->qdisk, state, self->super.persist_name);
+}
+
+/*
+ * Remove the files of the queue if it is empty, the queue must not be
+ * used afterwards, only unreferenced.  Called from the output thread,
+ * returns TRUE if the queue was removed.
+ */
+gboolean
+log_queue_disk_remove(LogQueue *s)
+{
+  LogQueueDisk *self = (LogQueueDisk *) s;
+  gboolean removed = FALSE;
+
+  if (!qdisk_is_started(self->qdisk) || !g_queue_is_empty(&self->qout) || !g_queue_is_empty(&self->qbacklog))
+    return FALSE;
+
+  log_queue_disk_ack_pending(self);
+  g_static_mutex_lock(&self->super.lock);
+  if (qdisk_get_length(self->qdisk) == 0 && qdisk_get_backlog_length(self->qdisk) == 0 &&
+      g_queue_is_empty(&self->qoverflow))
+    {
+      qdisk_remove(self->qdisk, self->super.persist_name);
+      removed = TRUE;
+    }
+  g_static_mutex_unlock(&self->super.lock);
+  return removed;
+}
+
+gboolean
+log_queue_is_disk(LogQueue *s)
+{
+  return s->free_fn == log_queue_disk_free;
+}
+
+LogQueue *
+log_queue_disk_new(const QDiskOptions *options, const gchar *persist_name)
+{
+  LogQueueDisk *self = g_new0(LogQueueDisk, 1);
+
+  log_queue_init_instance(&self->super, persist_name);
+  self->super.use_backlog = FALSE;
+  self->super.get_length = log_queue_disk_get_length;
+  self->super.keep_on_reload = log_queue_disk_keep_on_reload;
+  self->super.push_tail = log_queue_disk_push_tail;
+  self->super.push_head = log_queue_disk_push_head;
+  self->super.pop_head = log_queue_disk_pop_head;
+  self->super.ack_backlog = log_queue_disk_ack_backlog;
+  self->super.rewind_backlog = log_queue_disk_rewind_backlog;
+  self->super.rewind_backlog_all = log_queue_disk_rewind_backlog_all;
+  self->super.get_read_delay = log_queue_disk_get_read_delay;
+  self->super.register_stats_counters = log_queue_disk_register_stats_counters;
+  self->super.unregister_stats_counters = log_queue_disk_unregister_stats_counters;
+  self->super.free_fn = log_queue_disk_free;
+
+  qdisk_options_copy(&self->options, options);
+  self->qdisk = qdisk_new(options);
+  g_queue_init(&self->qoverflow);
+  g_queue_init(&self->qout);
+  g_queue_init(&self->qbacklog);
+  return &self->super;
+}
@@ -67,8 +67,65 @@
  *   - the head of the queue is only manipulated from the output thread
  *   - the tail of the queue is only manipulated from the input threads
  *
+ * Memory accounting:
+ *   - besides the number of elements, the queue also keeps track of the
+ *     memory used by the queued messages (as returned by
+ *     log_msg_get_size()), using the same per-stage scheme as the
+ *     lengths above.  The size is stored in the queue node when the
+ *     message is queued, as the message may still grow afterwards
+ *     (e.g. LogMultiplexer write-unprotects it once delivered to every
+ *     queue).  If a memory limit is set, messages are dropped once it
+ *     would be exceeded, the same way as when log_fifo_size() is
+ *     reached.
+ *
+ * Lockless mode:
+ *   - when enabled (log_queue_fifo_set_lockless()), the input threads
+ *     don't move their input queues to the wait queue, instead they hand
+ *     them over as a single batch through a per-thread single-producer,
+ *     single-consumer ring, without acquiring any locks.  The output
+ *     thread drains the rings round-robin before looking at the wait
+ *     queue.
+ *
+ *   - if a ring is full, the input thread falls back to the locked wait
+ *     queue, messages from threads without a thread_id always go there.
+ *     To keep the order of a thread's messages, the thread keeps using
+ *     the wait queue until the output thread has taken it over, which
+ *     happens after the rings were drained.
+ *
+ *   - the number of elements in the rings is maintained with atomic
+ *     operations, the memory is summed from per-ring counters each
+ *     written by a single thread.  The output thread's
+ *     parallel_push_notify callback is checked without the lock after
+ *     rings_len was increased (a full barrier), see
+ *     log_queue_check_items() for the other half of this handshake.
+ *
  */
 
+/* number of batches per input thread, must be a power of 2 */
+#define LOG_QUEUE_FIFO_RING_SIZE 256
+
+typedef struct _LogQueueFifoBatch
+{
+  struct iv_list_head items;
+  gint len;
+  gsize memory;
+} LogQueueFifoBatch;
+
+typedef struct _LogQueueFifoRing
+{
+  /* only changed by the input thread */
+  gint tail;
+  /* only changed by the output thread */
+  gint head;
+  /* memory of the batches ever published/consumed, written by the input
+   * and the output thread respectively */
+  gsize pushed_memory;
+  gsize popped_memory;
+  /* the input thread uses the wait queue, protected by LogQueue->lock */
+  gboolean fallback;
+  LogQueueFifoBatch *slots[LOG_QUEUE_FIFO_RING_SIZE];
+} LogQueueFifoRing;
+
 
 typedef struct _LogQueueFifo
 {
@@ -80,14 +137,27 @@ typedef struct _LogQueueFifo
   gint qoverflow_wait_len;
   gint qoverflow_output_len;
   gint qoverflow_size; /* in number of elements */
+  gsize qoverflow_wait_memory;
+  gsize qoverflow_output_memory;
+  gsize qoverflow_memory_limit; /* in bytes, 0 means unlimited */
+
+  StatsCounterItem *memory_usage;
+
+  /* lockless mode, NULL if not enabled, one per input thread */
+  LogQueueFifoRing *rings;
+  /* updated atomically */
+  gint rings_len;
+  gint rings_drain_start;
 
   struct iv_list_head qbacklog;    /* entries that were sent but not acked yet */
   gint qbacklog_len;
+  gsize qbacklog_memory;
 
   struct
   {
     struct iv_list_head items;
     WorkerBatchCallback cb;
+    gsize memory;
     guint16 len;
     guint16 finish_cb_registered;
   } qoverflow_input[0];
@@ -106,9 +176,38 @@ log_queue_fifo_get_length(LogQueue *s)
 {
   LogQueueFifo *self = (LogQueueFifo *) s;
 
+  if (self->rings)
+    return self->qoverflow_wait_len + self->qoverflow_output_len + g_atomic_int_get(&self->rings_len);
   return self->qoverflow_wait_len + self->qoverflow_output_len;
 }
 
+/* NOTE: racy the same way as log_queue_fifo_get_length() */
+static gsize
+log_queue_fifo_get_memory(LogQueueFifo *self)
+{
+  gsize memory = self->qoverflow_wait_memory + self->qoverflow_output_memory;
+  gint i;
+
+  if (self->rings)
+    {
+      for (i = 0; i < log_queue_max_threads; i++)
+        {
+          gssize ring_memory = (gssize) (self->rings[i].pushed_memory - self->rings[i].popped_memory);
+
+          /* the two counters are read without synchronization */
+          if (ring_memory > 0)
+            memory += ring_memory;
+        }
+    }
+  return memory;
+}
+
+static inline gboolean
+log_queue_fifo_is_memory_limit_exceeded(LogQueueFifo *self, gsize queue_memory, gsize add)
+{
+  return self->qoverflow_memory_limit > 0 && queue_memory + add > self->qoverflow_memory_limit;
+}
+
 gboolean
 log_queue_fifo_is_empty_racy(LogQueue *s)
 {
@@ -131,6 +230,24 @@ log_queue_fifo_is_empty_racy(LogQueue *s)
   return !has_message_in_queue;
 }
 
+/* same as log_queue_fifo_is_empty_racy() but without the lock, as used in lockless mode */
+static gboolean
+log_queue_fifo_is_empty_racy_lockless(LogQueue *s)
+{
+  LogQueueFifo *self = (LogQueueFifo *) s;
+  gint i;
+
+  if (log_queue_fifo_get_length(s) > 0)
+    return FALSE;
+
+  for (i = 0; i < log_queue_max_threads; i++)
+    {
+      if (self->qoverflow_input[i].finish_cb_registered)
+        return FALSE;
+    }
+  return TRUE;
+}
+
 /* NOTE: this is inherently racy, can only be called if log processing is suspended (e.g. reload time) */
 static gboolean
 log_queue_fifo_keep_on_reload(LogQueue *s)
@@ -139,11 +256,12 @@ log_queue_fifo_keep_on_reload(LogQueue *s)
   return log_queue_fifo_get_length(s) > 0 || self->qbacklog_len > 0;
 }
 
-/* move items from the per-thread input queue to the lock-protected "wait" queue */
+/* drop items from the per-thread input queue that would overflow the queue */
 static void
-log_queue_fifo_move_input_unlocked(LogQueueFifo *self, gint thread_id)
+log_queue_fifo_drop_input_overflow(LogQueueFifo *self, gint thread_id)
 {
   gint queue_len;
+  gsize queue_memory;
 
   /* since we're in the input thread, queue_len will be racy. It can
    * increase due to log_queue_fifo_push_head() and can also decrease as
@@ -159,41 +277,126 @@ log_queue_fifo_move_input_unlocked(LogQueueFifo *self, gint thread_id)
    */
 
   queue_len = log_queue_fifo_get_length(&self->super);
-  if (queue_len + self->qoverflow_input[thread_id].len > self->qoverflow_size)
+  queue_memory = log_queue_fifo_get_memory(self);
+  if (queue_len + self->qoverflow_input[thread_id].len > self->qoverflow_size ||
+      log_queue_fifo_is_memory_limit_exceeded(self, queue_memory, self->qoverflow_input[thread_id].memory))
     {
       /* slow path, the input thread's queue would overflow the queue, let's drop some messages */
 
       LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
-      gint i;
-      gint n;
-
-      /* NOTE: MAX is needed here to ensure that the lost race on queue_len
-       * doesn't result in n < 0 */
-      n = self->qoverflow_input[thread_id].len - MAX(0, (self->qoverflow_size - queue_len));
+      gint n = 0;
 
-      for (i = 0; i < n; i++)
+      /* NOTE: the lost race on queue_len/queue_memory may only result
+       * in dropping a couple of messages too many or too few */
+      while (self->qoverflow_input[thread_id].len > 0 &&
+             (queue_len + self->qoverflow_input[thread_id].len > self->qoverflow_size ||
+              log_queue_fifo_is_memory_limit_exceeded(self, queue_memory, self->qoverflow_input[thread_id].memory)))
         {
           LogMessageQueueNode *node = iv_list_entry(self->qoverflow_input[thread_id].items.next, LogMessageQueueNode, list);
           LogMessage *msg = node->msg;
 
           iv_list_del(&node->list);
           self->qoverflow_input[thread_id].len--;
+          self->qoverflow_input[thread_id].memory -= node->size;
           path_options.ack_needed = node->ack_needed;
           stats_counter_inc(self->super.dropped_messages);
           log_msg_free_queue_node(node);
           log_msg_drop(msg, &path_options);
+          n++;
         }
       msg_debug("Destination queue full, dropping messages",
                 evt_tag_int("queue_len", queue_len),
                 evt_tag_int("log_fifo_size", self->qoverflow_size),
+                evt_tag_int("queue_memory", queue_memory),
+                evt_tag_int("memory_limit", self->qoverflow_memory_limit),
                 evt_tag_int("count", n),
                 evt_tag_str("persist_name", self->super.persist_name),
                 NULL);
     }
+}
+
+/* move items from the per-thread input queue to the lock-protected "wait" queue */
+static void
+log_queue_fifo_move_input_unlocked(LogQueueFifo *self, gint thread_id)
+{
+  log_queue_fifo_drop_input_overflow(self, thread_id);
+
   stats_counter_add(self->super.stored_messages, self->qoverflow_input[thread_id].len);
+  stats_counter_add(self->memory_usage, self->qoverflow_input[thread_id].memory);
   iv_list_splice_tail_init(&self->qoverflow_input[thread_id].items, &self->qoverflow_wait);
   self->qoverflow_wait_len += self->qoverflow_input[thread_id].len;
+  self->qoverflow_wait_memory += self->qoverflow_input[thread_id].memory;
+  self->qoverflow_input[thread_id].len = 0;
+  self->qoverflow_input[thread_id].memory = 0;
+}
+
+/* hand over the per-thread input queue to the output thread using the
+ * thread's ring, without locking.  Returns FALSE if the ring is full. */
+static gboolean
+log_queue_fifo_move_input_to_ring(LogQueueFifo *self, gint thread_id)
+{
+  LogQueueFifoRing *ring = &self->rings[thread_id];
+  LogQueueFifoBatch *batch;
+  guint tail = (guint) ring->tail;
+
+  if (tail - (guint) g_atomic_int_get(&ring->head) >= LOG_QUEUE_FIFO_RING_SIZE)
+    return FALSE;
+
+  log_queue_fifo_drop_input_overflow(self, thread_id);
+  if (self->qoverflow_input[thread_id].len == 0)
+    return TRUE;
+
+  batch = g_slice_new(LogQueueFifoBatch);
+  INIT_IV_LIST_HEAD(&batch->items);
+  iv_list_splice_tail_init(&self->qoverflow_input[thread_id].items, &batch->items);
+  batch->len = self->qoverflow_input[thread_id].len;
+  batch->memory = self->qoverflow_input[thread_id].memory;
   self->qoverflow_input[thread_id].len = 0;
+  self->qoverflow_input[thread_id].memory = 0;
+
+  stats_counter_add(self->super.stored_messages, batch->len);
+  stats_counter_add(self->memory_usage, batch->memory);
+
+  /* the counters are increased before publishing the batch, so that the
+   * output thread never decreases them below zero */
+  ring->pushed_memory += batch->memory;
+  g_atomic_int_add(&self->rings_len, batch->len);
+  ring->slots[tail & (LOG_QUEUE_FIFO_RING_SIZE - 1)] = batch;
+  g_atomic_int_set(&ring->tail, (gint) (tail + 1));
+  return TRUE;
+}
+
+/* move the batches published by the input threads to the output queue,
+ * only called from the output thread */
+static void
+log_queue_fifo_drain_rings(LogQueueFifo *self)
+{
+  gint i;
+
+  for (i = 0; i < log_queue_max_threads; i++)
+    {
+      LogQueueFifoRing *ring = &self->rings[(self->rings_drain_start + i) % log_queue_max_threads];
+      guint head = (guint) ring->head;
+      guint tail = (guint) g_atomic_int_get(&ring->tail);
+
+      if (head == tail)
+        continue;
+
+      while (head != tail)
+        {
+          LogQueueFifoBatch *batch = ring->slots[head & (LOG_QUEUE_FIFO_RING_SIZE - 1)];
+
+          iv_list_splice_tail_init(&batch->items, &self->qoverflow_output);
+          self->qoverflow_output_len += batch->len;
+          self->qoverflow_output_memory += batch->memory;
+          ring->popped_memory += batch->memory;
+          g_atomic_int_add(&self->rings_len, -batch->len);
+          g_slice_free(LogQueueFifoBatch, batch);
+          head++;
+        }
+      g_atomic_int_set(&ring->head, (gint) head);
+    }
+  self->rings_drain_start = (self->rings_drain_start + 1) % log_queue_max_threads;
 }
 
 /* move items from the per-thread input queue to the lock-protected
@@ -211,10 +414,39 @@ log_queue_fifo_move_input(gpointer user_data)
 
   g_assert(thread_id >= 0);
 
-  g_static_mutex_lock(&self->super.lock);
-  log_queue_fifo_move_input_unlocked(self, thread_id);
-  log_queue_push_notify(&self->super);
-  g_static_mutex_unlock(&self->super.lock);
+  /* the fallback flag is only set by this thread, so if it's seen
+   * cleared without the lock, it is really cleared */
+  if (self->rings && !g_atomic_int_get(&self->rings[thread_id].fallback) &&
+      log_queue_fifo_move_input_to_ring(self, thread_id))
+    {
+      /* lockless fastpath, only lock if the output thread is waiting for
+       * items.  rings_len was increased with a full barrier before
+       * reading the pointer, pairing with log_queue_check_items() */
+      if (g_atomic_pointer_get((gpointer *) &self->super.parallel_push_notify))
+        {
+          g_static_mutex_lock(&self->super.lock);
+          log_queue_push_notify(&self->super);
+          g_static_mutex_unlock(&self->super.lock);
+        }
+    }
+  else
+    {
+      g_static_mutex_lock(&self->super.lock);
+      if (self->rings && self->rings[thread_id].fallback)
+        {
+          log_queue_fifo_move_input_unlocked(self, thread_id);
+        }
+      else if (!self->rings || !log_queue_fifo_move_input_to_ring(self, thread_id))
+        {
+          /* the ring is full, the wait queue is used until the output
+           * thread consumed it */
+          log_queue_fifo_move_input_unlocked(self, thread_id);
+          if (self->rings)
+            g_atomic_int_set(&self->rings[thread_id].fallback, TRUE);
+        }
+      log_queue_push_notify(&self->super);
+      g_static_mutex_unlock(&self->super.lock);
+    }
   self->qoverflow_input[thread_id].finish_cb_registered = FALSE;
   return NULL;
 }
@@ -236,6 +468,7 @@ log_queue_fifo_push_tail(LogQueue *s, LogMessage *msg, const LogPathOptions *pat
   LogQueueFifo *self = (LogQueueFifo *) s;
   gint thread_id;
   LogMessageQueueNode *node;
+  gsize msg_size;
 
   thread_id = main_loop_worker_get_thread_id();
 
@@ -265,8 +498,10 @@ log_queue_fifo_push_tail(LogQueue *s, LogMessage *msg, const LogPathOptions *pat
         }
 
       node = log_msg_alloc_queue_node(msg, path_options);
+      node->size = log_msg_get_size(msg);
       iv_list_add_tail(&node->list, &self->qoverflow_input[thread_id].items);
       self->qoverflow_input[thread_id].len++;
+      self->qoverflow_input[thread_id].memory += node->size;
       log_msg_unref(msg);
       return;
     }
@@ -278,15 +513,20 @@ log_queue_fifo_push_tail(LogQueue *s, LogMessage *msg, const LogPathOptions *pat
   if (thread_id >= 0)
     log_queue_fifo_move_input_unlocked(self, thread_id);
   
-  if (log_queue_fifo_get_length(s) < self->qoverflow_size)
+  msg_size = log_msg_get_size(msg);
+  if (log_queue_fifo_get_length(s) < self->qoverflow_size &&
+      !log_queue_fifo_is_memory_limit_exceeded(self, log_queue_fifo_get_memory(self), msg_size))
     {
       node = log_msg_alloc_queue_node(msg, path_options);
+      node->size = msg_size;
 
       iv_list_add_tail(&node->list, &self->qoverflow_wait);
       self->qoverflow_wait_len++;
+      self->qoverflow_wait_memory += msg_size;
       log_queue_push_notify(&self->super);
 
       stats_counter_inc(self->super.stored_messages);
+      stats_counter_add(self->memory_usage, msg_size);
       g_static_mutex_unlock(&self->super.lock);
 
       log_msg_unref(msg);
@@ -300,6 +540,8 @@ log_queue_fifo_push_tail(LogQueue *s, LogMessage *msg, const LogPathOptions *pat
       msg_debug("Destination queue full, dropping message",
                 evt_tag_int("queue_len", log_queue_fifo_get_length(&self->super)),
                 evt_tag_int("log_fifo_size", self->qoverflow_size),
+                evt_tag_int("queue_memory", log_queue_fifo_get_memory(self)),
+                evt_tag_int("memory_limit", self->qoverflow_memory_limit),
                 evt_tag_str("persist_name", self->super.persist_name),
                 NULL);
     }
@@ -318,17 +560,54 @@ log_queue_fifo_push_head(LogQueue *s, LogMessage *msg, const LogPathOptions *pat
 {
   LogQueueFifo *self = (LogQueueFifo *) s;
   LogMessageQueueNode *node;
+  gsize msg_size = log_msg_get_size(msg);
 
   /* we don't check limits when putting items "in-front", as it
    * normally happens when we start processing an item, but at the end
    * can't deliver it. No checks, no drops either. */
 
   node = log_msg_alloc_dynamic_queue_node(msg, path_options);
+  node->size = msg_size;
   iv_list_add(&node->list, &self->qoverflow_output);
   self->qoverflow_output_len++;
+  self->qoverflow_output_memory += msg_size;
   log_msg_unref(msg);
 
   stats_counter_inc(self->super.stored_messages);
+  stats_counter_add(self->memory_usage, msg_size);
+}
+
+/* move the items published by the input threads to the output queue,
+ * only called from the output thread */
+static void
+log_queue_fifo_fill_output(LogQueueFifo *self)
+{
+  if (self->rings)
+    log_queue_fifo_drain_rings(self);
+
+  /* slow path, output queue is empty, get some elements from the wait
+   * queue. In lockless mode, the wait queue is only used as a
+   * fallback, so its length is checked without the lock first.  The
+   * rings are drained again with the lock held: a thread only falls back
+   * to the wait queue with the lock held once its ring is full, so its
+   * older batches get to the output queue first, and whatever it puts to
+   * its ring after the fallback is cleared is newer than the wait queue. */
+  if (!self->rings || self->qoverflow_wait_len > 0)
+    {
+      gint i;
+
+      g_static_mutex_lock(&self->super.lock);
+      if (self->rings)
+        log_queue_fifo_drain_rings(self);
+      iv_list_splice_tail_init(&self->qoverflow_wait, &self->qoverflow_output);
+      self->qoverflow_output_len += self->qoverflow_wait_len;
+      self->qoverflow_output_memory += self->qoverflow_wait_memory;
+      self->qoverflow_wait_len = 0;
+      self->qoverflow_wait_memory = 0;
+      for (i = 0; self->rings && i < log_queue_max_threads; i++)
+        g_atomic_int_set(&self->rings[i].fallback, FALSE);
+      g_static_mutex_unlock(&self->super.lock);
+    }
 }
 
 /*
@@ -342,16 +621,10 @@ log_queue_fifo_pop_head(LogQueue *s, LogPathOptions *path_options)
   LogQueueFifo *self = (LogQueueFifo *) s;
   LogMessageQueueNode *node;
   LogMessage *msg = NULL;
+  gsize msg_size;
 
   if (self->qoverflow_output_len == 0)
-    {
-      /* slow path, output queue is empty, get some elements from the wait queue */
-      g_static_mutex_lock(&self->super.lock);
-      iv_list_splice_tail_init(&self->qoverflow_wait, &self->qoverflow_output);
-      self->qoverflow_output_len = self->qoverflow_wait_len;
-      self->qoverflow_wait_len = 0;
-      g_static_mutex_unlock(&self->super.lock);
-    }
+    log_queue_fifo_fill_output(self);
 
   if (self->qoverflow_output_len > 0)
     {
@@ -359,7 +632,9 @@ log_queue_fifo_pop_head(LogQueue *s, LogPathOptions *path_options)
 
       msg = node->msg;
       path_options->ack_needed = node->ack_needed;
+      msg_size = node->size;
       self->qoverflow_output_len--;
+      self->qoverflow_output_memory -= msg_size;
       if (!self->super.use_backlog)
         {
           iv_list_del(&node->list);
@@ -383,17 +658,92 @@ log_queue_fifo_pop_head(LogQueue *s, LogPathOptions *path_options)
       return NULL;
     }
   stats_counter_dec(self->super.stored_messages);
+  stats_counter_add(self->memory_usage, -((gint) msg_size));
 
   if (self->super.use_backlog)
     {
       log_msg_ref(msg);
       iv_list_add_tail(&node->list, &self->qbacklog);
       self->qbacklog_len++;
+      self->qbacklog_memory += msg_size;
     }
 
   return msg;
 }
 
+/*
+ * Same as log_queue_fifo_pop_head(), but returns up to @max_msgs
+ * messages at once.  The popped nodes are moved to the backlog with a
+ * single list operation.
+ *
+ * Can only run from the output thread.
+ *
+ * NOTE: the caller must take care to free the returned references.
+ */
+static gint
+log_queue_fifo_pop_batch(LogQueue *s, LogMessage **msgs, LogPathOptions *path_options, gint max_msgs)
+{
+  LogQueueFifo *self = (LogQueueFifo *) s;
+  struct iv_list_head *first, *last;
+  gsize batch_memory = 0;
+  gint i, n;
+
+  if (self->qoverflow_output_len == 0)
+    log_queue_fifo_fill_output(self);
+
+  n = MIN(max_msgs, self->qoverflow_output_len);
+  if (n == 0)
+    return 0;
+
+  first = self->qoverflow_output.next;
+  last = &self->qoverflow_output;
+  for (i = 0; i < n; i++)
+    {
+      LogMessageQueueNode *node;
+
+      last = last->next;
+      node = iv_list_entry(last, LogMessageQueueNode, list);
+      msgs[i] = node->msg;
+      path_options[i] = (LogPathOptions) LOG_PATH_OPTIONS_INIT;
+      path_options[i].ack_needed = node->ack_needed;
+      batch_memory += node->size;
+    }
+
+  /* unlink the [first, last] range from the output queue */
+  self->qoverflow_output.next = last->next;
+  last->next->prev = &self->qoverflow_output;
+  self->qoverflow_output_len -= n;
+  self->qoverflow_output_memory -= batch_memory;
+  stats_counter_add(self->super.stored_messages, -n);
+  stats_counter_add(self->memory_usage, -((gint) batch_memory));
+
+  if (self->super.use_backlog)
+    {
+      /* append the range to the backlog */
+      first->prev = self->qbacklog.prev;
+      self->qbacklog.prev->next = first;
+      last->next = &self->qbacklog;
+      self->qbacklog.prev = last;
+      self->qbacklog_len += n;
+      self->qbacklog_memory += batch_memory;
+
+      for (i = 0; i < n; i++)
+        log_msg_ref(msgs[i]);
+    }
+  else
+    {
+      struct iv_list_head *lh, *next;
+
+      last->next = NULL;
+      for (lh = first; lh; lh = next)
+        {
+          next = lh->next;
+          log_msg_free_queue_node(iv_list_entry(lh, LogMessageQueueNode, list));
+        }
+    }
+  return n;
+}
+
 /*
  * Can only run from the output thread.
  */
@@ -413,6 +763,7 @@ log_queue_fifo_ack_backlog(LogQueue *s, gint rewind_count)
 
       iv_list_del(&node->list);
       self->qbacklog_len--;
+      self->qbacklog_memory -= node->size;
       path_options.ack_needed = node->ack_needed;
       log_msg_ack(msg, &path_options, AT_PROCESSED);
       log_msg_free_queue_node(node);
@@ -438,8 +789,11 @@ log_queue_fifo_rewind_backlog_all(LogQueue *s)
 
   iv_list_splice_tail_init(&self->qbacklog, &self->qoverflow_output);
   self->qoverflow_output_len += self->qbacklog_len;
+  self->qoverflow_output_memory += self->qbacklog_memory;
   stats_counter_add(self->super.stored_messages, self->qbacklog_len);
+  stats_counter_add(self->memory_usage, self->qbacklog_memory);
   self->qbacklog_len = 0;
+  self->qbacklog_memory = 0;
 }
 
 static void
@@ -454,6 +808,7 @@ log_queue_fifo_rewind_backlog(LogQueue *s, guint rewind_count)
   for (pos = 0; pos < rewind_count; pos++)
     {
       LogMessageQueueNode *node = iv_list_entry(self->qbacklog.prev, LogMessageQueueNode, list);
+      gsize msg_size = node->size;
       /*
        * Because the message go to the backlog only in case of pop_head
        * and pop_head add ack and ref when it pushes the message into the backlog
@@ -463,11 +818,31 @@ log_queue_fifo_rewind_backlog(LogQueue *s, guint rewind_count)
       iv_list_add(&node->list, &self->qoverflow_output);
 
       self->qbacklog_len--;
+      self->qbacklog_memory -= msg_size;
       self->qoverflow_output_len++;
+      self->qoverflow_output_memory += msg_size;
       stats_counter_inc(self->super.stored_messages);
+      stats_counter_add(self->memory_usage, msg_size);
     }
 }
 
+static void
+log_queue_fifo_register_stats_counters(LogQueue *s, gint stats_level, gint component, const gchar *id, const gchar *instance)
+{
+  LogQueueFifo *self = (LogQueueFifo *) s;
+
+  stats_register_counter(stats_level, component, id, instance, SC_TYPE_MEMORY_USAGE, &self->memory_usage);
+  stats_counter_set(self->memory_usage, log_queue_fifo_get_memory(self));
+}
+
+static void
+log_queue_fifo_unregister_stats_counters(LogQueue *s, gint component, const gchar *id, const gchar *instance)
+{
+  LogQueueFifo *self = (LogQueueFifo *) s;
+
+  stats_unregister_counter(component, id, instance, SC_TYPE_MEMORY_USAGE, &self->memory_usage);
+}
+
 static void
 log_queue_fifo_free_queue(struct iv_list_head *q)
 {
@@ -497,6 +872,12 @@ log_queue_fifo_free(LogQueue *s)
   for (i = 0; i < log_queue_max_threads; i++)
     log_queue_fifo_free_queue(&self->qoverflow_input[i].items);
 
+  if (self->rings)
+    {
+      log_queue_fifo_drain_rings(self);
+      g_free(self->rings);
+    }
+
   log_queue_fifo_free_queue(&self->qoverflow_wait);
   log_queue_fifo_free_queue(&self->qoverflow_output);
   log_queue_fifo_free_queue(&self->qbacklog);
@@ -519,9 +900,12 @@ log_queue_fifo_new(gint qoverflow_size, const gchar *persist_name)
   self->super.push_tail = log_queue_fifo_push_tail;
   self->super.push_head = log_queue_fifo_push_head;
   self->super.pop_head = log_queue_fifo_pop_head;
+  self->super.pop_batch = log_queue_fifo_pop_batch;
   self->super.ack_backlog = log_queue_fifo_ack_backlog;
   self->super.rewind_backlog = log_queue_fifo_rewind_backlog;
   self->super.rewind_backlog_all = log_queue_fifo_rewind_backlog_all;
+  self->super.register_stats_counters = log_queue_fifo_register_stats_counters;
+  self->super.unregister_stats_counters = log_queue_fifo_unregister_stats_counters;
 
   self->super.free_fn = log_queue_fifo_free;
   
@@ -539,3 +923,25 @@ log_queue_fifo_new(gint qoverflow_size, const gchar *persist_name)
   self->qoverflow_size = qoverflow_size;
   return &self->super;
 }
+
+void
+log_queue_fifo_set_memory_limit(LogQueue *s, gsize memory_limit)
+{
+  LogQueueFifo *self = (LogQueueFifo *) s;
+
+  self->qoverflow_memory_limit = memory_limit;
+}
+
+/* NOTE: must be called right after construction, before the queue is used */
+void
+log_queue_fifo_set_lockless(LogQueue *s, gboolean lockless)
+{
+  LogQueueFifo *self = (LogQueueFifo *) s;
+
+  g_assert(log_queue_fifo_get_length(s) == 0);
+  if (lockless && !self->rings && log_queue_max_threads > 0)
+    {
+      self->rings = g_new0(LogQueueFifoRing, log_queue_max_threads);
+      self->super.is_empty_racy = log_queue_fifo_is_empty_racy_lockless;
+    }
+}
@@ -28,5 +28,7 @@
 #include "logqueue.h"
 
 LogQueue *log_queue_fifo_new(gint qoverflow_size, const gchar *persist_name);
+void log_queue_fifo_set_memory_limit(LogQueue *s, gsize memory_limit);
+void log_queue_fifo_set_lockless(LogQueue *s, gboolean lockless);
 
 #endif
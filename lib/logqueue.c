@@ -102,18 +102,31 @@ log_queue_check_items(LogQueue *self, gint *timeout, LogQueuePushNotifyFunc para
   num_elements = log_queue_get_length(self);
   if (num_elements == 0)
     {
-      self->parallel_push_notify = parallel_push_notify;
       self->parallel_push_data = user_data;
       self->parallel_push_data_destroy = user_data_destroy;
-      g_static_mutex_unlock(&self->lock);
-      return FALSE;
+
+      /* lockless queue implementations check parallel_push_notify
+       * without holding self->lock after publishing their items, thus the
+       * length is checked again once the callback is set, otherwise we
+       * could miss a wakeup.  The callback is stored atomically, it has
+       * to be visible before the length is loaded again (with
+       * g_atomic_int_get() by such implementations), pairing with the
+       * barrier between publishing the items and loading the callback
+       * on the producer side. */
+      g_atomic_pointer_set((gpointer *) &self->parallel_push_notify, parallel_push_notify);
+      num_elements = log_queue_get_length(self);
+      if (num_elements == 0)
+        {
+          g_static_mutex_unlock(&self->lock);
+          return FALSE;
+        }
     }
 
   /* consume the user_data reference as we won't use the callback */
   if (user_data && user_data_destroy)
     user_data_destroy(user_data);
 
-  self->parallel_push_notify = NULL;
+  g_atomic_pointer_set((gpointer *) &self->parallel_push_notify, NULL);
   self->parallel_push_data = NULL;
 
   g_static_mutex_unlock(&self->lock);
@@ -164,6 +177,18 @@ log_queue_check_items(LogQueue *self, gint *timeout, LogQueuePushNotifyFunc para
         }
     }
 
+  if (num_elements && self->get_read_delay)
+    {
+      gint delay = self->get_read_delay(self);
+
+      if (delay > 0)
+        {
+          if (timeout)
+            *timeout = delay;
+          return FALSE;
+        }
+    }
+
   return TRUE;
 }
 
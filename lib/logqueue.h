@@ -26,6 +26,7 @@
 #define LOGQUEUE_H_INCLUDED
 
 #include "logmsg.h"
+#include "logpipe.h"
 #include "stats/stats-registry.h"
 
 extern gint log_queue_max_threads;
@@ -61,9 +62,18 @@ struct _LogQueue
   void (*push_tail)(LogQueue *self, LogMessage *msg, const LogPathOptions *path_options);
   void (*push_head)(LogQueue *self, LogMessage *msg, const LogPathOptions *path_options);
   LogMessage *(*pop_head)(LogQueue *self, LogPathOptions *path_options);
+  gint (*pop_batch)(LogQueue *self, LogMessage **msgs, LogPathOptions *path_options, gint max_msgs);
   void (*ack_backlog)(LogQueue *self, gint n);
   void (*rewind_backlog)(LogQueue *self, guint rewind_count);
   void (*rewind_backlog_all)(LogQueue *self);
+  /* optional: milliseconds to wait before the queued items can be read,
+   * e.g. after a transient read error, 0 if they can be read now */
+  gint (*get_read_delay)(LogQueue *self);
+
+  /* queue implementation specific counters, registered next to the
+   * stored/dropped counters of the owning destination */
+  void (*register_stats_counters)(LogQueue *self, gint stats_level, gint component, const gchar *id, const gchar *instance);
+  void (*unregister_stats_counters)(LogQueue *self, gint component, const gchar *id, const gchar *instance);
 
   void (*free_fn)(LogQueue *self);
 };
@@ -125,6 +135,51 @@ log_queue_pop_head_ignore_throttle(LogQueue *self, LogPathOptions *path_options)
   return self->pop_head(self, path_options);
 }
 
+/*
+ * Pops up to @max_msgs messages into @msgs, @path_options is an array of
+ * the same size, initialized by the queue for each message popped.
+ * Returns the number of messages popped, the caller must free the
+ * references returned.  Queue implementations without a native
+ * pop_batch method fall back to calling pop_head repeatedly.
+ */
+static inline gint
+log_queue_pop_batch_ignore_throttle(LogQueue *self, LogMessage **msgs, LogPathOptions *path_options, gint max_msgs)
+{
+  gint n = 0;
+
+  if (self->pop_batch)
+    return self->pop_batch(self, msgs, path_options, max_msgs);
+
+  while (n < max_msgs)
+    {
+      path_options[n] = (LogPathOptions) LOG_PATH_OPTIONS_INIT;
+      msgs[n] = self->pop_head(self, &path_options[n]);
+      if (!msgs[n])
+        break;
+      n++;
+    }
+  return n;
+}
+
+static inline gint
+log_queue_pop_batch(LogQueue *self, LogMessage **msgs, LogPathOptions *path_options, gint max_msgs)
+{
+  gint n;
+
+  if (self->throttle)
+    {
+      if (self->throttle_buckets == 0)
+        return 0;
+      max_msgs = MIN(max_msgs, self->throttle_buckets);
+    }
+
+  n = log_queue_pop_batch_ignore_throttle(self, msgs, path_options, max_msgs);
+
+  if (self->throttle)
+    self->throttle_buckets -= n;
+  return n;
+}
+
 static inline void
 log_queue_rewind_backlog(LogQueue *self, guint rewind_count)
 {
@@ -152,6 +207,21 @@ log_queue_ack_backlog(LogQueue *self, guint rewind_count)
   return self->ack_backlog(self, rewind_count);
 }
 
+/* NOTE: these are expected to be called with the stats lock held */
+static inline void
+log_queue_register_stats_counters(LogQueue *self, gint stats_level, gint component, const gchar *id, const gchar *instance)
+{
+  if (self->register_stats_counters)
+    self->register_stats_counters(self, stats_level, component, id, instance);
+}
+
+static inline void
+log_queue_unregister_stats_counters(LogQueue *self, gint component, const gchar *id, const gchar *instance)
+{
+  if (self->unregister_stats_counters)
+    self->unregister_stats_counters(self, component, id, instance);
+}
+
 static inline LogQueue *
 log_queue_ref(LogQueue *self)
 {
@@ -308,9 +308,10 @@ log_reader_handle_line(LogReader *self, const guchar *line, gint length, LogTran
             evt_tag_printf("line", "%.*s", length, line),
             NULL);
   /* use the current time to get the time zone offset */
-  m = log_msg_new((gchar *) line, length,
-                  aux->peer_addr ? : self->peer_addr,
-                  &self->options->parse_options);
+  m = log_msg_new_with_size_hint((gchar *) line, length,
+                                 aux->peer_addr ? : self->peer_addr,
+                                 &self->options->parse_options,
+                                 &self->super.size_hint);
 
   log_msg_refcache_start_producer(m);
   
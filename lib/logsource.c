@@ -134,6 +134,9 @@ static void
 log_source_msg_ack(LogMessage *msg, AckType ack_type)
 {
   AckTracker *ack_tracker = msg->ack_record->tracker;
+
+  /* all processing is done by now, the payload has its final size */
+  log_msg_size_hint_update(&ack_tracker->source->size_hint, msg);
   ack_tracker_manage_msg_ack(ack_tracker, msg, ack_type);
 }
 
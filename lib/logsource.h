@@ -73,6 +73,7 @@ struct _LogSource
   glong window_full_sleep_nsec;
   struct timespec last_ack_rate_time;
   AckTracker *ack_tracker;
+  LogMessageSizeHint size_hint;
 
   void (*wakeup)(LogSource *s);
 };
@@ -24,9 +24,25 @@
 
 #include "logthrdestdrv.h"
 #include "misc.h"
+#include "atomic.h"
+#include "tls-support.h"
+#include "scratch-buffers.h"
+#include "persist-state.h"
+#include "logqueue-disk.h"
+
+#include <stdlib.h>
 
 #define MAX_RETRIES_OF_FAILED_INSERT_DEFAULT 3
 
+TLS_BLOCK_START
+{
+  /* the worker running in the current thread */
+  LogThrDestWorker *current_worker;
+}
+TLS_BLOCK_END;
+
+#define current_worker __tls_deref(current_worker)
+
 static gchar *
 log_threaded_dest_driver_format_seqnum_for_persist(LogThrDestDriver *self)
 {
@@ -38,165 +54,434 @@ log_threaded_dest_driver_format_seqnum_for_persist(LogThrDestDriver *self)
   return persist_name;
 }
 
+static gchar *
+log_threaded_dest_driver_format_workers_for_persist(LogThrDestDriver *self)
+{
+  static gchar persist_name[256];
+
+  g_snprintf(persist_name, sizeof(persist_name),
+             "%s.workers", self->format.persist_name(self));
+
+  return persist_name;
+}
+
+/*
+ * The sequence number is shared by the workers, thus it is taken and
+ * stepped atomically, wrapping around the same way as
+ * step_sequence_number().
+ */
+static gint32
+log_threaded_dest_driver_take_sequence_number(LogThrDestDriver *self)
+{
+  gint32 old_value, new_value;
+
+  do
+    {
+      old_value = g_atomic_int_get(&self->seq_num);
+      new_value = old_value < G_MAXINT32 ? old_value + 1 : 1;
+    }
+  while (!g_atomic_int_compare_and_exchange(&self->seq_num, old_value, new_value));
+  return old_value;
+}
+
+/*
+ * The first worker uses the names of the driver, so that the queue and
+ * the counters of a single-worker destination are the same as before.
+ */
+static gchar *
+log_threaded_dest_worker_format_persist_name(LogThrDestWorker *worker)
+{
+  LogThrDestDriver *self = worker->owner;
+  static gchar persist_name[1024];
+
+  if (worker->worker_index == 0)
+    return self->format.persist_name(self);
+
+  g_snprintf(persist_name, sizeof(persist_name),
+             "%s#%d", self->format.persist_name(self), worker->worker_index);
+  return persist_name;
+}
+
+static gchar *
+log_threaded_dest_worker_format_stats_instance(LogThrDestWorker *worker)
+{
+  LogThrDestDriver *self = worker->owner;
+  static gchar stats_instance[1024];
+
+  if (worker->worker_index == 0)
+    return self->format.stats_instance(self);
+
+  g_snprintf(stats_instance, sizeof(stats_instance),
+             "%s#%d", self->format.stats_instance(self), worker->worker_index);
+  return stats_instance;
+}
+
+LogThrDestWorker *
+log_threaded_dest_driver_get_current_worker(LogThrDestDriver *self)
+{
+  g_assert(current_worker && current_worker->owner == self);
+
+  return current_worker;
+}
+
+gint32
+log_threaded_dest_driver_get_seq_num(LogThrDestDriver *self)
+{
+  return log_threaded_dest_driver_get_current_worker(self)->seq_num;
+}
+
+static void
+log_threaded_dest_worker_suspend(LogThrDestWorker *worker)
+{
+  iv_validate_now();
+  worker->timer_reopen.expires  = iv_now;
+  worker->timer_reopen.expires.tv_sec += worker->owner->time_reopen;
+  iv_timer_register(&worker->timer_reopen);
+}
+
 void
 log_threaded_dest_driver_suspend(LogThrDestDriver *self)
 {
-  iv_validate_now();
-  self->timer_reopen.expires  = iv_now;
-  self->timer_reopen.expires.tv_sec += self->time_reopen;
-  iv_timer_register(&self->timer_reopen);
+  log_threaded_dest_worker_suspend(log_threaded_dest_driver_get_current_worker(self));
 }
 
 static void
-log_threaded_dest_driver_message_became_available_in_the_queue(gpointer user_data)
+log_threaded_dest_worker_message_became_available_in_the_queue(gpointer user_data)
 {
-  LogThrDestDriver *self = (LogThrDestDriver *) user_data;
-  iv_event_post(&self->wake_up_event);
+  LogThrDestWorker *worker = (LogThrDestWorker *) user_data;
+  iv_event_post(&worker->wake_up_event);
 }
 
 static void
-log_threaded_dest_driver_wake_up(gpointer data)
+log_threaded_dest_worker_wake_up(gpointer data)
 {
-  LogThrDestDriver *self = (LogThrDestDriver *)data;
+  LogThrDestWorker *worker = (LogThrDestWorker *)data;
 
-  if (!iv_task_registered(&self->do_work))
+  if (!iv_task_registered(&worker->do_work))
     {
-      iv_task_register(&self->do_work);
+      iv_task_register(&worker->do_work);
     }
 }
 
 static void
-log_threaded_dest_driver_start_watches(LogThrDestDriver* self)
+log_threaded_dest_worker_start_watches(LogThrDestWorker *worker)
 {
-  iv_task_register(&self->do_work);
+  iv_task_register(&worker->do_work);
 }
 
 static void
-log_threaded_dest_driver_stop_watches(LogThrDestDriver* self)
+log_threaded_dest_worker_stop_watches(LogThrDestWorker *worker)
 {
-  if (iv_task_registered(&self->do_work))
+  if (iv_task_registered(&worker->do_work))
     {
-      iv_task_unregister(&self->do_work);
+      iv_task_unregister(&worker->do_work);
     }
-  if (iv_timer_registered(&self->timer_reopen))
+  if (iv_timer_registered(&worker->timer_reopen))
     {
-      iv_timer_unregister(&self->timer_reopen);
+      iv_timer_unregister(&worker->timer_reopen);
     }
-  if (iv_timer_registered(&self->timer_throttle))
+  if (iv_timer_registered(&worker->timer_throttle))
     {
-      iv_timer_unregister(&self->timer_throttle);
+      iv_timer_unregister(&worker->timer_throttle);
     }
 }
 
 static void
-log_threaded_dest_driver_shutdown(gpointer data)
+log_threaded_dest_worker_shutdown(gpointer data)
 {
-  LogThrDestDriver *self = (LogThrDestDriver *)data;
-  log_threaded_dest_driver_stop_watches(self);
+  LogThrDestWorker *worker = (LogThrDestWorker *)data;
+  log_threaded_dest_worker_stop_watches(worker);
+  if (iv_timer_registered(&worker->timer_flush))
+    iv_timer_unregister(&worker->timer_flush);
   iv_quit();
 }
 
 
 static void
-__connect(LogThrDestDriver *self)
+__connect(LogThrDestWorker *worker)
 {
-  self->worker.connected = TRUE;
+  LogThrDestDriver *self = worker->owner;
+
+  worker->connected = TRUE;
   if (self->worker.connect)
     {
-      self->worker.connected = self->worker.connect(self);
+      worker->connected = self->worker.connect(self);
     }
 
-  if (!self->worker.connected)
+  if (!worker->connected)
     {
-      log_queue_reset_parallel_push(self->queue);
-      log_threaded_dest_driver_suspend(self);
+      log_queue_reset_parallel_push(worker->queue);
+      log_threaded_dest_worker_suspend(worker);
     }
   else
     {
-      log_threaded_dest_driver_start_watches(self);
+      log_threaded_dest_worker_start_watches(worker);
     }
 }
 
 static void
-__disconnect(LogThrDestDriver *self)
+__disconnect(LogThrDestWorker *worker)
 {
+  LogThrDestDriver *self = worker->owner;
+
   if (self->worker.disconnect)
     {
       self->worker.disconnect(self);
     }
-  self->worker.connected = FALSE;
+  worker->connected = FALSE;
 }
 
 
 
 static void
-_disconnect_and_suspend(LogThrDestDriver *self)
+_disconnect_and_suspend(LogThrDestWorker *worker)
 {
-  self->suspended = TRUE;
-  __disconnect(self);
-  log_queue_reset_parallel_push(self->queue);
-  log_threaded_dest_driver_suspend(self);
+  worker->suspended = TRUE;
+  __disconnect(worker);
+  log_queue_reset_parallel_push(worker->queue);
+  log_threaded_dest_worker_suspend(worker);
 }
 
+/* the number of messages fetched from the queue at once */
+#define LOG_THREADED_DEST_DRIVER_POP_BATCH_SIZE 64
+
 static void
-log_threaded_dest_driver_do_insert(LogThrDestDriver *self)
+log_threaded_dest_worker_accept_batch(LogThrDestWorker *worker)
 {
-  LogMessage *msg;
-  worker_insert_result_t result;
-  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  worker->retries_counter = 0;
+  g_array_remove_range(worker->seq_nums, 0, MIN((guint) worker->batch_size, worker->seq_nums->len));
+  stats_counter_add(worker->dropped_messages, worker->batch_dropped);
+  log_queue_ack_backlog(worker->queue, worker->batch_size);
+  worker->batch_size = 0;
+  worker->batch_dropped = 0;
+}
 
-  while (!self->suspended &&
-         (msg = log_queue_pop_head(self->queue, &path_options)) != NULL)
-    {
-      msg_set_context(msg);
-      log_msg_refcache_start_consumer(msg, &path_options);
+static void
+log_threaded_dest_worker_drop_batch(LogThrDestWorker *worker)
+{
+  stats_counter_add(worker->dropped_messages, worker->batch_size - worker->batch_dropped);
+  log_threaded_dest_worker_accept_batch(worker);
+}
 
-      result = self->worker.insert(self, msg);
+/*
+ * The messages of the batch are put back to the head of the queue, the
+ * sequence numbers in seq_nums are given out again to them, in the same
+ * order, when they are retried.
+ */
+static void
+log_threaded_dest_worker_rewind_batch(LogThrDestWorker *worker)
+{
+  log_queue_rewind_backlog(worker->queue, worker->batch_size);
+  worker->batch_size = 0;
+  worker->batch_dropped = 0;
+}
 
-      switch (result)
+/*
+ * Apply the result of an insert() or flush() call to all messages of the
+ * current batch, these are the last batch_size messages in the backlog.
+ * @msg is the message being inserted, or NULL when flushing.
+ *
+ * Returns TRUE if the batch was rewound.
+ */
+static gboolean
+log_threaded_dest_worker_process_result(LogThrDestWorker *worker, worker_insert_result_t result, LogMessage *msg)
+{
+  LogThrDestDriver *self = worker->owner;
+  gboolean rewound = FALSE;
+
+  switch (result)
+    {
+    case WORKER_INSERT_RESULT_DROP:
+      if (msg && worker->batch_size > 1)
         {
-        case WORKER_INSERT_RESULT_DROP:
-          log_threaded_dest_driver_message_drop(self, msg);
-          _disconnect_and_suspend(self);
+          /* only @msg is dropped, the messages queued before it are still
+           * pending in the driver and are sent by the next flush(), the
+           * drop is accounted once that batch is done */
+          worker->batch_dropped++;
           break;
+        }
+      log_threaded_dest_worker_drop_batch(worker);
+      _disconnect_and_suspend(worker);
+      break;
 
-        case WORKER_INSERT_RESULT_ERROR:
-          self->retries.counter++;
-
-          if (self->retries.counter >= self->retries.max)
-            {
-              if (self->messages.retry_over)
-                self->messages.retry_over(self, msg);
-              log_threaded_dest_driver_message_drop(self, msg);
-            }
-          else
-            {
-              log_threaded_dest_driver_message_rewind(self, msg);
-              _disconnect_and_suspend(self);
-            }
-          break;
+    case WORKER_INSERT_RESULT_ERROR:
+      worker->retries_counter++;
 
-        case WORKER_INSERT_RESULT_NOT_CONNECTED:
-          log_threaded_dest_driver_message_rewind(self, msg);
-          _disconnect_and_suspend(self);
-          break;
+      if (worker->retries_counter >= self->retries.max)
+        {
+          if (self->messages.retry_over && msg)
+            self->messages.retry_over(self, msg);
+          log_threaded_dest_worker_drop_batch(worker);
+        }
+      else
+        {
+          log_threaded_dest_worker_rewind_batch(worker);
+          rewound = TRUE;
+          _disconnect_and_suspend(worker);
+        }
+      break;
+
+    case WORKER_INSERT_RESULT_NOT_CONNECTED:
+      log_threaded_dest_worker_rewind_batch(worker);
+      rewound = TRUE;
+      _disconnect_and_suspend(worker);
+      break;
+
+    case WORKER_INSERT_RESULT_REWIND:
+      log_threaded_dest_worker_rewind_batch(worker);
+      rewound = TRUE;
+      break;
+
+    case WORKER_INSERT_RESULT_SUCCESS:
+      log_threaded_dest_worker_accept_batch(worker);
+      break;
+
+    case WORKER_INSERT_RESULT_QUEUED:
+    default:
+      break;
+    }
 
-        case WORKER_INSERT_RESULT_REWIND:
-          log_threaded_dest_driver_message_rewind(self, msg);
-          break;
+  return rewound;
+}
 
-        case WORKER_INSERT_RESULT_SUCCESS:
-          log_threaded_dest_driver_message_accept(self, msg);
-          break;
+/*
+ * Send out the messages queued by the driver so far.  Returns FALSE if
+ * they were rewound.
+ */
+static gboolean
+log_threaded_dest_worker_flush(LogThrDestWorker *worker)
+{
+  LogThrDestDriver *self = worker->owner;
+  worker_insert_result_t result;
 
-        default:
-          break;
-        }
+  if (iv_timer_registered(&worker->timer_flush))
+    iv_timer_unregister(&worker->timer_flush);
+
+  if (worker->batch_size == 0 || !self->worker.flush)
+    return TRUE;
+
+  result = self->worker.flush(self);
+  return !log_threaded_dest_worker_process_result(worker, result, NULL);
+}
+
+static void
+log_threaded_dest_worker_flush_timer_expired(gpointer data)
+{
+  LogThrDestWorker *worker = (LogThrDestWorker *)data;
+
+  /* the rewound messages are back in the queue, process them again
+   * unless the worker got suspended, timer_reopen takes care of that */
+  if (!log_threaded_dest_worker_flush(worker) && !worker->suspended &&
+      !iv_task_registered(&worker->do_work))
+    iv_task_register(&worker->do_work);
+}
+
+/*
+ * Called when the queue is drained: the batch is either flushed right
+ * away, or batch_timeout() milliseconds after the queue first became
+ * empty, giving a chance to more messages to join the batch.
+ */
+static void
+log_threaded_dest_worker_schedule_flush(LogThrDestWorker *worker)
+{
+  LogThrDestDriver *self = worker->owner;
 
-      msg_set_context(NULL);
-      log_msg_refcache_stop();
+  if (worker->batch_size == 0)
+    return;
+
+  if (self->batch_timeout <= 0)
+    {
+      log_threaded_dest_worker_flush(worker);
+      return;
     }
-  if (!self->suspended)
+
+  if (!iv_timer_registered(&worker->timer_flush))
+    {
+      iv_validate_now();
+      worker->timer_flush.expires = iv_now;
+      timespec_add_msec(&worker->timer_flush.expires, self->batch_timeout);
+      iv_timer_register(&worker->timer_flush);
+    }
+}
+
+/*
+ * Returns FALSE if the rest of the current batch must not be processed,
+ * e.g. because the message was rewound or the driver got suspended.
+ */
+static gboolean
+log_threaded_dest_worker_insert_message(LogThrDestWorker *worker, LogMessage *msg, LogPathOptions *path_options)
+{
+  LogThrDestDriver *self = worker->owner;
+  worker_insert_result_t result;
+  gboolean rewound;
+
+  msg_set_context(msg);
+  log_msg_refcache_start_consumer(msg, path_options);
+
+  worker->batch_size++;
+  if ((guint) worker->batch_size <= worker->seq_nums->len)
+    {
+      worker->seq_num = g_array_index(worker->seq_nums, gint32, worker->batch_size - 1);
+    }
+  else
+    {
+      worker->seq_num = log_threaded_dest_driver_take_sequence_number(self);
+      g_array_append_val(worker->seq_nums, worker->seq_num);
+    }
+  result = self->worker.insert(self, msg);
+  rewound = log_threaded_dest_worker_process_result(worker, result, msg);
+
+  if (!rewound && worker->batch_size > 0 && worker->batch_size >= self->batch_lines)
+    rewound = !log_threaded_dest_worker_flush(worker);
+
+  log_msg_unref(msg);
+
+  msg_set_context(NULL);
+  log_msg_refcache_stop();
+
+  return !rewound && !worker->suspended;
+}
+
+/*
+ * Put back the messages of a batch that were not processed, @first is
+ * the index of the first such message.  They are at the end of the
+ * backlog, thus rewinding them by count restores the original order,
+ * even if the last processed message was rewound already.
+ */
+static void
+log_threaded_dest_worker_rewind_unprocessed_messages(LogThrDestWorker *worker, LogMessage **msgs, gint first, gint count)
+{
+  gint i;
+
+  if (first >= count)
+    return;
+
+  log_queue_rewind_backlog(worker->queue, count - first);
+  for (i = first; i < count; i++)
+    log_msg_unref(msgs[i]);
+}
+
+static void
+log_threaded_dest_worker_do_insert(LogThrDestWorker *worker)
+{
+  LogThrDestDriver *self = worker->owner;
+  LogMessage *msgs[LOG_THREADED_DEST_DRIVER_POP_BATCH_SIZE];
+  LogPathOptions path_options[LOG_THREADED_DEST_DRIVER_POP_BATCH_SIZE];
+  gint count, i;
+
+  while (!worker->suspended &&
+         (count = log_queue_pop_batch(worker->queue, msgs, path_options, LOG_THREADED_DEST_DRIVER_POP_BATCH_SIZE)) > 0)
+    {
+      for (i = 0; i < count; i++)
+        {
+          if (!log_threaded_dest_worker_insert_message(worker, msgs[i], &path_options[i]))
+            break;
+        }
+      log_threaded_dest_worker_rewind_unprocessed_messages(worker, msgs, i + 1, count);
+    }
+  if (!worker->suspended)
+    log_threaded_dest_worker_schedule_flush(worker);
+  if (!worker->suspended)
     {
       if (self->worker.worker_message_queue_empty)
         {
@@ -206,128 +491,330 @@ log_threaded_dest_driver_do_insert(LogThrDestDriver *self)
 }
 
 static void
-log_threaded_dest_driver_do_work(gpointer data)
+log_threaded_dest_worker_do_work(gpointer data)
 {
-  LogThrDestDriver *self = (LogThrDestDriver *)data;
+  LogThrDestWorker *worker = (LogThrDestWorker *)data;
   gint timeout_msec = 0;
 
-  self->suspended = FALSE;
-  log_threaded_dest_driver_stop_watches(self);
+  worker->suspended = FALSE;
+  log_threaded_dest_worker_stop_watches(worker);
 
-  if (!self->worker.connected)
+  if (!worker->connected)
     {
-      __connect(self);
+      __connect(worker);
     }
 
-  else if (log_queue_check_items(self->queue, &timeout_msec,
-                                        log_threaded_dest_driver_message_became_available_in_the_queue,
-                                        self, NULL))
+  else if (log_queue_check_items(worker->queue, &timeout_msec,
+                                        log_threaded_dest_worker_message_became_available_in_the_queue,
+                                        worker, NULL))
     {
-      log_threaded_dest_driver_do_insert(self);
-      if (!self->suspended)
-        log_threaded_dest_driver_start_watches(self);
+      log_threaded_dest_worker_do_insert(worker);
+      if (!worker->suspended)
+        log_threaded_dest_worker_start_watches(worker);
     }
   else if (timeout_msec != 0)
     {
-      log_queue_reset_parallel_push(self->queue);
+      log_queue_reset_parallel_push(worker->queue);
       iv_validate_now();
-      self->timer_throttle.expires = iv_now;
-      timespec_add_msec(&self->timer_throttle.expires, timeout_msec);
-      iv_timer_register(&self->timer_throttle);
+      worker->timer_throttle.expires = iv_now;
+      timespec_add_msec(&worker->timer_throttle.expires, timeout_msec);
+      iv_timer_register(&worker->timer_throttle);
     }
 }
 
 static void
-log_threaded_dest_driver_init_watches(LogThrDestDriver* self)
+log_threaded_dest_worker_init_watches(LogThrDestWorker *worker)
 {
-  IV_EVENT_INIT(&self->wake_up_event);
-  self->wake_up_event.cookie = self;
-  self->wake_up_event.handler = log_threaded_dest_driver_wake_up;
-  iv_event_register(&self->wake_up_event);
-
-  IV_EVENT_INIT(&self->shutdown_event);
-  self->shutdown_event.cookie = self;
-  self->shutdown_event.handler = log_threaded_dest_driver_shutdown;
-  iv_event_register(&self->shutdown_event);
+  IV_EVENT_INIT(&worker->wake_up_event);
+  worker->wake_up_event.cookie = worker;
+  worker->wake_up_event.handler = log_threaded_dest_worker_wake_up;
+  iv_event_register(&worker->wake_up_event);
+
+  IV_EVENT_INIT(&worker->shutdown_event);
+  worker->shutdown_event.cookie = worker;
+  worker->shutdown_event.handler = log_threaded_dest_worker_shutdown;
+  iv_event_register(&worker->shutdown_event);
+
+  IV_TIMER_INIT(&worker->timer_reopen);
+  worker->timer_reopen.cookie = worker;
+  worker->timer_reopen.handler = log_threaded_dest_worker_do_work;
+
+  IV_TIMER_INIT(&worker->timer_throttle);
+  worker->timer_throttle.cookie = worker;
+  worker->timer_throttle.handler = log_threaded_dest_worker_do_work;
+
+  IV_TIMER_INIT(&worker->timer_flush);
+  worker->timer_flush.cookie = worker;
+  worker->timer_flush.handler = log_threaded_dest_worker_flush_timer_expired;
+
+  IV_TASK_INIT(&worker->do_work);
+  worker->do_work.cookie = worker;
+  worker->do_work.handler = log_threaded_dest_worker_do_work;
+}
 
-  IV_TIMER_INIT(&self->timer_reopen);
-  self->timer_reopen.cookie = self;
-  self->timer_reopen.handler = log_threaded_dest_driver_do_work;
+/*
+ * The main loop is not running anymore, so the driver is not suspended
+ * on failure, the batch is simply put back to the queue.
+ */
+static void
+log_threaded_dest_worker_flush_on_exit(LogThrDestWorker *worker)
+{
+  LogThrDestDriver *self = worker->owner;
+  worker_insert_result_t result;
 
-  IV_TIMER_INIT(&self->timer_throttle);
-  self->timer_throttle.cookie = self;
-  self->timer_throttle.handler = log_threaded_dest_driver_do_work;
+  if (worker->batch_size == 0 || !self->worker.flush)
+    return;
 
-  IV_TASK_INIT(&self->do_work);
-  self->do_work.cookie = self;
-  self->do_work.handler = log_threaded_dest_driver_do_work;
+  result = self->worker.flush(self);
+  switch (result)
+    {
+    case WORKER_INSERT_RESULT_SUCCESS:
+      log_threaded_dest_worker_accept_batch(worker);
+      break;
+    case WORKER_INSERT_RESULT_DROP:
+      log_threaded_dest_worker_drop_batch(worker);
+      break;
+    default:
+      log_threaded_dest_worker_rewind_batch(worker);
+      break;
+    }
 }
 
 static void
-log_threaded_dest_driver_worker_thread_main(gpointer arg)
+log_threaded_dest_worker_thread_main(gpointer arg)
 {
-  LogThrDestDriver *self = (LogThrDestDriver *)arg;
+  LogThrDestWorker *worker = (LogThrDestWorker *)arg;
+  LogThrDestDriver *self = worker->owner;
 
   iv_init();
+  current_worker = worker;
 
   msg_debug("Worker thread started",
             evt_tag_str("driver", self->super.super.id),
+            evt_tag_int("worker", worker->worker_index),
             NULL);
 
-  log_queue_set_use_backlog(self->queue, TRUE);
+  log_queue_set_use_backlog(worker->queue, TRUE);
 
-  log_threaded_dest_driver_init_watches(self);
+  log_threaded_dest_worker_init_watches(worker);
 
-  log_threaded_dest_driver_start_watches(self);
+  log_threaded_dest_worker_start_watches(worker);
 
   if (self->worker.thread_init)
     self->worker.thread_init(self);
 
   iv_main();
 
-  __disconnect(self);
+  log_threaded_dest_worker_flush_on_exit(worker);
+  __disconnect(worker);
   if (self->worker.thread_deinit)
     self->worker.thread_deinit(self);
 
   msg_debug("Worker thread finished",
             evt_tag_str("driver", self->super.super.id),
+            evt_tag_int("worker", worker->worker_index),
             NULL);
+  current_worker = NULL;
   iv_deinit();
 }
 
 static void
-log_threaded_dest_driver_stop_thread(gpointer s)
+log_threaded_dest_worker_stop_thread(gpointer s)
+{
+  LogThrDestWorker *worker = (LogThrDestWorker *) s;
+
+  iv_event_post(&worker->shutdown_event);
+}
+
+static void
+log_threaded_dest_worker_start_thread(LogThrDestWorker *worker)
+{
+  main_loop_create_worker_thread(log_threaded_dest_worker_thread_main,
+                                 log_threaded_dest_worker_stop_thread,
+                                 worker, &worker->owner->worker_options);
+}
+
+static void
+log_threaded_dest_driver_register_worker_stats(LogThrDestDriver *self, LogThrDestWorker *worker)
+{
+  gchar *stats_instance = log_threaded_dest_worker_format_stats_instance(worker);
+
+  stats_register_counter(0, self->stats_source | SCS_DESTINATION, self->super.super.id,
+                         stats_instance, SC_TYPE_STORED, &worker->stored_messages);
+  stats_register_counter(0, self->stats_source | SCS_DESTINATION, self->super.super.id,
+                         stats_instance, SC_TYPE_DROPPED, &worker->dropped_messages);
+  log_queue_register_stats_counters(worker->queue, 0, self->stats_source | SCS_DESTINATION, self->super.super.id,
+                                    stats_instance);
+}
+
+static void
+log_threaded_dest_driver_unregister_worker_stats(LogThrDestDriver *self, LogThrDestWorker *worker)
+{
+  gchar *stats_instance = log_threaded_dest_worker_format_stats_instance(worker);
+
+  stats_unregister_counter(self->stats_source | SCS_DESTINATION, self->super.super.id,
+                           stats_instance, SC_TYPE_STORED, &worker->stored_messages);
+  stats_unregister_counter(self->stats_source | SCS_DESTINATION, self->super.super.id,
+                           stats_instance, SC_TYPE_DROPPED, &worker->dropped_messages);
+  log_queue_unregister_stats_counters(worker->queue, self->stats_source | SCS_DESTINATION, self->super.super.id,
+                                      stats_instance);
+}
+
+/*
+ * Messages with the same partition key are always processed by the same
+ * worker, thus they keep their order, otherwise the workers are used in
+ * a round-robin fashion.
+ */
+static LogThrDestWorker *
+log_threaded_dest_driver_select_worker(LogThrDestDriver *self, LogMessage *msg)
+{
+  GlobalConfig *cfg = log_pipe_get_config(&self->super.super.super);
+  SBGString *key;
+  guint index;
+
+  if (self->num_workers == 1)
+    return &self->workers[0];
+
+  if (self->worker_partition_key)
+    {
+      key = sb_gstring_acquire();
+      log_template_format(self->worker_partition_key, msg, &cfg->template_options, LTZ_SEND,
+                          g_atomic_int_get(&self->seq_num), NULL, sb_gstring_string(key));
+      index = g_str_hash(sb_gstring_string(key)->str);
+      sb_gstring_release(key);
+    }
+  else
+    {
+      index = (guint) g_atomic_counter_exchange_and_add(&self->last_worker, 1);
+    }
+
+  return &self->workers[index % self->num_workers];
+}
+
+static void
+log_threaded_dest_driver_free_workers(LogThrDestDriver *self)
 {
-  LogThrDestDriver *self = (LogThrDestDriver *) s;
+  gint i;
+
+  if (!self->workers)
+    return;
 
-  iv_event_post(&self->shutdown_event);
+  for (i = 0; i < self->num_workers; i++)
+    {
+      if (self->workers[i].seq_nums)
+        g_array_free(self->workers[i].seq_nums, TRUE);
+    }
+  g_free(self->workers);
+  self->workers = NULL;
 }
 
+/* release the queues of the first @count workers, if starting fails midway */
 static void
-log_threaded_dest_driver_start_thread(LogThrDestDriver *self)
+log_threaded_dest_driver_release_worker_queues(LogThrDestDriver *self, gint count)
 {
-  main_loop_create_worker_thread(log_threaded_dest_driver_worker_thread_main,
-                                 log_threaded_dest_driver_stop_thread,
-                                 self, &self->worker_options);
+  gint i;
+
+  for (i = 0; i < count; i++)
+    log_dest_driver_release_queue(&self->super, self->workers[i].queue);
+  log_threaded_dest_driver_free_workers(self);
+}
+
+/*
+ * Move the messages of a worker that is not used anymore (workers() was
+ * lowered) to the queues of the remaining workers.  No worker threads
+ * are running at this point.
+ */
+static void
+log_threaded_dest_driver_merge_worker_queue(LogThrDestDriver *self, gint worker_index)
+{
+  LogThrDestWorker removed_worker = { 0 };
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogQueue *queue;
+  LogMessage *msg;
+  gint64 count;
+
+  removed_worker.owner = self;
+  removed_worker.worker_index = worker_index;
+  queue = log_dest_driver_acquire_queue(&self->super, log_threaded_dest_worker_format_persist_name(&removed_worker));
+  if (!queue)
+    return;
+
+  log_queue_rewind_backlog_all(queue);
+  log_queue_set_use_backlog(queue, FALSE);
+  count = log_queue_get_length(queue);
+  while ((msg = log_queue_pop_head(queue, &path_options)) != NULL)
+    {
+      log_queue_push_tail(log_threaded_dest_driver_select_worker(self, msg)->queue, msg, &path_options);
+      path_options = (LogPathOptions) LOG_PATH_OPTIONS_INIT;
+    }
+
+  if (count > 0)
+    msg_info("Moved the messages of a removed worker to the remaining ones",
+             evt_tag_str("driver", self->super.super.id),
+             evt_tag_int("worker", worker_index),
+             evt_tag_int("count", count),
+             NULL);
+
+  /* a drained disk-queue is removed, otherwise its files would be kept forever */
+  if (log_queue_is_disk(queue) && log_queue_disk_remove(queue))
+    log_queue_unref(queue);
+  else
+    log_dest_driver_release_queue(&self->super, queue);
 }
 
+/*
+ * The number of workers is kept in the persist file, so that the queues
+ * of the workers removed since the last run or reload are not left
+ * behind.
+ */
+static void
+log_threaded_dest_driver_merge_removed_workers(LogThrDestDriver *self, GlobalConfig *cfg)
+{
+  gchar *persist_name = log_threaded_dest_driver_format_workers_for_persist(self);
+  gchar *value;
+  gchar buf[16];
+  gint i, prev_num_workers = 0;
+
+  if (!cfg || !cfg->state)
+    return;
+
+  value = persist_state_lookup_string(cfg->state, persist_name, NULL, NULL);
+  if (value)
+    {
+      prev_num_workers = atoi(value);
+      g_free(value);
+    }
+
+  for (i = self->num_workers; i < prev_num_workers; i++)
+    log_threaded_dest_driver_merge_worker_queue(self, i);
+
+  if (prev_num_workers != self->num_workers)
+    {
+      g_snprintf(buf, sizeof(buf), "%d", self->num_workers);
+      persist_state_alloc_string(cfg->state, persist_name, buf, -1);
+    }
+}
 
 gboolean
 log_threaded_dest_driver_start(LogPipe *s)
 {
   LogThrDestDriver *self = (LogThrDestDriver *)s;
   GlobalConfig *cfg = log_pipe_get_config(s);
+  gint i;
 
   if (cfg && self->time_reopen == -1)
     self->time_reopen = cfg->time_reopen;
 
-  self->queue = log_dest_driver_acquire_queue(&self->super,
-                                              self->format.persist_name(self));
-
-  if (self->queue == NULL)
+  if (self->num_workers > 1 && !self->supports_multiple_workers)
     {
-      return FALSE;
+      msg_warning("This destination does not support multiple workers, using a single one",
+                  evt_tag_int("workers", self->num_workers),
+                  evt_tag_str("driver", self->super.super.id),
+                  NULL);
+      self->num_workers = 1;
     }
+  if (self->num_workers <= 0)
+    self->num_workers = 1;
 
   if (self->retries.max <= 0)
     {
@@ -339,26 +826,53 @@ log_threaded_dest_driver_start(LogPipe *s)
       self->retries.max = MAX_RETRIES_OF_FAILED_INSERT_DEFAULT;
     }
 
+  if (self->batch_lines <= 0)
+    {
+      msg_warning("Wrong value for batch_lines(), setting to default",
+                  evt_tag_int("value", self->batch_lines),
+                  evt_tag_int("default", 1),
+                  evt_tag_str("driver", self->super.super.id),
+                  NULL);
+      self->batch_lines = 1;
+    }
+
+  self->workers = g_new0(LogThrDestWorker, self->num_workers);
+  for (i = 0; i < self->num_workers; i++)
+    {
+      LogThrDestWorker *worker = &self->workers[i];
+
+      worker->owner = self;
+      worker->worker_index = i;
+      worker->seq_nums = g_array_new(FALSE, FALSE, sizeof(gint32));
+      worker->queue = log_dest_driver_acquire_queue(&self->super,
+                                                    log_threaded_dest_worker_format_persist_name(worker));
+      if (worker->queue == NULL)
+        {
+          log_threaded_dest_driver_release_worker_queues(self, i);
+          return FALSE;
+        }
+    }
+
   stats_lock();
-  stats_register_counter(0, self->stats_source | SCS_DESTINATION, self->super.super.id,
-                         self->format.stats_instance(self),
-                         SC_TYPE_STORED, &self->stored_messages);
-  stats_register_counter(0, self->stats_source | SCS_DESTINATION, self->super.super.id,
-                         self->format.stats_instance(self),
-                         SC_TYPE_DROPPED, &self->dropped_messages);
   stats_register_counter(0, self->stats_source | SCS_DESTINATION, self->super.super.id,
                          self->format.stats_instance(self),
                          SC_TYPE_PROCESSED, &self->processed_messages);
+  for (i = 0; i < self->num_workers; i++)
+    log_threaded_dest_driver_register_worker_stats(self, &self->workers[i]);
   stats_unlock();
 
-  log_queue_set_counters(self->queue, self->stored_messages,
-                         self->dropped_messages);
+  for (i = 0; i < self->num_workers; i++)
+    log_queue_set_counters(self->workers[i].queue, self->workers[i].stored_messages,
+                           self->workers[i].dropped_messages);
 
   self->seq_num = GPOINTER_TO_INT(cfg_persist_config_fetch(cfg, log_threaded_dest_driver_format_seqnum_for_persist(self)));
   if (!self->seq_num)
     init_sequence_number(&self->seq_num);
 
-  log_threaded_dest_driver_start_thread(self);
+  log_threaded_dest_driver_merge_removed_workers(self, cfg);
+
+  for (i = 0; i < self->num_workers; i++)
+    log_threaded_dest_worker_start_thread(&self->workers[i]);
 
   return TRUE;
 }
@@ -367,27 +881,29 @@ gboolean
 log_threaded_dest_driver_deinit_method(LogPipe *s)
 {
   LogThrDestDriver *self = (LogThrDestDriver *)s;
+  gint i;
 
-  log_queue_reset_parallel_push(self->queue);
-
-  log_queue_set_counters(self->queue, NULL, NULL);
+  for (i = 0; i < self->num_workers; i++)
+    {
+      log_queue_reset_parallel_push(self->workers[i].queue);
+      log_queue_set_counters(self->workers[i].queue, NULL, NULL);
+    }
 
   cfg_persist_config_add(log_pipe_get_config(s),
                          log_threaded_dest_driver_format_seqnum_for_persist(self),
                          GINT_TO_POINTER(self->seq_num), NULL, FALSE);
 
   stats_lock();
-  stats_unregister_counter(self->stats_source | SCS_DESTINATION, self->super.super.id,
-                           self->format.stats_instance(self),
-                           SC_TYPE_STORED, &self->stored_messages);
-  stats_unregister_counter(self->stats_source | SCS_DESTINATION, self->super.super.id,
-                           self->format.stats_instance(self),
-                           SC_TYPE_DROPPED, &self->dropped_messages);
   stats_unregister_counter(self->stats_source | SCS_DESTINATION, self->super.super.id,
                            self->format.stats_instance(self),
                            SC_TYPE_PROCESSED, &self->processed_messages);
+  for (i = 0; i < self->num_workers; i++)
+    log_threaded_dest_driver_unregister_worker_stats(self, &self->workers[i]);
   stats_unlock();
 
+  /* the worker threads are stopped by now, the queues are released below */
+  log_threaded_dest_driver_free_workers(self);
+
   if (!log_dest_driver_deinit_method(s))
     return FALSE;
 
@@ -399,6 +915,8 @@ log_threaded_dest_driver_free(LogPipe *s)
 {
   LogThrDestDriver *self = (LogThrDestDriver *)s;
 
+  log_template_unref(self->worker_partition_key);
+  log_threaded_dest_driver_free_workers(self);
   log_dest_driver_free((LogPipe *)self);
 }
 
@@ -408,6 +926,7 @@ log_threaded_dest_driver_queue(LogPipe *s, LogMessage *msg,
                                gpointer user_data)
 {
   LogThrDestDriver *self = (LogThrDestDriver *)s;
+  LogThrDestWorker *worker;
   LogPathOptions local_options;
 
   if (!path_options->flow_control_requested)
@@ -416,8 +935,10 @@ log_threaded_dest_driver_queue(LogPipe *s, LogMessage *msg,
   if (self->queue_method)
     self->queue_method(self);
 
+  worker = log_threaded_dest_driver_select_worker(self, msg);
+
   log_msg_add_ack(msg, path_options);
-  log_queue_push_tail(self->queue, log_msg_ref(msg), path_options);
+  log_queue_push_tail(worker->queue, log_msg_ref(msg), path_options);
 
   stats_counter_inc(self->processed_messages);
 
@@ -438,15 +959,19 @@ log_threaded_dest_driver_init_instance(LogThrDestDriver *self, GlobalConfig *cfg
   self->time_reopen = -1;
 
   self->retries.max = MAX_RETRIES_OF_FAILED_INSERT_DEFAULT;
+  self->batch_lines = 1;
+  self->batch_timeout = -1;
+  self->num_workers = 1;
 }
 
 void
 log_threaded_dest_driver_message_accept(LogThrDestDriver *self,
                                         LogMessage *msg)
 {
-  self->retries.counter = 0;
-  step_sequence_number(&self->seq_num);
-  log_queue_ack_backlog(self->queue, 1);
+  LogThrDestWorker *worker = log_threaded_dest_driver_get_current_worker(self);
+
+  worker->retries_counter = 0;
+  log_queue_ack_backlog(worker->queue, 1);
   log_msg_unref(msg);
 }
 
@@ -454,7 +979,9 @@ void
 log_threaded_dest_driver_message_drop(LogThrDestDriver *self,
                                       LogMessage *msg)
 {
-  stats_counter_inc(self->dropped_messages);
+  LogThrDestWorker *worker = log_threaded_dest_driver_get_current_worker(self);
+
+  stats_counter_inc(worker->dropped_messages);
   log_threaded_dest_driver_message_accept(self, msg);
 }
 
@@ -462,7 +989,9 @@ void
 log_threaded_dest_driver_message_rewind(LogThrDestDriver *self,
                                         LogMessage *msg)
 {
-  log_queue_rewind_backlog(self->queue, 1);
+  LogThrDestWorker *worker = log_threaded_dest_driver_get_current_worker(self);
+
+  log_queue_rewind_backlog(worker->queue, 1);
   log_msg_unref(msg);
 }
 
@@ -473,3 +1002,36 @@ log_threaded_dest_driver_set_max_retries(LogDriver *s, gint max_retries)
 
   self->retries.max = max_retries;
 }
+
+void
+log_threaded_dest_driver_set_batch_lines(LogDriver *s, gint batch_lines)
+{
+  LogThrDestDriver *self = (LogThrDestDriver *)s;
+
+  self->batch_lines = batch_lines;
+}
+
+void
+log_threaded_dest_driver_set_batch_timeout(LogDriver *s, gint batch_timeout)
+{
+  LogThrDestDriver *self = (LogThrDestDriver *)s;
+
+  self->batch_timeout = batch_timeout;
+}
+
+void
+log_threaded_dest_driver_set_num_workers(LogDriver *s, gint num_workers)
+{
+  LogThrDestDriver *self = (LogThrDestDriver *)s;
+
+  self->num_workers = num_workers;
+}
+
+void
+log_threaded_dest_driver_set_worker_partition_key(LogDriver *s, LogTemplate *key)
+{
+  LogThrDestDriver *self = (LogThrDestDriver *)s;
+
+  log_template_unref(self->worker_partition_key);
+  self->worker_partition_key = log_template_ref(key);
+}
@@ -30,39 +30,90 @@
 #include "stats/stats-registry.h"
 #include "logqueue.h"
 #include "mainloop-worker.h"
+#include "template/templates.h"
+#include "atomic.h"
 #include <iv.h>
 #include <iv_event.h>
 
 typedef enum
 {
+  /* when returned by insert() for a message of a pending batch, only that
+   * message is dropped, the driver must keep the messages queued before it */
   WORKER_INSERT_RESULT_DROP,
   WORKER_INSERT_RESULT_ERROR,
   WORKER_INSERT_RESULT_REWIND,
   WORKER_INSERT_RESULT_SUCCESS,
-  WORKER_INSERT_RESULT_NOT_CONNECTED
+  WORKER_INSERT_RESULT_NOT_CONNECTED,
+  /* the message was added to the current batch, the outcome is reported
+   * by a later insert() or flush() call for the whole batch */
+  WORKER_INSERT_RESULT_QUEUED
 } worker_insert_result_t;
 
 typedef struct _LogThrDestDriver LogThrDestDriver;
-struct _LogThrDestDriver
+typedef struct _LogThrDestWorker LogThrDestWorker;
+
+/*
+ * A worker thread of a threaded destination.  Each worker has its own
+ * queue and connection; the worker callbacks of LogThrDestDriver are
+ * called from these threads, and the driver may keep its per-thread
+ * state in user_data.
+ */
+struct _LogThrDestWorker
 {
-  LogDestDriver super;
+  LogThrDestDriver *owner;
+  gint worker_index;
 
+  LogQueue *queue;
   StatsCounterItem *dropped_messages;
   StatsCounterItem *stored_messages;
-  StatsCounterItem *processed_messages;
 
+  gboolean connected;
   gboolean suspended;
+  gint retries_counter;
+
+  /* number of messages inserted with WORKER_INSERT_RESULT_QUEUED and not yet flushed */
+  gint batch_size;
+  /* messages of the current batch the driver dropped with WORKER_INSERT_RESULT_DROP */
+  gint batch_dropped;
+
+  /* the sequence number of the message being inserted */
+  gint32 seq_num;
+  /* the sequence numbers of the current batch, followed by those of a
+   * rewound batch, which are given out again when it is retried */
+  GArray *seq_nums;
+
+  gpointer user_data;
+
+  struct iv_event wake_up_event;
+  struct iv_event shutdown_event;
+  struct iv_timer timer_reopen;
+  struct iv_timer timer_throttle;
+  struct iv_timer timer_flush;
+  struct iv_task  do_work;
+};
+
+struct _LogThrDestDriver
+{
+  LogDestDriver super;
+
+  StatsCounterItem *processed_messages;
+
   time_t time_reopen;
 
-  LogQueue *queue;
+  gint num_workers;
+  /* set by drivers that keep their per-connection state in LogThrDestWorker->user_data */
+  gboolean supports_multiple_workers;
+  LogTemplate *worker_partition_key;
+  LogThrDestWorker *workers;
+  GAtomicCounter last_worker;
 
   /* Worker stuff */
   struct
   {
-    gboolean connected;
     void (*thread_init) (LogThrDestDriver *s);
     void (*thread_deinit) (LogThrDestDriver *s);
     worker_insert_result_t (*insert) (LogThrDestDriver *s, LogMessage *msg);
+    worker_insert_result_t (*flush) (LogThrDestDriver *s);
     gboolean (*connect) (LogThrDestDriver *s);
     void (*worker_message_queue_empty)(LogThrDestDriver *s);
     void (*disconnect) (LogThrDestDriver *s);
@@ -79,21 +130,19 @@ struct _LogThrDestDriver
     gchar *(*persist_name) (LogThrDestDriver *s);
   } format;
   gint stats_source;
+  /* the next sequence number to be given out, shared by the workers */
   gint32 seq_num;
 
   struct
   {
-    gint counter;
     gint max;
   } retries;
 
+  gint batch_lines;
+  gint batch_timeout;
+
   void (*queue_method) (LogThrDestDriver *s);
   WorkerOptions worker_options;
-  struct iv_event wake_up_event;
-  struct iv_event shutdown_event;
-  struct iv_timer timer_reopen;
-  struct iv_timer timer_throttle;
-  struct iv_task  do_work;
 };
 
 gboolean log_threaded_dest_driver_deinit_method(LogPipe *s);
@@ -103,6 +152,8 @@ void log_threaded_dest_driver_init_instance(LogThrDestDriver *self, GlobalConfig
 void log_threaded_dest_driver_free(LogPipe *s);
 
 void log_threaded_dest_driver_suspend(LogThrDestDriver *self);
+LogThrDestWorker *log_threaded_dest_driver_get_current_worker(LogThrDestDriver *self);
+gint32 log_threaded_dest_driver_get_seq_num(LogThrDestDriver *self);
 
 void log_threaded_dest_driver_message_accept(LogThrDestDriver *self,
                                              LogMessage *msg);
@@ -112,5 +163,9 @@ void log_threaded_dest_driver_message_rewind(LogThrDestDriver *self,
                                              LogMessage *msg);
 
 void log_threaded_dest_driver_set_max_retries(LogDriver *s, gint max_retries);
+void log_threaded_dest_driver_set_batch_lines(LogDriver *s, gint batch_lines);
+void log_threaded_dest_driver_set_batch_timeout(LogDriver *s, gint batch_timeout);
+void log_threaded_dest_driver_set_num_workers(LogDriver *s, gint num_workers);
+void log_threaded_dest_driver_set_worker_partition_key(LogDriver *s, LogTemplate *key);
 
 #endif
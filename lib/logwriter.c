@@ -1097,13 +1097,34 @@ log_writer_write_message(LogWriter *self, LogMessage *msg, LogPathOptions *path_
     }
 }
 
-static inline LogMessage *
-log_writer_queue_pop_message(LogWriter *self, LogPathOptions *path_options, gboolean force_flush)
+/* the number of messages fetched from the queue at once */
+#define LOG_WRITER_POP_BATCH_SIZE 256
+
+static inline gint
+log_writer_queue_pop_messages(LogWriter *self, LogMessage **msgs, LogPathOptions *path_options, gboolean force_flush)
 {
   if (force_flush)
-    return log_queue_pop_head_ignore_throttle(self->queue, path_options);
+    return log_queue_pop_batch_ignore_throttle(self->queue, msgs, path_options, LOG_WRITER_POP_BATCH_SIZE);
   else
-    return log_queue_pop_head(self->queue, path_options);
+    return log_queue_pop_batch(self->queue, msgs, path_options, LOG_WRITER_POP_BATCH_SIZE);
+}
+
+/*
+ * Put back the messages of a batch that were not processed, @first is
+ * the index of the first such message.  They are at the end of the
+ * backlog, thus rewinding them by count restores the original order.
+ */
+static void
+log_writer_rewind_unprocessed_messages(LogWriter *self, LogMessage **msgs, gint first, gint count)
+{
+  gint i;
+
+  if (first >= count)
+    return;
+
+  log_queue_rewind_backlog(self->queue, count - first);
+  for (i = first; i < count; i++)
+    log_msg_unref(msgs[i]);
 }
 
 /*
@@ -1130,14 +1151,27 @@ log_writer_flush(LogWriter *self, LogWriterFlushMode flush_mode)
 
   while ((!main_loop_worker_job_quit() || flush_mode == LW_FLUSH_FORCE) && !write_error)
     {
-      LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
-      LogMessage *msg = log_writer_queue_pop_message(self, &path_options, flush_mode == LW_FLUSH_FORCE);
+      LogMessage *msgs[LOG_WRITER_POP_BATCH_SIZE];
+      LogPathOptions path_options[LOG_WRITER_POP_BATCH_SIZE];
+      gint count, i;
 
-      if (!msg)
+      count = log_writer_queue_pop_messages(self, msgs, path_options, flush_mode == LW_FLUSH_FORCE);
+      if (count == 0)
         break;
 
-      if (!log_writer_write_message(self, msg, &path_options, &write_error))
-        break;
+      for (i = 0; i < count; i++)
+        {
+          /* log_writer_write_message() rewinds a single message from the
+           * backlog on failure, the rest of the batch is rewound here */
+          if (!log_writer_write_message(self, msgs[i], &path_options[i], &write_error))
+            break;
+        }
+
+      if (i < count)
+        {
+          log_writer_rewind_unprocessed_messages(self, msgs, i + 1, count);
+          break;
+        }
     }
 
   if (write_error)
@@ -1213,6 +1247,7 @@ log_writer_init(LogPipe *s)
       stats_register_counter(self->stats_level, self->stats_source | SCS_DESTINATION, self->stats_id, self->stats_instance, SC_TYPE_PROCESSED, &self->processed_messages);
       
       stats_register_counter(self->stats_level, self->stats_source | SCS_DESTINATION, self->stats_id, self->stats_instance, SC_TYPE_STORED, &self->stored_messages);
+      log_queue_register_stats_counters(self->queue, self->stats_level, self->stats_source | SCS_DESTINATION, self->stats_id, self->stats_instance);
       stats_unlock();
     }
   log_queue_set_counters(self->queue, self->stored_messages, self->dropped_messages);
@@ -1262,6 +1297,7 @@ log_writer_deinit(LogPipe *s)
   stats_unregister_counter(self->stats_source | SCS_DESTINATION, self->stats_id, self->stats_instance, SC_TYPE_SUPPRESSED, &self->suppressed_messages);
   stats_unregister_counter(self->stats_source | SCS_DESTINATION, self->stats_id, self->stats_instance, SC_TYPE_PROCESSED, &self->processed_messages);
   stats_unregister_counter(self->stats_source | SCS_DESTINATION, self->stats_id, self->stats_instance, SC_TYPE_STORED, &self->stored_messages);
+  log_queue_unregister_stats_counters(self->queue, self->stats_source | SCS_DESTINATION, self->stats_id, self->stats_instance);
   stats_unlock();
   
   return TRUE;
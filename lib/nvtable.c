@@ -220,6 +220,150 @@ nv_table_resolve_entry(NVTable *self, NVEntry *entry, gssize *length)
     return nv_table_resolve_indirect(self, entry, length);
 }
 
+/* dynamic value index */
+
+/* number of dynamic values that triggers building the index */
+#define NV_TABLE_DYN_INDEX_THRESHOLD 64
+
+static inline guint16 *
+nv_table_get_dyn_index(NVTable *self)
+{
+  return (guint16 *) (nv_table_get_top(self) - self->dyn_index_ofs);
+}
+
+/* returns the position of @handle in the dynamic value array or -1 */
+static inline gint
+nv_table_dyn_index_lookup(NVTable *self, NVHandle handle)
+{
+  guint16 *dyn_index = nv_table_get_dyn_index(self);
+  NVDynValue *dyn_entries = nv_table_get_dyn_entries(self);
+  guint32 mask = self->dyn_index_size - 1;
+  guint32 slot = handle & mask;
+
+  /* the load factor is kept below 3/4, so there's always an empty slot */
+  while (dyn_index[slot])
+    {
+      gint pos = dyn_index[slot] - 1;
+
+      if (NV_TABLE_DYNVALUE_HANDLE(dyn_entries[pos]) == handle)
+        return pos;
+      slot = (slot + 1) & mask;
+    }
+  return -1;
+}
+
+static inline void
+nv_table_dyn_index_insert(NVTable *self, NVHandle handle, gint pos)
+{
+  guint16 *dyn_index = nv_table_get_dyn_index(self);
+  guint32 mask = self->dyn_index_size - 1;
+  guint32 slot = handle & mask;
+
+  while (dyn_index[slot])
+    slot = (slot + 1) & mask;
+  dyn_index[slot] = pos + 1;
+}
+
+static gboolean
+nv_table_dyn_index_build(NVTable *self)
+{
+  NVDynValue *dyn_entries = nv_table_get_dyn_entries(self);
+  guint32 size = 16;
+  gsize alloc_size;
+  gint i;
+
+  while (size < self->num_dyn_entries * 2)
+    size <<= 1;
+  alloc_size = NV_TABLE_BOUND(size * sizeof(guint16));
+
+  /* the index is only an accelerator, it may not eat into the space
+   * needed by values: build it only if at least as much space remains
+   * free as is currently used, which is the case right after the table
+   * was reallocated (the index is smaller than the dynamic value array) */
+  if (nv_table_get_bottom(self) - nv_table_get_ofs_table_top(self) < (gssize) (alloc_size + self->used))
+    return FALSE;
+
+  self->used += alloc_size;
+  self->dyn_index_ofs = self->used;
+  self->dyn_index_size = size;
+  memset(nv_table_get_dyn_index(self), 0, size * sizeof(guint16));
+  for (i = 0; i < self->num_dyn_entries; i++)
+    nv_table_dyn_index_insert(self, NV_TABLE_DYNVALUE_HANDLE(dyn_entries[i]), i);
+  return TRUE;
+}
+
+static inline gsize
+nv_table_dyn_index_alloc_size(NVTable *self)
+{
+  return NV_TABLE_BOUND(self->dyn_index_size * sizeof(guint16));
+}
+
+/*
+ * Build a larger index.  The space of the old index can only be given
+ * back if it was the last allocation, then the new index may reuse it.
+ * On failure the old index is left intact.
+ */
+static gboolean
+nv_table_dyn_index_rebuild(NVTable *self)
+{
+  gsize old_alloc_size = nv_table_dyn_index_alloc_size(self);
+  gboolean released = (self->dyn_index_ofs == self->used);
+
+  if (released)
+    self->used -= old_alloc_size;
+  if (nv_table_dyn_index_build(self))
+    return TRUE;
+  if (released)
+    self->used += old_alloc_size;
+  return FALSE;
+}
+
+/* fall back to binary search, releasing the space of the index if possible */
+static void
+nv_table_dyn_index_drop(NVTable *self)
+{
+  if (self->dyn_index_ofs == self->used)
+    self->used -= nv_table_dyn_index_alloc_size(self);
+  self->dyn_index_ofs = 0;
+  self->dyn_index_size = 0;
+}
+
+/* called after a new dynamic value was inserted at position @ndx */
+static void
+nv_table_dyn_index_add(NVTable *self, NVHandle handle, gint ndx)
+{
+  guint16 *dyn_index;
+  guint32 i;
+
+  if (!self->dyn_index_ofs)
+    {
+      if (self->num_dyn_entries >= NV_TABLE_DYN_INDEX_THRESHOLD)
+        nv_table_dyn_index_build(self);
+      return;
+    }
+
+  if (self->num_dyn_entries * 4 > self->dyn_index_size * 3 &&
+      nv_table_dyn_index_rebuild(self))
+    return;
+
+  /* if a larger index could not be built, the current one is used as
+   * long as a slot remains empty, which terminates the lookups */
+  if (self->num_dyn_entries >= self->dyn_index_size)
+    {
+      nv_table_dyn_index_drop(self);
+      return;
+    }
+
+  /* entries after @ndx were shifted by one */
+  dyn_index = nv_table_get_dyn_index(self);
+  for (i = 0; i < self->dyn_index_size; i++)
+    {
+      if (dyn_index[i] > ndx)
+        dyn_index[i]++;
+    }
+  nv_table_dyn_index_insert(self, handle, ndx);
+}
+
 NVEntry *
 nv_table_get_entry_slow(NVTable *self, NVHandle handle, NVDynValue **dyn_slot)
 {
@@ -234,8 +378,18 @@ nv_table_get_entry_slow(NVTable *self, NVHandle handle, NVDynValue **dyn_slot)
       return NULL;
     }
 
-  /* open-coded binary search */
   *dyn_slot = NULL;
+  if (self->dyn_index_ofs)
+    {
+      gint pos = nv_table_dyn_index_lookup(self, handle);
+
+      if (pos < 0)
+        return NULL;
+      *dyn_slot = &dyn_entries[pos];
+      return nv_table_get_entry_at_ofs(self, NV_TABLE_DYNVALUE_OFS(dyn_entries[pos]));
+    }
+
+  /* open-coded binary search */
   l = 0;
   h = self->num_dyn_entries - 1;
   ofs = 0;
@@ -276,34 +430,43 @@ nv_table_reserve_table_entry(NVTable *self, NVHandle handle, NVDynValue **dyn_sl
       if (!nv_table_alloc_check(self, sizeof(dyn_entries[0])))
         return FALSE;
 
-      l = 0;
-      h = self->num_dyn_entries - 1;
       ndx = -1;
-      while (l <= h)
+      if (self->dyn_index_ofs)
         {
-          guint16 mv;
-
-          m = (l+h) >> 1;
-          mv = NV_TABLE_DYNVALUE_HANDLE(dyn_entries[m]);
+          ndx = nv_table_dyn_index_lookup(self, handle);
+          found = (ndx >= 0);
+        }
 
-          if (mv == handle)
-            {
-              ndx = m;
-              found = TRUE;
-              break;
-            }
-          else if (mv > handle)
-            {
-              h = m - 1;
-            }
-          else
+      if (!found)
+        {
+          l = 0;
+          h = self->num_dyn_entries - 1;
+          while (l <= h)
             {
-              l = m + 1;
+              guint16 mv;
+
+              m = (l+h) >> 1;
+              mv = NV_TABLE_DYNVALUE_HANDLE(dyn_entries[m]);
+
+              if (mv == handle)
+                {
+                  ndx = m;
+                  found = TRUE;
+                  break;
+                }
+              else if (mv > handle)
+                {
+                  h = m - 1;
+                }
+              else
+                {
+                  l = m + 1;
+                }
             }
+          /* if we find the proper slot we set that, if we don't, we insert a new entry */
+          if (!found)
+            ndx = l;
         }
-      /* if we find the proper slot we set that, if we don't, we insert a new entry */
-      if (!found)
-        ndx = l;
 
       g_assert(ndx >= 0 && ndx <= self->num_dyn_entries);
       if (ndx < self->num_dyn_entries)
@@ -318,7 +481,10 @@ nv_table_reserve_table_entry(NVTable *self, NVHandle handle, NVDynValue **dyn_sl
       (**dyn_slot).handle = handle;
       (**dyn_slot).ofs    = 0;
       if (!found)
-        self->num_dyn_entries++;
+        {
+          self->num_dyn_entries++;
+          nv_table_dyn_index_add(self, handle, ndx);
+        }
     }
   return TRUE;
 }
@@ -613,6 +779,8 @@ nv_table_clear(NVTable *self)
   g_assert(self->ref_cnt == 1);
   self->used = 0;
   self->num_dyn_entries = 0;
+  self->dyn_index_ofs = 0;
+  self->dyn_index_size = 0;
   memset(&self->static_entries[0], 0, self->num_static_entries * sizeof(self->static_entries[0]));
 }
 
@@ -623,6 +791,8 @@ nv_table_init(NVTable *self, gsize alloc_length, gint num_static_entries)
   self->size = alloc_length;
   self->used = 0;
   self->num_dyn_entries = 0;
+  self->dyn_index_ofs = 0;
+  self->dyn_index_size = 0;
   self->num_static_entries = num_static_entries;
   self->ref_cnt = 1;
   self->borrowed = FALSE;
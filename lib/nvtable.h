@@ -169,6 +169,17 @@ nv_entry_get_name(NVEntry *self)
  *   - a dynamically sized NVDynEntry array (contains ID + offset)
  *   - dynamic values are sorted by the global ID
  *
+ * Dynamic value index:
+ *   - once the number of dynamic values grows large, an open-addressing
+ *     hash index is built that maps handles to positions in the
+ *     dynamic value array, making lookups O(1) instead of a binary search
+ *   - the index is an array of guint16 slots (position + 1, zero means
+ *     empty) allocated in the name-value area, so cloning, reallocating
+ *     and serializing the table needs no special treatment
+ *   - the index is optional: it is only built when there is ample free
+ *     space in the table; if it cannot be grown, it is used until it
+ *     fills up and then dropped
+ *
  * Memory allocation
  * =================
  *   - the memory used by NVTable is managed by the caller, sometimes it is
@@ -196,6 +207,9 @@ struct _NVTable
   guint8 num_static_entries;
   guint8 ref_cnt:7,
     borrowed:1; /* specifies if the memory used by NVTable was borrowed from the container struct */
+  /* offset of the dynamic value index from the top, 0 if there's none */
+  guint32 dyn_index_ofs;
+  guint32 dyn_index_size;
 
   /* variable data, see memory layout in the comment above */
   union
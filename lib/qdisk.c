@@ -0,0 +1,899 @@
+/*
+ * Copyright (c) 2002-2015 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2015 Balázs Scheidler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "qdisk.h"
+#include "persistable-state-header.h"
+#include "messages.h"
+#include "reloc.h"
+#include "misc.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+/*
+ * QDisk is a segmented, append-only on-disk FIFO of opaque records.
+ *
+ * Records are addressed by a 64 bit logical position that grows
+ * monotonically.  The position space is cut into segments of
+ * segment_size bytes each, and every segment is stored in its own file
+ * within the directory of the queue:
+ *
+ *     <dir>/syslog-ng-NNNNN.qd/SSSSSSSSSSSSSSSS.seg
+ *
+ * Each record is a 32 bit big-endian length followed by the record
+ * payload.  Records never span segment boundaries, if a record doesn't
+ * fit in the remainder of the current segment, a zero length marker is
+ * written (if there's space for it) and the record goes to the start of
+ * the next segment.
+ *
+ * Three positions are tracked:
+ *
+ *   - backlog_head: the first record that was not acknowledged yet
+ *   - read_head: the next record to be read
+ *   - write_head: where the next record is appended
+ *
+ * Segments that are completely behind backlog_head are unlinked, this
+ * is how disk space is reclaimed.  backlog_head, write_head and the
+ * number of records in between are stored in persist-state, thus after
+ * a restart every record that was not acknowledged is read again.
+ *
+ * Neither the segments nor the persist-state are fsync()-ed: a record
+ * survives syslog-ng crashing, but not the OS crashing.  The state is
+ * saved every QDISK_STATE_SAVE_BATCH changes (and whenever segments are
+ * unlinked), not after every record.  Records appended after the last
+ * save are recovered at startup by walking the segments from the saved
+ * write_head, acks lost that way cause the records to be sent again.
+ */
+
+#define QDISK_RECORD_HDR_LEN 4
+#define QDISK_STATE_SAVE_BATCH 64
+
+typedef struct _QDiskState
+{
+  PersistableStateHeader header;
+  guint32 dir_id;
+  gint64 segment_size;
+  gint64 backlog_head;
+  gint64 write_head;
+  gint64 length;
+} QDiskState;
+
+struct _QDisk
+{
+  QDiskOptions options;
+
+  PersistState *persist_state;
+  PersistEntryHandle persist_handle;
+  gchar *dirname;
+  gboolean started;
+
+  gint64 segment_size;
+  gint64 backlog_head;
+  gint64 read_head;
+  gint64 write_head;
+
+  /* number of records between read_head and write_head */
+  gint64 length;
+  /* number of records between backlog_head and read_head */
+  gint64 backlog_length;
+
+  gint read_fd;
+  gint64 read_segment;
+  gint write_fd;
+  gint64 write_segment;
+
+  /* number of pushes and acks since the state was last saved */
+  gint unsaved_changes;
+};
+
+void
+qdisk_options_defaults(QDiskOptions *options)
+{
+  options->disk_buf_size = QDISK_DEFAULT_DISK_BUF_SIZE;
+  options->segment_size = QDISK_DEFAULT_SEGMENT_SIZE;
+  options->qout_size = QDISK_DEFAULT_QOUT_SIZE;
+  options->mem_buf_length = QDISK_DEFAULT_MEM_BUF_LENGTH;
+  options->dir = NULL;
+}
+
+void
+qdisk_options_copy(QDiskOptions *dest, const QDiskOptions *src)
+{
+  *dest = *src;
+  dest->dir = g_strdup(src->dir);
+}
+
+void
+qdisk_options_destroy(QDiskOptions *options)
+{
+  g_free(options->dir);
+  options->dir = NULL;
+}
+
+static inline gint64
+qdisk_segment_of(QDisk *self, gint64 pos)
+{
+  return pos / self->segment_size;
+}
+
+static inline gint64
+qdisk_segment_ofs(QDisk *self, gint64 pos)
+{
+  return pos % self->segment_size;
+}
+
+static gchar *
+qdisk_format_segment_filename(QDisk *self, gint64 segment)
+{
+  return g_strdup_printf("%s/%016" G_GINT64_MODIFIER "x.seg", self->dirname, segment);
+}
+
+static void
+qdisk_close_fd(gint *fd)
+{
+  if (*fd >= 0)
+    close(*fd);
+  *fd = -1;
+}
+
+static gint
+qdisk_open_segment_file(QDisk *self, gint64 segment, gint flags)
+{
+  gchar *filename = qdisk_format_segment_filename(self, segment);
+  gint fd;
+
+  fd = open(filename, flags, 0600);
+  g_free(filename);
+  if (fd >= 0)
+    g_fd_set_cloexec(fd, TRUE);
+  return fd;
+}
+
+/* NOTE: errno is preserved on failure */
+static gboolean
+qdisk_open_segment(QDisk *self, gint64 segment, gint flags, gint *fd, gint64 *current_segment)
+{
+  gchar *filename;
+  gint error;
+
+  if (*fd >= 0 && *current_segment == segment)
+    return TRUE;
+
+  qdisk_close_fd(fd);
+  *fd = qdisk_open_segment_file(self, segment, flags);
+  if (*fd < 0)
+    {
+      error = errno;
+      filename = qdisk_format_segment_filename(self, segment);
+      msg_error("Error opening disk-queue segment",
+                evt_tag_str("filename", filename),
+                evt_tag_errno("error", error),
+                NULL);
+      g_free(filename);
+      errno = error;
+      return FALSE;
+    }
+  *current_segment = segment;
+  return TRUE;
+}
+
+static void
+qdisk_unlink_segments(QDisk *self, gint64 first, gint64 last)
+{
+  gint64 segment;
+
+  for (segment = first; segment < last; segment++)
+    {
+      gchar *filename = qdisk_format_segment_filename(self, segment);
+
+      if (unlink(filename) < 0 && errno != ENOENT)
+        msg_error("Error removing disk-queue segment",
+                  evt_tag_str("filename", filename),
+                  evt_tag_errno("error", errno),
+                  NULL);
+      g_free(filename);
+    }
+}
+
+static void
+qdisk_save_state(QDisk *self)
+{
+  QDiskState *state;
+
+  if (!self->persist_handle)
+    return;
+
+  state = persist_state_map_entry(self->persist_state, self->persist_handle);
+  state->backlog_head = self->backlog_head;
+  state->write_head = self->write_head;
+  state->length = self->length + self->backlog_length;
+  persist_state_unmap_entry(self->persist_state, self->persist_handle);
+  self->unsaved_changes = 0;
+}
+
+static void
+qdisk_save_state_batched(QDisk *self)
+{
+  if (++self->unsaved_changes >= QDISK_STATE_SAVE_BATCH)
+    qdisk_save_state(self);
+}
+
+static void
+qdisk_swap_state(QDiskState *state)
+{
+  state->dir_id = GUINT32_SWAP_LE_BE(state->dir_id);
+  state->segment_size = GUINT64_SWAP_LE_BE(state->segment_size);
+  state->backlog_head = GUINT64_SWAP_LE_BE(state->backlog_head);
+  state->write_head = GUINT64_SWAP_LE_BE(state->write_head);
+  state->length = GUINT64_SWAP_LE_BE(state->length);
+  state->header.big_endian = !state->header.big_endian;
+}
+
+static gchar *
+qdisk_format_dirname(QDisk *self, guint32 dir_id)
+{
+  const gchar *dir = self->options.dir ? self->options.dir : get_installation_path_for(PATH_LOCALSTATEDIR);
+
+  return g_strdup_printf("%s/syslog-ng-%05d.qd", dir, dir_id);
+}
+
+static void
+qdisk_collect_dir_id(gchar *name, gint entry_size, gpointer entry, gpointer user_data)
+{
+  GHashTable *dir_ids = (GHashTable *) user_data;
+  QDiskState *state = (QDiskState *) entry;
+  guint32 dir_id;
+
+  if (!g_str_has_suffix(name, ".qdisk") || entry_size != sizeof(QDiskState))
+    return;
+
+  dir_id = state->dir_id;
+  if ((state->header.big_endian && G_BYTE_ORDER == G_LITTLE_ENDIAN) ||
+      (!state->header.big_endian && G_BYTE_ORDER == G_BIG_ENDIAN))
+    dir_id = GUINT32_SWAP_LE_BE(dir_id);
+  g_hash_table_insert(dir_ids, GUINT_TO_POINTER(dir_id + 1), GUINT_TO_POINTER(TRUE));
+}
+
+static void
+qdisk_remove_dir(const gchar *dirname)
+{
+  GDir *dir;
+  const gchar *entry;
+
+  dir = g_dir_open(dirname, 0, NULL);
+  if (dir)
+    {
+      while ((entry = g_dir_read_name(dir)))
+        {
+          gchar *filename = g_build_filename(dirname, entry, NULL);
+
+          unlink(filename);
+          g_free(filename);
+        }
+      g_dir_close(dir);
+    }
+  if (rmdir(dirname) < 0)
+    msg_error("Error removing disk-queue directory",
+              evt_tag_str("dir", dirname),
+              evt_tag_errno("error", errno),
+              NULL);
+}
+
+/* remove a queue directory that no persist entry refers to anymore */
+static void
+qdisk_remove_orphaned_dir(const gchar *dirname)
+{
+  msg_warning("Removing orphaned disk-queue directory, no persist entry refers to it",
+              evt_tag_str("dir", dirname),
+              NULL);
+  qdisk_remove_dir(dirname);
+}
+
+/*
+ * Allocate the lowest directory id not used by any queue in the persist
+ * file.  A directory with that id is a leftover of a queue whose persist
+ * entry is gone (e.g. the persist file was removed), its contents can't
+ * be found anymore, so it is reused instead of piling up new directories.
+ */
+static guint32
+qdisk_alloc_dir_id(QDisk *self)
+{
+  GHashTable *dir_ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+  guint32 dir_id;
+  gchar *dirname;
+
+  persist_state_foreach_entry(self->persist_state, qdisk_collect_dir_id, dir_ids);
+  for (dir_id = 0; g_hash_table_lookup(dir_ids, GUINT_TO_POINTER(dir_id + 1)); dir_id++)
+    ;
+  g_hash_table_destroy(dir_ids);
+
+  dirname = qdisk_format_dirname(self, dir_id);
+  if (g_file_test(dirname, G_FILE_TEST_EXISTS))
+    qdisk_remove_orphaned_dir(dirname);
+  g_free(dirname);
+  return dir_id;
+}
+
+static gboolean
+qdisk_load_state(QDisk *self, const gchar *persist_name)
+{
+  QDiskState *state;
+  gsize size;
+  guint8 version;
+  gchar *state_name;
+  guint32 dir_id = 0;
+  gboolean new_state = FALSE;
+
+  state_name = g_strdup_printf("%s.qdisk", persist_name);
+  self->persist_handle = persist_state_lookup_entry(self->persist_state, state_name, &size, &version);
+  if (self->persist_handle && size != sizeof(QDiskState))
+    {
+      msg_error("Disk-queue state has an unexpected size, starting with an empty queue",
+                evt_tag_str("persist_name", persist_name),
+                NULL);
+      self->persist_handle = 0;
+    }
+
+  if (!self->persist_handle)
+    {
+      /* before the new entry exists, which would be seen as dir_id 0 */
+      dir_id = qdisk_alloc_dir_id(self);
+      self->persist_handle = persist_state_alloc_entry(self->persist_state, state_name, sizeof(QDiskState));
+      new_state = TRUE;
+    }
+  g_free(state_name);
+
+  if (!self->persist_handle)
+    return FALSE;
+
+  state = persist_state_map_entry(self->persist_state, self->persist_handle);
+  if (new_state)
+    {
+      memset(state, 0, sizeof(*state));
+      state->header.version = 0;
+      state->header.big_endian = (G_BYTE_ORDER == G_BIG_ENDIAN);
+      state->dir_id = dir_id;
+      state->segment_size = self->options.segment_size;
+    }
+  else if ((state->header.big_endian && G_BYTE_ORDER == G_LITTLE_ENDIAN) ||
+           (!state->header.big_endian && G_BYTE_ORDER == G_BIG_ENDIAN))
+    {
+      qdisk_swap_state(state);
+    }
+
+  self->dirname = qdisk_format_dirname(self, state->dir_id);
+  /* the segment size of an existing queue cannot change, as positions are relative to it */
+  self->segment_size = state->segment_size;
+  self->backlog_head = self->read_head = state->backlog_head;
+  self->write_head = state->write_head;
+  self->length = state->length;
+  self->backlog_length = 0;
+  persist_state_unmap_entry(self->persist_state, self->persist_handle);
+
+  if (!new_state && !g_file_test(self->dirname, G_FILE_TEST_IS_DIR) && self->length > 0)
+    {
+      msg_error("Disk-queue directory is missing, messages stored in it are lost",
+                evt_tag_str("dir", self->dirname),
+                evt_tag_int("lost", self->length),
+                NULL);
+      self->length = 0;
+      self->backlog_head = self->read_head = self->write_head;
+    }
+  return TRUE;
+}
+
+/* NOTE: a short read means the segment is truncated, thus damaged */
+static QDiskPopResult
+qdisk_read_at(QDisk *self, gint fd, gpointer buf, gsize len, gint64 pos)
+{
+  gssize rc;
+
+  do
+    {
+      rc = pread(fd, buf, len, qdisk_segment_ofs(self, pos));
+    }
+  while (rc < 0 && errno == EINTR);
+
+  if (rc < 0)
+    return QDISK_POP_ERROR;
+  if ((gsize) rc != len)
+    return QDISK_POP_CORRUPT;
+  return QDISK_POP_OK;
+}
+
+/* a zero @len is the end-of-segment marker */
+static QDiskPopResult
+qdisk_read_header(QDisk *self, gint fd, gint64 pos, guint32 *len)
+{
+  QDiskPopResult result;
+  guint32 hdr;
+
+  result = qdisk_read_at(self, fd, &hdr, sizeof(hdr), pos);
+  if (result != QDISK_POP_OK)
+    return result;
+
+  *len = GUINT32_FROM_BE(hdr);
+  if (*len > self->segment_size - qdisk_segment_ofs(self, pos) - QDISK_RECORD_HDR_LEN)
+    return QDISK_POP_CORRUPT;
+  return QDISK_POP_OK;
+}
+
+static inline gint64
+qdisk_next_segment_start(QDisk *self, gint64 pos)
+{
+  return pos - qdisk_segment_ofs(self, pos) + self->segment_size;
+}
+
+/*
+ * Count the records between @pos and write_head.  Segments that are
+ * missing or damaged are skipped, their records are not counted.
+ * Returns FALSE if a segment couldn't be read for another reason.
+ */
+static gboolean
+qdisk_count_records(QDisk *self, gint64 pos, gint64 *count)
+{
+  QDiskPopResult result = QDISK_POP_OK;
+  gint64 segment = -1;
+  gint fd = -1;
+  guint32 len;
+
+  *count = 0;
+  while (pos < self->write_head)
+    {
+      if (self->segment_size - qdisk_segment_ofs(self, pos) < QDISK_RECORD_HDR_LEN)
+        {
+          pos = qdisk_next_segment_start(self, pos);
+          continue;
+        }
+
+      if (segment != qdisk_segment_of(self, pos))
+        {
+          qdisk_close_fd(&fd);
+          segment = qdisk_segment_of(self, pos);
+          fd = qdisk_open_segment_file(self, segment, O_RDONLY);
+          if (fd < 0 && errno != ENOENT)
+            {
+              result = QDISK_POP_ERROR;
+              break;
+            }
+        }
+
+      if (fd >= 0)
+        result = qdisk_read_header(self, fd, pos, &len);
+      else
+        result = QDISK_POP_CORRUPT;
+
+      if (result == QDISK_POP_ERROR)
+        break;
+      if (result == QDISK_POP_CORRUPT || len == 0)
+        {
+          result = QDISK_POP_OK;
+          pos = qdisk_next_segment_start(self, pos);
+          continue;
+        }
+      pos += len + QDISK_RECORD_HDR_LEN;
+      (*count)++;
+    }
+  qdisk_close_fd(&fd);
+  return result != QDISK_POP_ERROR;
+}
+
+/*
+ * The state is saved in batches, find the records appended after the
+ * saved write_head.  The walk stops at the first incomplete record,
+ * e.g. one that was being written when syslog-ng crashed.
+ */
+static void
+qdisk_recover_unsaved_records(QDisk *self)
+{
+  gint64 pos = self->write_head;
+  gint64 segment = -1;
+  gint64 recovered = 0;
+  gint64 file_size = 0;
+  gint fd = -1;
+  guint32 len;
+  struct stat st;
+
+  while (TRUE)
+    {
+      if (self->segment_size - qdisk_segment_ofs(self, pos) < QDISK_RECORD_HDR_LEN)
+        pos = qdisk_next_segment_start(self, pos);
+
+      if (segment != qdisk_segment_of(self, pos))
+        {
+          qdisk_close_fd(&fd);
+          segment = qdisk_segment_of(self, pos);
+          fd = qdisk_open_segment_file(self, segment, O_RDONLY);
+          if (fd < 0 || fstat(fd, &st) < 0)
+            break;
+          file_size = st.st_size;
+        }
+
+      if (qdisk_read_header(self, fd, pos, &len) != QDISK_POP_OK)
+        break;
+      if (len == 0)
+        {
+          pos = qdisk_next_segment_start(self, pos);
+          continue;
+        }
+      if (file_size < qdisk_segment_ofs(self, pos) + QDISK_RECORD_HDR_LEN + len)
+        break;
+
+      pos += len + QDISK_RECORD_HDR_LEN;
+      self->write_head = pos;
+      recovered++;
+    }
+  qdisk_close_fd(&fd);
+
+  if (recovered > 0)
+    {
+      self->length += recovered;
+      msg_notice("Recovered disk-queue records written after the state was last saved",
+                 evt_tag_str("dir", self->dirname),
+                 evt_tag_int("recovered", recovered),
+                 NULL);
+    }
+}
+
+/* discard anything written after the last complete record, e.g. after a crash */
+static gboolean
+qdisk_truncate_write_segment(QDisk *self)
+{
+  if (!qdisk_open_segment(self, qdisk_segment_of(self, self->write_head), O_WRONLY | O_CREAT,
+                          &self->write_fd, &self->write_segment))
+    return FALSE;
+
+  if (ftruncate(self->write_fd, qdisk_segment_ofs(self, self->write_head)) < 0 ||
+      lseek(self->write_fd, qdisk_segment_ofs(self, self->write_head), SEEK_SET) < 0)
+    {
+      msg_error("Error positioning disk-queue segment",
+                evt_tag_str("dir", self->dirname),
+                evt_tag_errno("error", errno),
+                NULL);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+gboolean
+qdisk_start(QDisk *self, PersistState *state, const gchar *persist_name)
+{
+  g_assert(!self->started);
+
+  self->persist_state = state;
+  if (!qdisk_load_state(self, persist_name))
+    return FALSE;
+
+  if (g_mkdir_with_parents(self->dirname, 0700) < 0)
+    {
+      msg_error("Error creating disk-queue directory",
+                evt_tag_str("dir", self->dirname),
+                evt_tag_errno("error", errno),
+                NULL);
+      return FALSE;
+    }
+
+  qdisk_recover_unsaved_records(self);
+  if (!qdisk_truncate_write_segment(self))
+    return FALSE;
+
+  self->started = TRUE;
+  qdisk_save_state(self);
+
+  msg_verbose("Disk-queue started",
+              evt_tag_str("dir", self->dirname),
+              evt_tag_str("persist_name", persist_name),
+              evt_tag_int("length", self->length),
+              NULL);
+  return TRUE;
+}
+
+void
+qdisk_stop(QDisk *self)
+{
+  if (!self->started)
+    return;
+
+  qdisk_save_state(self);
+  qdisk_close_fd(&self->read_fd);
+  qdisk_close_fd(&self->write_fd);
+  self->started = FALSE;
+}
+
+/*
+ * Remove the files and the persist entry of an empty queue that is not
+ * used anymore, e.g. the queue of a removed worker once it is drained.
+ */
+void
+qdisk_remove(QDisk *self, const gchar *persist_name)
+{
+  gchar *state_name;
+
+  if (!self->started)
+    return;
+
+  g_assert(self->length == 0 && self->backlog_length == 0);
+
+  qdisk_close_fd(&self->read_fd);
+  qdisk_close_fd(&self->write_fd);
+  qdisk_remove_dir(self->dirname);
+
+  state_name = g_strdup_printf("%s.qdisk", persist_name);
+  persist_state_remove_entry(self->persist_state, state_name);
+  g_free(state_name);
+  self->persist_handle = 0;
+  self->started = FALSE;
+}
+
+gboolean
+qdisk_is_started(QDisk *self)
+{
+  return self->started;
+}
+
+gboolean
+qdisk_is_space_avail(QDisk *self, gsize record_len)
+{
+  return qdisk_get_usage(self) + record_len + QDISK_RECORD_HDR_LEN <= self->options.disk_buf_size;
+}
+
+static gboolean
+qdisk_write_buffer(QDisk *self, struct iovec *iov, gint iov_count, gsize len)
+{
+  gssize rc;
+
+  rc = writev(self->write_fd, iov, iov_count);
+  if (rc < 0 || (gsize) rc != len)
+    {
+      msg_error("Error writing disk-queue segment",
+                evt_tag_str("dir", self->dirname),
+                evt_tag_errno("error", rc < 0 ? errno : ENOSPC),
+                NULL);
+      /* don't leave a partial record behind */
+      qdisk_truncate_write_segment(self);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static gboolean
+qdisk_skip_to_next_write_segment(QDisk *self)
+{
+  gint64 ofs = qdisk_segment_ofs(self, self->write_head);
+
+  if (self->segment_size - ofs >= QDISK_RECORD_HDR_LEN)
+    {
+      guint32 marker = 0;
+      struct iovec iov = { &marker, sizeof(marker) };
+
+      if (!qdisk_write_buffer(self, &iov, 1, sizeof(marker)))
+        return FALSE;
+    }
+  self->write_head += self->segment_size - ofs;
+  return qdisk_open_segment(self, qdisk_segment_of(self, self->write_head), O_WRONLY | O_CREAT | O_TRUNC,
+                            &self->write_fd, &self->write_segment);
+}
+
+gboolean
+qdisk_push_tail(QDisk *self, GString *record)
+{
+  guint32 hdr;
+  struct iovec iov[2];
+  gsize total_len = record->len + QDISK_RECORD_HDR_LEN;
+
+  if (total_len > self->segment_size)
+    {
+      msg_error("Message too large to be stored in the disk-queue, increase segment-size()",
+                evt_tag_int("len", record->len),
+                evt_tag_int("segment_size", self->segment_size),
+                NULL);
+      return FALSE;
+    }
+
+  if (qdisk_segment_ofs(self, self->write_head) + total_len > self->segment_size &&
+      !qdisk_skip_to_next_write_segment(self))
+    return FALSE;
+
+  hdr = GUINT32_TO_BE(record->len);
+  iov[0].iov_base = &hdr;
+  iov[0].iov_len = sizeof(hdr);
+  iov[1].iov_base = record->str;
+  iov[1].iov_len = record->len;
+  if (!qdisk_write_buffer(self, iov, 2, total_len))
+    return FALSE;
+
+  self->write_head += total_len;
+  self->length++;
+  qdisk_save_state_batched(self);
+  return TRUE;
+}
+
+static void
+qdisk_log_read_error(QDisk *self, QDiskPopResult result, gint error)
+{
+  if (result == QDISK_POP_CORRUPT)
+    msg_error("Damaged record in disk-queue segment",
+              evt_tag_str("dir", self->dirname),
+              evt_tag_int("segment", qdisk_segment_of(self, self->read_head)),
+              evt_tag_int("offset", qdisk_segment_ofs(self, self->read_head)),
+              NULL);
+  else
+    msg_error("Error reading disk-queue segment",
+              evt_tag_str("dir", self->dirname),
+              evt_tag_int("segment", qdisk_segment_of(self, self->read_head)),
+              evt_tag_errno("error", error),
+              NULL);
+}
+
+/*
+ * QDISK_POP_ERROR leaves the read position as it is, the same record is
+ * read again by the next call.
+ */
+QDiskPopResult
+qdisk_pop_head(QDisk *self, GString *record, gint64 *record_end)
+{
+  QDiskPopResult result;
+  guint32 len;
+
+  if (self->length == 0)
+    return QDISK_POP_EMPTY;
+
+  while (TRUE)
+    {
+      if (self->segment_size - qdisk_segment_ofs(self, self->read_head) < QDISK_RECORD_HDR_LEN)
+        {
+          self->read_head = qdisk_next_segment_start(self, self->read_head);
+          continue;
+        }
+
+      /* the error is already logged */
+      if (!qdisk_open_segment(self, qdisk_segment_of(self, self->read_head), O_RDONLY,
+                              &self->read_fd, &self->read_segment))
+        return errno == ENOENT ? QDISK_POP_CORRUPT : QDISK_POP_ERROR;
+
+      result = qdisk_read_header(self, self->read_fd, self->read_head, &len);
+      if (result != QDISK_POP_OK)
+        goto error;
+
+      if (len != 0)
+        break;
+
+      /* end-of-segment marker */
+      self->read_head = qdisk_next_segment_start(self, self->read_head);
+    }
+
+  g_string_set_size(record, len);
+  result = qdisk_read_at(self, self->read_fd, record->str, len, self->read_head + QDISK_RECORD_HDR_LEN);
+  if (result != QDISK_POP_OK)
+    goto error;
+
+  self->read_head += len + QDISK_RECORD_HDR_LEN;
+  self->length--;
+  self->backlog_length++;
+  *record_end = self->read_head;
+  return QDISK_POP_OK;
+
+ error:
+  qdisk_log_read_error(self, result, errno);
+  return result;
+}
+
+/*
+ * Skip the rest of the segment containing a damaged record, as the start
+ * of the next record in it can't be found.  The records of later segments
+ * are counted to find out how many records were lost.  The lost records
+ * become part of the backlog and are acked together with the next record
+ * read.  Returns the number of records lost, or -1 if the records could
+ * not be counted, in which case nothing is skipped.
+ */
+gint64
+qdisk_skip_corrupt(QDisk *self)
+{
+  gint64 next = MIN(qdisk_next_segment_start(self, self->read_head), self->write_head);
+  gint64 remaining, skipped;
+
+  if (!qdisk_count_records(self, next, &remaining))
+    return -1;
+
+  skipped = MAX(self->length - remaining, 0);
+  self->read_head = next;
+  self->length = remaining;
+  self->backlog_length += skipped;
+  qdisk_close_fd(&self->read_fd);
+  qdisk_save_state(self);
+  return skipped;
+}
+
+/*
+ * Acknowledge @count records, the last of them ending at @record_end.
+ */
+void
+qdisk_ack_backlog(QDisk *self, gint64 record_end, gint count)
+{
+  gint64 old_segment = qdisk_segment_of(self, self->backlog_head);
+
+  g_assert(record_end <= self->read_head);
+
+  self->backlog_head = record_end;
+  self->backlog_length -= count;
+  if (old_segment == qdisk_segment_of(self, self->backlog_head))
+    {
+      qdisk_save_state_batched(self);
+      return;
+    }
+
+  /* saved right away, so that a restart doesn't look for the unlinked records */
+  qdisk_save_state(self);
+  qdisk_unlink_segments(self, old_segment, qdisk_segment_of(self, self->backlog_head));
+}
+
+gint64
+qdisk_get_length(QDisk *self)
+{
+  return self->length;
+}
+
+gint64
+qdisk_get_backlog_length(QDisk *self)
+{
+  return self->backlog_length;
+}
+
+gint64
+qdisk_get_usage(QDisk *self)
+{
+  return self->write_head - self->backlog_head;
+}
+
+const gchar *
+qdisk_get_dirname(QDisk *self)
+{
+  return self->dirname;
+}
+
+QDisk *
+qdisk_new(const QDiskOptions *options)
+{
+  QDisk *self = g_new0(QDisk, 1);
+
+  qdisk_options_copy(&self->options, options);
+  self->segment_size = options->segment_size;
+  self->read_fd = -1;
+  self->write_fd = -1;
+  return self;
+}
+
+void
+qdisk_free(QDisk *self)
+{
+  qdisk_stop(self);
+  qdisk_options_destroy(&self->options);
+  g_free(self->dirname);
+  g_free(self);
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2002-2015 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2015 Balázs Scheidler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef QDISK_H_INCLUDED
+#define QDISK_H_INCLUDED
+
+#include "syslog-ng.h"
+#include "persist-state.h"
+
+/* default options for a QDisk instance */
+#define QDISK_DEFAULT_DISK_BUF_SIZE  (1024 * 1024 * 1024)
+#define QDISK_DEFAULT_SEGMENT_SIZE   (16 * 1024 * 1024)
+#define QDISK_DEFAULT_QOUT_SIZE      64
+#define QDISK_DEFAULT_MEM_BUF_LENGTH 1000
+
+typedef struct _QDiskOptions
+{
+  gint64 disk_buf_size;
+  gint64 segment_size;
+  gint qout_size;
+  gint mem_buf_length;
+  gchar *dir;
+} QDiskOptions;
+
+typedef struct _QDisk QDisk;
+
+typedef enum
+{
+  QDISK_POP_OK,
+  QDISK_POP_EMPTY,
+  /* the record could not be read now (e.g. EMFILE or EIO), retry later */
+  QDISK_POP_ERROR,
+  /* the record at the read position is damaged, see qdisk_skip_corrupt() */
+  QDISK_POP_CORRUPT,
+} QDiskPopResult;
+
+void qdisk_options_defaults(QDiskOptions *options);
+void qdisk_options_copy(QDiskOptions *dest, const QDiskOptions *src);
+void qdisk_options_destroy(QDiskOptions *options);
+
+gboolean qdisk_start(QDisk *self, PersistState *state, const gchar *persist_name);
+void qdisk_stop(QDisk *self);
+void qdisk_remove(QDisk *self, const gchar *persist_name);
+gboolean qdisk_is_started(QDisk *self);
+
+gboolean qdisk_is_space_avail(QDisk *self, gsize record_len);
+gboolean qdisk_push_tail(QDisk *self, GString *record);
+QDiskPopResult qdisk_pop_head(QDisk *self, GString *record, gint64 *record_end);
+gint64 qdisk_skip_corrupt(QDisk *self);
+void qdisk_ack_backlog(QDisk *self, gint64 record_end, gint count);
+
+gint64 qdisk_get_length(QDisk *self);
+gint64 qdisk_get_backlog_length(QDisk *self);
+gint64 qdisk_get_usage(QDisk *self);
+const gchar *qdisk_get_dirname(QDisk *self);
+
+QDisk *qdisk_new(const QDiskOptions *options);
+void qdisk_free(QDisk *self);
+
+#endif
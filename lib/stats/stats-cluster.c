@@ -49,6 +49,11 @@ stats_cluster_get_type_name(gint type)
     /* [SC_TYPE_STORED]   = */  "stored",
     /* [SC_TYPE_SUPPRESSED] = */ "suppressed",
     /* [SC_TYPE_STAMP] = */ "stamp",
+    /* [SC_TYPE_DISK_USAGE] = */ "disk_usage_kb",
+    /* [SC_TYPE_MEMORY_USAGE] = */ "memory_usage",
+    /* [SC_TYPE_SYSCALLS] = */ "syscalls",
+    /* [SC_TYPE_RAW_BYTES] = */ "raw_bytes",
+    /* [SC_TYPE_COMPRESSED_BYTES] = */ "compressed_bytes",
   };
 
   return tag_names[type];
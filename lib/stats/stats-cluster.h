@@ -34,6 +34,11 @@ typedef enum
   SC_TYPE_STORED,    /* number of messages on disk */
   SC_TYPE_SUPPRESSED,/* number of messages suppressed */
   SC_TYPE_STAMP,     /* timestamp */
+  SC_TYPE_DISK_USAGE, /* disk space used by a disk-based queue, in kilobytes */
+  SC_TYPE_MEMORY_USAGE, /* memory used by the messages in a queue, in bytes */
+  SC_TYPE_SYSCALLS,  /* number of write syscalls issued by a destination */
+  SC_TYPE_RAW_BYTES, /* number of bytes passed through a compressed transport, before compression */
+  SC_TYPE_COMPRESSED_BYTES, /* number of bytes passed through a compressed transport, after compression */
   SC_TYPE_MAX
 } StatsCounterType;
 
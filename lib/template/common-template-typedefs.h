@@ -25,5 +25,6 @@
 #define COMMON_TYPEDEFS_H_INCLUDED
 
 typedef struct _LogTemplateOptions LogTemplateOptions;
+typedef struct _LogTemplateProgram LogTemplateProgram;
 
 #endif
@@ -23,6 +23,12 @@
  */
 
 #include "template/repr.h"
+#include "template/macros.h"
+
+#include <string.h>
+
+/* the expected output length of a single macro, value or function */
+#define LOG_TEMPLATE_OP_SIZE_ESTIMATE 16
 
 void
 log_template_elem_free(LogTemplateElem *e)
@@ -57,3 +63,90 @@ log_template_elem_free_list(GList *l)
     }
   g_list_free(l);
 }
+
+static LogTemplateOp *
+log_template_program_add_op(LogTemplateProgram *self, guint8 opcode)
+{
+  LogTemplateOp *op = &self->ops[self->num_ops++];
+
+  op->opcode = opcode;
+  return op;
+}
+
+static void
+log_template_program_add_literal(LogTemplateProgram *self, gchar **literals_end, const gchar *text, gsize text_len)
+{
+  LogTemplateOp *last = self->num_ops ? &self->ops[self->num_ops - 1] : NULL;
+
+  /* literals are stored consecutively, so adjacent ones can be merged */
+  memcpy(*literals_end, text, text_len);
+  if (last && last->opcode == LTO_LITERAL)
+    {
+      last->literal.text_len += text_len;
+    }
+  else
+    {
+      LogTemplateOp *op = log_template_program_add_op(self, LTO_LITERAL);
+
+      op->literal.text = *literals_end;
+      op->literal.text_len = text_len;
+    }
+  *literals_end += text_len;
+  self->size_hint += text_len;
+}
+
+LogTemplateProgram *
+log_template_program_new(GList *compiled_template)
+{
+  LogTemplateProgram *self = g_new0(LogTemplateProgram, 1);
+  gsize literals_len = 0;
+  gint max_ops = 0;
+  gchar *literals_end;
+  GList *p;
+
+  for (p = compiled_template; p; p = p->next)
+    {
+      literals_len += ((LogTemplateElem *) p->data)->text_len;
+      max_ops += 2;
+    }
+  self->ops = g_new0(LogTemplateOp, max_ops);
+  self->literals = g_malloc(literals_len + 1);
+  literals_end = self->literals;
+
+  for (p = compiled_template; p; p = p->next)
+    {
+      LogTemplateElem *e = (LogTemplateElem *) p->data;
+      LogTemplateOp *op;
+
+      if (e->text_len)
+        log_template_program_add_literal(self, &literals_end, e->text, e->text_len);
+
+      switch (e->type)
+        {
+        case LTE_MACRO:
+          if (e->macro == M_NONE)
+            continue;
+          op = log_template_program_add_op(self, LTO_MACRO);
+          break;
+        case LTE_VALUE:
+          op = log_template_program_add_op(self, LTO_VALUE);
+          break;
+        case LTE_FUNC:
+          op = log_template_program_add_op(self, LTO_FUNC);
+          break;
+        default:
+          g_assert_not_reached();
+        }
+      op->elem = e;
+      self->size_hint += LOG_TEMPLATE_OP_SIZE_ESTIMATE;
+    }
+  return self;
+}
+
+void
+log_template_program_free(LogTemplateProgram *self)
+{
+  g_free(self->ops);
+  g_free(self->literals);
+  g_free(self);
+}
@@ -56,5 +56,48 @@ typedef struct _LogTemplateElem
 
 void log_template_elem_free_list(GList *el);
 
+enum
+{
+  LTO_LITERAL,
+  LTO_MACRO,
+  LTO_VALUE,
+  LTO_FUNC
+};
+
+/* a single instruction of the linear form of a compiled template */
+typedef struct _LogTemplateOp
+{
+  guint8 opcode;
+  union
+  {
+    struct
+    {
+      const gchar *text;
+      gsize text_len;
+    } literal;
+    /* macro, value and function ops refer to the element they were created from */
+    LogTemplateElem *elem;
+  };
+} LogTemplateOp;
+
+/*
+ * The list of LogTemplateElem instances produced by the compiler
+ * flattened into an array of ops: literal texts become separate ops
+ * (adjacent ones are merged), elements that produce no output are
+ * dropped.
+ */
+struct _LogTemplateProgram
+{
+  gint num_ops;
+  LogTemplateOp *ops;
+  /* storage for the text of LTO_LITERAL ops */
+  gchar *literals;
+  /* estimated length of the formatted output, used to size the result buffer */
+  gsize size_hint;
+};
+
+LogTemplateProgram *log_template_program_new(GList *compiled_template);
+void log_template_program_free(LogTemplateProgram *self);
+
 
 #endif
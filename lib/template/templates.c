@@ -28,9 +28,17 @@
 #include "template/escaping.h"
 #include "cfg.h"
 
+/* upper limit for the learned output size of a template */
+#define LOG_TEMPLATE_SIZE_HINT_MAX 8192
+/* a shorter output moves the learned size 1/16 of the way towards its length */
+#define LOG_TEMPLATE_SIZE_HINT_DECAY 16
+
 static void
 log_template_reset_compiled(LogTemplate *self)
 {
+  if (self->program)
+    log_template_program_free(self->program);
+  self->program = NULL;
   log_template_elem_free_list(self->compiled_template);
   self->compiled_template = NULL;
 }
@@ -51,6 +59,7 @@ log_template_compile(LogTemplate *self, const gchar *template, GError **error)
   log_template_compiler_init(&compiler, self);
   result = log_template_compiler_compile(&compiler, &self->compiled_template, error);
   log_template_compiler_clear(&compiler);
+  self->program = log_template_program_new(self->compiled_template);
   return result;
 }
 
@@ -72,22 +81,37 @@ log_template_set_type_hint(LogTemplate *self, const gchar *type_hint, GError **e
 void
 log_template_append_format_with_context(LogTemplate *self, LogMessage **messages, gint num_messages, const LogTemplateOptions *opts, gint tz, gint32 seq_num, const gchar *context_id, GString *result)
 {
-  GList *p;
+  LogTemplateProgram *program = self->program;
   LogTemplateElem *e;
+  gsize start = result->len, len;
+  gint i;
+
+  if (!program)
+    return;
 
   if (!opts)
     opts = &self->cfg->template_options;
 
-  for (p = self->compiled_template; p; p = g_list_next(p))
+  /* reserve space for the whole output at once */
+  if (result->allocated_len <= start + program->size_hint)
+    {
+      g_string_set_size(result, start + program->size_hint);
+      g_string_truncate(result, start);
+    }
+
+  for (i = 0; i < program->num_ops; i++)
     {
+      LogTemplateOp *op = &program->ops[i];
       gint msg_ndx;
 
-      e = (LogTemplateElem *) p->data;
-      if (e->text)
+      if (op->opcode == LTO_LITERAL)
         {
-          g_string_append_len(result, e->text, e->text_len);
+          g_string_append_len(result, op->literal.text, op->literal.text_len);
+          continue;
         }
 
+      e = op->elem;
+
       /* NOTE: msg_ref is 1 larger than the index specified by the user in
        * order to make it distinguishable from the zero value.  Therefore
        * the '>' instead of '>='
@@ -102,9 +126,9 @@ log_template_append_format_with_context(LogTemplate *self, LogMessage **messages
       if (e->msg_ref == 0)
         msg_ndx--;
 
-      switch (e->type)
+      switch (op->opcode)
         {
-        case LTE_VALUE:
+        case LTO_VALUE:
           {
             const gchar *value = NULL;
             gssize value_len = -1;
@@ -116,19 +140,16 @@ log_template_append_format_with_context(LogTemplate *self, LogMessage **messages
               result_append(result, e->default_value, -1, self->escape);
             break;
           }
-        case LTE_MACRO:
+        case LTO_MACRO:
           {
             gint len = result->len;
 
-            if (e->macro)
-              {
-                log_macro_expand(result, e->macro, self->escape, opts ? opts : &self->cfg->template_options, tz, seq_num, context_id, messages[msg_ndx]);
-                if (len == result->len && e->default_value)
-                  g_string_append(result, e->default_value);
-              }
+            log_macro_expand(result, e->macro, self->escape, opts ? opts : &self->cfg->template_options, tz, seq_num, context_id, messages[msg_ndx]);
+            if (len == result->len && e->default_value)
+              g_string_append(result, e->default_value);
             break;
           }
-        case LTE_FUNC:
+        case LTO_FUNC:
           {
             g_static_mutex_lock(&self->arg_lock);
             if (!self->arg_bufs)
@@ -162,6 +183,16 @@ log_template_append_format_with_context(LogTemplate *self, LogMessage **messages
           }
         }
     }
+
+  /* learn the size of the output for the next invocation: it grows right
+   * away, but decays slowly, so that a single large output does not
+   * oversize the buffers for good.  The update is racy if the template
+   * is shared between threads, but it is only a hint */
+  len = MIN(result->len - start, LOG_TEMPLATE_SIZE_HINT_MAX);
+  if (len > program->size_hint)
+    program->size_hint = len;
+  else
+    program->size_hint -= (program->size_hint - len) / LOG_TEMPLATE_SIZE_HINT_DECAY;
 }
 
 void
@@ -61,6 +61,7 @@ typedef struct _LogTemplate
   gchar *name;
   gchar *template;
   GList *compiled_template;
+  LogTemplateProgram *program;
   gboolean escape;
   gboolean def_inline;
   GlobalConfig *cfg;
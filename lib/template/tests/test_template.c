@@ -3,6 +3,7 @@
 
 #include "logmsg.h"
 #include "template/templates.h"
+#include "template/repr.h"
 #include "template/user-function.h"
 #include "misc.h"
 #include "apphook.h"
@@ -269,6 +270,32 @@ test_user_template_function(void)
   assert_template_failure("$(dummy arg)", "User defined template function $(dummy) cannot have arguments");
 }
 
+static void
+test_size_hint_decays_after_a_large_output(void)
+{
+  LogTemplate *templ = compile_template("$MSG", FALSE);
+  LogMessage *msg = create_sample_message();
+  GString *result = g_string_sized_new(0);
+  gchar *large = g_strnfill(4000, 'x');
+  gint i;
+
+  log_msg_set_value(msg, LM_V_MESSAGE, large, -1);
+  log_template_format(templ, msg, NULL, LTZ_SEND, 0, NULL, result);
+  assert_true(templ->program->size_hint >= 4000, "The size hint did not grow to the output length; size_hint=%d",
+              (gint) templ->program->size_hint);
+
+  log_msg_set_value(msg, LM_V_MESSAGE, "short", -1);
+  for (i = 0; i < 200; i++)
+    log_template_format(templ, msg, NULL, LTZ_SEND, 0, NULL, result);
+  assert_true(templ->program->size_hint < 100, "The size hint did not decay after shorter outputs; size_hint=%d",
+              (gint) templ->program->size_hint);
+
+  g_free(large);
+  g_string_free(result, TRUE);
+  log_msg_unref(msg);
+  log_template_unref(templ);
+}
+
 int
 main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
 {
@@ -292,6 +319,7 @@ main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
   test_multi_thread();
   test_escaping();
   test_user_template_function();
+  test_size_hint_decays_after_a_large_output();
   /* multi-threaded expansion */
 
 
@@ -384,6 +384,58 @@ test_template_compile_func(void)
   TEMPLATE_TESTCASE(test_qouted_string_in_name_template_function);
 }
 
+static void
+assert_program_op(gint ndx, guint8 opcode, const gchar *literal)
+{
+  LogTemplateOp *op;
+
+  assert_true(ndx < template->program->num_ops, ASSERTION_ERROR("Too few ops in compiled program"));
+  op = &template->program->ops[ndx];
+  assert_gint(op->opcode, opcode, ASSERTION_ERROR("Bad opcode in compiled program"));
+  if (opcode == LTO_LITERAL)
+    assert_nstring(op->literal.text, op->literal.text_len, literal, -1, ASSERTION_ERROR("Bad literal in compiled program"));
+  else
+    assert_gpointer(op->elem, current_elem, ASSERTION_ERROR("Bad element in compiled program"));
+}
+
+static void
+test_program_of_literal_only_template(void)
+{
+  assert_template_compile("Test String");
+  assert_gint(template->program->num_ops, 1, ASSERTION_ERROR("Bad number of ops"));
+  assert_program_op(0, LTO_LITERAL, "Test String");
+  assert_true(template->program->size_hint >= strlen("Test String"), ASSERTION_ERROR("Output size estimate too small"));
+}
+
+static void
+test_program_splits_literals_from_macros(void)
+{
+  assert_template_compile("foo $MSG bar");
+  assert_gint(template->program->num_ops, 3, ASSERTION_ERROR("Bad number of ops"));
+  assert_program_op(0, LTO_LITERAL, "foo ");
+  assert_program_op(1, LTO_MACRO, NULL);
+  assert_program_op(2, LTO_LITERAL, " bar");
+}
+
+static void
+test_program_of_values_and_functions(void)
+{
+  assert_template_compile("${VALUE_NAME}$(hello)test value");
+  assert_gint(template->program->num_ops, 3, ASSERTION_ERROR("Bad number of ops"));
+  assert_program_op(0, LTO_VALUE, NULL);
+  select_next_element();
+  assert_program_op(1, LTO_FUNC, NULL);
+  assert_program_op(2, LTO_LITERAL, "test value");
+}
+
+static void
+test_template_compile_program(void)
+{
+  TEMPLATE_TESTCASE(test_program_of_literal_only_template);
+  TEMPLATE_TESTCASE(test_program_splits_literals_from_macros);
+  TEMPLATE_TESTCASE(test_program_of_values_and_functions);
+}
+
 static void
 test_invalid_macro(void)
 {
@@ -451,6 +503,7 @@ int main(int argc, char **argv)
   test_template_compile_macro();
   test_template_compile_value();
   test_template_compile_func();
+  test_template_compile_program();
   test_template_compile_negativ_tests();
 
   log_msg_registry_deinit();
@@ -70,6 +70,19 @@ testcase(const gchar *msg_str, gboolean syslog_proto, gchar *template)
   g_get_current_time(&end);
   printf("      %-90.*s speed: %12.3f msg/sec\n", (int) strlen(template) - 1, template, i * 1e6 / g_time_val_diff(&end, &start));
 
+  /* formatting into a new buffer for each message, this is where sizing
+   * the result buffer in advance counts */
+  g_get_current_time(&start);
+  for (i = 0; i < BENCHMARK_COUNT; i++)
+    {
+      GString *fresh_res = g_string_sized_new(0);
+
+      log_template_format(templ, msg, NULL, LTZ_LOCAL, 0, NULL, fresh_res);
+      g_string_free(fresh_res, TRUE);
+    }
+  g_get_current_time(&end);
+  printf("      %-90s speed: %12.3f msg/sec\n", "  (new result buffer per message)", i * 1e6 / g_time_val_diff(&end, &start));
+
   log_template_unref(templ);
   g_string_free(res, TRUE);
   log_msg_unref(msg);
@@ -116,6 +129,16 @@ main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
   testcase("<155>2006-02-11T10:34:56.156+01:00 bzorp syslog-ng[23323]:árvíztűrőtükörfúrógép", FALSE,
            "$DATE $HOST $MSGHDR$MSG ${APP.VALUE}\n");
 
+  /* common file destination templates */
+  testcase("<155>2006-02-11T10:34:56.156+01:00 bzorp syslog-ng[23323]:árvíztűrőtükörfúrógép", FALSE,
+           "${ISODATE} ${HOST} ${MSGHDR}${MESSAGE}\n");
+
+  testcase("<155>2006-02-11T10:34:56.156+01:00 bzorp syslog-ng[23323]:árvíztűrőtükörfúrógép", FALSE,
+           "$ISODATE $HOST $PROGRAM[$PID]: $MSG\n");
+
+  testcase("<155>2006-02-11T10:34:56.156+01:00 bzorp syslog-ng[23323]:árvíztűrőtükörfúrógép", FALSE,
+           "$R_ISODATE $FULLHOST_FROM $FACILITY.$PRIORITY $MSGHDR$MSG\n");
+
   testcase("<155>2006-02-11T10:34:56.156+01:00 bzorp syslog-ng[23323]:árvíztűrőtükörfúrógép", FALSE,
            "$MSG\n");
 
@@ -25,6 +25,8 @@
 #include "logtransport.h"
 #include "messages.h"
 
+#include <unistd.h>
+
 void
 log_transport_free_method(LogTransport *s)
 {
@@ -37,11 +39,30 @@ log_transport_free_method(LogTransport *s)
     }
 }
 
+/* writes the buffers using writev() followed by an fsync() if @sync is
+ * set, unless the transport is able to do both in one go */
+gssize
+log_transport_writev(LogTransport *self, const struct iovec *iov, gint iovcnt, gboolean sync)
+{
+  gssize rc;
+
+  if (self->writev)
+    return self->writev(self, iov, iovcnt, sync);
+
+  rc = writev(self->fd, iov, iovcnt);
+  if (rc > 0 && sync)
+    fsync(self->fd);
+  return rc;
+}
+
 void
 log_transport_init_instance(LogTransport *self, gint fd)
 {
   self->fd = fd;
   self->cond = 0;
+  self->has_pending_data = NULL;
+  self->send_batch = NULL;
+  self->writev = NULL;
   self->free_fn = log_transport_free_method;
 }
 
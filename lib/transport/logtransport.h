@@ -28,6 +28,8 @@
 #include "syslog-ng.h"
 #include "transport/transport-aux-data.h"
 
+#include <sys/uio.h>
+
 typedef struct _LogTransport LogTransport;
 
 struct _LogTransport
@@ -36,6 +38,14 @@ struct _LogTransport
   GIOCondition cond;
   gssize (*read)(LogTransport *self, gpointer buf, gsize count, LogTransportAuxData *aux);
   gssize (*write)(LogTransport *self, const gpointer buf, gsize count);
+  /* returns TRUE if data was already received and can be read without polling the fd */
+  gboolean (*has_pending_data)(LogTransport *self);
+  /* optional: sends each of the @count buffers as a separate datagram
+   * using a single syscall, returns the number of datagrams sent */
+  gint (*send_batch)(LogTransport *self, const struct iovec *iov, gint count);
+  /* optional: writes @iovcnt buffers with a single operation and flushes
+   * them to stable storage if @sync is TRUE, see log_transport_writev() */
+  gssize (*writev)(LogTransport *self, const struct iovec *iov, gint iovcnt, gboolean sync);
   void (*free_fn)(LogTransport *self);
 };
 
@@ -51,6 +61,26 @@ log_transport_read(LogTransport *self, gpointer buf, gsize count, LogTransportAu
   return self->read(self, buf, count, aux);
 }
 
+static inline gboolean
+log_transport_has_send_batch(LogTransport *self)
+{
+  return self->send_batch != NULL;
+}
+
+static inline gint
+log_transport_send_batch(LogTransport *self, const struct iovec *iov, gint count)
+{
+  return self->send_batch(self, iov, count);
+}
+
+static inline gboolean
+log_transport_has_pending_data(LogTransport *self)
+{
+  return self->has_pending_data && self->has_pending_data(self);
+}
+
+gssize log_transport_writev(LogTransport *self, const struct iovec *iov, gint iovcnt, gboolean sync);
+
 void log_transport_init_instance(LogTransport *s, gint fd);
 void log_transport_free_method(LogTransport *s);
 void log_transport_free(LogTransport *s);
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2002-2014 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2014 Balázs Scheidler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ */
+#include "testutils.h"
+#include "apphook.h"
+#include "transport/transport-compress.h"
+
+#include <errno.h>
+#include <string.h>
+
+/*
+ * A transport writing into and reading from a shared in-memory buffer,
+ * accepting at most write_limit bytes in a single write.
+ */
+typedef struct _MemoryWire
+{
+  GString *data;
+  gsize read_pos;
+  gsize write_limit;
+} MemoryWire;
+
+typedef struct _LogTransportMemory
+{
+  LogTransport super;
+  MemoryWire *wire;
+} LogTransportMemory;
+
+static gssize
+log_transport_memory_read(LogTransport *s, gpointer buf, gsize buflen, LogTransportAuxData *aux)
+{
+  MemoryWire *wire = ((LogTransportMemory *) s)->wire;
+  gsize len = MIN(buflen, wire->data->len - wire->read_pos);
+
+  if (len == 0)
+    {
+      errno = EAGAIN;
+      return -1;
+    }
+  memcpy(buf, wire->data->str + wire->read_pos, len);
+  wire->read_pos += len;
+  return len;
+}
+
+static gssize
+log_transport_memory_write(LogTransport *s, const gpointer buf, gsize buflen)
+{
+  MemoryWire *wire = ((LogTransportMemory *) s)->wire;
+  gsize len = MIN(buflen, wire->write_limit);
+
+  g_string_append_len(wire->data, buf, len);
+  return len;
+}
+
+static void
+log_transport_memory_free(LogTransport *s)
+{
+}
+
+static LogTransport *
+log_transport_memory_new(MemoryWire *wire)
+{
+  LogTransportMemory *self = g_new0(LogTransportMemory, 1);
+
+  log_transport_init_instance(&self->super, -1);
+  self->super.read = log_transport_memory_read;
+  self->super.write = log_transport_memory_write;
+  self->super.free_fn = log_transport_memory_free;
+  self->wire = wire;
+  return &self->super;
+}
+
+static void
+write_all(LogTransport *transport, const gchar *buf, gsize len)
+{
+  gssize rc;
+
+  /* a write that could not be sent in whole is retried with the same data */
+  while ((rc = log_transport_write(transport, (gpointer) buf, len)) < 0)
+    assert_gint(errno, EAGAIN, "write() failed with an unexpected error");
+  assert_gint(rc, len, "write() should report the whole buffer as written");
+}
+
+static GString *
+read_all(LogTransport *transport, gsize chunk)
+{
+  GString *result = g_string_new("");
+  gchar *buf = g_malloc(chunk);
+  gssize rc;
+
+  while ((rc = log_transport_read(transport, buf, chunk, NULL)) > 0 || log_transport_has_pending_data(transport))
+    {
+      if (rc > 0)
+        g_string_append_len(result, buf, rc);
+    }
+  assert_gint(errno, EAGAIN, "read() failed with an unexpected error");
+  g_free(buf);
+  return result;
+}
+
+static void
+test_compressed_roundtrip(const gchar *method_name)
+{
+  gint method = log_transport_compression_lookup(method_name);
+  MemoryWire wire = { g_string_new(""), 0, G_MAXSIZE };
+  StatsCounterItem raw_bytes = { 0 }, compressed_bytes = { 0 };
+  LogTransport *writer, *reader;
+  GString *expected = g_string_new(""), *received;
+  gchar line[256];
+  gint i;
+
+  if (method < 0)
+    return;
+
+  testcase_begin("%s", method_name);
+  writer = log_transport_compress_new(log_transport_memory_new(&wire), method, -1);
+  reader = log_transport_compress_new(log_transport_memory_new(&wire), method, -1);
+  log_transport_compress_set_counters(writer, &raw_bytes, &compressed_bytes);
+
+  for (i = 0; i < 1000; i++)
+    {
+      g_snprintf(line, sizeof(line), "<13>Oct 18 10:00:00 localhost prog[%d]: message number %d\n", 1000 + i % 7, i);
+
+      /* trickle the compressed data out for a while */
+      wire.write_limit = (i >= 500 && i < 600) ? 5 : G_MAXSIZE;
+      write_all(writer, line, strlen(line));
+      g_string_append(expected, line);
+    }
+
+  assert_gint(stats_counter_get(&raw_bytes), expected->len, "raw_bytes counter mismatch");
+  assert_gint(stats_counter_get(&compressed_bytes), wire.data->len, "compressed_bytes counter mismatch");
+  assert_true(wire.data->len < expected->len / 2, "data is not compressed, raw=%d compressed=%d",
+              (gint) expected->len, (gint) wire.data->len);
+
+  /* small reads leave decompressed data in the transport */
+  received = read_all(reader, 17);
+  assert_nstring(received->str, received->len, expected->str, expected->len, "decompressed data mismatch");
+
+  /* garbage on the wire is an error, not something to pass on */
+  g_string_append(wire.data, "\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff");
+  assert_gint(log_transport_read(reader, line, sizeof(line), NULL), -1, "reading corrupt data should fail");
+  assert_gint(errno, EINVAL, "reading corrupt data should fail with EINVAL");
+
+  log_transport_free(writer);
+  log_transport_free(reader);
+  g_string_free(received, TRUE);
+  g_string_free(expected, TRUE);
+  g_string_free(wire.data, TRUE);
+  testcase_end();
+}
+
+int
+main()
+{
+  app_startup();
+  assert_gint(log_transport_compression_lookup("none"), LTC_NONE, "none should always be supported");
+  assert_gint(log_transport_compression_lookup("foobar"), -1, "unknown compression method accepted");
+  test_compressed_roundtrip("zlib");
+  test_compressed_roundtrip("zstd");
+  app_shutdown();
+  return 0;
+}
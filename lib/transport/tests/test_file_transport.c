@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2002-2014 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2014 Balázs Scheidler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ */
+#include "testutils.h"
+#include "apphook.h"
+#include "transport/transport-file.h"
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define TEST_FILE "test_file_transport.log"
+
+static void
+assert_read_would_block(LogTransport *transport)
+{
+  gchar buf[64];
+
+  assert_gint(log_transport_read(transport, buf, sizeof(buf), NULL), -1, "read() should report no data");
+  assert_gint(errno, EAGAIN, "read() should fail with EAGAIN");
+}
+
+static void
+test_file_transport_writes_and_reads_back(void)
+{
+  struct iovec iov[2] = { { "hello ", 6 }, { "world\n", 6 } };
+  LogTransport *writer, *reader;
+  gchar buf[64];
+  gint fd;
+
+  unlink(TEST_FILE);
+  fd = open(TEST_FILE, O_WRONLY | O_CREAT | O_APPEND | O_NONBLOCK, 0600);
+  writer = log_transport_file_new(fd);
+  assert_gint(log_transport_writev(writer, iov, 2, TRUE), 12, "writev() returned an unexpected value");
+  assert_gint(log_transport_write(writer, "foo\n", 4), 4, "write() returned an unexpected value");
+
+  fd = open(TEST_FILE, O_RDONLY | O_NONBLOCK);
+  reader = log_transport_file_new(fd);
+  assert_gint(log_transport_read(reader, buf, 6, NULL), 6, "read() returned an unexpected value");
+  assert_nstring(buf, 6, "hello ", 6, "read() returned unexpected data");
+  assert_gint(log_transport_read(reader, buf, sizeof(buf), NULL), 10, "read() returned an unexpected value");
+  assert_nstring(buf, 10, "world\nfoo\n", 10, "read() returned unexpected data");
+  assert_read_would_block(reader);
+  assert_read_would_block(reader);
+
+  assert_gint(log_transport_write(writer, "bar\n", 4), 4, "write() returned an unexpected value");
+  assert_gint(log_transport_read(reader, buf, sizeof(buf), NULL), 4, "data appended to the file is not read");
+  assert_nstring(buf, 4, "bar\n", 4, "read() returned unexpected data");
+
+  log_transport_free(reader);
+  log_transport_free(writer);
+  unlink(TEST_FILE);
+}
+
+int
+main()
+{
+  app_startup();
+  test_file_transport_writes_and_reads_back();
+  app_shutdown();
+  return 0;
+}
@@ -0,0 +1,432 @@
+/*
+ * Copyright (c) 2002-2014 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2013 Balázs Scheidler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "transport/transport-compress.h"
+#include "messages.h"
+
+#include <errno.h>
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/* the amount of compressed data read from the underlying transport at once */
+#define COMPRESS_INPUT_SIZE 16384
+/* don't keep a huge output buffer around after a single large write */
+#define COMPRESS_OUTPUT_KEEP_SIZE (4 * COMPRESS_INPUT_SIZE)
+
+/*
+ * LogTransportCompress
+ *
+ * Stacks between a LogProtoClient/LogProtoServer and a stream transport,
+ * compressing the outgoing and decompressing the incoming byte stream.
+ * Each write() is flushed through the compressor, so every chunk that
+ * the protocol layer writes can be decompressed by the peer as soon as
+ * it arrives; the compression context is kept across writes, so the
+ * redundancy between messages is exploited.
+ *
+ * Writes are all-or-nothing from the caller's point of view: a write()
+ * is compressed once, and it is reported as written only when all of its
+ * compressed form has been sent. Until then the write fails with EAGAIN
+ * and the caller is expected to retry it with the same data, which is
+ * what the stream clients do anyway (and what TLS requires as well).
+ */
+typedef struct _LogTransportCompress LogTransportCompress;
+struct _LogTransportCompress
+{
+  LogTransport super;
+  LogTransport *transport;
+  StatsCounterItem *raw_bytes;
+  StatsCounterItem *compressed_bytes;
+
+  /* compressed form of the pending write() */
+  guchar *output;
+  gsize output_size, output_len, output_pos;
+  /* length of the pending write() in uncompressed bytes, 0 if there's none */
+  gsize output_consumed;
+
+  /* compressed data read from the underlying transport */
+  guchar *input;
+  gsize input_len, input_pos;
+  /* the caller's buffer filled up during decompression, so the
+   * decompressor may have output even without further input */
+  gboolean decompress_pending;
+
+  gboolean (*compress)(LogTransportCompress *self, const guchar *buf, gsize buflen);
+  gssize (*decompress)(LogTransportCompress *self, guchar *buf, gsize buflen);
+  void (*free_codec)(LogTransportCompress *self);
+
+  union
+  {
+#ifdef HAVE_ZLIB
+    struct
+    {
+      z_stream deflate;
+      z_stream inflate;
+    } zlib;
+#endif
+#ifdef HAVE_ZSTD
+    struct
+    {
+      ZSTD_CCtx *cctx;
+      ZSTD_DCtx *dctx;
+    } zstd;
+#endif
+    gint dummy;
+  } codec;
+};
+
+static void
+log_transport_compress_reserve_output(LogTransportCompress *self, gsize len)
+{
+  if (self->output_size - self->output_len >= len)
+    return;
+
+  self->output_size = MAX(self->output_size * 2, self->output_len + len);
+  self->output = g_realloc(self->output, self->output_size);
+}
+
+#ifdef HAVE_ZLIB
+
+static gboolean
+log_transport_compress_zlib_compress(LogTransportCompress *self, const guchar *buf, gsize buflen)
+{
+  z_stream *z = &self->codec.zlib.deflate;
+  gint rc;
+
+  z->next_in = (Bytef *) buf;
+  z->avail_in = buflen;
+  do
+    {
+      /* room for the sync flush marker too */
+      log_transport_compress_reserve_output(self, deflateBound(z, z->avail_in) + 16);
+      z->next_out = self->output + self->output_len;
+      z->avail_out = self->output_size - self->output_len;
+
+      rc = deflate(z, Z_SYNC_FLUSH);
+      if (rc != Z_OK && rc != Z_BUF_ERROR)
+        return FALSE;
+
+      self->output_len = self->output_size - z->avail_out;
+    }
+  while (z->avail_out == 0);
+  return TRUE;
+}
+
+static gssize
+log_transport_compress_zlib_decompress(LogTransportCompress *self, guchar *buf, gsize buflen)
+{
+  z_stream *z = &self->codec.zlib.inflate;
+  gint rc;
+
+  z->next_in = self->input + self->input_pos;
+  z->avail_in = self->input_len - self->input_pos;
+  z->next_out = buf;
+  z->avail_out = buflen;
+
+  rc = inflate(z, Z_SYNC_FLUSH);
+  if (rc == Z_STREAM_END)
+    inflateReset(z);
+  else if (rc != Z_OK && rc != Z_BUF_ERROR)
+    return -1;
+
+  self->input_pos = self->input_len - z->avail_in;
+  self->decompress_pending = z->avail_out == 0;
+  return buflen - z->avail_out;
+}
+
+static void
+log_transport_compress_zlib_free(LogTransportCompress *self)
+{
+  deflateEnd(&self->codec.zlib.deflate);
+  inflateEnd(&self->codec.zlib.inflate);
+}
+
+static void
+log_transport_compress_zlib_init(LogTransportCompress *self, gint level)
+{
+  gint rc;
+
+  rc = deflateInit(&self->codec.zlib.deflate, level < 0 ? Z_DEFAULT_COMPRESSION : level);
+  g_assert(rc == Z_OK);
+  rc = inflateInit(&self->codec.zlib.inflate);
+  g_assert(rc == Z_OK);
+
+  self->compress = log_transport_compress_zlib_compress;
+  self->decompress = log_transport_compress_zlib_decompress;
+  self->free_codec = log_transport_compress_zlib_free;
+}
+
+#endif
+
+#ifdef HAVE_ZSTD
+
+static gboolean
+log_transport_compress_zstd_compress(LogTransportCompress *self, const guchar *buf, gsize buflen)
+{
+  ZSTD_inBuffer in = { buf, buflen, 0 };
+  ZSTD_outBuffer out;
+  gsize remaining;
+
+  do
+    {
+      log_transport_compress_reserve_output(self, ZSTD_compressBound(in.size - in.pos) + 64);
+      out.dst = self->output + self->output_len;
+      out.size = self->output_size - self->output_len;
+      out.pos = 0;
+
+      remaining = ZSTD_compressStream2(self->codec.zstd.cctx, &out, &in, ZSTD_e_flush);
+      if (ZSTD_isError(remaining))
+        return FALSE;
+
+      self->output_len += out.pos;
+    }
+  while (remaining != 0);
+  return TRUE;
+}
+
+static gssize
+log_transport_compress_zstd_decompress(LogTransportCompress *self, guchar *buf, gsize buflen)
+{
+  ZSTD_inBuffer in = { self->input, self->input_len, self->input_pos };
+  ZSTD_outBuffer out = { buf, buflen, 0 };
+  gsize rc;
+
+  rc = ZSTD_decompressStream(self->codec.zstd.dctx, &out, &in);
+  if (ZSTD_isError(rc))
+    return -1;
+
+  self->input_pos = in.pos;
+  self->decompress_pending = out.pos == out.size;
+  return out.pos;
+}
+
+static void
+log_transport_compress_zstd_free(LogTransportCompress *self)
+{
+  ZSTD_freeCCtx(self->codec.zstd.cctx);
+  ZSTD_freeDCtx(self->codec.zstd.dctx);
+}
+
+static void
+log_transport_compress_zstd_init(LogTransportCompress *self, gint level)
+{
+  self->codec.zstd.cctx = ZSTD_createCCtx();
+  self->codec.zstd.dctx = ZSTD_createDCtx();
+  g_assert(self->codec.zstd.cctx && self->codec.zstd.dctx);
+  ZSTD_CCtx_setParameter(self->codec.zstd.cctx, ZSTD_c_compressionLevel, level < 0 ? ZSTD_CLEVEL_DEFAULT : level);
+
+  self->compress = log_transport_compress_zstd_compress;
+  self->decompress = log_transport_compress_zstd_decompress;
+  self->free_codec = log_transport_compress_zstd_free;
+}
+
+#endif
+
+static gssize
+log_transport_compress_read_method(LogTransport *s, gpointer buf, gsize buflen, LogTransportAuxData *aux)
+{
+  LogTransportCompress *self = (LogTransportCompress *) s;
+  gssize rc;
+
+  while (TRUE)
+    {
+      if (self->input_pos < self->input_len || self->decompress_pending)
+        {
+          rc = self->decompress(self, buf, buflen);
+          if (rc < 0)
+            {
+              msg_error("Error decompressing incoming data, check that compression() matches on both ends",
+                        evt_tag_int("fd", self->super.fd),
+                        NULL);
+              errno = EINVAL;
+              return -1;
+            }
+          if (rc > 0)
+            {
+              stats_counter_add(self->raw_bytes, rc);
+              return rc;
+            }
+        }
+
+      rc = log_transport_read(self->transport, self->input, COMPRESS_INPUT_SIZE, aux);
+      self->super.cond = self->transport->cond;
+      if (rc <= 0)
+        return rc;
+
+      stats_counter_add(self->compressed_bytes, rc);
+      self->input_len = rc;
+      self->input_pos = 0;
+    }
+}
+
+static gssize
+log_transport_compress_write_method(LogTransport *s, const gpointer buf, gsize buflen)
+{
+  LogTransportCompress *self = (LogTransportCompress *) s;
+  gssize rc;
+
+  if (self->output_consumed == 0)
+    {
+      if (!self->compress(self, buf, buflen))
+        {
+          msg_error("Error compressing outgoing data",
+                    evt_tag_int("fd", self->super.fd),
+                    NULL);
+          errno = EINVAL;
+          return -1;
+        }
+      self->output_consumed = buflen;
+      stats_counter_add(self->raw_bytes, buflen);
+    }
+
+  while (self->output_pos < self->output_len)
+    {
+      rc = log_transport_write(self->transport, self->output + self->output_pos, self->output_len - self->output_pos);
+      self->super.cond = self->transport->cond;
+      if (rc < 0)
+        return -1;
+
+      stats_counter_add(self->compressed_bytes, rc);
+      self->output_pos += rc;
+    }
+
+  rc = self->output_consumed;
+  self->output_consumed = 0;
+  self->output_len = self->output_pos = 0;
+  if (self->output_size > COMPRESS_OUTPUT_KEEP_SIZE)
+    {
+      g_free(self->output);
+      self->output = NULL;
+      self->output_size = 0;
+    }
+  return rc;
+}
+
+static gboolean
+log_transport_compress_has_pending_data(LogTransport *s)
+{
+  LogTransportCompress *self = (LogTransportCompress *) s;
+
+  return self->input_pos < self->input_len ||
+         self->decompress_pending ||
+         log_transport_has_pending_data(self->transport);
+}
+
+static void
+log_transport_compress_free_method(LogTransport *s)
+{
+  LogTransportCompress *self = (LogTransportCompress *) s;
+
+  self->free_codec(self);
+  g_free(self->output);
+  g_free(self->input);
+  /* the fd is closed by the underlying transport */
+  log_transport_free(self->transport);
+}
+
+gint
+log_transport_compression_lookup(const gchar *name)
+{
+  if (strcmp(name, "none") == 0)
+    return LTC_NONE;
+#ifdef HAVE_ZLIB
+  if (strcmp(name, "zlib") == 0)
+    return LTC_ZLIB;
+#endif
+#ifdef HAVE_ZSTD
+  if (strcmp(name, "zstd") == 0)
+    return LTC_ZSTD;
+#endif
+  return -1;
+}
+
+gboolean
+log_transport_compression_check_level(LogTransportCompression method, gint level)
+{
+  if (level < 0)
+    return TRUE;
+
+  switch (method)
+    {
+#ifdef HAVE_ZLIB
+    case LTC_ZLIB:
+      return level <= 9;
+#endif
+#ifdef HAVE_ZSTD
+    case LTC_ZSTD:
+      return level <= ZSTD_maxCLevel();
+#endif
+    default:
+      return TRUE;
+    }
+}
+
+void
+log_transport_compress_set_counters(LogTransport *s, StatsCounterItem *raw_bytes, StatsCounterItem *compressed_bytes)
+{
+  LogTransportCompress *self = (LogTransportCompress *) s;
+
+  self->raw_bytes = raw_bytes;
+  self->compressed_bytes = compressed_bytes;
+}
+
+LogTransport *
+log_transport_compress_new(LogTransport *transport, LogTransportCompression method, gint level)
+{
+  LogTransportCompress *self;
+
+  if (method == LTC_NONE)
+    return transport;
+
+  self = g_new0(LogTransportCompress, 1);
+  log_transport_init_instance(&self->super, transport->fd);
+  self->super.read = log_transport_compress_read_method;
+  self->super.write = log_transport_compress_write_method;
+  self->super.has_pending_data = log_transport_compress_has_pending_data;
+  self->super.free_fn = log_transport_compress_free_method;
+  self->transport = transport;
+  self->input = g_malloc(COMPRESS_INPUT_SIZE);
+
+  switch (method)
+    {
+#ifdef HAVE_ZLIB
+    case LTC_ZLIB:
+      log_transport_compress_zlib_init(self, level);
+      break;
+#endif
+#ifdef HAVE_ZSTD
+    case LTC_ZSTD:
+      log_transport_compress_zstd_init(self, level);
+      break;
+#endif
+    default:
+      g_assert_not_reached();
+    }
+  return &self->super;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2002-2014 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2013 Balázs Scheidler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef TRANSPORT_TRANSPORT_COMPRESS_H_INCLUDED
+#define TRANSPORT_TRANSPORT_COMPRESS_H_INCLUDED 1
+
+#include "transport/logtransport.h"
+#include "stats/stats-counter.h"
+
+typedef enum
+{
+  LTC_NONE = 0,
+  LTC_ZLIB,
+  LTC_ZSTD,
+} LogTransportCompression;
+
+/* returns -1 if @name is unknown or support for it was not compiled in */
+gint log_transport_compression_lookup(const gchar *name);
+/* checks @level against the range accepted by @method, -1 is always valid */
+gboolean log_transport_compression_check_level(LogTransportCompression method, gint level);
+
+/* wraps @transport (a stream socket or TLS) so that everything written is
+ * compressed and everything read is decompressed, @level is the
+ * compression level of the selected method, -1 for its default */
+LogTransport *log_transport_compress_new(LogTransport *transport, LogTransportCompression method, gint level);
+void log_transport_compress_set_counters(LogTransport *s, StatsCounterItem *raw_bytes, StatsCounterItem *compressed_bytes);
+
+#endif
@@ -23,12 +23,28 @@
 
 #include "transport-file.h"
 
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <unistd.h>
+
 static gssize
 log_transport_file_read_method(LogTransport *s, gpointer buf, gsize buflen, LogTransportAuxData *aux)
 {
   LogTransportFile *self = (LogTransportFile *) s;
   gint rc;
-  
+
+  /* the previous read reached the end of the file, this one would only
+   * return EOF. Anything appended since then gets the file reported
+   * readable again, so nothing is missed by skipping the syscall. */
+  if (self->drained)
+    {
+      self->drained = FALSE;
+      errno = EAGAIN;
+      return -1;
+    }
+
   do
     {
       rc = read(self->super.fd, buf, buflen);
@@ -41,6 +57,10 @@ log_transport_file_read_method(LogTransport *s, gpointer buf, gsize buflen, LogT
       rc = -1;
       errno = EAGAIN;
     }
+  else if (rc > 0 && self->is_regular)
+    {
+      self->drained = (gsize) rc < buflen;
+    }
   return rc;
 }
 
@@ -58,6 +78,42 @@ log_transport_file_write_method(LogTransport *s, const gpointer buf, gsize bufle
   return rc;
 }
 
+static gssize
+log_transport_file_writev_method(LogTransport *s, const struct iovec *iov, gint iovcnt, gboolean sync)
+{
+  LogTransportFile *self = (LogTransportFile *) s;
+  gssize rc;
+
+#if defined(HAVE_PWRITEV2) && defined(RWF_SYNC)
+  /* write and flush to stable storage using a single syscall, offset -1
+   * means the current file position, just like writev() */
+  if (sync && !self->sync_write_unsupported)
+    {
+      do
+        {
+          rc = pwritev2(self->super.fd, iov, iovcnt, -1, RWF_SYNC);
+        }
+      while (rc == -1 && errno == EINTR);
+
+      if (rc >= 0 || (errno != EOPNOTSUPP && errno != ENOSYS && errno != EINVAL))
+        return rc;
+
+      /* kernels before 4.7 */
+      self->sync_write_unsupported = TRUE;
+    }
+#endif
+
+  do
+    {
+      rc = writev(self->super.fd, iov, iovcnt);
+    }
+  while (rc == -1 && errno == EINTR);
+
+  if (rc > 0 && sync)
+    fsync(self->super.fd);
+  return rc;
+}
+
 void
 log_transport_file_init_instance(LogTransportFile *self, gint fd)
 {
@@ -72,7 +128,10 @@ LogTransport *
 log_transport_file_new(gint fd)
 {
   LogTransportFile *self = g_new0(LogTransportFile, 1);
+  struct stat st;
 
   log_transport_file_init_instance(self, fd);
+  self->super.writev = log_transport_file_writev_method;
+  self->is_regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
   return &self->super;
 }
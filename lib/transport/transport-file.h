@@ -32,6 +32,12 @@ typedef struct _LogTransportFile LogTransportFile;
 struct _LogTransportFile
 {
   LogTransport super;
+  /* regular file: a short read means the end of the file was reached */
+  gboolean is_regular;
+  /* the previous read came up short, the next one would only return EOF */
+  gboolean drained;
+  /* pwritev2() with RWF_SYNC was rejected by the kernel */
+  gboolean sync_write_unsupported;
 };
 
 void log_transport_file_init_instance(LogTransportFile *self, gint fd);
@@ -23,6 +23,9 @@
 
 #include "transport-socket.h"
 
+#include <sys/socket.h>
+#include <errno.h>
+#include <string.h>
 
 static gssize
 log_transport_dgram_socket_read_method(LogTransport *s, gpointer buf, gsize buflen, LogTransportAuxData *aux)
@@ -76,12 +79,50 @@ log_transport_dgram_socket_write_method(LogTransport *s, const gpointer buf, gsi
   return rc;
 }
 
+#ifdef HAVE_SENDMMSG
+
+/* the number of datagrams passed to a single sendmmsg() call */
+#define LOG_TRANSPORT_SEND_BATCH_MAX 64
+
+static gint
+log_transport_dgram_socket_send_batch_method(LogTransport *s, const struct iovec *iov, gint count)
+{
+  LogTransportSocket *self = (LogTransportSocket *) s;
+  struct mmsghdr msgs[LOG_TRANSPORT_SEND_BATCH_MAX];
+  gint i, rc;
+
+  count = MIN(count, LOG_TRANSPORT_SEND_BATCH_MAX);
+  memset(msgs, 0, sizeof(msgs[0]) * count);
+  for (i = 0; i < count; i++)
+    {
+      msgs[i].msg_hdr.msg_iov = (struct iovec *) &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+  do
+    {
+      rc = sendmmsg(self->super.fd, msgs, count, 0);
+    }
+  while (rc == -1 && errno == EINTR);
+
+  /* NOTE: see the comment on ENOBUFS in the write method above, the
+   * datagram that couldn't be sent is dropped */
+  if (rc < 0 && errno == ENOBUFS)
+    return 1;
+  return rc;
+}
+
+#endif
+
 void
 log_transport_dgram_socket_init_instance(LogTransportSocket *self, gint fd)
 {
   log_transport_init_instance(&self->super, fd);
   self->super.read = log_transport_dgram_socket_read_method;
   self->super.write = log_transport_dgram_socket_write_method;
+#ifdef HAVE_SENDMMSG
+  self->super.send_batch = log_transport_dgram_socket_send_batch_method;
+#endif
 }
 
 LogTransport *
@@ -93,6 +134,165 @@ log_transport_dgram_socket_new(gint fd)
   return &self->super;
 }
 
+#ifdef HAVE_RECVMMSG
+
+/* datagram transport that receives multiple datagrams with a single
+ * recvmmsg() call, subsequent reads are served from the received batch */
+typedef struct _LogTransportBatchedDGramSocket
+{
+  LogTransportSocket super;
+  gint batch_size;
+  gsize slot_size;
+  gchar *buffers;
+  struct mmsghdr *msgs;
+  struct iovec *iov;
+  struct sockaddr_storage *addrs;
+  gint num_received;
+  gint current;
+  /* consecutive datagrams from the same peer share the GSockAddr instance */
+  GSockAddr *last_peer_addr;
+} LogTransportBatchedDGramSocket;
+
+static void
+log_transport_batched_dgram_socket_alloc_buffers(LogTransportBatchedDGramSocket *self, gsize slot_size)
+{
+  gint i;
+
+  self->slot_size = slot_size;
+  self->buffers = g_malloc(self->batch_size * slot_size);
+  self->msgs = g_new0(struct mmsghdr, self->batch_size);
+  self->iov = g_new0(struct iovec, self->batch_size);
+  self->addrs = g_new0(struct sockaddr_storage, self->batch_size);
+  for (i = 0; i < self->batch_size; i++)
+    {
+      self->iov[i].iov_base = self->buffers + i * slot_size;
+      self->iov[i].iov_len = slot_size;
+      self->msgs[i].msg_hdr.msg_iov = &self->iov[i];
+      self->msgs[i].msg_hdr.msg_iovlen = 1;
+      self->msgs[i].msg_hdr.msg_name = &self->addrs[i];
+    }
+}
+
+static gint
+log_transport_batched_dgram_socket_receive_batch(LogTransportBatchedDGramSocket *self)
+{
+  gint i, rc;
+
+  for (i = 0; i < self->batch_size; i++)
+    self->msgs[i].msg_hdr.msg_namelen = sizeof(self->addrs[i]);
+
+  do
+    {
+      rc = recvmmsg(self->super.super.fd, self->msgs, self->batch_size, 0, NULL);
+    }
+  while (rc == -1 && errno == EINTR);
+
+  self->current = 0;
+  self->num_received = MAX(rc, 0);
+  return rc;
+}
+
+static GSockAddr *
+log_transport_batched_dgram_socket_get_peer_addr(LogTransportBatchedDGramSocket *self, struct sockaddr *sa, socklen_t salen)
+{
+  GSockAddr *peer_addr = self->last_peer_addr;
+
+  if (!peer_addr || peer_addr->salen != salen || memcmp(g_sockaddr_get_sa(peer_addr), sa, salen) != 0)
+    {
+      g_sockaddr_unref(peer_addr);
+      peer_addr = self->last_peer_addr = g_sockaddr_new(sa, salen);
+    }
+  return g_sockaddr_ref(peer_addr);
+}
+
+static gssize
+log_transport_batched_dgram_socket_read_method(LogTransport *s, gpointer buf, gsize buflen, LogTransportAuxData *aux)
+{
+  LogTransportBatchedDGramSocket *self = (LogTransportBatchedDGramSocket *) s;
+  struct mmsghdr *msg;
+  gsize len;
+
+  if (!self->buffers)
+    log_transport_batched_dgram_socket_alloc_buffers(self, buflen);
+
+  do
+    {
+      if (self->current >= self->num_received)
+        {
+          gint rc = log_transport_batched_dgram_socket_receive_batch(self);
+
+          if (rc < 0)
+            return rc;
+          if (rc == 0)
+            {
+              errno = EAGAIN;
+              return -1;
+            }
+        }
+      msg = &self->msgs[self->current++];
+    }
+  /* DGRAM sockets should never return EOF, skip empty datagrams */
+  while (msg->msg_len == 0);
+
+  /* the datagram is truncated, just like recvfrom() would do */
+  len = MIN(msg->msg_len, buflen);
+  memcpy(buf, msg->msg_hdr.msg_iov->iov_base, len);
+
+  if (msg->msg_hdr.msg_namelen && aux)
+    log_transport_aux_data_set_peer_addr_ref(aux,
+                                             log_transport_batched_dgram_socket_get_peer_addr(self, (struct sockaddr *) msg->msg_hdr.msg_name,
+                                                 msg->msg_hdr.msg_namelen));
+  return len;
+}
+
+static gboolean
+log_transport_batched_dgram_socket_has_pending_data(LogTransport *s)
+{
+  LogTransportBatchedDGramSocket *self = (LogTransportBatchedDGramSocket *) s;
+
+  return self->current < self->num_received;
+}
+
+static void
+log_transport_batched_dgram_socket_free_method(LogTransport *s)
+{
+  LogTransportBatchedDGramSocket *self = (LogTransportBatchedDGramSocket *) s;
+
+  g_sockaddr_unref(self->last_peer_addr);
+  g_free(self->buffers);
+  g_free(self->msgs);
+  g_free(self->iov);
+  g_free(self->addrs);
+  log_transport_free_method(s);
+}
+
+LogTransport *
+log_transport_batched_dgram_socket_new(gint fd, gint batch_size)
+{
+  LogTransportBatchedDGramSocket *self;
+
+  if (batch_size <= 1)
+    return log_transport_dgram_socket_new(fd);
+
+  self = g_new0(LogTransportBatchedDGramSocket, 1);
+  log_transport_dgram_socket_init_instance(&self->super, fd);
+  self->super.super.read = log_transport_batched_dgram_socket_read_method;
+  self->super.super.has_pending_data = log_transport_batched_dgram_socket_has_pending_data;
+  self->super.super.free_fn = log_transport_batched_dgram_socket_free_method;
+  self->batch_size = batch_size;
+  return &self->super.super;
+}
+
+#else
+
+LogTransport *
+log_transport_batched_dgram_socket_new(gint fd, gint batch_size)
+{
+  return log_transport_dgram_socket_new(fd);
+}
+
+#endif
+
 static gssize
 log_transport_stream_socket_read_method(LogTransport *s, gpointer buf, gsize buflen, LogTransportAuxData *aux)
 {
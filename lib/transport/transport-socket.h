@@ -35,6 +35,7 @@ struct _LogTransportSocket
 
 void log_transport_dgram_socket_init_instance(LogTransportSocket *self, gint fd);
 LogTransport *log_transport_dgram_socket_new(gint fd);
+LogTransport *log_transport_batched_dgram_socket_new(gint fd, gint batch_size);
 
 void log_transport_stream_socket_init_instance(LogTransportSocket *self, gint fd);
 LogTransport *log_transport_stream_socket_new(gint fd);
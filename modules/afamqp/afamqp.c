@@ -449,7 +449,7 @@ afamqp_worker_publish(AMQPDestDriver *self, LogMessage *msg)
   gpointer user_data[] = { &self->entries, &pos, &self->max_entries };
 
   value_pairs_foreach(self->vp, afamqp_vp_foreach, msg,
-                      self->super.seq_num,
+                      log_threaded_dest_driver_get_seq_num(&self->super),
                       LTZ_SEND, &self->template_options, user_data);
 
   table.num_entries = pos;
@@ -462,13 +462,13 @@ afamqp_worker_publish(AMQPDestDriver *self, LogMessage *msg)
   props.headers = table;
 
   log_template_format(self->routing_key_template, msg, NULL, LTZ_LOCAL,
-                      self->super.seq_num,
+                      log_threaded_dest_driver_get_seq_num(&self->super),
                       NULL, sb_gstring_string(routing_key));
 
   if (self->body_template)
     {
       log_template_format(self->body_template, msg, NULL, LTZ_LOCAL,
-                          self->super.seq_num,
+                          log_threaded_dest_driver_get_seq_num(&self->super),
                           NULL, sb_gstring_string(body));
       body_bytes = amqp_cstring_bytes(sb_gstring_string(body)->str);
     }
@@ -34,6 +34,10 @@
 #include <time.h>
 #include <stdlib.h>
 
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+
 static const gchar* spurious_paths[] = {"../", "/..", NULL};
 
 static inline gboolean
@@ -169,3 +173,34 @@ affile_open_file(gchar *name, FileOpenOptions *open_opts, FilePermOptions *perm_
 
   return (*fd != -1);
 }
+
+#define NFS_SUPER_MAGIC  0x6969
+#define SMB_SUPER_MAGIC  0x517B
+#define CIFS_SUPER_MAGIC 0xFF534D42
+#define SMB2_SUPER_MAGIC 0xFE534D42
+
+/* changes made by other hosts on network filesystems are not reported
+ * via inotify, files and directories there have to be polled */
+gboolean
+affile_is_on_network_fs(gint fd)
+{
+#ifdef __linux__
+  struct statfs sfs;
+
+  if (fstatfs(fd, &sfs) < 0)
+    return TRUE;
+
+  switch ((guint32) sfs.f_type)
+    {
+    case NFS_SUPER_MAGIC:
+    case SMB_SUPER_MAGIC:
+    case CIFS_SUPER_MAGIC:
+    case SMB2_SUPER_MAGIC:
+      return TRUE;
+    default:
+      return FALSE;
+    }
+#else
+  return FALSE;
+#endif
+}
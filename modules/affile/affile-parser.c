@@ -42,6 +42,13 @@ static CfgLexerKeyword affile_keywords[] = {
   { "multi_line_prefix",  KW_MULTI_LINE_PREFIX, 0x0305 },
   { "multi_line_garbage", KW_MULTI_LINE_GARBAGE, 0x0305 },
   { "multi_line_suffix",  KW_MULTI_LINE_GARBAGE, 0x0306 },
+
+  { "wildcard_file",      KW_WILDCARD_FILE },
+  { "base_dir",           KW_BASE_DIR },
+  { "filename_pattern",   KW_FILENAME_PATTERN },
+  { "recursive",          KW_RECURSIVE },
+  { "max_files",          KW_MAX_FILES },
+  { "idle_timeout",       KW_IDLE_TIMEOUT },
   { NULL }
 };
 
@@ -29,6 +29,8 @@
 #include "logproto/logproto-regexp-multiline-server.h"
 #include "affile-common.h"
 
+#define DEFAULT_SD_OPEN_FLAGS (O_RDONLY | O_NOCTTY | O_NONBLOCK | O_LARGEFILE)
+#define DEFAULT_SD_OPEN_FLAGS_PIPE (O_RDWR | O_NOCTTY | O_NONBLOCK | O_LARGEFILE)
 
 enum
 {
@@ -50,15 +52,23 @@ typedef struct _AFFileSourceDriver
   gint follow_freq;
   gint multi_line_mode;
   MultiLineRegexp *multi_line_prefix, *multi_line_garbage;
-  /* state information to follow a set of files using a wildcard expression */
 } AFFileSourceDriver;
 
 LogDriver *affile_sd_new(gchar *filename, GlobalConfig *cfg);
 LogDriver *afpipe_sd_new(gchar *filename, GlobalConfig *cfg);
 
+void affile_sd_init_instance(AFFileSourceDriver *self, gchar *filename, GlobalConfig *cfg);
+void affile_sd_free(LogPipe *s);
+
+gboolean affile_sd_open_file(AFFileSourceDriver *self, gchar *name, gint *fd);
+PollEvents *affile_sd_construct_poll_events(AFFileSourceDriver *self, const gchar *filename, gint fd, LogPipe *control);
+LogProtoServer *affile_sd_construct_proto(AFFileSourceDriver *self, const gchar *filename, gint fd);
+void affile_sd_recover_state(AFFileSourceDriver *self, const gchar *filename, GlobalConfig *cfg, LogProtoServer *proto);
+
 gboolean affile_sd_set_multi_line_prefix(LogDriver *s, const gchar *prefix_regexp, GError **error);
 gboolean affile_sd_set_multi_line_garbage(LogDriver *s, const gchar *garbage_regexp, GError **error);
 gboolean affile_sd_set_multi_line_mode(LogDriver *s, const gchar *mode);
+gboolean affile_sd_check_multi_line_options(AFFileSourceDriver *self);
 void affile_sd_set_follow_freq(LogDriver *s, gint follow_freq);
 
 void affile_sd_set_recursion(LogDriver *s, const gint recursion);
@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2002-2014 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2013 Balázs Scheidler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#include "directory-monitor.h"
+#include "affile-common.h"
+#include "messages.h"
+#include "timeutils.h"
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <iv.h>
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+/*
+ * DirectoryMonitor
+ *
+ * Reports files appearing, changing and disappearing in a set of
+ * directories. On Linux the directories are watched using a single
+ * inotify instance, directories that cannot be watched that way (network
+ * filesystems, or running out of fs.inotify.max_user_watches) make the
+ * monitor request a complete rescan every rescan_freq milliseconds, until
+ * each of them could be watched.
+ */
+struct _DirectoryMonitor
+{
+  gint rescan_freq;
+  DirectoryMonitorCallback callback;
+  gpointer user_data;
+  struct iv_timer rescan_timer;
+  gboolean started;
+  /* directories that are not watched using inotify, e.g. because they do
+   * not exist yet, the rescan timer runs while there is any */
+  GHashTable *unwatched_dirs;
+#ifdef HAVE_SYS_INOTIFY_H
+  gint inotify_fd;
+  struct iv_fd inotify_watch;
+  /* watch descriptor -> directory name */
+  GHashTable *directories;
+#endif
+};
+
+static void
+directory_monitor_start_rescan_timer(DirectoryMonitor *self)
+{
+  if (!self->started || g_hash_table_size(self->unwatched_dirs) == 0 || iv_timer_registered(&self->rescan_timer))
+    return;
+
+  iv_validate_now();
+  self->rescan_timer.expires = iv_now;
+  timespec_add_msec(&self->rescan_timer.expires, self->rescan_freq);
+  iv_timer_register(&self->rescan_timer);
+}
+
+static void
+directory_monitor_rescan(gpointer s)
+{
+  DirectoryMonitor *self = (DirectoryMonitor *) s;
+
+  /* the rescan adds every directory that still exists again */
+  g_hash_table_remove_all(self->unwatched_dirs);
+  self->callback(NULL, NULL, DM_RESCAN, self->user_data);
+  directory_monitor_start_rescan_timer(self);
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+#define DIRECTORY_MONITOR_INOTIFY_MASK (IN_CREATE | IN_MOVED_TO | IN_MODIFY | IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+static void
+directory_monitor_process_event(DirectoryMonitor *self, const struct inotify_event *event)
+{
+  const gchar *dir;
+
+  if (event->mask & IN_Q_OVERFLOW)
+    {
+      msg_notice("inotify event queue overflowed, rescanning monitored directories",
+                 NULL);
+      self->callback(NULL, NULL, DM_RESCAN, self->user_data);
+      return;
+    }
+
+  dir = g_hash_table_lookup(self->directories, GINT_TO_POINTER(event->wd));
+  if (!dir)
+    return;
+
+  if (event->mask & IN_IGNORED)
+    {
+      /* the directory is gone, the kernel has removed the watch */
+      g_hash_table_remove(self->directories, GINT_TO_POINTER(event->wd));
+      return;
+    }
+  if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+    {
+      inotify_rm_watch(self->inotify_fd, event->wd);
+      return;
+    }
+  if (event->len == 0)
+    return;
+
+  if (event->mask & IN_ISDIR)
+    {
+      if (event->mask & (IN_CREATE | IN_MOVED_TO))
+        self->callback(dir, event->name, DM_DIRECTORY_CREATED, self->user_data);
+    }
+  else if (event->mask & (IN_CREATE | IN_MOVED_TO))
+    self->callback(dir, event->name, DM_FILE_CREATED, self->user_data);
+  else if (event->mask & IN_MODIFY)
+    self->callback(dir, event->name, DM_FILE_CHANGED, self->user_data);
+  else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+    self->callback(dir, event->name, DM_FILE_DELETED, self->user_data);
+}
+
+static void
+directory_monitor_read_events(gpointer s)
+{
+  DirectoryMonitor *self = (DirectoryMonitor *) s;
+  gchar buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  const struct inotify_event *event;
+  const gchar *p;
+  gssize len;
+
+  while ((len = read(self->inotify_fd, buf, sizeof(buf))) > 0)
+    {
+      for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + event->len)
+        {
+          event = (const struct inotify_event *) p;
+          directory_monitor_process_event(self, event);
+        }
+    }
+  if (len < 0 && errno != EAGAIN && errno != EINTR)
+    msg_error("Error reading inotify events",
+              evt_tag_errno("error", errno),
+              NULL);
+}
+
+static gboolean
+directory_monitor_is_on_network_fs(const gchar *dir)
+{
+  gboolean result;
+  gint fd;
+
+  fd = open(dir, O_RDONLY | O_DIRECTORY);
+  if (fd < 0)
+    return TRUE;
+  result = affile_is_on_network_fs(fd);
+  close(fd);
+  return result;
+}
+
+static gboolean
+directory_monitor_inotify_add_directory(DirectoryMonitor *self, const gchar *dir)
+{
+  gint wd;
+
+  if (self->inotify_fd < 0 || directory_monitor_is_on_network_fs(dir))
+    return FALSE;
+
+  wd = inotify_add_watch(self->inotify_fd, dir, DIRECTORY_MONITOR_INOTIFY_MASK);
+  if (wd < 0)
+    {
+      msg_warning("Unable to watch directory using inotify, falling back to rescanning it periodically",
+                  evt_tag_str("dir", dir),
+                  evt_tag_errno("error", errno),
+                  NULL);
+      return FALSE;
+    }
+  g_hash_table_insert(self->directories, GINT_TO_POINTER(wd), g_strdup(dir));
+  return TRUE;
+}
+
+static void
+directory_monitor_inotify_init(DirectoryMonitor *self)
+{
+  self->directories = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+  self->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (self->inotify_fd < 0)
+    {
+      msg_debug("inotify is not available, falling back to rescanning directories periodically",
+                evt_tag_errno("error", errno),
+                NULL);
+      return;
+    }
+  IV_FD_INIT(&self->inotify_watch);
+  self->inotify_watch.fd = self->inotify_fd;
+  self->inotify_watch.cookie = self;
+  self->inotify_watch.handler_in = directory_monitor_read_events;
+}
+
+static void
+directory_monitor_inotify_start(DirectoryMonitor *self)
+{
+  if (self->inotify_fd >= 0)
+    iv_fd_register(&self->inotify_watch);
+}
+
+static void
+directory_monitor_inotify_stop(DirectoryMonitor *self)
+{
+  if (self->inotify_fd >= 0)
+    iv_fd_unregister(&self->inotify_watch);
+}
+
+static void
+directory_monitor_inotify_free(DirectoryMonitor *self)
+{
+  if (self->inotify_fd >= 0)
+    close(self->inotify_fd);
+  g_hash_table_destroy(self->directories);
+}
+
+#else
+
+static gboolean
+directory_monitor_inotify_add_directory(DirectoryMonitor *self, const gchar *dir)
+{
+  return FALSE;
+}
+
+static void
+directory_monitor_inotify_init(DirectoryMonitor *self)
+{
+}
+
+static void
+directory_monitor_inotify_start(DirectoryMonitor *self)
+{
+}
+
+static void
+directory_monitor_inotify_stop(DirectoryMonitor *self)
+{
+}
+
+static void
+directory_monitor_inotify_free(DirectoryMonitor *self)
+{
+}
+
+#endif
+
+/* returns FALSE if changes in the directory are only noticed by the
+ * periodic rescan */
+gboolean
+directory_monitor_add_directory(DirectoryMonitor *self, const gchar *dir)
+{
+  if (directory_monitor_inotify_add_directory(self, dir))
+    {
+      g_hash_table_remove(self->unwatched_dirs, dir);
+      return TRUE;
+    }
+
+  g_hash_table_insert(self->unwatched_dirs, g_strdup(dir), GINT_TO_POINTER(TRUE));
+  directory_monitor_start_rescan_timer(self);
+  return FALSE;
+}
+
+void
+directory_monitor_start(DirectoryMonitor *self)
+{
+  self->started = TRUE;
+  directory_monitor_inotify_start(self);
+  directory_monitor_start_rescan_timer(self);
+}
+
+void
+directory_monitor_stop(DirectoryMonitor *self)
+{
+  if (!self->started)
+    return;
+
+  if (iv_timer_registered(&self->rescan_timer))
+    iv_timer_unregister(&self->rescan_timer);
+  directory_monitor_inotify_stop(self);
+  self->started = FALSE;
+}
+
+DirectoryMonitor *
+directory_monitor_new(gint rescan_freq, DirectoryMonitorCallback callback, gpointer user_data)
+{
+  DirectoryMonitor *self = g_new0(DirectoryMonitor, 1);
+
+  self->rescan_freq = rescan_freq;
+  self->callback = callback;
+  self->user_data = user_data;
+
+  IV_TIMER_INIT(&self->rescan_timer);
+  self->rescan_timer.cookie = self;
+  self->rescan_timer.handler = directory_monitor_rescan;
+  self->unwatched_dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  directory_monitor_inotify_init(self);
+  return self;
+}
+
+void
+directory_monitor_free(DirectoryMonitor *self)
+{
+  directory_monitor_stop(self);
+  directory_monitor_inotify_free(self);
+  g_hash_table_destroy(self->unwatched_dirs);
+  g_free(self);
+}
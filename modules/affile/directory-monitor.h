@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2002-2014 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2013 Balázs Scheidler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#ifndef DIRECTORY_MONITOR_H_INCLUDED
+#define DIRECTORY_MONITOR_H_INCLUDED
+
+#include "syslog-ng.h"
+
+typedef enum
+{
+  /* a file was created or moved into a watched directory */
+  DM_FILE_CREATED,
+  /* a file in a watched directory was written to */
+  DM_FILE_CHANGED,
+  /* a file was removed or moved out of a watched directory */
+  DM_FILE_DELETED,
+  /* a subdirectory was created or moved into a watched directory */
+  DM_DIRECTORY_CREATED,
+  /* events may have been lost, the whole tree needs to be scanned again */
+  DM_RESCAN,
+} DirectoryMonitorEvent;
+
+typedef void (*DirectoryMonitorCallback)(const gchar *dir, const gchar *name, DirectoryMonitorEvent event, gpointer user_data);
+
+typedef struct _DirectoryMonitor DirectoryMonitor;
+
+gboolean directory_monitor_add_directory(DirectoryMonitor *self, const gchar *dir);
+void directory_monitor_start(DirectoryMonitor *self);
+void directory_monitor_stop(DirectoryMonitor *self);
+DirectoryMonitor *directory_monitor_new(gint rescan_freq, DirectoryMonitorCallback callback, gpointer user_data);
+void directory_monitor_free(DirectoryMonitor *self);
+
+#endif
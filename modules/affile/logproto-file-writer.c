@@ -34,7 +34,6 @@ typedef struct _LogProtoFileWriter
   gsize partial_len, partial_pos;
   gint buf_size;
   gint buf_count;
-  gint fd;
   gint sum_len;
   gboolean fsync;
   struct iovec buffer[0];
@@ -59,9 +58,7 @@ log_proto_file_writer_flush(LogProtoClient *s)
   if (self->buf_count == 0)
     return LPS_SUCCESS;
 
-  rc = writev(self->fd, self->buffer, self->buf_count);
-  if (rc > 0 && self->fsync)
-    fsync(self->fd);
+  rc = log_transport_writev(self->super.transport, self->buffer, self->buf_count, self->fsync);
 
   if (rc < 0)
     {
@@ -146,10 +143,9 @@ log_proto_file_writer_post(LogProtoClient *s, guchar *msg, gsize msg_len, gboole
     {
       /* there is still some data from the previous file writing process */
       gint len = self->partial_len - self->partial_pos;
+      struct iovec iov = { self->partial + self->partial_pos, len };
 
-      rc = write(self->fd, self->partial + self->partial_pos, len);
-      if (rc > 0 && self->fsync)
-        fsync(self->fd);
+      rc = log_transport_writev(self->super.transport, &iov, 1, self->fsync);
       if (rc < 0)
         {
           goto write_error;
@@ -229,7 +225,6 @@ log_proto_file_writer_new(LogTransport *transport, const LogProtoClientOptions *
   LogProtoFileWriter *self = (LogProtoFileWriter *)g_malloc0(sizeof(LogProtoFileWriter) + sizeof(struct iovec)*flush_lines);
 
   log_proto_client_init(&self->super, transport, options);
-  self->fd = transport->fd;
   self->buf_size = flush_lines;
   self->fsync = fsync;
   self->super.prepare = log_proto_file_writer_prepare;
@@ -21,6 +21,7 @@
  *
  */
 #include "poll-file-changes.h"
+#include "affile-common.h"
 #include "logpipe.h"
 
 #include <sys/types.h>
@@ -36,7 +37,19 @@
 #include <iv.h>
 #include <iv_work.h>
 
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 
+/*
+ * PollFileChanges
+ *
+ * Checks whether a followed file has grown, got truncated or was moved
+ * away. On Linux the file is watched using inotify and it is only checked
+ * when the kernel reports a change, otherwise (and on filesystems where
+ * inotify does not see remote changes) it is checked every follow_freq
+ * milliseconds.
+ */
 typedef struct _PollFileChanges
 {
   PollEvents super;
@@ -45,8 +58,258 @@ typedef struct _PollFileChanges
   gint follow_freq;
   struct iv_timer follow_timer;
   LogPipe *control;
+
+  /* inotify watch descriptor, -1 if the file is polled using follow_timer */
+  gint inotify_wd;
+  /* the LogReader is waiting for input */
+  gboolean armed;
+  /* the file may have changed since it was last checked */
+  gboolean changed;
 } PollFileChanges;
 
+static void poll_file_changes_schedule_check(PollFileChanges *self);
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+/* all followed files share a single inotify instance, as the number of
+ * those is limited per user (fs.inotify.max_user_instances) */
+static struct
+{
+  gint fd;
+  struct iv_fd fd_watch;
+  /* watch descriptor -> GList of PollFileChanges, as the same file may be
+   * followed by multiple sources */
+  GHashTable *watchers;
+  /* events are being dispatched, the instance must not be freed */
+  gboolean dispatching;
+} inotify_monitor = { .fd = -1 };
+
+#define POLL_FILE_CHANGES_INOTIFY_MASK (IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+
+static void poll_file_changes_inotify_stop(PollFileChanges *self, gboolean remove_watch);
+static void poll_file_changes_inotify_monitor_unref(void);
+
+static void
+poll_file_changes_inotify_mark_changed(PollFileChanges *self)
+{
+  self->changed = TRUE;
+  if (self->armed && !iv_timer_registered(&self->follow_timer))
+    poll_file_changes_schedule_check(self);
+}
+
+static void
+poll_file_changes_inotify_process_event(PollFileChanges *self, const struct inotify_event *event)
+{
+  struct stat st;
+
+  msg_trace("inotify event on followed file",
+            evt_tag_str("follow_filename", self->follow_filename),
+            evt_tag_printf("mask", "0x%x", event->mask),
+            NULL);
+
+  if (event->mask & IN_IGNORED)
+    {
+      /* the kernel has removed the watch */
+      poll_file_changes_inotify_stop(self, FALSE);
+    }
+  else if ((event->mask & (IN_MOVE_SELF | IN_DELETE_SELF)) ||
+           ((event->mask & IN_ATTRIB) && fstat(self->fd, &st) == 0 && st.st_nlink == 0))
+    {
+      /* the file was moved away or deleted, no further events are
+       * reported once it is recreated, so look for that using the timer */
+      poll_file_changes_inotify_stop(self, TRUE);
+    }
+
+  poll_file_changes_inotify_mark_changed(self);
+}
+
+/* events may have been lost, including the one about the file being
+ * moved away or deleted, so check the file itself */
+static void
+poll_file_changes_inotify_process_overflow(PollFileChanges *self)
+{
+  struct stat st, followed_st;
+
+  if (fstat(self->fd, &st) < 0 || st.st_nlink == 0 ||
+      !self->follow_filename || stat(self->follow_filename, &followed_st) < 0 ||
+      st.st_ino != followed_st.st_ino || st.st_dev != followed_st.st_dev)
+    poll_file_changes_inotify_stop(self, TRUE);
+
+  poll_file_changes_inotify_mark_changed(self);
+}
+
+static void
+poll_file_changes_inotify_collect_watchers(gpointer key, gpointer value, gpointer user_data)
+{
+  GList **all_watchers = (GList **) user_data;
+
+  *all_watchers = g_list_concat(*all_watchers, g_list_copy((GList *) value));
+}
+
+static void
+poll_file_changes_inotify_overflow(void)
+{
+  GList *all_watchers = NULL, *l;
+
+  msg_notice("inotify event queue overflowed, checking all followed files",
+             NULL);
+
+  /* processing the overflow may remove watchers from the hash table */
+  g_hash_table_foreach(inotify_monitor.watchers, poll_file_changes_inotify_collect_watchers, &all_watchers);
+  for (l = all_watchers; l; l = l->next)
+    poll_file_changes_inotify_process_overflow((PollFileChanges *) l->data);
+  g_list_free(all_watchers);
+}
+
+static void
+poll_file_changes_inotify_read_events(gpointer s)
+{
+  gchar buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  const struct inotify_event *event;
+  gssize len;
+  gchar *p;
+
+  inotify_monitor.dispatching = TRUE;
+  while ((len = read(inotify_monitor.fd, buf, sizeof(buf))) > 0)
+    {
+      for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + event->len)
+        {
+          GList *watchers, *l, *next;
+
+          event = (const struct inotify_event *) p;
+          if (event->mask & IN_Q_OVERFLOW)
+            {
+              poll_file_changes_inotify_overflow();
+              continue;
+            }
+
+          watchers = g_hash_table_lookup(inotify_monitor.watchers, GINT_TO_POINTER(event->wd));
+
+          /* processing an event may remove the watcher from the list */
+          for (l = watchers; l; l = next)
+            {
+              next = l->next;
+              poll_file_changes_inotify_process_event((PollFileChanges *) l->data, event);
+            }
+        }
+    }
+  if (len < 0 && errno != EAGAIN && errno != EINTR)
+    msg_error("Error reading inotify events",
+              evt_tag_errno("error", errno),
+              NULL);
+  inotify_monitor.dispatching = FALSE;
+
+  /* the last watcher may have been removed while processing the events */
+  poll_file_changes_inotify_monitor_unref();
+}
+
+static gboolean
+poll_file_changes_inotify_monitor_ref(void)
+{
+  if (inotify_monitor.fd >= 0)
+    return TRUE;
+
+  inotify_monitor.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_monitor.fd < 0)
+    {
+      msg_debug("inotify is not available, falling back to polling followed files",
+                evt_tag_errno("error", errno),
+                NULL);
+      return FALSE;
+    }
+
+  inotify_monitor.watchers = g_hash_table_new(g_direct_hash, g_direct_equal);
+  IV_FD_INIT(&inotify_monitor.fd_watch);
+  inotify_monitor.fd_watch.fd = inotify_monitor.fd;
+  inotify_monitor.fd_watch.handler_in = poll_file_changes_inotify_read_events;
+  iv_fd_register(&inotify_monitor.fd_watch);
+  return TRUE;
+}
+
+static void
+poll_file_changes_inotify_monitor_unref(void)
+{
+  if (inotify_monitor.dispatching || g_hash_table_size(inotify_monitor.watchers) > 0)
+    return;
+
+  iv_fd_unregister(&inotify_monitor.fd_watch);
+  close(inotify_monitor.fd);
+  inotify_monitor.fd = -1;
+  g_hash_table_destroy(inotify_monitor.watchers);
+  inotify_monitor.watchers = NULL;
+}
+
+static gboolean
+poll_file_changes_inotify_start(PollFileChanges *self)
+{
+  gchar path[64];
+  GList *watchers;
+  gint wd;
+
+  if (self->fd < 0 || affile_is_on_network_fs(self->fd))
+    return FALSE;
+
+  if (!poll_file_changes_inotify_monitor_ref())
+    return FALSE;
+
+  /* watch the file we have opened, not whatever is at follow_filename by now */
+  g_snprintf(path, sizeof(path), "/proc/self/fd/%d", self->fd);
+  wd = inotify_add_watch(inotify_monitor.fd, path, POLL_FILE_CHANGES_INOTIFY_MASK);
+  if (wd < 0)
+    {
+      msg_debug("Unable to watch followed file using inotify, falling back to polling",
+                evt_tag_str("follow_filename", self->follow_filename),
+                evt_tag_errno("error", errno),
+                NULL);
+      poll_file_changes_inotify_monitor_unref();
+      return FALSE;
+    }
+
+  watchers = g_hash_table_lookup(inotify_monitor.watchers, GINT_TO_POINTER(wd));
+  g_hash_table_insert(inotify_monitor.watchers, GINT_TO_POINTER(wd), g_list_prepend(watchers, self));
+  self->inotify_wd = wd;
+  return TRUE;
+}
+
+static void
+poll_file_changes_inotify_stop(PollFileChanges *self, gboolean remove_watch)
+{
+  GList *watchers;
+
+  if (self->inotify_wd < 0)
+    return;
+
+  watchers = g_hash_table_lookup(inotify_monitor.watchers, GINT_TO_POINTER(self->inotify_wd));
+  watchers = g_list_remove(watchers, self);
+  if (watchers)
+    {
+      g_hash_table_insert(inotify_monitor.watchers, GINT_TO_POINTER(self->inotify_wd), watchers);
+    }
+  else
+    {
+      g_hash_table_remove(inotify_monitor.watchers, GINT_TO_POINTER(self->inotify_wd));
+      if (remove_watch)
+        inotify_rm_watch(inotify_monitor.fd, self->inotify_wd);
+    }
+  self->inotify_wd = -1;
+  poll_file_changes_inotify_monitor_unref();
+}
+
+#else
+
+static gboolean
+poll_file_changes_inotify_start(PollFileChanges *self)
+{
+  return FALSE;
+}
+
+static void
+poll_file_changes_inotify_stop(PollFileChanges *self, gboolean remove_watch)
+{
+}
+
+#endif
+
 /* follow timer callback. Check if the file has new content, or deleted or
  * moved.  Ran every follow_freq seconds.  */
 static void
@@ -151,6 +414,7 @@ poll_file_changes_stop_watches(PollEvents *s)
 
   if (iv_timer_registered(&self->follow_timer))
     iv_timer_unregister(&self->follow_timer);
+  self->armed = FALSE;
 }
 
 static void
@@ -162,6 +426,16 @@ poll_file_changes_rearm_timer(PollFileChanges *self)
   iv_timer_register(&self->follow_timer);
 }
 
+/* check the file as soon as we get back to the main loop */
+static void
+poll_file_changes_schedule_check(PollFileChanges *self)
+{
+  iv_validate_now();
+  self->changed = FALSE;
+  self->follow_timer.expires = iv_now;
+  iv_timer_register(&self->follow_timer);
+}
+
 static void
 poll_file_changes_update_watches(PollEvents *s, GIOCondition cond)
 {
@@ -172,8 +446,14 @@ poll_file_changes_update_watches(PollEvents *s, GIOCondition cond)
 
   poll_file_changes_stop_watches(s);
 
-  if (cond & G_IO_IN)
+  if ((cond & G_IO_IN) == 0)
+    return;
+
+  self->armed = TRUE;
+  if (self->inotify_wd < 0)
     poll_file_changes_rearm_timer(self);
+  else if (self->changed)
+    poll_file_changes_schedule_check(self);
 }
 
 static void
@@ -181,6 +461,7 @@ poll_file_changes_free(PollEvents *s)
 {
   PollFileChanges *self = (PollFileChanges *) s;
 
+  poll_file_changes_inotify_stop(self, TRUE);
   log_pipe_unref(self->control);
   g_free(self->follow_filename);
 }
@@ -203,5 +484,10 @@ poll_file_changes_new(gint fd, const gchar *follow_filename, gint follow_freq, L
   self->follow_timer.cookie = self;
   self->follow_timer.handler = poll_file_changes_check_file;
 
+  /* the file may already have unread content */
+  self->changed = TRUE;
+  self->inotify_wd = -1;
+  poll_file_changes_inotify_start(self);
+
   return &self->super;
 }
@@ -0,0 +1,262 @@
+#include "testutils.h"
+#include "affile/poll-file-changes.h"
+#include "logpipe.h"
+#include "apphook.h"
+#include "timeutils.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <iv.h>
+
+#define POLL_FILE_CHANGES_TESTCASE(testfunc, ...) { testcase_begin("%s(%s)", #testfunc, #__VA_ARGS__); testfunc(__VA_ARGS__); testcase_end(); }
+
+#define TEST_FILE "test_poll_file_changes.log"
+#define NOISE_FILE "test_poll_file_changes_noise.log"
+/* long enough not to expire during the test, only inotify can report the change */
+#define NEVER_FREQ 600000
+
+typedef struct _TestControl
+{
+  LogPipe super;
+  gint eof_count;
+  gint moved_count;
+  gint callback_count;
+} TestControl;
+
+static TestControl control;
+static PollEvents *poll_events;
+
+static void
+test_control_notify(LogPipe *s, gint notify_code, gpointer user_data)
+{
+  TestControl *self = (TestControl *) s;
+
+  if (notify_code == NC_FILE_EOF)
+    self->eof_count++;
+  else if (notify_code == NC_FILE_MOVED)
+    {
+      self->moved_count++;
+      iv_quit();
+    }
+}
+
+/* the input is "read" by stopping the watches, as LogReader does */
+static void
+test_poll_callback(gpointer user_data)
+{
+  control.callback_count++;
+  poll_events_stop_watches(poll_events);
+  iv_quit();
+}
+
+static void
+quit_main_loop(gpointer user_data)
+{
+  iv_quit();
+}
+
+/* runs the main loop until an event quits it or @timeout_msec passes */
+static void
+run_main_loop(gint timeout_msec)
+{
+  struct iv_timer guard;
+
+  IV_TIMER_INIT(&guard);
+  guard.handler = quit_main_loop;
+  iv_validate_now();
+  guard.expires = iv_now;
+  timespec_add_msec(&guard.expires, timeout_msec);
+  iv_timer_register(&guard);
+
+  iv_main();
+
+  if (iv_timer_registered(&guard))
+    iv_timer_unregister(&guard);
+}
+
+static void
+append_to_file(const gchar *data)
+{
+  FILE *f = fopen(TEST_FILE, "a");
+
+  fputs(data, f);
+  fclose(f);
+}
+
+static gint
+open_test_file(void)
+{
+  unlink(TEST_FILE);
+  append_to_file("");
+  return open(TEST_FILE, O_RDONLY | O_NONBLOCK);
+}
+
+static void
+start_following(gint fd, gint follow_freq)
+{
+  memset(&control, 0, sizeof(control));
+  log_pipe_init_instance(&control.super, NULL);
+  control.super.notify = test_control_notify;
+
+  poll_events = poll_file_changes_new(fd, TEST_FILE, follow_freq, &control.super);
+  poll_events_set_callback(poll_events, test_poll_callback, NULL);
+  poll_events_update_watches(poll_events, G_IO_IN);
+}
+
+static void
+stop_following(gint fd)
+{
+  poll_events_stop_watches(poll_events);
+  poll_events_free(poll_events);
+  poll_events = NULL;
+  if (fd >= 0)
+    close(fd);
+  unlink(TEST_FILE);
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+static void
+test_armed_reader_is_woken_up_by_inotify(void)
+{
+  gint fd = open_test_file();
+
+  start_following(fd, NEVER_FREQ);
+  run_main_loop(200);
+  assert_gint(control.eof_count, 1, "The initial check should have reached EOF");
+  assert_gint(control.callback_count, 0, "No input was expected on an empty file");
+
+  append_to_file("new line\n");
+  run_main_loop(5000);
+  assert_gint(control.callback_count, 1, "The change of the file was not reported to the armed reader");
+
+  stop_following(fd);
+}
+
+static void
+test_change_while_disarmed_is_checked_on_rearm(void)
+{
+  gint fd = open_test_file();
+
+  start_following(fd, NEVER_FREQ);
+  run_main_loop(200);
+
+  poll_events_stop_watches(poll_events);
+  append_to_file("new line\n");
+  run_main_loop(200);
+  assert_gint(control.callback_count, 0, "The reader was woken up while it was not waiting for input");
+
+  poll_events_update_watches(poll_events, G_IO_IN);
+  run_main_loop(5000);
+  assert_gint(control.callback_count, 1, "The change seen while disarmed was not checked when rearmed");
+
+  stop_following(fd);
+}
+
+static void
+test_deleted_file_falls_back_to_timer(void)
+{
+  gint fd = open_test_file();
+
+  start_following(fd, 10);
+  run_main_loop(200);
+
+  /* no more inotify events are reported for the recreated file */
+  unlink(TEST_FILE);
+  run_main_loop(200);
+  append_to_file("new file\n");
+  run_main_loop(5000);
+  assert_gint(control.moved_count, 1, "The recreated file was not noticed after the followed one was deleted");
+
+  stop_following(fd);
+}
+
+static gint
+read_max_queued_events(void)
+{
+  FILE *f = fopen("/proc/sys/fs/inotify/max_queued_events", "r");
+  gint max_events = -1;
+
+  if (!f)
+    return -1;
+  if (fscanf(f, "%d", &max_events) != 1)
+    max_events = -1;
+  fclose(f);
+  return max_events;
+}
+
+static void
+test_queue_overflow_checks_every_followed_file(void)
+{
+  gint max_events = read_max_queued_events();
+  PollEvents *noise;
+  gint fd, noise_fd, i;
+
+  if (max_events < 0 || max_events > 1024 * 1024)
+    {
+      fprintf(stderr, "Unable to overflow the inotify queue, skipping\n");
+      return;
+    }
+
+  fd = open_test_file();
+  start_following(fd, NEVER_FREQ);
+  run_main_loop(200);
+
+  /* fill the queue with the events of another file, alternating them so
+   * that the kernel cannot merge them */
+  noise_fd = open(NOISE_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  noise = poll_file_changes_new(noise_fd, NOISE_FILE, NEVER_FREQ, &control.super);
+  for (i = 0; i < max_events; i++)
+    {
+      assert_gint(write(noise_fd, "x", 1), 1, "Unable to write the noise file");
+      fchmod(noise_fd, (i & 1) ? 0600 : 0644);
+    }
+
+  /* the event of this change is lost */
+  append_to_file("new line\n");
+  run_main_loop(5000);
+  assert_gint(control.callback_count, 1, "The followed file was not checked after the inotify queue overflowed");
+
+  poll_events_free(noise);
+  close(noise_fd);
+  unlink(NOISE_FILE);
+  stop_following(fd);
+}
+
+#endif
+
+static void
+test_timer_fallback_without_inotify(void)
+{
+  /* without an fd there is nothing to watch with inotify, the file is polled */
+  unlink(TEST_FILE);
+  start_following(-1, 10);
+  run_main_loop(200);
+  assert_gint(control.moved_count, 0, "The followed file does not exist yet");
+
+  append_to_file("new file\n");
+  run_main_loop(5000);
+  assert_gint(control.moved_count, 1, "The polling timer did not notice the created file");
+
+  stop_following(-1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  app_startup();
+
+#ifdef HAVE_SYS_INOTIFY_H
+  POLL_FILE_CHANGES_TESTCASE(test_armed_reader_is_woken_up_by_inotify);
+  POLL_FILE_CHANGES_TESTCASE(test_change_while_disarmed_is_checked_on_rearm);
+  POLL_FILE_CHANGES_TESTCASE(test_deleted_file_falls_back_to_timer);
+  POLL_FILE_CHANGES_TESTCASE(test_queue_overflow_checks_every_followed_file);
+#endif
+  POLL_FILE_CHANGES_TESTCASE(test_timer_fallback_without_inotify);
+
+  app_shutdown();
+  return 0;
+}
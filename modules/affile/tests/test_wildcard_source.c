@@ -0,0 +1,334 @@
+#include "testutils.h"
+#include "affile/wildcard-source.h"
+#include "libtest/persist_lib.h"
+#include "logpipe.h"
+#include "apphook.h"
+#include "plugin.h"
+#include "mainloop.h"
+#include "mainloop-call.h"
+#include "timeutils.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <iv.h>
+
+#define WILDCARD_TESTCASE(testfunc, ...) { testcase_begin("%s(%s)", #testfunc, #__VA_ARGS__); testfunc(__VA_ARGS__); testcase_end(); }
+
+#define TEST_DIR "wildcard_test_dir"
+#define TEST_PERSIST_FILE "test_wildcard_source.persist"
+#define TEST_FOLLOW_FREQ 50
+
+/* receives the messages of the source, counting them per file */
+typedef struct _TestCapture
+{
+  LogPipe super;
+  WildcardSourceDriver *driver;
+  GHashTable *counts;
+  gint total;
+  gint expected;
+  gint open_files_violations;
+} TestCapture;
+
+static TestCapture capture;
+
+static void
+test_capture_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options, gpointer user_data)
+{
+  gchar *name = g_path_get_basename(log_msg_get_value_by_name(msg, "FILE_NAME", NULL));
+
+  g_hash_table_insert(capture.counts, name, GINT_TO_POINTER(GPOINTER_TO_INT(g_hash_table_lookup(capture.counts, name)) + 1));
+  capture.total++;
+  if ((gint) g_queue_get_length(capture.driver->open_readers) > capture.driver->max_files)
+    capture.open_files_violations++;
+
+  log_msg_drop(msg, path_options);
+  if (capture.total >= capture.expected)
+    iv_quit();
+}
+
+static gint
+get_count(const gchar *name)
+{
+  return GPOINTER_TO_INT(g_hash_table_lookup(capture.counts, name));
+}
+
+static void
+quit_main_loop(gpointer user_data)
+{
+  iv_quit();
+}
+
+/* runs the main loop until @expected messages were received or @timeout_msec passes */
+static void
+run_until(gint expected, gint timeout_msec)
+{
+  struct iv_timer guard;
+
+  capture.expected = expected;
+  if (capture.total >= expected)
+    return;
+
+  IV_TIMER_INIT(&guard);
+  guard.handler = quit_main_loop;
+  iv_validate_now();
+  guard.expires = iv_now;
+  timespec_add_msec(&guard.expires, timeout_msec);
+  iv_timer_register(&guard);
+
+  iv_main();
+
+  if (iv_timer_registered(&guard))
+    iv_timer_unregister(&guard);
+}
+
+static void
+run_for(gint msec)
+{
+  run_until(G_MAXINT, msec);
+}
+
+static void
+append_line(const gchar *name, const gchar *line)
+{
+  gchar *path = g_build_filename(TEST_DIR, name, NULL);
+  FILE *f = fopen(path, "a");
+
+  fprintf(f, "%s\n", line);
+  fclose(f);
+  g_free(path);
+}
+
+static void
+remove_test_file(const gchar *name)
+{
+  gchar *path = g_build_filename(TEST_DIR, name, NULL);
+
+  unlink(path);
+  g_free(path);
+}
+
+static void
+remove_test_dir(void)
+{
+  GDir *dir = g_dir_open(TEST_DIR, 0, NULL);
+  const gchar *name;
+
+  if (!dir)
+    return;
+  while ((name = g_dir_read_name(dir)))
+    remove_test_file(name);
+  g_dir_close(dir);
+  rmdir(TEST_DIR);
+}
+
+static WildcardSourceDriver *
+start_source(gint max_files, gint idle_timeout)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) wildcard_sd_new(configuration);
+  LogDriver *driver = &self->super.super.super;
+
+  driver->group = g_strdup("s_wildcard");
+  driver->id = g_strdup("s_wildcard#0");
+  wildcard_sd_set_base_dir(driver, TEST_DIR);
+  wildcard_sd_set_filename_pattern(driver, "*.log");
+  wildcard_sd_set_max_files(driver, max_files);
+  wildcard_sd_set_idle_timeout(driver, idle_timeout);
+  affile_sd_set_follow_freq(driver, TEST_FOLLOW_FREQ);
+  log_pipe_append(&driver->super, &capture.super);
+
+  capture.driver = self;
+  assert_true(log_pipe_init(&driver->super), "Error initializing the wildcard-file() source");
+  return self;
+}
+
+static void
+stop_source(WildcardSourceDriver *self)
+{
+  assert_true(log_pipe_deinit(&self->super.super.super.super), "Error deinitializing the wildcard-file() source");
+  log_pipe_unref(&self->super.super.super.super);
+  capture.driver = NULL;
+}
+
+static void
+setup(void)
+{
+  remove_test_dir();
+  configuration->state = clean_and_create_persist_state_for_test(TEST_PERSIST_FILE);
+
+  log_pipe_init_instance(&capture.super, configuration);
+  capture.super.queue = test_capture_queue;
+  capture.counts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  capture.total = 0;
+  capture.open_files_violations = 0;
+}
+
+static void
+teardown(void)
+{
+  g_hash_table_destroy(capture.counts);
+  cancel_and_destroy_persist_state(configuration->state);
+  configuration->state = NULL;
+  remove_test_dir();
+}
+
+static void
+test_matching_files_are_discovered(void)
+{
+  WildcardSourceDriver *self;
+
+  setup();
+  mkdir(TEST_DIR, 0755);
+  append_line("existing.log", "existing");
+  append_line("ignored.txt", "ignored");
+
+  self = start_source(WILDCARD_SD_DEFAULT_MAX_FILES, WILDCARD_SD_DEFAULT_IDLE_TIMEOUT);
+  run_until(1, 5000);
+
+  append_line("created.log", "created 1");
+  append_line("created.log", "created 2");
+  run_until(3, 5000);
+  run_for(200);
+
+  assert_gint(get_count("existing.log"), 1, "The file existing at startup was not read");
+  assert_gint(get_count("created.log"), 2, "The file created later was not read");
+  assert_gint(get_count("ignored.txt"), 0, "A file not matching the pattern was read");
+  stop_source(self);
+  teardown();
+}
+
+static void
+test_base_dir_created_later_is_discovered(void)
+{
+  WildcardSourceDriver *self;
+
+  setup();
+  self = start_source(WILDCARD_SD_DEFAULT_MAX_FILES, WILDCARD_SD_DEFAULT_IDLE_TIMEOUT);
+  run_for(100);
+
+  mkdir(TEST_DIR, 0755);
+  append_line("late.log", "late");
+  run_until(1, 5000);
+
+  assert_gint(get_count("late.log"), 1, "The file in the base directory created after startup was not read");
+  stop_source(self);
+  teardown();
+}
+
+static void
+test_number_of_open_files_is_capped(void)
+{
+  WildcardSourceDriver *self;
+  gchar name[32];
+  gint i;
+
+  setup();
+  mkdir(TEST_DIR, 0755);
+  for (i = 0; i < 5; i++)
+    {
+      g_snprintf(name, sizeof(name), "capped%d.log", i);
+      append_line(name, "line");
+    }
+
+  self = start_source(2, WILDCARD_SD_DEFAULT_IDLE_TIMEOUT);
+  run_until(5, 10000);
+
+  assert_gint(capture.total, 5, "Files waiting for a slot were not read");
+  assert_gint(capture.open_files_violations, 0, "More files were open than max-files()");
+  assert_true((gint) g_queue_get_length(self->open_readers) <= 2, "More files are open than max-files()");
+  stop_source(self);
+  teardown();
+}
+
+static void
+test_positions_are_kept_across_reload(void)
+{
+  WildcardSourceDriver *self;
+
+  setup();
+  mkdir(TEST_DIR, 0755);
+  append_line("reload.log", "line 1");
+  append_line("reload.log", "line 2");
+
+  self = start_source(WILDCARD_SD_DEFAULT_MAX_FILES, WILDCARD_SD_DEFAULT_IDLE_TIMEOUT);
+  run_until(2, 5000);
+  stop_source(self);
+
+  append_line("reload.log", "line 3");
+  self = start_source(WILDCARD_SD_DEFAULT_MAX_FILES, WILDCARD_SD_DEFAULT_IDLE_TIMEOUT);
+  run_until(3, 5000);
+  run_for(200);
+
+  assert_gint(get_count("reload.log"), 3, "The file was not continued from its persisted position");
+  stop_source(self);
+  teardown();
+}
+
+static void
+test_idle_files_are_closed_and_reopened(void)
+{
+  WildcardSourceDriver *self;
+
+  setup();
+  mkdir(TEST_DIR, 0755);
+  append_line("idle.log", "line 1");
+
+  self = start_source(WILDCARD_SD_DEFAULT_MAX_FILES, 1);
+  run_until(1, 5000);
+
+  /* the first run of the idle timer clears the activity, the second closes the file */
+  run_for(2500);
+  assert_gint(g_queue_get_length(self->open_readers), 0, "The idle file was not closed");
+
+  append_line("idle.log", "line 2");
+  run_until(2, 5000);
+  run_for(200);
+  assert_gint(get_count("idle.log"), 2, "The idle file was not reopened at its last position");
+  stop_source(self);
+  teardown();
+}
+
+static void
+test_unlinked_file_is_closed_at_eof(void)
+{
+  WildcardSourceDriver *self;
+
+  setup();
+  mkdir(TEST_DIR, 0755);
+  append_line("unlinked.log", "line");
+
+  /* without idle-timeout() only the unlink can get the file closed */
+  self = start_source(WILDCARD_SD_DEFAULT_MAX_FILES, 0);
+  run_until(1, 5000);
+
+  remove_test_file("unlinked.log");
+  run_for(500);
+  assert_gint(g_queue_get_length(self->open_readers), 0, "The unlinked file was kept open");
+  assert_gint(g_hash_table_size(self->file_readers), 0, "The unlinked file was not forgotten");
+  stop_source(self);
+  teardown();
+}
+
+int
+main(int argc, char *argv[])
+{
+  app_startup();
+  main_thread_handle = get_thread_id();
+  main_loop_call_init();
+
+  configuration = cfg_new(0x0302);
+  plugin_load_module("syslogformat", configuration, NULL);
+
+  WILDCARD_TESTCASE(test_matching_files_are_discovered);
+  WILDCARD_TESTCASE(test_base_dir_created_later_is_discovered);
+  WILDCARD_TESTCASE(test_number_of_open_files_is_capped);
+  WILDCARD_TESTCASE(test_positions_are_kept_across_reload);
+  WILDCARD_TESTCASE(test_idle_files_are_closed_and_reopened);
+  WILDCARD_TESTCASE(test_unlinked_file_is_closed_at_eof);
+
+  cfg_free(configuration);
+  main_loop_call_deinit();
+  app_shutdown();
+  return 0;
+}
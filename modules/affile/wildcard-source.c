@@ -0,0 +1,726 @@
+/*
+ * Copyright (c) 2002-2014 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2013 Balázs Scheidler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#include "wildcard-source.h"
+#include "messages.h"
+#include "timeutils.h"
+#include "stats/stats-registry.h"
+#include "compat/lfs.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+/*
+ * WildcardFileReader
+ *
+ * A single file followed by a WildcardSourceDriver. The LogReader is only
+ * present while the file is open, in between the position is kept in the
+ * persistent state of the LogProtoServer, the same way as it is kept when
+ * a file() source is reloaded.
+ */
+typedef struct _WildcardFileReader
+{
+  LogPipe super;
+  WildcardSourceDriver *owner;
+  GString *filename;
+  LogReader *reader;
+  /* owned by reader, identifies the notifications about the current file */
+  PollEvents *poll_events;
+  gint fd;
+  /* set from the reader threads whenever a message is read */
+  gint active;
+  /* waiting in the pending_readers queue of the owner */
+  gboolean pending;
+  GList *open_link;
+  /* identity and read position of the file when it was closed, to notice
+   * changes when the directory is rescanned instead of being watched */
+  ino_t closed_ino;
+  off_t closed_pos;
+  /* closes the file once it was read to its end after being unlinked */
+  struct iv_task close_unlinked_task;
+} WildcardFileReader;
+
+static void wildcard_sd_request_open(WildcardSourceDriver *self, WildcardFileReader *file_reader);
+static void wildcard_sd_close_reader(WildcardSourceDriver *self, WildcardFileReader *file_reader);
+static void wildcard_sd_open_pending_readers(WildcardSourceDriver *self);
+
+static gboolean
+wildcard_file_reader_open(WildcardFileReader *self)
+{
+  AFFileSourceDriver *owner = &self->owner->super;
+  GlobalConfig *cfg = log_pipe_get_config(&self->super);
+  LogProtoServer *proto;
+  PollEvents *poll_events;
+  gint fd;
+
+  if (!affile_sd_open_file(owner, self->filename->str, &fd))
+    {
+      msg_error("Error opening file for reading",
+                evt_tag_str("filename", self->filename->str),
+                evt_tag_errno(EVT_TAG_OSERROR, errno),
+                NULL);
+      return FALSE;
+    }
+
+  poll_events = affile_sd_construct_poll_events(owner, self->filename->str, fd, &self->super);
+  if (!poll_events)
+    {
+      close(fd);
+      return FALSE;
+    }
+
+  proto = affile_sd_construct_proto(owner, self->filename->str, fd);
+  self->reader = log_reader_new(cfg);
+  log_reader_reopen(self->reader, proto, poll_events);
+
+  log_reader_set_options(self->reader,
+                         &self->super,
+                         &owner->reader_options,
+                         STATS_LEVEL1,
+                         SCS_FILE,
+                         owner->super.super.id,
+                         self->filename->str);
+
+  log_pipe_append((LogPipe *) self->reader, &self->super);
+  if (!log_pipe_init((LogPipe *) self->reader))
+    {
+      msg_error("Error initializing log_reader",
+                evt_tag_str("filename", self->filename->str),
+                NULL);
+      log_pipe_unref((LogPipe *) self->reader);
+      self->reader = NULL;
+      return FALSE;
+    }
+  affile_sd_recover_state(owner, self->filename->str, cfg, proto);
+
+  self->fd = fd;
+  self->poll_events = poll_events;
+  g_atomic_int_set(&self->active, 0);
+  g_queue_push_tail(self->owner->open_readers, self);
+  self->open_link = self->owner->open_readers->tail;
+  return TRUE;
+}
+
+static void
+wildcard_file_reader_close(WildcardFileReader *self)
+{
+  struct stat st;
+
+  if (!self->reader)
+    return;
+
+  if (fstat(self->fd, &st) == 0)
+    {
+      self->closed_ino = st.st_ino;
+      self->closed_pos = lseek(self->fd, 0, SEEK_CUR);
+    }
+
+  if (iv_task_registered(&self->close_unlinked_task))
+    iv_task_unregister(&self->close_unlinked_task);
+
+  log_pipe_deinit((LogPipe *) self->reader);
+  log_pipe_unref((LogPipe *) self->reader);
+  self->reader = NULL;
+  self->poll_events = NULL;
+  self->fd = -1;
+
+  g_queue_delete_link(self->owner->open_readers, self->open_link);
+  self->open_link = NULL;
+}
+
+/* everything written to the file has been read, closing it loses nothing */
+static gboolean
+wildcard_file_reader_is_at_eof(WildcardFileReader *self)
+{
+  struct stat st;
+  off_t pos;
+
+  pos = lseek(self->fd, 0, SEEK_CUR);
+  if (pos == (off_t) -1 || fstat(self->fd, &st) < 0)
+    return TRUE;
+  return pos >= st.st_size;
+}
+
+/* nothing will be written to the file anymore */
+static gboolean
+wildcard_file_reader_is_unlinked(WildcardFileReader *self)
+{
+  struct stat st;
+
+  return fstat(self->fd, &st) == 0 && st.st_nlink == 0;
+}
+
+static void
+wildcard_file_reader_close_unlinked(gpointer s)
+{
+  WildcardFileReader *self = (WildcardFileReader *) s;
+  WildcardSourceDriver *owner = self->owner;
+
+  /* closing the reader may drop the last reference to us */
+  log_pipe_ref(&self->super);
+  wildcard_sd_close_reader(owner, self);
+  wildcard_sd_open_pending_readers(owner);
+  log_pipe_unref(&self->super);
+}
+
+static gboolean
+wildcard_file_reader_has_changed_since_closed(WildcardFileReader *self, struct stat *st)
+{
+  return st->st_ino != self->closed_ino || st->st_size != self->closed_pos;
+}
+
+/* NOTE: runs in the main thread */
+static void
+wildcard_file_reader_notify(LogPipe *s, gint notify_code, gpointer user_data)
+{
+  WildcardFileReader *self = (WildcardFileReader *) s;
+  WildcardSourceDriver *owner = self->owner;
+
+  /* a LogReader still working after it was closed may report its result */
+  if (!self->reader)
+    return;
+
+  /* closing the reader may drop the last reference to us */
+  log_pipe_ref(s);
+  switch (notify_code)
+    {
+    case NC_FILE_MOVED:
+      if (user_data != self->poll_events)
+        break;
+      msg_verbose("Follow-mode file source moved, tracking of the new file is started",
+                  evt_tag_str("filename", self->filename->str),
+                  NULL);
+      wildcard_sd_close_reader(owner, self);
+      break;
+    case NC_FILE_EOF:
+      /* the PollEvents instance reporting this is freed along with the
+       * reader, thus it is closed from a task */
+      if (user_data == self->poll_events && wildcard_file_reader_is_unlinked(self) &&
+          !iv_task_registered(&self->close_unlinked_task))
+        iv_task_register(&self->close_unlinked_task);
+      break;
+    case NC_CLOSE:
+    case NC_READ_ERROR:
+      if (user_data == self->reader)
+        wildcard_sd_close_reader(owner, self);
+      break;
+    default:
+      break;
+    }
+  wildcard_sd_open_pending_readers(owner);
+  log_pipe_unref(s);
+}
+
+static void
+wildcard_file_reader_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options, gpointer user_data)
+{
+  WildcardFileReader *self = (WildcardFileReader *) s;
+  static NVHandle filename_handle = 0;
+
+  if (!filename_handle)
+    filename_handle = log_msg_get_value_handle("FILE_NAME");
+
+  g_atomic_int_set(&self->active, 1);
+  log_msg_set_value(msg, filename_handle, self->filename->str, self->filename->len);
+
+  log_pipe_forward_msg(s, msg, path_options);
+}
+
+static void
+wildcard_file_reader_free(LogPipe *s)
+{
+  WildcardFileReader *self = (WildcardFileReader *) s;
+
+  g_assert(!self->reader);
+  g_string_free(self->filename, TRUE);
+}
+
+static WildcardFileReader *
+wildcard_file_reader_new(WildcardSourceDriver *owner, const gchar *filename)
+{
+  WildcardFileReader *self = g_new0(WildcardFileReader, 1);
+  LogPipe *owner_pipe = &owner->super.super.super.super;
+
+  log_pipe_init_instance(&self->super, log_pipe_get_config(owner_pipe));
+  self->super.queue = wildcard_file_reader_queue;
+  self->super.notify = wildcard_file_reader_notify;
+  self->super.free_fn = wildcard_file_reader_free;
+  self->super.expr_node = owner_pipe->expr_node;
+  log_pipe_append(&self->super, owner_pipe);
+
+  self->owner = owner;
+  self->filename = g_string_new(filename);
+  self->fd = -1;
+
+  IV_TASK_INIT(&self->close_unlinked_task);
+  self->close_unlinked_task.cookie = self;
+  self->close_unlinked_task.handler = wildcard_file_reader_close_unlinked;
+  return self;
+}
+
+/* WildcardSourceDriver */
+
+void
+wildcard_sd_set_base_dir(LogDriver *s, const gchar *base_dir)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+
+  g_string_assign(self->super.filename, base_dir);
+}
+
+void
+wildcard_sd_set_filename_pattern(LogDriver *s, const gchar *filename_pattern)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+
+  g_free(self->filename_pattern);
+  if (self->compiled_pattern)
+    g_pattern_spec_free(self->compiled_pattern);
+  self->filename_pattern = g_strdup(filename_pattern);
+  self->compiled_pattern = g_pattern_spec_new(filename_pattern);
+}
+
+void
+wildcard_sd_set_recursive(LogDriver *s, gboolean recursive)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+
+  self->recursive = recursive;
+}
+
+void
+wildcard_sd_set_max_files(LogDriver *s, gint max_files)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+
+  self->max_files = max_files;
+}
+
+void
+wildcard_sd_set_idle_timeout(LogDriver *s, gint idle_timeout)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+
+  self->idle_timeout = idle_timeout;
+}
+
+static void
+wildcard_sd_start_timer(struct iv_timer *timer, glong msec)
+{
+  if (iv_timer_registered(timer))
+    return;
+
+  iv_validate_now();
+  timer->expires = iv_now;
+  timespec_add_msec(&timer->expires, msec);
+  iv_timer_register(timer);
+}
+
+static void
+wildcard_sd_stop_timer(struct iv_timer *timer)
+{
+  if (iv_timer_registered(timer))
+    iv_timer_unregister(timer);
+}
+
+/* stop following a file that is gone */
+static void
+wildcard_sd_forget_reader(WildcardSourceDriver *self, WildcardFileReader *file_reader)
+{
+  msg_verbose("File removed, no longer following it",
+              evt_tag_str("filename", file_reader->filename->str),
+              NULL);
+
+  if (file_reader->pending)
+    {
+      g_queue_remove(self->pending_readers, file_reader);
+      file_reader->pending = FALSE;
+    }
+  wildcard_file_reader_close(file_reader);
+  g_hash_table_remove(self->file_readers, file_reader->filename->str);
+}
+
+static void
+wildcard_sd_open_reader(WildcardSourceDriver *self, WildcardFileReader *file_reader)
+{
+  struct stat st;
+
+  if (stat(file_reader->filename->str, &st) < 0)
+    {
+      wildcard_sd_forget_reader(self, file_reader);
+      return;
+    }
+
+  msg_debug("Opening file matching wildcard-file() source",
+            evt_tag_str("filename", file_reader->filename->str),
+            evt_tag_int("open_files", g_queue_get_length(self->open_readers)),
+            NULL);
+  wildcard_file_reader_open(file_reader);
+}
+
+static void
+wildcard_sd_request_open(WildcardSourceDriver *self, WildcardFileReader *file_reader)
+{
+  if (file_reader->reader || file_reader->pending)
+    return;
+
+  if ((gint) g_queue_get_length(self->open_readers) < self->max_files)
+    {
+      wildcard_sd_open_reader(self, file_reader);
+      return;
+    }
+
+  msg_debug("Too many files open, deferring opening file",
+            evt_tag_str("filename", file_reader->filename->str),
+            evt_tag_int("max_files", self->max_files),
+            NULL);
+  file_reader->pending = TRUE;
+  g_queue_push_tail(self->pending_readers, file_reader);
+  wildcard_sd_start_timer(&self->pending_timer, self->super.follow_freq);
+}
+
+static void
+wildcard_sd_open_pending_readers(WildcardSourceDriver *self)
+{
+  WildcardFileReader *file_reader;
+
+  while (!g_queue_is_empty(self->pending_readers) &&
+         (gint) g_queue_get_length(self->open_readers) < self->max_files)
+    {
+      file_reader = g_queue_pop_head(self->pending_readers);
+      file_reader->pending = FALSE;
+      wildcard_sd_open_reader(self, file_reader);
+    }
+}
+
+/* the file is forgotten if it was removed in the meantime and reopened
+ * right away if it was replaced, truncated or written to while we were
+ * closing it */
+static void
+wildcard_sd_close_reader(WildcardSourceDriver *self, WildcardFileReader *file_reader)
+{
+  struct stat st;
+
+  wildcard_file_reader_close(file_reader);
+  if (stat(file_reader->filename->str, &st) < 0)
+    wildcard_sd_forget_reader(self, file_reader);
+  else if (wildcard_file_reader_has_changed_since_closed(file_reader, &st))
+    wildcard_sd_request_open(self, file_reader);
+}
+
+/* files with pending content are waiting for a slot, close the ones that
+ * have been read completely, they are reopened as soon as they change */
+static void
+wildcard_sd_make_room_for_pending_readers(gpointer s)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+  gint needed = (gint) g_queue_get_length(self->pending_readers) - (self->max_files - (gint) g_queue_get_length(self->open_readers));
+  GList *l, *next;
+
+  for (l = self->open_readers->head; l && needed > 0; l = next)
+    {
+      WildcardFileReader *file_reader = (WildcardFileReader *) l->data;
+
+      next = l->next;
+      if (wildcard_file_reader_is_at_eof(file_reader))
+        {
+          wildcard_sd_close_reader(self, file_reader);
+          needed--;
+        }
+    }
+
+  wildcard_sd_open_pending_readers(self);
+  if (!g_queue_is_empty(self->pending_readers))
+    wildcard_sd_start_timer(&self->pending_timer, self->super.follow_freq);
+}
+
+/* close files that were read completely and had no new messages since
+ * the previous run, idle_timeout seconds ago */
+static void
+wildcard_sd_reap_idle_readers(gpointer s)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+  GList *l, *next;
+
+  for (l = self->open_readers->head; l; l = next)
+    {
+      WildcardFileReader *file_reader = (WildcardFileReader *) l->data;
+
+      next = l->next;
+      if (g_atomic_int_get(&file_reader->active))
+        {
+          g_atomic_int_set(&file_reader->active, 0);
+          continue;
+        }
+
+      if (wildcard_file_reader_is_at_eof(file_reader))
+        {
+          msg_debug("Closing idle file",
+                    evt_tag_str("filename", file_reader->filename->str),
+                    evt_tag_int("idle_timeout", self->idle_timeout),
+                    NULL);
+          wildcard_sd_close_reader(self, file_reader);
+        }
+    }
+
+  wildcard_sd_open_pending_readers(self);
+  wildcard_sd_start_timer(&self->idle_timer, self->idle_timeout * 1000);
+}
+
+static void
+wildcard_sd_file_changed(WildcardSourceDriver *self, const gchar *filename, struct stat *st)
+{
+  WildcardFileReader *file_reader;
+
+  file_reader = g_hash_table_lookup(self->file_readers, filename);
+  if (!file_reader)
+    {
+      file_reader = wildcard_file_reader_new(self, filename);
+      g_hash_table_insert(self->file_readers, file_reader->filename->str, file_reader);
+    }
+  else if (st && !wildcard_file_reader_has_changed_since_closed(file_reader, st))
+    return;
+
+  wildcard_sd_request_open(self, file_reader);
+}
+
+static void
+wildcard_sd_file_deleted(WildcardSourceDriver *self, const gchar *filename)
+{
+  WildcardFileReader *file_reader;
+
+  file_reader = g_hash_table_lookup(self->file_readers, filename);
+
+  /* an open file is read until its end and forgotten when it is closed,
+   * see NC_FILE_EOF in wildcard_file_reader_notify() */
+  if (file_reader && !file_reader->reader)
+    wildcard_sd_forget_reader(self, file_reader);
+}
+
+static void wildcard_sd_add_directory(WildcardSourceDriver *self, const gchar *dir);
+
+static void
+wildcard_sd_scan_directory(WildcardSourceDriver *self, const gchar *dir)
+{
+  GError *error = NULL;
+  const gchar *name;
+  GDir *d;
+
+  d = g_dir_open(dir, 0, &error);
+  if (!d)
+    {
+      if (error->code == G_FILE_ERROR_NOENT)
+        msg_debug("Directory does not exist",
+                  evt_tag_str("dir", dir),
+                  NULL);
+      else
+        msg_error("Error opening directory",
+                  evt_tag_str("dir", dir),
+                  evt_tag_str("error", error->message),
+                  NULL);
+      g_clear_error(&error);
+      return;
+    }
+
+  while ((name = g_dir_read_name(d)))
+    {
+      gchar *path = g_build_filename(dir, name, NULL);
+      struct stat st;
+
+      /* symlinks to directories are not followed to avoid loops */
+      if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode))
+        {
+          if (self->recursive)
+            wildcard_sd_add_directory(self, path);
+        }
+      else if (g_pattern_match_string(self->compiled_pattern, name) &&
+               stat(path, &st) == 0 && S_ISREG(st.st_mode))
+        {
+          wildcard_sd_file_changed(self, path, &st);
+        }
+      g_free(path);
+    }
+  g_dir_close(d);
+}
+
+static void
+wildcard_sd_add_directory(WildcardSourceDriver *self, const gchar *dir)
+{
+  /* start watching first, files created during the scan are not missed that way */
+  directory_monitor_add_directory(self->monitor, dir);
+  wildcard_sd_scan_directory(self, dir);
+}
+
+static void
+wildcard_sd_handle_directory_event(const gchar *dir, const gchar *name, DirectoryMonitorEvent event, gpointer user_data)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) user_data;
+  gchar *path;
+
+  if (event == DM_RESCAN)
+    {
+      wildcard_sd_add_directory(self, self->super.filename->str);
+      return;
+    }
+
+  path = g_build_filename(dir, name, NULL);
+  switch (event)
+    {
+    case DM_DIRECTORY_CREATED:
+      if (self->recursive)
+        wildcard_sd_add_directory(self, path);
+      break;
+    case DM_FILE_CREATED:
+    case DM_FILE_CHANGED:
+      if (g_pattern_match_string(self->compiled_pattern, name))
+        wildcard_sd_file_changed(self, path, NULL);
+      break;
+    case DM_FILE_DELETED:
+      wildcard_sd_file_deleted(self, path);
+      break;
+    default:
+      break;
+    }
+  g_free(path);
+}
+
+static gboolean
+wildcard_sd_init(LogPipe *s)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+  GlobalConfig *cfg = log_pipe_get_config(s);
+  const gchar *base_dir = self->super.filename->str;
+
+  if (!log_src_driver_init_method(s))
+    return FALSE;
+
+  log_reader_options_init(&self->super.reader_options, cfg, self->super.super.super.group);
+
+  if (!affile_sd_check_multi_line_options(&self->super))
+    return FALSE;
+
+  if (self->super.filename->len == 0 || !self->filename_pattern)
+    {
+      msg_error("Both base-dir() and filename-pattern() must be specified for wildcard-file() sources",
+                NULL);
+      return FALSE;
+    }
+
+  if (self->super.follow_freq <= 0)
+    {
+      msg_error("wildcard-file() sources need a positive follow-freq()",
+                evt_tag_str("base_dir", base_dir),
+                NULL);
+      return FALSE;
+    }
+
+  if (!g_file_test(base_dir, G_FILE_TEST_IS_DIR))
+    msg_warning("Base directory of wildcard-file() source does not exist, waiting for it to be created",
+                evt_tag_str("base_dir", base_dir),
+                NULL);
+
+  self->monitor = directory_monitor_new(self->super.follow_freq, wildcard_sd_handle_directory_event, self);
+  directory_monitor_start(self->monitor);
+  wildcard_sd_add_directory(self, base_dir);
+
+  if (self->idle_timeout > 0)
+    wildcard_sd_start_timer(&self->idle_timer, self->idle_timeout * 1000);
+  return TRUE;
+}
+
+static gboolean
+wildcard_sd_deinit(LogPipe *s)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+  WildcardFileReader *file_reader;
+
+  if (self->monitor)
+    {
+      directory_monitor_free(self->monitor);
+      self->monitor = NULL;
+    }
+  wildcard_sd_stop_timer(&self->idle_timer);
+  wildcard_sd_stop_timer(&self->pending_timer);
+
+  while ((file_reader = g_queue_peek_head(self->open_readers)))
+    wildcard_file_reader_close(file_reader);
+  g_queue_clear(self->pending_readers);
+  g_hash_table_remove_all(self->file_readers);
+
+  if (!log_src_driver_deinit_method(s))
+    return FALSE;
+
+  return TRUE;
+}
+
+static void
+wildcard_sd_free(LogPipe *s)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+
+  g_free(self->filename_pattern);
+  if (self->compiled_pattern)
+    g_pattern_spec_free(self->compiled_pattern);
+  g_hash_table_destroy(self->file_readers);
+  g_queue_free(self->open_readers);
+  g_queue_free(self->pending_readers);
+
+  affile_sd_free(s);
+}
+
+LogDriver *
+wildcard_sd_new(GlobalConfig *cfg)
+{
+  WildcardSourceDriver *self = g_new0(WildcardSourceDriver, 1);
+
+  affile_sd_init_instance(&self->super, "", cfg);
+  self->super.super.super.super.init = wildcard_sd_init;
+  self->super.super.super.super.deinit = wildcard_sd_deinit;
+  self->super.super.super.super.free_fn = wildcard_sd_free;
+  /* FILE_NAME is set by the WildcardFileReader instances */
+  self->super.super.super.super.queue = log_src_driver_queue_method;
+  self->super.super.super.super.notify = NULL;
+
+  self->super.file_open_options.is_pipe = FALSE;
+  self->super.file_open_options.open_flags = DEFAULT_SD_OPEN_FLAGS;
+  self->super.follow_freq = 1000;
+
+  self->max_files = WILDCARD_SD_DEFAULT_MAX_FILES;
+  self->idle_timeout = WILDCARD_SD_DEFAULT_IDLE_TIMEOUT;
+  self->file_readers = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify) log_pipe_unref);
+  self->open_readers = g_queue_new();
+  self->pending_readers = g_queue_new();
+
+  IV_TIMER_INIT(&self->idle_timer);
+  self->idle_timer.cookie = self;
+  self->idle_timer.handler = wildcard_sd_reap_idle_readers;
+
+  IV_TIMER_INIT(&self->pending_timer);
+  self->pending_timer.cookie = self;
+  self->pending_timer.handler = wildcard_sd_make_room_for_pending_readers;
+
+  return &self->super.super.super;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2002-2014 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2013 Balázs Scheidler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#ifndef WILDCARD_SOURCE_H_INCLUDED
+#define WILDCARD_SOURCE_H_INCLUDED
+
+#include "affile-source.h"
+#include "directory-monitor.h"
+
+#include <iv.h>
+
+#define WILDCARD_SD_DEFAULT_MAX_FILES 100
+#define WILDCARD_SD_DEFAULT_IDLE_TIMEOUT 60
+
+/*
+ * Follows every file matching filename_pattern below a base directory
+ * (stored as the filename of the underlying AFFileSourceDriver). At most
+ * max_files of them are kept open, files that do not receive new content
+ * for idle_timeout seconds are closed and reopened once they change.
+ */
+typedef struct _WildcardSourceDriver
+{
+  AFFileSourceDriver super;
+  gchar *filename_pattern;
+  GPatternSpec *compiled_pattern;
+  gboolean recursive;
+  gint max_files;
+  gint idle_timeout;
+
+  DirectoryMonitor *monitor;
+  /* filename -> WildcardFileReader, for all matching files seen so far */
+  GHashTable *file_readers;
+  /* WildcardFileReader instances having an open LogReader */
+  GQueue *open_readers;
+  /* WildcardFileReader instances waiting for one of the max_files slots */
+  GQueue *pending_readers;
+  struct iv_timer idle_timer;
+  struct iv_timer pending_timer;
+} WildcardSourceDriver;
+
+LogDriver *wildcard_sd_new(GlobalConfig *cfg);
+
+void wildcard_sd_set_base_dir(LogDriver *s, const gchar *base_dir);
+void wildcard_sd_set_filename_pattern(LogDriver *s, const gchar *filename_pattern);
+void wildcard_sd_set_recursive(LogDriver *s, gboolean recursive);
+void wildcard_sd_set_max_files(LogDriver *s, gint max_files);
+void wildcard_sd_set_idle_timeout(LogDriver *s, gint idle_timeout);
+
+#endif
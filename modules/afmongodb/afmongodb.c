@@ -77,6 +77,8 @@ typedef struct
 
   GString *current_value;
   bson *bson;
+  /* finished documents of the current batch */
+  GPtrArray *bulk;
 } MongoDBDestDriver;
 
 /*
@@ -456,11 +458,50 @@ afmongodb_worker_retry_over_message(LogThrDestDriver *s, LogMessage *msg)
             evt_tag_str("driver", self->super.super.super.id),
             evt_tag_int("number_of_retries", s->retries.max),
             evt_tag_value_pairs("message", self->vp, msg,
-                                self->super.seq_num,
+                                log_threaded_dest_driver_get_seq_num(&self->super),
                                 LTZ_SEND, &self->template_options),
             NULL);
 }
 
+static worker_insert_result_t
+afmongodb_worker_flush(LogThrDestDriver *s)
+{
+  MongoDBDestDriver *self = (MongoDBDestDriver *)s;
+  gboolean success = TRUE;
+
+  if (self->bulk->len == 0)
+    return WORKER_INSERT_RESULT_SUCCESS;
+
+  if (!afmongodb_dd_connect(self, TRUE))
+    {
+      g_ptr_array_set_size(self->bulk, 0);
+      return WORKER_INSERT_RESULT_NOT_CONNECTED;
+    }
+
+  if (!mongo_sync_cmd_insert_n(self->conn, self->ns, self->bulk->len,
+                               (const bson **)self->bulk->pdata))
+    {
+      msg_error("Network error while inserting into MongoDB",
+                evt_tag_int("time_reopen", self->super.time_reopen),
+                evt_tag_str("reason", mongo_sync_conn_get_last_error(self->conn)),
+                evt_tag_int("batch_size", self->bulk->len),
+                evt_tag_str("driver", self->super.super.super.id),
+                NULL);
+      success = FALSE;
+    }
+
+  /* on failure the whole batch is rewound and formatted again */
+  g_ptr_array_set_size(self->bulk, 0);
+
+  if (!success && (errno == ENOTCONN))
+    return WORKER_INSERT_RESULT_NOT_CONNECTED;
+
+  if (!success)
+    return WORKER_INSERT_RESULT_ERROR;
+
+  return WORKER_INSERT_RESULT_SUCCESS;
+}
+
 static worker_insert_result_t
 afmongodb_worker_insert (LogThrDestDriver *s, LogMessage *msg)
 {
@@ -469,7 +510,10 @@ afmongodb_worker_insert (LogThrDestDriver *s, LogMessage *msg)
   gboolean drop_silently = self->template_options.on_error & ON_ERROR_SILENT;
 
   if (!afmongodb_dd_connect(self, TRUE))
-    return WORKER_INSERT_RESULT_NOT_CONNECTED;
+    {
+      g_ptr_array_set_size(self->bulk, 0);
+      return WORKER_INSERT_RESULT_NOT_CONNECTED;
+    }
 
   bson_reset (self->bson);
 
@@ -477,7 +521,7 @@ afmongodb_worker_insert (LogThrDestDriver *s, LogMessage *msg)
                              afmongodb_vp_obj_start,
                              afmongodb_vp_process_value,
                              afmongodb_vp_obj_end,
-                             msg, self->super.seq_num,
+                             msg, log_threaded_dest_driver_get_seq_num(&self->super),
                              LTZ_SEND,
                              &self->template_options,
                              self);
@@ -489,40 +533,25 @@ afmongodb_worker_insert (LogThrDestDriver *s, LogMessage *msg)
         {
           msg_error("Failed to format message for MongoDB, dropping message",
                     evt_tag_value_pairs("message", self->vp, msg,
-                                        self->super.seq_num,
+                                        log_threaded_dest_driver_get_seq_num(&self->super),
                                         LTZ_SEND, &self->template_options),
                     evt_tag_str("driver", self->super.super.super.id),
                     NULL);
         }
       return WORKER_INSERT_RESULT_DROP;
     }
-  else
-    {
-      msg_debug("Outgoing message to MongoDB destination",
-                evt_tag_value_pairs("message", self->vp, msg,
-                                    self->super.seq_num,
-                                    LTZ_SEND, &self->template_options),
-                evt_tag_str("driver", self->super.super.super.id),
-                NULL);
-      if (!mongo_sync_cmd_insert_n(self->conn, self->ns, 1,
-                                   (const bson **)&self->bson))
-        {
-          msg_error("Network error while inserting into MongoDB",
-                    evt_tag_int("time_reopen", self->super.time_reopen),
-                    evt_tag_str("reason", mongo_sync_conn_get_last_error(self->conn)),
-                    evt_tag_str("driver", self->super.super.super.id),
-                    NULL);
-          success = FALSE;
-        }
-    }
 
-  if (!success && (errno == ENOTCONN))
-    return WORKER_INSERT_RESULT_NOT_CONNECTED;
+  msg_debug("Outgoing message to MongoDB destination",
+            evt_tag_value_pairs("message", self->vp, msg,
+                                log_threaded_dest_driver_get_seq_num(&self->super),
+                                LTZ_SEND, &self->template_options),
+            evt_tag_str("driver", self->super.super.super.id),
+            NULL);
 
-  if (!success)
-    return WORKER_INSERT_RESULT_ERROR;
+  g_ptr_array_add(self->bulk, self->bson);
+  self->bson = bson_new_sized(4096);
 
-  return WORKER_INSERT_RESULT_SUCCESS;
+  return WORKER_INSERT_RESULT_QUEUED;
 }
 
 static void
@@ -537,6 +566,7 @@ afmongodb_worker_thread_init(LogThrDestDriver *d)
   self->current_value = g_string_sized_new(256);
 
   self->bson = bson_new_sized(4096);
+  self->bulk = g_ptr_array_new_with_free_func((GDestroyNotify) bson_free);
 }
 
 static void
@@ -548,6 +578,7 @@ afmongodb_worker_thread_deinit(LogThrDestDriver *d)
   g_string_free (self->current_value, TRUE);
 
   bson_free (self->bson);
+  g_ptr_array_free (self->bulk, TRUE);
 }
 
 /*
@@ -723,6 +754,7 @@ afmongodb_dd_new(GlobalConfig *cfg)
   self->super.worker.thread_deinit = afmongodb_worker_thread_deinit;
   self->super.worker.disconnect = afmongodb_dd_disconnect;
   self->super.worker.insert = afmongodb_worker_insert;
+  self->super.worker.flush = afmongodb_worker_flush;
   self->super.format.stats_instance = afmongodb_dd_format_stats_instance;
   self->super.format.persist_name = afmongodb_dd_format_persist_name;
   self->super.stats_source = SCS_MONGODB;
@@ -252,7 +252,7 @@ static void
 _smtp_message_add_recipient_from_template(smtp_message_t self, AFSMTPDriver *driver, LogTemplate *template, LogMessage *msg)
 {
   log_template_format(template, msg, &driver->template_options, LTZ_SEND,
-                      driver->super.seq_num, NULL, driver->str);
+                      log_threaded_dest_driver_get_seq_num(&driver->super), NULL, driver->str);
   smtp_add_recipient(self, afsmtp_wash_string (driver->str->str));
 }
 
@@ -275,7 +275,7 @@ afsmtp_dd_msg_add_header(AFSMTPHeader *hdr, gpointer user_data)
   smtp_message_t message = ((gpointer *)user_data)[2];
 
   log_template_format(hdr->template, msg, &self->template_options, LTZ_LOCAL,
-                      self->super.seq_num, NULL, self->str);
+                      log_threaded_dest_driver_get_seq_num(&self->super), NULL, self->str);
 
   smtp_set_header(message, hdr->name, afsmtp_wash_string (self->str->str), NULL);
   smtp_set_header_option(message, hdr->name, Hdr_OVERRIDE, 1);
@@ -400,7 +400,7 @@ __build_message(AFSMTPDriver *self, LogMessage *msg, smtp_session_t session)
   message = smtp_add_message(session);
 
   log_template_format(self->mail_from->template, msg, &self->template_options, LTZ_SEND,
-                      self->super.seq_num, NULL, self->str);
+                      log_threaded_dest_driver_get_seq_num(&self->super), NULL, self->str);
   smtp_set_reverse_path(message, afsmtp_wash_string(self->str->str));
 
   /* Defaults */
@@ -408,7 +408,7 @@ __build_message(AFSMTPDriver *self, LogMessage *msg, smtp_session_t session)
   smtp_set_header(message, "From", NULL, NULL);
 
   log_template_format(self->subject_template, msg, &self->template_options, LTZ_SEND,
-                      self->super.seq_num, NULL, self->str);
+                      log_threaded_dest_driver_get_seq_num(&self->super), NULL, self->str);
   smtp_set_header(message, "Subject", afsmtp_wash_string(self->str->str));
   smtp_set_header_option(message, "Subject", Hdr_OVERRIDE, 1);
 
@@ -429,7 +429,7 @@ __build_message(AFSMTPDriver *self, LogMessage *msg, smtp_session_t session)
    */
   g_string_assign(self->str, "X-Mailer: syslog-ng " VERSION "\r\n\r\n");
   log_template_append_format(self->body_template, msg, &self->template_options,
-                             LTZ_SEND, self->super.seq_num,
+                             LTZ_SEND, log_threaded_dest_driver_get_seq_num(&self->super),
                              NULL, self->str);
   smtp_set_message_str(message, self->str->str);
   return message;
@@ -493,7 +493,7 @@ __worker_message_retry_over(LogThrDestDriver *self, LogMessage *msg)
   msg_error("Multiple failures while sending message in email to the server, "
             "message dropped",
             evt_tag_str("driver", self->super.super.id),
-            evt_tag_int("attempts", self->retries.counter),
+            evt_tag_int("attempts", log_threaded_dest_driver_get_current_worker(self)->retries_counter),
             evt_tag_int("max-attempts", self->retries.max),
             NULL);
 }
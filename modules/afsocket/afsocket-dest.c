@@ -27,6 +27,7 @@
 #include "logwriter.h"
 #include "gsocket.h"
 #include "stats/stats-registry.h"
+#include "transport/transport-compress.h"
 #include "mainloop.h"
 
 #include <string.h>
@@ -169,7 +170,10 @@ afsocket_dd_start_reconnect_timer(AFSocketDestDriver *self)
 static LogTransport *
 afsocket_dd_construct_transport(AFSocketDestDriver *self, gint fd)
 {
-  return transport_mapper_construct_log_transport(self->transport_mapper, fd);
+  LogTransport *transport = transport_mapper_construct_log_transport(self->transport_mapper, fd);
+
+  return transport_mapper_compress_log_transport(self->transport_mapper, transport,
+                                                 self->raw_bytes, self->compressed_bytes);
 }
 
 static gboolean
@@ -220,6 +224,7 @@ afsocket_dd_connected(AFSocketDestDriver *self)
     goto error_reconnect;
 
   proto = log_proto_client_factory_construct(self->proto_factory, transport, &self->writer_options.proto_options.super);
+  log_proto_client_set_syscalls_counter(proto, self->syscalls);
 
   log_writer_reopen(self->writer, proto);
   return TRUE;
@@ -401,6 +406,18 @@ afsocket_dd_setup_writer(AFSocketDestDriver *self)
     }
 
   log_pipe_append(&self->super.super.super, (LogPipe *) self->writer);
+
+  stats_lock();
+  stats_register_counter(STATS_LEVEL1, self->transport_mapper->stats_source | SCS_DESTINATION, self->super.super.id,
+                         afsocket_dd_stats_instance(self), SC_TYPE_SYSCALLS, &self->syscalls);
+  if (self->transport_mapper->compression != LTC_NONE)
+    {
+      stats_register_counter(STATS_LEVEL1, self->transport_mapper->stats_source | SCS_DESTINATION, self->super.super.id,
+                             afsocket_dd_stats_instance(self), SC_TYPE_RAW_BYTES, &self->raw_bytes);
+      stats_register_counter(STATS_LEVEL1, self->transport_mapper->stats_source | SCS_DESTINATION, self->super.super.id,
+                             afsocket_dd_stats_instance(self), SC_TYPE_COMPRESSED_BYTES, &self->compressed_bytes);
+    }
+  stats_unlock();
   return TRUE;
 }
 
@@ -465,6 +482,15 @@ afsocket_dd_deinit(LogPipe *s)
   afsocket_dd_stop_watches(self);
   afsocket_dd_stop_writer(self);
 
+  stats_lock();
+  stats_unregister_counter(self->transport_mapper->stats_source | SCS_DESTINATION, self->super.super.id,
+                           afsocket_dd_stats_instance(self), SC_TYPE_SYSCALLS, &self->syscalls);
+  stats_unregister_counter(self->transport_mapper->stats_source | SCS_DESTINATION, self->super.super.id,
+                           afsocket_dd_stats_instance(self), SC_TYPE_RAW_BYTES, &self->raw_bytes);
+  stats_unregister_counter(self->transport_mapper->stats_source | SCS_DESTINATION, self->super.super.id,
+                           afsocket_dd_stats_instance(self), SC_TYPE_COMPRESSED_BYTES, &self->compressed_bytes);
+  stats_unlock();
+
   if (self->connection_initialized)
     {
       afsocket_dd_save_connection(self);
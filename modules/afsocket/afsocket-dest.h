@@ -53,6 +53,11 @@ struct _AFSocketDestDriver
   struct iv_timer reconnect_timer;
   SocketOptions *socket_options;
   TransportMapper *transport_mapper;
+  /* write syscalls issued by the LogProtoClient instance */
+  StatsCounterItem *syscalls;
+  /* bytes written before and after compression(), if enabled */
+  StatsCounterItem *raw_bytes;
+  StatsCounterItem *compressed_bytes;
 
   LogWriter *(*construct_writer)(AFSocketDestDriver *self);
   gboolean (*setup_addresses)(AFSocketDestDriver *s);
@@ -64,6 +64,7 @@ static CfgLexerKeyword afsocket_keywords[] = {
   { "so_rcvbuf",          KW_SO_RCVBUF },
   { "so_sndbuf",          KW_SO_SNDBUF },
   { "so_keepalive",       KW_SO_KEEPALIVE },
+  { "so_reuseport",       KW_SO_REUSEPORT },
   { "tcp_keep_alive",     KW_SO_KEEPALIVE }, /* old, once deprecated form, but revived in 3.4 */
   { "tcp_keepalive",      KW_SO_KEEPALIVE, 0x0304 }, /* alias for so-keepalive, as tcp is the only option actually using it */
   { "tcp_keepalive_time", KW_TCP_KEEPALIVE_TIME, 0x0304 },
@@ -74,6 +75,10 @@ static CfgLexerKeyword afsocket_keywords[] = {
   { "ip_protocol",        KW_IP_PROTOCOL },
   { "max_connections",    KW_MAX_CONNECTIONS },
   { "keep_alive",         KW_KEEP_ALIVE },
+  { "recv_batch_size",    KW_RECV_BATCH_SIZE },
+  { "listeners",          KW_LISTENERS },
+  { "compression",        KW_COMPRESSION },
+  { "compression_level",  KW_COMPRESSION_LEVEL },
   { "systemd_syslog",            KW_SYSTEMD_SYSLOG  },
   { NULL }
 };
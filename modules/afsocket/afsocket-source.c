@@ -26,6 +26,7 @@
 #include "misc.h"
 #include "gsocket.h"
 #include "stats/stats-registry.h"
+#include "transport/transport-compress.h"
 #include "mainloop.h"
 #include "poll-fd-events.h"
 
@@ -46,8 +47,20 @@ typedef struct _AFSocketSourceConnection
   LogReader *reader;
   int sock;
   GSockAddr *peer_addr;
+  /* index of the listener socket for dgram connections */
+  gint listener_index;
+  /* bytes read before and after decompression, if compression() is enabled */
+  StatsCounterItem *raw_bytes;
+  StatsCounterItem *compressed_bytes;
 } AFSocketSourceConnection;
 
+struct _AFSocketSourceListener
+{
+  struct iv_fd listen_fd;
+  AFSocketSourceDriver *owner;
+  gint fd;
+};
+
 static void afsocket_sd_close_connection(AFSocketSourceDriver *self, AFSocketSourceConnection *sc);
 
 static gchar *
@@ -62,6 +75,14 @@ afsocket_sc_stats_instance(AFSocketSourceConnection *self)
       if (self->owner->bind_addr)
         {
           g_sockaddr_format(self->owner->bind_addr, buf, sizeof(buf), GSA_ADDRESS_ONLY);
+
+          /* additional SO_REUSEPORT listeners get their own counters */
+          if (self->listener_index > 0)
+            {
+              gsize len = strlen(buf);
+
+              g_snprintf(buf + len, sizeof(buf) - len, "#%d", self->listener_index);
+            }
           return buf;
         }
       else
@@ -76,7 +97,39 @@ afsocket_sc_stats_instance(AFSocketSourceConnection *self)
 static LogTransport *
 afsocket_sc_construct_transport(AFSocketSourceConnection *self, gint fd)
 {
-  return transport_mapper_construct_log_transport(self->owner->transport_mapper, fd);
+  LogTransport *transport = transport_mapper_construct_log_transport(self->owner->transport_mapper, fd);
+
+  return transport_mapper_compress_log_transport(self->owner->transport_mapper, transport,
+                                                 self->raw_bytes, self->compressed_bytes);
+}
+
+static void
+afsocket_sc_register_compression_counters(AFSocketSourceConnection *self)
+{
+  TransportMapper *transport_mapper = self->owner->transport_mapper;
+
+  if (transport_mapper->compression == LTC_NONE)
+    return;
+
+  stats_lock();
+  stats_register_counter(STATS_LEVEL1, transport_mapper->stats_source | SCS_SOURCE, self->owner->super.super.id,
+                         afsocket_sc_stats_instance(self), SC_TYPE_RAW_BYTES, &self->raw_bytes);
+  stats_register_counter(STATS_LEVEL1, transport_mapper->stats_source | SCS_SOURCE, self->owner->super.super.id,
+                         afsocket_sc_stats_instance(self), SC_TYPE_COMPRESSED_BYTES, &self->compressed_bytes);
+  stats_unlock();
+}
+
+static void
+afsocket_sc_unregister_compression_counters(AFSocketSourceConnection *self)
+{
+  TransportMapper *transport_mapper = self->owner->transport_mapper;
+
+  stats_lock();
+  stats_unregister_counter(transport_mapper->stats_source | SCS_SOURCE, self->owner->super.super.id,
+                           afsocket_sc_stats_instance(self), SC_TYPE_RAW_BYTES, &self->raw_bytes);
+  stats_unregister_counter(transport_mapper->stats_source | SCS_SOURCE, self->owner->super.super.id,
+                           afsocket_sc_stats_instance(self), SC_TYPE_COMPRESSED_BYTES, &self->compressed_bytes);
+  stats_unlock();
 }
 
 static gboolean
@@ -86,6 +139,10 @@ afsocket_sc_init(LogPipe *s)
   LogTransport *transport;
   LogProtoServer *proto;
 
+  /* counters are kept in the stats registry across reloads, so a
+   * transport kept from the previous configuration still points to
+   * the right ones */
+  afsocket_sc_register_compression_counters(self);
   if (!self->reader)
     {
       transport = afsocket_sc_construct_transport(self, self->sock);
@@ -118,6 +175,7 @@ afsocket_sc_deinit(LogPipe *s)
 {
   AFSocketSourceConnection *self = (AFSocketSourceConnection *) s;
 
+  afsocket_sc_unregister_compression_counters(self);
   log_pipe_unref(&self->owner->super.super.super);
   self->owner = NULL;
 
@@ -248,6 +306,14 @@ afsocket_sd_set_max_connections(LogDriver *s, gint max_connections)
   self->max_connections = max_connections;
 }
 
+void
+afsocket_sd_set_listeners(LogDriver *s, gint num_listeners)
+{
+  AFSocketSourceDriver *self = (AFSocketSourceDriver *) s;
+
+  self->num_listeners = num_listeners;
+}
+
 static inline gchar *
 afsocket_sd_format_persist_name(AFSocketSourceDriver *self, gboolean listener_name)
 {
@@ -261,6 +327,40 @@ afsocket_sd_format_persist_name(AFSocketSourceDriver *self, gboolean listener_na
   return persist_name;
 }
 
+static inline gchar *
+afsocket_sd_format_listener_persist_name(AFSocketSourceDriver *self, gint listener_index)
+{
+  static gchar persist_name[160];
+
+  /* the first listener keeps the name used before listeners() existed */
+  if (listener_index == 0)
+    return afsocket_sd_format_persist_name(self, TRUE);
+
+  g_snprintf(persist_name, sizeof(persist_name), "%s#%d",
+             afsocket_sd_format_persist_name(self, TRUE), listener_index);
+  return persist_name;
+}
+
+static gboolean
+afsocket_sd_setup_connection(AFSocketSourceDriver *self, GSockAddr *client_addr, gint fd, gint listener_index)
+{
+  AFSocketSourceConnection *conn;
+
+  conn = afsocket_sc_new(client_addr, fd, self->super.super.super.cfg);
+  conn->listener_index = listener_index;
+  afsocket_sc_set_owner(conn, self);
+  if (!log_pipe_init(&conn->super))
+    {
+      log_pipe_unref(&conn->super);
+      return FALSE;
+    }
+
+  afsocket_sd_add_connection(self, conn);
+  self->num_connections++;
+  log_pipe_append(&conn->super, &self->super.super.super);
+  return TRUE;
+}
+
 static gboolean
 afsocket_sd_process_connection(AFSocketSourceDriver *self, GSockAddr *client_addr, GSockAddr *local_addr, gint fd)
 {
@@ -298,25 +398,7 @@ afsocket_sd_process_connection(AFSocketSourceDriver *self, GSockAddr *client_add
                 NULL);
       return FALSE;
     }
-  else
-    {
-      AFSocketSourceConnection *conn;
-
-      conn = afsocket_sc_new(client_addr, fd, self->super.super.super.cfg);
-      afsocket_sc_set_owner(conn, self);
-      if (log_pipe_init(&conn->super))
-        {
-          afsocket_sd_add_connection(self, conn);
-          self->num_connections++;
-          log_pipe_append(&conn->super, &self->super.super.super);
-        }
-      else
-        {
-          log_pipe_unref(&conn->super);
-          return FALSE;
-        }
-    }
-  return TRUE;
+  return afsocket_sd_setup_connection(self, client_addr, fd, 0);
 }
 
 #define MAX_ACCEPTS_AT_A_TIME 30
@@ -324,7 +406,8 @@ afsocket_sd_process_connection(AFSocketSourceDriver *self, GSockAddr *client_add
 static void
 afsocket_sd_accept(gpointer s)
 {
-  AFSocketSourceDriver *self = (AFSocketSourceDriver *) s;
+  AFSocketSourceListener *listener = (AFSocketSourceListener *) s;
+  AFSocketSourceDriver *self = listener->owner;
   GSockAddr *peer_addr;
   gchar buf1[256], buf2[256];
   gint new_fd;
@@ -335,7 +418,7 @@ afsocket_sd_accept(gpointer s)
     {
       GIOStatus status;
 
-      status = g_accept(self->fd, &new_fd, &peer_addr);
+      status = g_accept(listener->fd, &new_fd, &peer_addr);
       if (status == G_IO_STATUS_AGAIN)
         {
           /* no more connections to accept */
@@ -406,18 +489,30 @@ afsocket_sd_close_connection(AFSocketSourceDriver *self, AFSocketSourceConnectio
 static void
 afsocket_sd_start_watches(AFSocketSourceDriver *self)
 {
-  IV_FD_INIT(&self->listen_fd);
-  self->listen_fd.fd = self->fd;
-  self->listen_fd.cookie = self;
-  self->listen_fd.handler_in = afsocket_sd_accept;
-  iv_fd_register(&self->listen_fd);
+  gint i;
+
+  for (i = 0; i < self->num_listeners; i++)
+    {
+      AFSocketSourceListener *listener = &self->listeners[i];
+
+      IV_FD_INIT(&listener->listen_fd);
+      listener->listen_fd.fd = listener->fd;
+      listener->listen_fd.cookie = listener;
+      listener->listen_fd.handler_in = afsocket_sd_accept;
+      iv_fd_register(&listener->listen_fd);
+    }
 }
 
 static void
 afsocket_sd_stop_watches(AFSocketSourceDriver *self)
 {
-  if (iv_fd_registered (&self->listen_fd))
-    iv_fd_unregister(&self->listen_fd);
+  gint i;
+
+  for (i = 0; i < self->num_listeners; i++)
+    {
+      if (iv_fd_registered (&self->listeners[i].listen_fd))
+        iv_fd_unregister(&self->listeners[i].listen_fd);
+    }
 }
 
 static gboolean
@@ -500,31 +595,114 @@ afsocket_sd_restore_kept_alive_connections(AFSocketSourceDriver *self)
   return TRUE;
 }
 
+/*
+ * The additional listeners can only be bound next to the first one if
+ * that was bound with SO_REUSEPORT too, which is not the case for a
+ * socket kept alive from a listeners(1) configuration or one passed by
+ * the runtime environment.
+ */
 static gboolean
-afsocket_sd_open_listener(AFSocketSourceDriver *self)
+afsocket_sd_listener_is_shareable(AFSocketSourceDriver *self, gint sock)
+{
+  if (self->num_listeners <= 1)
+    return TRUE;
+
+#ifdef SO_REUSEPORT
+  {
+    gint reuseport = 0;
+    socklen_t len = sizeof(reuseport);
+
+    if (getsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &reuseport, &len) == 0 && reuseport)
+      return TRUE;
+  }
+#endif
+  return FALSE;
+}
+
+static gboolean
+afsocket_sd_open_socket(AFSocketSourceDriver *self, gint listener_index, gint *sock)
+{
+  /* the runtime environment hands over at most a single socket, any
+   * additional listeners are opened by us */
+  if (listener_index == 0)
+    {
+      if (!afsocket_sd_acquire_socket(self, sock))
+        return FALSE;
+      if (*sock != -1)
+        {
+          if (afsocket_sd_listener_is_shareable(self, *sock))
+            return TRUE;
+
+          msg_error("The socket passed by the runtime environment is not bound with SO_REUSEPORT, "
+                    "it cannot be shared with additional listeners, use listeners(1) with it",
+                    evt_tag_int("fd", *sock),
+                    evt_tag_int("listeners", self->num_listeners),
+                    NULL);
+          *sock = -1;
+          return FALSE;
+        }
+    }
+  return transport_mapper_open_socket(self->transport_mapper, self->socket_options, self->bind_addr, AFSOCKET_DIR_RECV, sock);
+}
+
+static void
+afsocket_sd_log_reopen_listener(AFSocketSourceDriver *self, gint sock)
+{
+  msg_verbose("Reopening the kept alive listener with SO_REUSEPORT, as the number of listeners changed",
+              evt_tag_int("fd", sock),
+              evt_tag_int("listeners", self->num_listeners),
+              NULL);
+}
+
+static void
+afsocket_sd_close_listeners(AFSocketSourceDriver *self)
+{
+  gint i;
+
+  for (i = 0; i < self->num_listeners; i++)
+    {
+      if (self->listeners[i].fd != -1)
+        close(self->listeners[i].fd);
+    }
+  g_free(self->listeners);
+  self->listeners = NULL;
+}
+
+static gboolean
+afsocket_sd_open_stream_listeners(AFSocketSourceDriver *self)
 {
   GlobalConfig *cfg = log_pipe_get_config(&self->super.super.super);
-  gint sock;
-  gboolean res = FALSE;
+  gint i;
 
-  /* ok, we have connection list, check if we need to open a listener */
-  sock = -1;
-  if (self->transport_mapper->sock_type == SOCK_STREAM)
+  self->listeners = g_new0(AFSocketSourceListener, self->num_listeners);
+  for (i = 0; i < self->num_listeners; i++)
+    self->listeners[i].fd = -1;
+
+  for (i = 0; i < self->num_listeners; i++)
     {
+      AFSocketSourceListener *listener = &self->listeners[i];
+      gint sock = -1;
+
+      listener->owner = self;
       if (self->connections_kept_alive_accross_reloads)
         {
           /* NOTE: this assumes that fd 0 will never be used for listening fds,
            * main.c opens fd 0 so this assumption can hold */
-          sock = GPOINTER_TO_UINT(cfg_persist_config_fetch(cfg, afsocket_sd_format_persist_name(self, TRUE))) - 1;
+          sock = GPOINTER_TO_UINT(cfg_persist_config_fetch(cfg, afsocket_sd_format_listener_persist_name(self, i))) - 1;
+          if (sock != -1 && !afsocket_sd_listener_is_shareable(self, sock))
+            {
+              afsocket_sd_log_reopen_listener(self, sock);
+              close(sock);
+              sock = -1;
+            }
         }
 
-      if (sock == -1)
+      if (sock == -1 && !afsocket_sd_open_socket(self, i, &sock))
         {
-          if (!afsocket_sd_acquire_socket(self, &sock))
-            return self->super.super.optional;
-          if (sock == -1 && !transport_mapper_open_socket(self->transport_mapper, self->socket_options, self->bind_addr, AFSOCKET_DIR_RECV, &sock))
-            return self->super.super.optional;
+          afsocket_sd_close_listeners(self);
+          return self->super.super.optional;
         }
+      listener->fd = sock;
 
       /* set up listening source */
       if (listen(sock, self->listen_backlog) < 0)
@@ -532,30 +710,78 @@ afsocket_sd_open_listener(AFSocketSourceDriver *self)
           msg_error("Error during listen()",
                     evt_tag_errno(EVT_TAG_OSERROR, errno),
                     NULL);
-          close(sock);
+          afsocket_sd_close_listeners(self);
           return FALSE;
         }
+    }
+
+  afsocket_sd_start_watches(self);
+  return TRUE;
+}
 
-      self->fd = sock;
-      afsocket_sd_start_watches(self);
-      res = TRUE;
+static gboolean
+afsocket_sd_has_dgram_listener(AFSocketSourceDriver *self, gint listener_index)
+{
+  GList *l;
+
+  for (l = self->connections; l; l = l->next)
+    {
+      if (((AFSocketSourceConnection *) l->data)->listener_index == listener_index)
+        return TRUE;
     }
-  else
+  return FALSE;
+}
+
+static gboolean
+afsocket_sd_open_dgram_listeners(AFSocketSourceDriver *self)
+{
+  GList *l, *next;
+  gint i;
+
+  /* drop kept-alive sockets that are beyond the configured listeners(),
+   * or that additional listeners could not be bound next to */
+  for (l = self->connections; l; l = next)
     {
-      if (!self->connections)
+      AFSocketSourceConnection *sc = (AFSocketSourceConnection *) l->data;
+      gboolean reopen = (sc->listener_index == 0 && !afsocket_sd_listener_is_shareable(self, sc->sock));
+
+      next = l->next;
+      if (reopen)
+        afsocket_sd_log_reopen_listener(self, sc->sock);
+      if (reopen || sc->listener_index >= self->num_listeners)
         {
-          if (!afsocket_sd_acquire_socket(self, &sock))
-            return self->super.super.optional;
-          if (sock == -1 && !transport_mapper_open_socket(self->transport_mapper, self->socket_options, self->bind_addr, AFSOCKET_DIR_RECV, &sock))
-            return self->super.super.optional;
+          log_pipe_deinit(&sc->super);
+          self->connections = g_list_remove(self->connections, sc);
+          afsocket_sd_kill_connection(sc);
+          self->num_connections--;
         }
-      self->fd = -1;
+    }
+
+  /* each dgram socket is a connection on its own, open the ones that
+   * were not kept alive across the reload */
+  for (i = 0; i < self->num_listeners; i++)
+    {
+      gint sock;
+
+      if (afsocket_sd_has_dgram_listener(self, i))
+        continue;
 
-      /* we either have self->connections != NULL, or sock contains a new fd */
-      if (self->connections || afsocket_sd_process_connection(self, NULL, self->bind_addr, sock))
-        res = TRUE;
+      if (!afsocket_sd_open_socket(self, i, &sock))
+        return self->super.super.optional;
+      if (!afsocket_sd_setup_connection(self, NULL, sock, i))
+        return FALSE;
     }
-  return res;
+  return TRUE;
+}
+
+static gboolean
+afsocket_sd_open_listener(AFSocketSourceDriver *self)
+{
+  /* ok, we have connection list, check if we need to open a listener */
+  if (self->transport_mapper->sock_type == SOCK_STREAM)
+    return afsocket_sd_open_stream_listeners(self);
+  else
+    return afsocket_sd_open_dgram_listeners(self);
 }
 
 static void
@@ -595,23 +821,32 @@ afsocket_sd_save_listener(AFSocketSourceDriver *self)
 {
   GlobalConfig *cfg = log_pipe_get_config(&self->super.super.super);
 
-  if (self->transport_mapper->sock_type == SOCK_STREAM)
+  gint i;
+
+  if (self->transport_mapper->sock_type == SOCK_STREAM && self->listeners)
     {
       afsocket_sd_stop_watches(self);
-      if (!self->connections_kept_alive_accross_reloads)
-        {
-          msg_verbose("Closing listener fd",
-                      evt_tag_int("fd", self->fd),
-                      NULL);
-          close(self->fd);
-        }
-      else
+      for (i = 0; i < self->num_listeners; i++)
         {
-          /* NOTE: the fd is incremented by one when added to persistent config
-           * as persist config cannot store NULL */
+          gint fd = self->listeners[i].fd;
 
-          cfg_persist_config_add(cfg, afsocket_sd_format_persist_name(self, TRUE), GUINT_TO_POINTER(self->fd + 1), afsocket_sd_close_fd, FALSE);
+          if (!self->connections_kept_alive_accross_reloads)
+            {
+              msg_verbose("Closing listener fd",
+                          evt_tag_int("fd", fd),
+                          NULL);
+              close(fd);
+            }
+          else
+            {
+              /* NOTE: the fd is incremented by one when added to persistent config
+               * as persist config cannot store NULL */
+
+              cfg_persist_config_add(cfg, afsocket_sd_format_listener_persist_name(self, i), GUINT_TO_POINTER(fd + 1), afsocket_sd_close_fd, FALSE);
+            }
         }
+      g_free(self->listeners);
+      self->listeners = NULL;
     }
 }
 
@@ -627,6 +862,11 @@ afsocket_sd_init_method(LogPipe *s)
 {
   AFSocketSourceDriver *self = (AFSocketSourceDriver *) s;
 
+  /* the additional listeners are bound to the same address, which needs
+   * SO_REUSEPORT regardless of where so-reuseport() was in the config */
+  if (self->num_listeners > 1)
+    self->socket_options->so_reuseport = TRUE;
+
   return log_src_driver_init_method(s) &&
          afsocket_sd_setup_transport(self) &&
          afsocket_sd_setup_addresses(self) &&
@@ -688,6 +928,7 @@ afsocket_sd_init_instance(AFSocketSourceDriver *self,
   self->socket_options = socket_options;
   self->transport_mapper = transport_mapper;
   self->max_connections = 10;
+  self->num_listeners = 1;
   self->listen_backlog = 255;
   self->connections_kept_alive_accross_reloads = TRUE;
   log_reader_options_defaults(&self->reader_options);
@@ -25,6 +25,30 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <errno.h>
+
+/* SO_REUSEPORT only has an effect if it is set before bind(), thus it is
+ * not part of the setup_socket() method which runs after binding */
+gboolean
+socket_options_setup_reuseport(SocketOptions *self, gint fd)
+{
+  if (!self->so_reuseport)
+    return TRUE;
+
+#ifdef SO_REUSEPORT
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &self->so_reuseport, sizeof(self->so_reuseport)) < 0)
+    {
+      msg_error("Error setting SO_REUSEPORT on socket",
+                evt_tag_errno(EVT_TAG_OSERROR, errno),
+                NULL);
+      return FALSE;
+    }
+  return TRUE;
+#else
+  msg_error("so-reuseport() is set but no SO_REUSEPORT setsockopt on this platform", NULL);
+  return FALSE;
+#endif
+}
 
 gboolean
 socket_options_setup_socket_method(SocketOptions *self, gint fd, GSockAddr *bind_addr, AFSocketDirection dir)
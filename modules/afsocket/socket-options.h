@@ -40,10 +40,12 @@ struct _SocketOptions
   gint so_rcvbuf;
   gint so_broadcast;
   gint so_keepalive;
+  gint so_reuseport;
   gboolean (*setup_socket)(SocketOptions *s, gint sock, GSockAddr *bind_addr, AFSocketDirection dir);
   void (*free)(gpointer s);
 };
 
+gboolean socket_options_setup_reuseport(SocketOptions *self, gint fd);
 gboolean socket_options_setup_socket_method(SocketOptions *self, gint fd, GSockAddr *bind_addr, AFSocketDirection dir);
 void socket_options_init_instance(SocketOptions *self);
 SocketOptions *socket_options_new(void);
@@ -0,0 +1,116 @@
+#include "afinet-source.h"
+#include "afsocket-source.h"
+#include "apphook.h"
+#include "cfg.h"
+#include "mainloop.h"
+#include "plugin.h"
+#include "libtest/testutils.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string.h>
+
+static gint test_port;
+
+static AFSocketSourceDriver *
+create_source(gboolean stream, gint port, gint num_listeners)
+{
+  AFInetSourceDriver *self = stream ? afinet_sd_new_tcp(configuration) : afinet_sd_new_udp(configuration);
+  gchar port_str[16];
+
+  g_snprintf(port_str, sizeof(port_str), "%d", port);
+  self->super.super.super.group = g_strdup("s_test");
+  self->super.super.super.id = g_strdup("s_test#0");
+  afinet_sd_set_localip(&self->super.super.super, "127.0.0.1");
+  afinet_sd_set_localport(&self->super.super.super, port_str);
+  afsocket_sd_set_listeners(&self->super.super.super, num_listeners);
+  return &self->super;
+}
+
+static void
+destroy_source(AFSocketSourceDriver *self)
+{
+  assert_true(log_pipe_deinit(&self->super.super.super), "Error deinitializing the source");
+  log_pipe_unref(&self->super.super.super);
+}
+
+/* binding another SO_REUSEPORT socket only succeeds if every socket bound to the port uses it */
+static gboolean
+port_is_shared(gboolean stream, gint port)
+{
+  struct sockaddr_in sin;
+  gint fd, on = 1;
+  gboolean result;
+
+  fd = socket(AF_INET, stream ? SOCK_STREAM : SOCK_DGRAM, 0);
+#ifdef SO_REUSEPORT
+  setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+#endif
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(port);
+  sin.sin_addr.s_addr = inet_addr("127.0.0.1");
+  result = bind(fd, (struct sockaddr *) &sin, sizeof(sin)) == 0;
+  close(fd);
+  return result;
+}
+
+static void
+test_dgram_listeners_share_the_port(void)
+{
+  gint port = test_port++;
+  AFSocketSourceDriver *self = create_source(FALSE, port, 4);
+
+  assert_true(log_pipe_init(&self->super.super.super), "Error initializing a source with listeners(4)");
+  assert_gint(self->num_connections, 4, "Every listener should have its own dgram connection");
+  assert_true(port_is_shared(FALSE, port), "The listeners were not bound with SO_REUSEPORT");
+  destroy_source(self);
+}
+
+static void
+test_kept_alive_listener_is_reopened_when_listeners_are_added(gboolean stream)
+{
+  gint port = test_port++;
+  AFSocketSourceDriver *self = create_source(stream, port, 1);
+
+  testcase_begin("%s(%s)", __FUNCTION__, stream ? "stream" : "dgram");
+
+  /* the listener of listeners(1) is bound without SO_REUSEPORT and kept alive across the reload */
+  assert_true(log_pipe_init(&self->super.super.super), "Error initializing a source with listeners(1)");
+  destroy_source(self);
+
+  self = create_source(stream, port, 4);
+  assert_true(log_pipe_init(&self->super.super.super),
+              "Additional listeners could not be bound next to the kept alive one");
+  if (!stream)
+    assert_gint(self->num_connections, 4, "Every listener should have its own dgram connection");
+  assert_true(port_is_shared(stream, port), "The kept alive listener was not reopened with SO_REUSEPORT");
+  destroy_source(self);
+
+  testcase_end();
+}
+
+int
+main(int argc, char *argv[])
+{
+  app_startup();
+  main_thread_handle = get_thread_id();
+
+  configuration = cfg_new(0x0302);
+  configuration->persist = persist_config_new();
+  plugin_load_module("syslogformat", configuration, NULL);
+  test_port = 20000 + getpid() % 20000;
+
+  test_dgram_listeners_share_the_port();
+  test_kept_alive_listener_is_reopened_when_listeners_are_added(TRUE);
+  test_kept_alive_listener_is_reopened_when_listeners_are_added(FALSE);
+
+  persist_config_free(configuration->persist);
+  configuration->persist = NULL;
+  cfg_free(configuration);
+
+  app_shutdown();
+  return 0;
+}
@@ -6,6 +6,11 @@
 #include "socket-options-inet.h"
 #include "transport-mapper-lib.h"
 
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
 TransportMapper *transport_mapper;
 
 #define transport_mapper_inet_testcase_begin(init_name, func, args) 	        \
@@ -71,6 +76,25 @@ create_socket_with_address(GSockAddr *addr, gint *sock)
   return transport_mapper_open_socket(transport_mapper, &sock_options->super, addr, AFSOCKET_DIR_RECV, sock);
 }
 
+static gboolean
+create_reuseport_socket_with_address(GSockAddr *addr, gint *sock)
+{
+  SocketOptionsInet *sock_options = socket_options_inet_new_instance();
+
+  sock_options->super.so_reuseport = TRUE;
+  return transport_mapper_open_socket(transport_mapper, &sock_options->super, addr, AFSOCKET_DIR_RECV, sock);
+}
+
+static GSockAddr *
+get_bound_address(gint sock)
+{
+  struct sockaddr_in sin;
+  socklen_t len = sizeof(sin);
+
+  assert_gint(getsockname(sock, (struct sockaddr *) &sin, &len), 0, "getsockname() failed");
+  return g_sockaddr_inet_new("127.0.0.1", ntohs(sin.sin_port));
+}
+
 static gboolean
 create_socket(gint *sock)
 {
@@ -323,6 +347,27 @@ test_open_socket_fails_properly_on_bind_failure(void)
   g_sockaddr_unref(addr);
 }
 
+#ifdef SO_REUSEPORT
+static void
+test_open_socket_with_reuseport_shares_the_address(void)
+{
+  GSockAddr *addr = g_sockaddr_inet_new("127.0.0.1", 0);
+  gint first, second, third;
+
+  assert_true(create_reuseport_socket_with_address(addr, &first), "opening the first SO_REUSEPORT socket failed");
+  g_sockaddr_unref(addr);
+
+  addr = get_bound_address(first);
+  assert_true(create_reuseport_socket_with_address(addr, &second), "opening a second SO_REUSEPORT socket on the same address failed");
+  assert_true(create_reuseport_socket_with_address(addr, &third), "opening a third SO_REUSEPORT socket on the same address failed");
+  g_sockaddr_unref(addr);
+
+  close(first);
+  close(second);
+  close(third);
+}
+#endif
+
 static void
 test_transport_mapper_inet(void)
 {
@@ -346,6 +391,10 @@ test_transport_mapper_inet(void)
   TRANSPORT_MAPPER_TESTCASE(tcp, test_open_socket_opens_a_socket_and_applies_socket_options);
   TRANSPORT_MAPPER_TESTCASE(tcp, test_open_socket_fails_properly_on_socket_failure);
   TRANSPORT_MAPPER_TESTCASE(tcp, test_open_socket_fails_properly_on_bind_failure);
+#ifdef SO_REUSEPORT
+  TRANSPORT_MAPPER_TESTCASE(udp, test_open_socket_with_reuseport_shares_the_address);
+  TRANSPORT_MAPPER_TESTCASE(tcp, test_open_socket_with_reuseport_shares_the_address);
+#endif
 }
 
 int
@@ -81,7 +81,8 @@ transport_mapper_inet_apply_transport_method(TransportMapper *s, GlobalConfig *c
   if (!transport_mapper_apply_transport_method(s, cfg))
     return FALSE;
   
-  return transport_mapper_inet_validate_tls_options(self);
+  return transport_mapper_inet_validate_tls_options(self) &&
+         transport_mapper_validate_compression(s);
 }
 
 static LogTransport *
@@ -225,7 +226,8 @@ transport_mapper_network_apply_transport(TransportMapper *s, GlobalConfig *cfg)
 
   g_assert(self->server_port != 0);
 
-  if (!transport_mapper_inet_validate_tls_options(self))
+  if (!transport_mapper_inet_validate_tls_options(self) ||
+      !transport_mapper_validate_compression(s))
     return FALSE;
 
   return TRUE;
@@ -298,7 +300,8 @@ transport_mapper_syslog_apply_transport(TransportMapper *s, GlobalConfig *cfg)
     }
   g_assert(self->server_port != 0);
 
-  if (!transport_mapper_inet_validate_tls_options(self))
+  if (!transport_mapper_inet_validate_tls_options(self) ||
+      !transport_mapper_validate_compression(s))
     return FALSE;
 
   return TRUE;
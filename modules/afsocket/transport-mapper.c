@@ -28,6 +28,7 @@
 #include "messages.h"
 #include "misc.h"
 #include "transport/transport-socket.h"
+#include "transport/transport-compress.h"
 
 static gboolean
 transport_mapper_privileged_bind(gint sock, GSockAddr *bind_addr)
@@ -66,6 +67,9 @@ transport_mapper_open_socket(TransportMapper *self,
   g_fd_set_nonblock(sock, TRUE);
   g_fd_set_cloexec(sock, TRUE);
 
+  if (!socket_options_setup_reuseport(socket_options, sock))
+    goto error_close;
+
   if (!transport_mapper_privileged_bind(sock, bind_addr))
     {
       gchar buf[256];
@@ -96,15 +100,52 @@ transport_mapper_apply_transport_method(TransportMapper *self, GlobalConfig *cfg
   return TRUE;
 }
 
+/* called once sock_type is known, as only stream connections can be compressed */
+gboolean
+transport_mapper_validate_compression(TransportMapper *self)
+{
+  if (self->compression == LTC_NONE)
+    return TRUE;
+
+  if (self->sock_type != SOCK_STREAM)
+    {
+      msg_error("compression() is only supported for stream based transports",
+                evt_tag_str("transport", self->transport),
+                NULL);
+      return FALSE;
+    }
+  if (!log_transport_compression_check_level(self->compression, self->compression_level))
+    {
+      msg_error("compression-level() is out of range for the selected compression() method",
+                evt_tag_int("compression-level", self->compression_level),
+                NULL);
+      return FALSE;
+    }
+  return TRUE;
+}
+
 LogTransport *
 transport_mapper_construct_log_transport_method(TransportMapper *self, gint fd)
 {
   if (self->sock_type == SOCK_DGRAM)
-    return log_transport_dgram_socket_new(fd);
+    return log_transport_batched_dgram_socket_new(fd, self->recv_batch_size);
   else
     return log_transport_stream_socket_new(fd);
 }
 
+/* stacks the compression() layer on top of @transport, if any */
+LogTransport *
+transport_mapper_compress_log_transport(TransportMapper *self, LogTransport *transport,
+                                        StatsCounterItem *raw_bytes, StatsCounterItem *compressed_bytes)
+{
+  if (!transport || self->compression == LTC_NONE)
+    return transport;
+
+  transport = log_transport_compress_new(transport, self->compression, self->compression_level);
+  log_transport_compress_set_counters(transport, raw_bytes, compressed_bytes);
+  return transport;
+}
+
 void
 transport_mapper_set_transport(TransportMapper *self, const gchar *transport)
 {
@@ -118,6 +159,30 @@ transport_mapper_set_address_family(TransportMapper *self, gint address_family)
   self->address_family = address_family;
 }
 
+void
+transport_mapper_set_recv_batch_size(TransportMapper *self, gint recv_batch_size)
+{
+  self->recv_batch_size = recv_batch_size;
+}
+
+gboolean
+transport_mapper_set_compression(TransportMapper *self, const gchar *compression)
+{
+  gint method = log_transport_compression_lookup(compression);
+
+  if (method < 0)
+    return FALSE;
+
+  self->compression = method;
+  return TRUE;
+}
+
+void
+transport_mapper_set_compression_level(TransportMapper *self, gint compression_level)
+{
+  self->compression_level = compression_level;
+}
+
 void
 transport_mapper_free_method(TransportMapper *self)
 {
@@ -130,6 +195,9 @@ transport_mapper_init_instance(TransportMapper *self, const gchar *transport)
   self->transport = g_strdup(transport);
   self->address_family = -1;
   self->sock_type = -1;
+  self->recv_batch_size = 1;
+  self->compression = LTC_NONE;
+  self->compression_level = -1;
   self->free_fn = transport_mapper_free_method;
   self->apply_transport = transport_mapper_apply_transport_method;
   self->construct_log_transport = transport_mapper_construct_log_transport_method;
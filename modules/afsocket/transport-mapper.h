@@ -26,6 +26,7 @@
 
 #include "socket-options.h"
 #include "transport/logtransport.h"
+#include "stats/stats-counter.h"
 #include "gsockaddr.h"
 
 typedef struct _TransportMapper TransportMapper;
@@ -44,6 +45,11 @@ struct _TransportMapper
 
   const gchar *logproto;
   gint stats_source;
+  /* number of datagrams received by a single syscall in datagram based sources */
+  gint recv_batch_size;
+  /* LTC_XXX method applied to stream connections and its level, -1 for the default */
+  gint compression;
+  gint compression_level;
 
   gboolean (*apply_transport)(TransportMapper *self, GlobalConfig *cfg);
   LogTransport *(*construct_log_transport)(TransportMapper *self, gint fd);
@@ -52,6 +58,9 @@ struct _TransportMapper
 
 void transport_mapper_set_transport(TransportMapper *self, const gchar *transport);
 void transport_mapper_set_address_family(TransportMapper *self, gint address_family);
+void transport_mapper_set_recv_batch_size(TransportMapper *self, gint recv_batch_size);
+gboolean transport_mapper_set_compression(TransportMapper *self, const gchar *compression);
+void transport_mapper_set_compression_level(TransportMapper *self, gint compression_level);
 
 gboolean transport_mapper_open_socket(TransportMapper *self,
                                       SocketOptions *socket_options,
@@ -60,7 +69,10 @@ gboolean transport_mapper_open_socket(TransportMapper *self,
                                       int *fd);
 
 gboolean transport_mapper_apply_transport_method(TransportMapper *self, GlobalConfig *cfg);
+gboolean transport_mapper_validate_compression(TransportMapper *self);
 LogTransport *transport_mapper_construct_log_transport_method(TransportMapper *self, gint fd);
+LogTransport *transport_mapper_compress_log_transport(TransportMapper *self, LogTransport *transport,
+                                                      StatsCounterItem *raw_bytes, StatsCounterItem *compressed_bytes);
 
 void transport_mapper_init_instance(TransportMapper *self, const gchar *transport);
 void transport_mapper_free(TransportMapper *self);
@@ -260,7 +260,7 @@ afstomp_set_frame_body(STOMPDestDriver *self, SBGString *body, stomp_frame* fram
   if (self->body_template)
     {
       log_template_format(self->body_template, msg, NULL, LTZ_LOCAL,
-                          self->super.seq_num, NULL, sb_gstring_string(body));
+                          log_threaded_dest_driver_get_seq_num(&self->super), NULL, sb_gstring_string(body));
       stomp_frame_set_body(frame, sb_gstring_string(body)->str, sb_gstring_string(body)->len);
     }
 }
@@ -289,12 +289,12 @@ afstomp_worker_publish(STOMPDestDriver *self, LogMessage *msg)
   stomp_frame_add_header(&frame, "destination", self->destination);
   if (self->ack_needed)
     {
-      g_snprintf(seq_num, sizeof(seq_num), "%i", self->super.seq_num);
+      g_snprintf(seq_num, sizeof(seq_num), "%i", log_threaded_dest_driver_get_seq_num(&self->super));
       stomp_frame_add_header(&frame, "receipt", seq_num);
     };
 
   value_pairs_foreach(self->vp, afstomp_vp_foreach, msg,
-                      self->super.seq_num, LTZ_SEND,
+                      log_threaded_dest_driver_get_seq_num(&self->super), LTZ_SEND,
                       &self->template_options, &frame);
 
   afstomp_set_frame_body(self, body, &frame, msg);
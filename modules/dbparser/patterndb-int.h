@@ -194,12 +194,14 @@ typedef struct _PDBProgram
 {
   guint ref_cnt;
   RNode *rules;
+  RCompiledTree *compiled_rules;
 } PDBProgram;
 
 /* rules loaded from a pdb file */
 typedef struct _PDBRuleSet
 {
   RNode *programs;
+  RCompiledTree *compiled_programs;
   gchar *version;
   gchar *pub_date;
 } PDBRuleSet;
@@ -219,15 +221,44 @@ struct _PDBLookupParams
   gssize message_len;
 };
 
-struct _PatternDB
+/* number of independently locked partitions of the correllation state,
+ * entries are assigned to a shard based on the hash of their key */
+#define PDB_STATE_SHARDS 16
+
+typedef struct _PDBStateShard
 {
-  GStaticRWLock lock;
-  PDBRuleSet *ruleset;
+  GStaticMutex lock;
   GHashTable *state;
+  /* NULL for rate limit shards, those have no timers */
   TimerWheel *timer_wheel;
+} PDBStateShard;
+
+struct _PatternDB
+{
+  /* the ruleset is immutable once loaded and is replaced as a whole on
+   * reload. Lookups don't lock, they register themselves in
+   * ruleset_readers[ruleset_epoch & 1] instead, and a reload waits for the
+   * readers of the previous epoch before freeing the old ruleset. */
+  GStaticMutex ruleset_lock;
+  PDBRuleSet *ruleset;
+  gint ruleset_epoch;
+  gint ruleset_readers[2];
+
+  /* the current time of the correllation engine and the system time it
+   * was last updated at, the timer wheels of the shards catch up with
+   * "now" whenever they are locked */
+  GStaticMutex time_lock;
+  glong now;
   GTimeVal last_tick;
+
+  /* contexts and rate limits are stored separately, so that a context
+   * shard lock may be held while a rate limit is checked */
+  PDBStateShard context_shards[PDB_STATE_SHARDS];
+  PDBStateShard rate_limit_shards[PDB_STATE_SHARDS];
   PatternDBEmitFunc emit;
   gpointer emit_data;
 };
 
+void pattern_db_advance_time(PatternDB *self, gint timeout);
+
 #endif
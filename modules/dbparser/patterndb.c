@@ -274,6 +274,96 @@ pdb_state_entry_free(gpointer s)
     pdb_rate_limit_free(&self->rate_limit);
 }
 
+/*********************************************************
+ * PDBStateShard, a partition of the state hash table
+ *********************************************************/
+
+static void
+pdb_state_shard_init(PDBStateShard *self, gboolean with_timers)
+{
+  g_static_mutex_init(&self->lock);
+  self->state = g_hash_table_new_full(pdb_state_key_hash, pdb_state_key_equal, NULL, (GDestroyNotify) pdb_state_entry_free);
+  self->timer_wheel = with_timers ? timer_wheel_new() : NULL;
+}
+
+static void
+pdb_state_shard_destroy(PDBStateShard *self)
+{
+  /* the timer wheel holds references to the contexts, free it first */
+  if (self->timer_wheel)
+    timer_wheel_free(self->timer_wheel);
+  if (self->state)
+    g_hash_table_destroy(self->state);
+  self->timer_wheel = NULL;
+  self->state = NULL;
+  g_static_mutex_free(&self->lock);
+}
+
+/* drops all state in the shard, no timeouts are run */
+static void
+pdb_state_shard_forget(PDBStateShard *self)
+{
+  gboolean with_timers = self->timer_wheel != NULL;
+
+  g_static_mutex_lock(&self->lock);
+  if (self->timer_wheel)
+    timer_wheel_free(self->timer_wheel);
+  g_hash_table_destroy(self->state);
+  self->state = g_hash_table_new_full(pdb_state_key_hash, pdb_state_key_equal, NULL, (GDestroyNotify) pdb_state_entry_free);
+  self->timer_wheel = with_timers ? timer_wheel_new() : NULL;
+  g_static_mutex_unlock(&self->lock);
+}
+
+static inline PDBStateShard *
+pattern_db_get_context_shard(PatternDB *self, PDBStateKey *key)
+{
+  return &self->context_shards[pdb_state_key_hash(key) % PDB_STATE_SHARDS];
+}
+
+static inline PDBStateShard *
+pattern_db_get_rate_limit_shard(PatternDB *self, PDBStateKey *key)
+{
+  return &self->rate_limit_shards[pdb_state_key_hash(key) % PDB_STATE_SHARDS];
+}
+
+/* NOTE: reads "now" without taking time_lock, it is a single word that
+ * only ever increases between pattern_db_forget_state() calls */
+static inline guint64
+pattern_db_get_time(PatternDB *self)
+{
+  return (guint64) self->now;
+}
+
+/*
+ * Locks a context shard and brings its timer wheel up to date, which
+ * might expire some of the contexts in the shard.
+ */
+static void
+pattern_db_lock_context_shard(PatternDB *self, PDBStateShard *shard)
+{
+  g_static_mutex_lock(&shard->lock);
+  timer_wheel_set_time(shard->timer_wheel, pattern_db_get_time(self));
+}
+
+static void
+pattern_db_unlock_context_shard(PatternDB *self, PDBStateShard *shard)
+{
+  g_static_mutex_unlock(&shard->lock);
+}
+
+/* NOTE: must be called without holding any of the shard locks */
+static void
+pattern_db_advance_context_shards(PatternDB *self)
+{
+  gint i;
+
+  for (i = 0; i < PDB_STATE_SHARDS; i++)
+    {
+      pattern_db_lock_context_shard(self, &self->context_shards[i]);
+      pattern_db_unlock_context_shard(self, &self->context_shards[i]);
+    }
+}
+
 /*********************************************************
  * PDBMessage
  *********************************************************/
@@ -414,9 +504,11 @@ pdb_action_set_message_inheritance(PDBAction *self, const gchar *inherit_propert
 static inline gboolean
 pdb_action_check_rate_limit(PDBAction *self, PDBRule *rule, PatternDB *db, LogMessage *msg, GString *buffer)
 {
+  PDBStateShard *shard;
   PDBStateKey key;
   PDBRateLimit *rl;
   guint64 now;
+  gboolean passed = FALSE;
 
   if (self->rate == 0)
     return TRUE;
@@ -424,14 +516,16 @@ pdb_action_check_rate_limit(PDBAction *self, PDBRule *rule, PatternDB *db, LogMe
   g_string_printf(buffer, "%s:%d", rule->rule_id, self->id);
   pdb_state_key_setup(&key, PSK_RATE_LIMIT, rule, msg, buffer->str);
 
-  rl = g_hash_table_lookup(db->state, &key);
+  shard = pattern_db_get_rate_limit_shard(db, &key);
+  g_static_mutex_lock(&shard->lock);
+  rl = g_hash_table_lookup(shard->state, &key);
   if (!rl)
     {
       rl = pdb_rate_limit_new(&key);
-      g_hash_table_insert(db->state, &rl->key, rl);
+      g_hash_table_insert(shard->state, &rl->key, rl);
       g_string_steal(buffer);
     }
-  now = timer_wheel_get_time(db->timer_wheel);
+  now = pattern_db_get_time(db);
   if (rl->last_check == 0)
     {
       rl->last_check = now;
@@ -455,9 +549,10 @@ pdb_action_check_rate_limit(PDBAction *self, PDBRule *rule, PatternDB *db, LogMe
   if (rl->buckets)
     {
       rl->buckets--;
-      return TRUE;
+      passed = TRUE;
     }
-  return FALSE;
+  g_static_mutex_unlock(&shard->lock);
+  return passed;
 }
 
 gboolean
@@ -847,6 +942,8 @@ pdb_program_unref(PDBProgram *s)
 
   if (--self->ref_cnt == 0)
     {
+      if (self->compiled_rules)
+        r_free_compiled_tree(self->compiled_rules);
       if (self->rules)
         r_free_node(self->rules, (void (*)(void *)) pdb_rule_unref);
 
@@ -1325,6 +1422,32 @@ GMarkupParser db_parser =
   .error = NULL
 };
 
+static void
+_compile_program_rules(RNode *node)
+{
+  PDBProgram *program = (PDBProgram *) node->value;
+  gint i;
+
+  if (program && !program->compiled_rules)
+    program->compiled_rules = r_compile_tree(program->rules);
+
+  for (i = 0; i < node->num_children; i++)
+    _compile_program_rules(node->children[i]);
+  for (i = 0; i < node->num_pchildren; i++)
+    _compile_program_rules(node->pchildren[i]);
+}
+
+/*
+ * Builds the compiled representation of the program and rule radix trees
+ * used by pdb_rule_set_lookup(). The trees must not change afterwards.
+ */
+static void
+pdb_rule_set_compile(PDBRuleSet *self)
+{
+  _compile_program_rules(self->programs);
+  self->compiled_programs = r_compile_tree(self->programs);
+}
+
 gboolean
 pdb_rule_set_load(PDBRuleSet *self, GlobalConfig *cfg, const gchar *config, GList **examples)
 {
@@ -1380,6 +1503,8 @@ pdb_rule_set_load(PDBRuleSet *self, GlobalConfig *cfg, const gchar *config, GLis
       goto error;
     }
 
+  pdb_rule_set_compile(self);
+
   if (state.load_examples)
     *examples = state.examples;
 
@@ -1442,12 +1567,12 @@ pdb_rule_set_lookup(PDBRuleSet *self, PDBLookupParams *lookup, GArray *dbg_list)
   const gchar *program;
   gssize program_len;
 
-  if (G_UNLIKELY(!self->programs))
+  if (G_UNLIKELY(!self->compiled_programs))
     return FALSE;
 
   program = log_msg_get_value(msg, lookup->program_handle, &program_len);
   prg_matches = g_array_new(FALSE, TRUE, sizeof(RParserMatch));
-  node = r_find_node(self->programs, (gchar *) program, program_len, prg_matches);
+  node = r_find_compiled_node(self->compiled_programs, (gchar *) program, program_len, prg_matches);
 
   if (node)
     {
@@ -1482,7 +1607,7 @@ pdb_rule_set_lookup(PDBRuleSet *self, PDBLookupParams *lookup, GArray *dbg_list)
           if (G_UNLIKELY(dbg_list))
             msg_node = r_find_node_dbg(program->rules, (gchar *) message, message_len, matches, dbg_list);
           else
-            msg_node = r_find_node(program->rules, (gchar *) message, message_len, matches);
+            msg_node = r_find_compiled_node(program->compiled_rules, (gchar *) message, message_len, matches);
 
           if (msg_node)
             {
@@ -1535,6 +1660,8 @@ pdb_rule_set_new(void)
 void
 pdb_rule_set_free(PDBRuleSet *self)
 {
+  if (self->compiled_programs)
+    r_free_compiled_tree(self->compiled_programs);
   if (self->programs)
     r_free_node(self->programs, (GDestroyNotify) pdb_program_unref);
   if (self->version)
@@ -1542,6 +1669,7 @@ pdb_rule_set_free(PDBRuleSet *self)
   if (self->pub_date)
     g_free(self->pub_date);
   self->programs = NULL;
+  self->compiled_programs = NULL;
   self->version = NULL;
   self->pub_date = NULL;
 
@@ -1552,12 +1680,10 @@ pdb_rule_set_free(PDBRuleSet *self)
  * PatternDB
  *********************************************************/
 
-/* NOTE: this function requires PatternDB reader/writer lock to be
- * write-locked.
- *
- * Currently, it is, as timer_wheel_set_time() is only called with that
- * precondition, and timer-wheel callbacks are only called from within
- * timer_wheel_set_time().
+/* NOTE: this function is called with the lock of the context's shard
+ * held, as timer-wheel callbacks are only called from within
+ * timer_wheel_set_time() and timer_wheel_expire_all(), and the timer wheel
+ * of a shard is only touched with its lock held.
  */
 
 static void
@@ -1570,11 +1696,11 @@ pattern_db_expire_entry(guint64 now, gpointer user_data)
 
   msg_debug("Expiring patterndb correllation context",
             evt_tag_str("last_rule", context->rule->rule_id),
-            evt_tag_long("utc", timer_wheel_get_time(context->db->timer_wheel)),
+            evt_tag_long("utc", now),
             NULL);
   if (pdb->emit)
     pdb_rule_run_actions(context->rule, context->db, RAT_TIMEOUT, context, msg, buffer);
-  g_hash_table_remove(context->db->state, &context->key);
+  g_hash_table_remove(pattern_db_get_context_shard(pdb, &context->key)->state, &context->key);
   g_string_free(buffer, TRUE);
 
   /* pdb_context_free is automatically called when returning from
@@ -1595,8 +1721,9 @@ pattern_db_timer_tick(PatternDB *self)
 {
   GTimeVal now;
   glong diff;
+  gboolean advanced = FALSE;
 
-  g_static_rw_lock_writer_lock(&self->lock);
+  g_static_mutex_lock(&self->time_lock);
   cached_g_current_time(&now);
   diff = g_time_val_diff(&now, &self->last_tick);
 
@@ -1604,10 +1731,9 @@ pattern_db_timer_tick(PatternDB *self)
     {
       glong diff_sec = diff / 1e6;
 
-      timer_wheel_set_time(self->timer_wheel, timer_wheel_get_time(self->timer_wheel) + diff_sec);
-      msg_debug("Advancing patterndb current time because of timer tick",
-                evt_tag_long("utc", timer_wheel_get_time(self->timer_wheel)),
-                NULL);
+      self->now += diff_sec;
+      advanced = TRUE;
+
       /* update last_tick, take the fraction of the seconds not calculated into this update into account */
 
       self->last_tick = now;
@@ -1621,14 +1747,30 @@ pattern_db_timer_tick(PatternDB *self)
        */
       self->last_tick = now;
     }
-  g_static_rw_lock_writer_unlock(&self->lock);
+  g_static_mutex_unlock(&self->time_lock);
+
+  if (advanced)
+    {
+      msg_debug("Advancing patterndb current time because of timer tick",
+                evt_tag_long("utc", pattern_db_get_time(self)),
+                NULL);
+      pattern_db_advance_context_shards(self);
+    }
 }
 
-/* NOTE: lock should be acquired for writing before calling this function. */
+/*
+ * NOTE: must be called without holding any of the shard locks.
+ *
+ * The time lock is only taken if the time moves forward or the system
+ * time reached a new second since the last update, so last_tick may lag
+ * behind the last message by less than a second.
+ */
 void
 pattern_db_set_time(PatternDB *self, const LogStamp *ls)
 {
   GTimeVal now;
+  glong new_time;
+  gboolean advanced;
 
   /* clamp the current time between the timestamp of the current message
    * (low limit) and the current system time (high limit).  This ensures
@@ -1636,21 +1778,64 @@ pattern_db_set_time(PatternDB *self, const LogStamp *ls)
    * correllation engine too much. */
 
   cached_g_current_time(&now);
+  new_time = MIN(ls->tv_sec, now.tv_sec);
+
+  if (new_time <= self->now && now.tv_sec == self->last_tick.tv_sec)
+    return;
+
+  g_static_mutex_lock(&self->time_lock);
   self->last_tick = now;
+  advanced = new_time > self->now;
+  if (advanced)
+    self->now = new_time;
+  g_static_mutex_unlock(&self->time_lock);
 
-  if (ls->tv_sec < now.tv_sec)
-    now.tv_sec = ls->tv_sec;
+  if (advanced)
+    {
+      msg_debug("Advancing patterndb current time because of an incoming message",
+                evt_tag_long("utc", new_time),
+                NULL);
+      pattern_db_advance_context_shards(self);
+    }
+}
 
-  timer_wheel_set_time(self->timer_wheel, now.tv_sec);
-  msg_debug("Advancing patterndb current time because of an incoming message",
-            evt_tag_long("utc", timer_wheel_get_time(self->timer_wheel)),
-            NULL);
+/* moves the time forward by @timeout seconds, expiring contexts as needed */
+void
+pattern_db_advance_time(PatternDB *self, gint timeout)
+{
+  g_static_mutex_lock(&self->time_lock);
+  self->now += timeout;
+  g_static_mutex_unlock(&self->time_lock);
+  pattern_db_advance_context_shards(self);
+}
+
+static PDBRuleSet *
+pattern_db_acquire_ruleset(PatternDB *self, gint *epoch)
+{
+  /* retry if a reload flipped the epoch under us, as that reload might
+   * not wait for the readers of the epoch we registered in */
+  while (1)
+    {
+      *epoch = g_atomic_int_get(&self->ruleset_epoch);
+      g_atomic_int_inc(&self->ruleset_readers[*epoch & 1]);
+      if (g_atomic_int_get(&self->ruleset_epoch) == *epoch)
+        break;
+      g_atomic_int_add(&self->ruleset_readers[*epoch & 1], -1);
+    }
+  return (PDBRuleSet *) g_atomic_pointer_get(&self->ruleset);
+}
+
+static void
+pattern_db_release_ruleset(PatternDB *self, gint epoch)
+{
+  g_atomic_int_add(&self->ruleset_readers[epoch & 1], -1);
 }
 
 gboolean
 pattern_db_reload_ruleset(PatternDB *self, GlobalConfig *cfg, const gchar *pdb_file)
 {
-  PDBRuleSet *new_ruleset;
+  PDBRuleSet *new_ruleset, *old_ruleset;
+  gint old_epoch;
 
   new_ruleset = pdb_rule_set_new();
   if (!pdb_rule_set_load(new_ruleset, cfg, pdb_file, NULL))
@@ -1658,37 +1843,53 @@ pattern_db_reload_ruleset(PatternDB *self, GlobalConfig *cfg, const gchar *pdb_f
       pdb_rule_set_free(new_ruleset);
       return FALSE;
     }
-  else
-    {
-      g_static_rw_lock_writer_lock(&self->lock);
-      if (self->ruleset)
-        pdb_rule_set_free(self->ruleset);
-      self->ruleset = new_ruleset;
-      g_static_rw_lock_writer_unlock(&self->lock);
-      return TRUE;
-    }
+
+  g_static_mutex_lock(&self->ruleset_lock);
+  old_ruleset = self->ruleset;
+  g_atomic_pointer_set(&self->ruleset, new_ruleset);
+
+  /* readers registering from now on use the other counter, wait until
+   * the ones that may still see the old ruleset are finished */
+  old_epoch = g_atomic_int_get(&self->ruleset_epoch);
+  g_atomic_int_inc(&self->ruleset_epoch);
+  while (g_atomic_int_get(&self->ruleset_readers[old_epoch & 1]) != 0)
+    g_thread_yield();
+  g_static_mutex_unlock(&self->ruleset_lock);
+
+  if (old_ruleset)
+    pdb_rule_set_free(old_ruleset);
+  return TRUE;
 }
 
 void
 pattern_db_expire_state(PatternDB *self)
 {
-  g_static_rw_lock_writer_lock(&self->lock);
-  timer_wheel_expire_all(self->timer_wheel);
-  g_static_rw_lock_writer_unlock(&self->lock);
+  gint i;
+
+  for (i = 0; i < PDB_STATE_SHARDS; i++)
+    {
+      PDBStateShard *shard = &self->context_shards[i];
+
+      g_static_mutex_lock(&shard->lock);
+      timer_wheel_expire_all(shard->timer_wheel);
+      g_static_mutex_unlock(&shard->lock);
+    }
 }
 
 void
 pattern_db_forget_state(PatternDB *self)
 {
-  g_static_rw_lock_writer_lock(&self->lock);
-  if (self->timer_wheel)
-    timer_wheel_free(self->timer_wheel);
+  gint i;
 
-  if (self->state)
-    g_hash_table_destroy(self->state);
-  self->state = g_hash_table_new_full(pdb_state_key_hash, pdb_state_key_equal, NULL, (GDestroyNotify) pdb_state_entry_free);
-  self->timer_wheel = timer_wheel_new();
-  g_static_rw_lock_writer_unlock(&self->lock);
+  for (i = 0; i < PDB_STATE_SHARDS; i++)
+    {
+      pdb_state_shard_forget(&self->context_shards[i]);
+      pdb_state_shard_forget(&self->rate_limit_shards[i]);
+    }
+
+  g_static_mutex_lock(&self->time_lock);
+  self->now = 0;
+  g_static_mutex_unlock(&self->time_lock);
 }
 
 void
@@ -1713,22 +1914,28 @@ pattern_db_get_ruleset_version(PatternDB *self)
 static gboolean
 _pattern_db_process(PatternDB *self, PDBLookupParams *lookup, GArray *dbg_list)
 {
+  PDBRuleSet *ruleset;
   PDBRule *rule;
   LogMessage *msg = lookup->msg;
+  gint epoch;
 
-  if (G_UNLIKELY(!self->ruleset))
-    return FALSE;
+  ruleset = pattern_db_acquire_ruleset(self, &epoch);
+  if (G_UNLIKELY(!ruleset))
+    {
+      pattern_db_release_ruleset(self, epoch);
+      return FALSE;
+    }
 
-  g_static_rw_lock_reader_lock(&self->lock);
-  rule = pdb_rule_set_lookup(self->ruleset, lookup, dbg_list);
-  g_static_rw_lock_reader_unlock(&self->lock);
+  rule = pdb_rule_set_lookup(ruleset, lookup, dbg_list);
+  pattern_db_release_ruleset(self, epoch);
+
+  pattern_db_set_time(self, &msg->timestamps[LM_TS_STAMP]);
   if (rule)
     {
       PDBContext *context = NULL;
+      PDBStateShard *shard = NULL;
       GString *buffer = g_string_sized_new(32);
 
-      g_static_rw_lock_writer_lock(&self->lock);
-      pattern_db_set_time(self, &msg->timestamps[LM_TS_STAMP]);
       if (rule->context_id_template)
         {
           PDBStateKey key;
@@ -1737,17 +1944,20 @@ _pattern_db_process(PatternDB *self, PDBLookupParams *lookup, GArray *dbg_list)
           log_msg_set_value(msg, context_id_handle, buffer->str, -1);
 
           pdb_state_key_setup(&key, PSK_CONTEXT, rule, msg, buffer->str);
-          context = g_hash_table_lookup(self->state, &key);
+          shard = pattern_db_get_context_shard(self, &key);
+          pattern_db_lock_context_shard(self, shard);
+
+          context = g_hash_table_lookup(shard->state, &key);
           if (!context)
             {
               msg_debug("Correllation context lookup failure, starting a new context",
                         evt_tag_str("rule", rule->rule_id),
                         evt_tag_str("context", buffer->str),
                         evt_tag_int("context_timeout", rule->context_timeout),
-                        evt_tag_int("context_expiration", timer_wheel_get_time(self->timer_wheel) + rule->context_timeout),
+                        evt_tag_int("context_expiration", timer_wheel_get_time(shard->timer_wheel) + rule->context_timeout),
                         NULL);
               context = pdb_context_new(self, &key);
-              g_hash_table_insert(self->state, &context->key, context);
+              g_hash_table_insert(shard->state, &context->key, context);
               g_string_steal(buffer);
             }
           else
@@ -1756,7 +1966,7 @@ _pattern_db_process(PatternDB *self, PDBLookupParams *lookup, GArray *dbg_list)
                         evt_tag_str("rule", rule->rule_id),
                         evt_tag_str("context", buffer->str),
                         evt_tag_int("context_timeout", rule->context_timeout),
-                        evt_tag_int("context_expiration", timer_wheel_get_time(self->timer_wheel) + rule->context_timeout),
+                        evt_tag_int("context_expiration", timer_wheel_get_time(shard->timer_wheel) + rule->context_timeout),
                         evt_tag_int("num_messages", context->messages->len),
                         NULL);
             }
@@ -1765,11 +1975,11 @@ _pattern_db_process(PatternDB *self, PDBLookupParams *lookup, GArray *dbg_list)
 
           if (context->timer)
             {
-              timer_wheel_mod_timer(self->timer_wheel, context->timer, rule->context_timeout);
+              timer_wheel_mod_timer(shard->timer_wheel, context->timer, rule->context_timeout);
             }
           else
             {
-              context->timer = timer_wheel_add_timer(self->timer_wheel, rule->context_timeout, pattern_db_expire_entry, pdb_context_ref(context), (GDestroyNotify) pdb_context_unref);
+              context->timer = timer_wheel_add_timer(shard->timer_wheel, rule->context_timeout, pattern_db_expire_entry, pdb_context_ref(context), (GDestroyNotify) pdb_context_unref);
             }
           if (context->rule != rule)
             {
@@ -1790,7 +2000,8 @@ _pattern_db_process(PatternDB *self, PDBLookupParams *lookup, GArray *dbg_list)
           pdb_rule_run_actions(rule, self, RAT_MATCH, context, msg, buffer);
         }
       pdb_rule_unref(rule);
-      g_static_rw_lock_writer_unlock(&self->lock);
+      if (shard)
+        pattern_db_unlock_context_shard(self, shard);
 
       if (context)
         log_msg_write_protect(msg);
@@ -1799,9 +2010,6 @@ _pattern_db_process(PatternDB *self, PDBLookupParams *lookup, GArray *dbg_list)
     }
   else
     {
-      g_static_rw_lock_writer_lock(&self->lock);
-      pattern_db_set_time(self, &msg->timestamps[LM_TS_STAMP]);
-      g_static_rw_lock_writer_unlock(&self->lock);
       if (self->emit)
         self->emit(msg, FALSE, self->emit_data);
     }
@@ -1851,26 +2059,35 @@ PatternDB *
 pattern_db_new(void)
 {
   PatternDB *self = g_new0(PatternDB, 1);
+  gint i;
 
   self->ruleset = pdb_rule_set_new();
-  self->state = g_hash_table_new_full(pdb_state_key_hash, pdb_state_key_equal, NULL, (GDestroyNotify) pdb_state_entry_free);
-  self->timer_wheel = timer_wheel_new();
+  for (i = 0; i < PDB_STATE_SHARDS; i++)
+    {
+      pdb_state_shard_init(&self->context_shards[i], TRUE);
+      pdb_state_shard_init(&self->rate_limit_shards[i], FALSE);
+    }
   cached_g_current_time(&self->last_tick);
-  g_static_rw_lock_init(&self->lock);
+  g_static_mutex_init(&self->ruleset_lock);
+  g_static_mutex_init(&self->time_lock);
   return self;
 }
 
 void
 pattern_db_free(PatternDB *self)
 {
+  gint i;
+
   if (self->ruleset)
     pdb_rule_set_free(self->ruleset);
 
-  if (self->state)
-    g_hash_table_destroy(self->state);
-  if (self->timer_wheel)
-    timer_wheel_free(self->timer_wheel);
-  g_static_rw_lock_free(&self->lock);
+  for (i = 0; i < PDB_STATE_SHARDS; i++)
+    {
+      pdb_state_shard_destroy(&self->context_shards[i]);
+      pdb_state_shard_destroy(&self->rate_limit_shards[i]);
+    }
+  g_static_mutex_free(&self->ruleset_lock);
+  g_static_mutex_free(&self->time_lock);
   g_free(self);
 }
 
@@ -96,21 +96,163 @@ ptz_find_frequent_words_remove_key_predicate(gpointer key, gpointer value, gpoin
   return (*((guint *) value) < GPOINTER_TO_UINT(support));
 }
 
-GHashTable *
-ptz_find_frequent_words(GPtrArray *logs, guint support, gchar *delimiters, gboolean two_pass)
+/*
+ * Threading: the input is split into contiguous ranges of log lines, each
+ * processed by its own thread into thread local hash tables, which are
+ * merged once all threads are finished.
+ */
+
+static guint
+ptz_get_num_of_threads(GPtrArray *logs, guint num_of_threads)
+{
+  return MAX(1, MIN(num_of_threads, logs->len));
+}
+
+static void
+ptz_get_thread_range(GPtrArray *logs, guint num_of_threads, guint thread_index, guint *first, guint *last)
+{
+  *first = (guint) (((guint64) logs->len * thread_index) / num_of_threads);
+  *last = (guint) (((guint64) logs->len * (thread_index + 1)) / num_of_threads);
+}
+
+/* runs @func for each of the @num_of_threads elements of the @workers array, in parallel */
+static void
+ptz_run_threads(GThreadFunc func, gpointer workers, gsize worker_size, guint num_of_threads)
+{
+  GThread **threads;
+  guint i;
+
+  if (num_of_threads == 1)
+    {
+      func(workers);
+      return;
+    }
+
+  threads = g_new(GThread *, num_of_threads);
+  for (i = 0; i < num_of_threads; i++)
+    threads[i] = g_thread_create(func, ((gchar *) workers) + i * worker_size, TRUE, NULL);
+  for (i = 0; i < num_of_threads; i++)
+    g_thread_join(threads[i]);
+  g_free(threads);
+}
+
+typedef struct _PtzFrequentWordsWorker
 {
-  int i, j, pass;
+  GPtrArray *logs;
+  guint first, last;
+  gchar *delimiters;
+  gint pass;
+  gboolean two_pass;
+  guint support;
+  /* shared between the threads, only updated atomically */
+  gint *wordlist_cache;
+  guint cachesize, cacheseed;
+  /* thread local word counts */
+  GHashTable *wordlist;
+} PtzFrequentWordsWorker;
+
+static gpointer
+ptz_find_frequent_words_thread(gpointer user_data)
+{
+  PtzFrequentWordsWorker *self = (PtzFrequentWordsWorker *) user_data;
+  GString *hash_key = g_string_sized_new(64);
+  guint cacheindex = 0;
   guint *curr_count;
   LogMessage *msg;
   gchar *msgstr;
   gssize msglen;
   gchar **words;
+  int i, j;
+
+  for (i = self->first; i < self->last; ++i)
+    {
+      msg = (LogMessage *) g_ptr_array_index(self->logs, i);
+      msgstr = (gchar *) log_msg_get_value(msg, LM_V_MESSAGE, &msglen);
+
+      words = g_strsplit_set(msgstr, self->delimiters, PTZ_MAXWORDS);
+
+      for (j = 0; words[j]; ++j)
+        {
+          /* NOTE: to calculate the key for the hash, we prefix a word with
+           * its position in the row and a space -- as we always split at
+           * spaces, this should not create confusion
+           */
+          g_string_printf(hash_key, "%d %s", j, words[j]);
+
+          if (self->two_pass)
+            cacheindex = ptz_str2hash(hash_key->str, self->cachesize, self->cacheseed);
+
+          if (self->pass == 1)
+            {
+              g_atomic_int_inc(&self->wordlist_cache[cacheindex]);
+            }
+          else if (self->pass == 2)
+            {
+              if (!self->two_pass || self->wordlist_cache[cacheindex] >= self->support)
+                {
+                  curr_count = (guint *) g_hash_table_lookup(self->wordlist, hash_key->str);
+                  if (!curr_count)
+                    {
+                      guint *currcount_ref = g_new(guint, 1);
+                      (*currcount_ref) = 1;
+                      g_hash_table_insert(self->wordlist, g_strdup(hash_key->str), currcount_ref);
+                    }
+                  else
+                    {
+                      (*curr_count)++;
+                    }
+                }
+            }
+        }
+
+      g_strfreev(words);
+    }
+
+  g_string_free(hash_key, TRUE);
+  return NULL;
+}
+
+/* callback function for g_hash_table_foreach_steal to sum up the word counts of two threads */
+static gboolean
+ptz_merge_wordlists(gpointer _key, gpointer _value, gpointer _target)
+{
+  guint *count = _value;
+  GHashTable *target = _target;
+  guint *target_count;
+
+  target_count = (guint *) g_hash_table_lookup(target, _key);
+  if (!target_count)
+    {
+      g_hash_table_insert(target, _key, count);
+    }
+  else
+    {
+      (*target_count) += (*count);
+      g_free(_key);
+      g_free(count);
+    }
+  return TRUE;
+}
+
+GHashTable *
+ptz_find_frequent_words(GPtrArray *logs, guint support, gchar *delimiters, gboolean two_pass, guint num_of_threads)
+{
+  int i, pass;
   GHashTable *wordlist;
-  int *wordlist_cache = NULL;
-  guint cachesize = 0, cacheseed = 0, cacheindex = 0;
-  gchar *hash_key;
+  PtzFrequentWordsWorker *workers;
+  gint *wordlist_cache = NULL;
+  guint cachesize = 0, cacheseed = 0;
 
-  wordlist = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  num_of_threads = ptz_get_num_of_threads(logs, num_of_threads);
+  workers = g_new0(PtzFrequentWordsWorker, num_of_threads);
+  for (i = 0; i < num_of_threads; ++i)
+    {
+      workers[i].logs = logs;
+      ptz_get_thread_range(logs, num_of_threads, i, &workers[i].first, &workers[i].last);
+      workers[i].delimiters = delimiters;
+      workers[i].two_pass = two_pass;
+      workers[i].support = support;
+    }
 
   for (pass = (two_pass ? 1 : 2); pass <= 2; ++pass)
     {
@@ -122,7 +264,7 @@ ptz_find_frequent_words(GPtrArray *logs, guint support, gchar *delimiters, gbool
           srand(time(NULL));
           cachesize = (guint) ((logs->len * PTZ_WORDLIST_CACHE));
           cacheseed = rand();
-          wordlist_cache = g_new0(int, cachesize);
+          wordlist_cache = g_new0(gint, cachesize);
         }
       else
         {
@@ -131,60 +273,32 @@ ptz_find_frequent_words(GPtrArray *logs, guint support, gchar *delimiters, gbool
                        NULL);
         }
 
-      for (i = 0; i < logs->len; ++i)
+      for (i = 0; i < num_of_threads; ++i)
         {
-          msg = (LogMessage *) g_ptr_array_index(logs, i);
-          msgstr = (gchar *) log_msg_get_value(msg, LM_V_MESSAGE, &msglen);
-
-          words = g_strsplit_set(msgstr, delimiters, PTZ_MAXWORDS);
-
-          for (j = 0; words[j]; ++j)
-            {
-              /* NOTE: to calculate the key for the hash, we prefix a word with
-               * its position in the row and a space -- as we always split at
-               * spaces, this should not create confusion
-               */
-              hash_key = g_strdup_printf("%d %s", j, words[j]);
-
-              if (two_pass)
-                cacheindex = ptz_str2hash(hash_key, cachesize, cacheseed);
-
-              if (pass == 1)
-                {
-                  wordlist_cache[cacheindex]++;
-                }
-              else if (pass == 2)
-                {
-                  if (!two_pass || wordlist_cache[cacheindex] >= support)
-                    {
-                      curr_count = (guint *) g_hash_table_lookup(wordlist, hash_key);
-                      if (!curr_count)
-                        {
-                          guint *currcount_ref = g_new(guint, 1);
-                          (*currcount_ref) = 1;
-                          g_hash_table_insert(wordlist, g_strdup(hash_key), currcount_ref);
-                        }
-                      else
-                        {
-                          (*curr_count)++;
-                        }
-                    }
-                }
-
-              g_free(hash_key);
-
-            }
-
-          g_strfreev(words);
+          workers[i].pass = pass;
+          workers[i].wordlist_cache = wordlist_cache;
+          workers[i].cachesize = cachesize;
+          workers[i].cacheseed = cacheseed;
+          if (pass == 2)
+            workers[i].wordlist = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
         }
+      ptz_run_threads(ptz_find_frequent_words_thread, workers, sizeof(workers[0]), num_of_threads);
+    }
 
-      /* g_hash_table_foreach(wordlist, _ptz_debug_print_word, NULL); */
-
-      g_hash_table_foreach_remove(wordlist, ptz_find_frequent_words_remove_key_predicate, GUINT_TO_POINTER(support));
+  wordlist = workers[0].wordlist;
+  for (i = 1; i < num_of_threads; ++i)
+    {
+      g_hash_table_foreach_steal(workers[i].wordlist, ptz_merge_wordlists, wordlist);
+      g_hash_table_destroy(workers[i].wordlist);
     }
 
+  /* g_hash_table_foreach(wordlist, _ptz_debug_print_word, NULL); */
+
+  g_hash_table_foreach_remove(wordlist, ptz_find_frequent_words_remove_key_predicate, GUINT_TO_POINTER(support));
+
   if (wordlist_cache)
     g_free(wordlist_cache);
+  g_free(workers);
 
   return wordlist;
 }
@@ -193,26 +307,21 @@ gboolean
 ptz_find_clusters_remove_cluster_predicate(gpointer key, gpointer value, gpointer data)
 {
   Cluster *val = (Cluster *) value;
-  gboolean ret;
-  LogMessage *msg;
   guint support;
-  int i;
 
   support = GPOINTER_TO_UINT(data);
 
-  ret = (val->loglines->len < support);
-  if (ret)
-    {
-      /* remove cluster reference from the relevant logs */
-      for (i = 0; i < val->loglines->len; ++i)
-        {
-          msg = (LogMessage *) g_ptr_array_index(val->loglines, i);
-          log_msg_clear_tag_by_id(msg, cluster_tag_id);
-        }
-    }
+  return (val->loglines->len < support);
+}
 
-  return ret;
+static void
+ptz_find_clusters_tag_loglines(gpointer key, gpointer value, gpointer user_data)
+{
+  Cluster *cluster = (Cluster *) value;
+  int i;
 
+  for (i = 0; i < cluster->loglines->len; ++i)
+    log_msg_set_tag_by_id((LogMessage *) g_ptr_array_index(cluster->loglines, i), cluster_tag_id);
 }
 
 static void
@@ -232,56 +341,60 @@ cluster_free(Cluster *cluster)
   g_free(cluster);
 }
 
-GHashTable *
-ptz_find_clusters_slct(GPtrArray *logs, guint support, gchar *delimiters, guint num_of_samples)
+typedef struct _PtzClustersWorker
 {
+  GPtrArray *logs;
+  guint first, last;
+  gchar *delimiters;
+  guint num_of_samples;
+  /* shared between the threads, read-only */
   GHashTable *wordlist;
+  /* thread local cluster candidates */
   GHashTable *clusters;
+} PtzClustersWorker;
+
+static gpointer
+ptz_find_clusters_slct_thread(gpointer user_data)
+{
+  PtzClustersWorker *self = (PtzClustersWorker *) user_data;
   int i, j;
   LogMessage *msg;
   gchar *msgstr;
   gssize msglen;
   gchar **words;
-  gchar *hash_key;
+  GString *hash_key;
   gboolean is_candidate;
   Cluster *cluster;
   GString *cluster_key;
   gchar * msgdelimiters;
 
-  /* get the frequent word list */
-  wordlist = ptz_find_frequent_words(logs, support, delimiters, TRUE);
-  /* g_hash_table_foreach(wordlist, _ptz_debug_print_word, NULL); */
-
-  /* find the cluster candidates */
-  clusters = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify) cluster_free);
   cluster_key = g_string_sized_new(0);
-  for (i = 0; i < logs->len; ++i)
+  hash_key = g_string_sized_new(64);
+  for (i = self->first; i < self->last; ++i)
     {
-      msg = (LogMessage *) g_ptr_array_index(logs, i);
+      msg = (LogMessage *) g_ptr_array_index(self->logs, i);
       msgstr = (gchar *) log_msg_get_value(msg, LM_V_MESSAGE, &msglen);
 
       g_string_truncate(cluster_key, 0);
 
-      words = g_strsplit_set(msgstr, delimiters, PTZ_MAXWORDS);
-      msgdelimiters = ptz_find_delimiters(msgstr, delimiters);
+      words = g_strsplit_set(msgstr, self->delimiters, PTZ_MAXWORDS);
+      msgdelimiters = ptz_find_delimiters(msgstr, self->delimiters);
 
       is_candidate = FALSE;
       for (j = 0; words[j]; ++j)
         {
-          hash_key = g_strdup_printf("%d %s", j, words[j]);
+          g_string_printf(hash_key, "%d %s", j, words[j]);
 
-          if (g_hash_table_lookup(wordlist, hash_key))
+          if (g_hash_table_lookup(self->wordlist, hash_key->str))
             {
               is_candidate = TRUE;
-              g_string_append(cluster_key, hash_key);
+              g_string_append(cluster_key, hash_key->str);
               g_string_append_c(cluster_key, PTZ_SEPARATOR_CHAR);
             }
           else
             {
               g_string_append_printf(cluster_key, "%d %c%c", j, PTZ_PARSER_MARKER_CHAR, PTZ_SEPARATOR_CHAR);
             }
-
-          g_free(hash_key);
         }
 
       /* append the delimiters of the message to the cluster key to assure unicity
@@ -293,13 +406,13 @@ ptz_find_clusters_slct(GPtrArray *logs, guint support, gchar *delimiters, guint
 
       if (is_candidate)
         {
-          cluster = (Cluster*) g_hash_table_lookup(clusters, cluster_key->str);
+          cluster = (Cluster*) g_hash_table_lookup(self->clusters, cluster_key->str);
 
           if (!cluster)
              {
                cluster = g_new0(Cluster, 1);
 
-               if (num_of_samples > 0)
+               if (self->num_of_samples > 0)
                  {
                    cluster->samples = g_ptr_array_sized_new(5);
                    g_ptr_array_add(cluster->samples, g_strdup(msgstr));
@@ -308,28 +421,104 @@ ptz_find_clusters_slct(GPtrArray *logs, guint support, gchar *delimiters, guint
                g_ptr_array_add(cluster->loglines, (gpointer) msg);
                cluster->words = g_strdupv(words);
 
-               g_hash_table_insert(clusters, g_strdup(cluster_key->str), (gpointer) cluster);
+               g_hash_table_insert(self->clusters, g_strdup(cluster_key->str), (gpointer) cluster);
              }
            else
              {
                g_ptr_array_add(cluster->loglines, (gpointer) msg);
-               if (cluster->samples && cluster->samples->len < num_of_samples)
+               if (cluster->samples && cluster->samples->len < self->num_of_samples)
                  {
                    g_ptr_array_add(cluster->samples, g_strdup(msgstr));
                  }
              }
-          log_msg_set_tag_by_id(msg, cluster_tag_id);
         }
 
       g_strfreev(words);
     }
 
+  g_string_free(hash_key, TRUE);
+  g_string_free(cluster_key, TRUE);
+  return NULL;
+}
+
+typedef struct _PtzMergeClustersState
+{
+  GHashTable *target;
+  guint num_of_samples;
+} PtzMergeClustersState;
+
+/* callback function for g_hash_table_foreach_steal to merge the cluster
+ * candidates of a thread into the ones found by the threads before it */
+static gboolean
+ptz_merge_cluster_candidates(gpointer _key, gpointer _value, gpointer _state)
+{
+  Cluster *cluster = _value;
+  PtzMergeClustersState *state = _state;
+  Cluster *target;
+  int i;
+
+  target = (Cluster *) g_hash_table_lookup(state->target, _key);
+  if (!target)
+    {
+      g_hash_table_insert(state->target, _key, cluster);
+      return TRUE;
+    }
+
+  for (i = 0; i < cluster->loglines->len; ++i)
+    g_ptr_array_add(target->loglines, g_ptr_array_index(cluster->loglines, i));
+  for (i = 0; target->samples && i < cluster->samples->len && target->samples->len < state->num_of_samples; ++i)
+    g_ptr_array_add(target->samples, g_strdup(g_ptr_array_index(cluster->samples, i)));
+
+  cluster_free(cluster);
+  g_free(_key);
+  return TRUE;
+}
+
+GHashTable *
+ptz_find_clusters_slct(GPtrArray *logs, guint support, gchar *delimiters, guint num_of_samples, guint num_of_threads)
+{
+  GHashTable *wordlist;
+  GHashTable *clusters;
+  PtzClustersWorker *workers;
+  PtzMergeClustersState merge_state;
+  int i;
+
+  /* get the frequent word list */
+  wordlist = ptz_find_frequent_words(logs, support, delimiters, TRUE, num_of_threads);
+  /* g_hash_table_foreach(wordlist, _ptz_debug_print_word, NULL); */
+
+  /* find the cluster candidates */
+  num_of_threads = ptz_get_num_of_threads(logs, num_of_threads);
+  workers = g_new0(PtzClustersWorker, num_of_threads);
+  for (i = 0; i < num_of_threads; ++i)
+    {
+      workers[i].logs = logs;
+      ptz_get_thread_range(logs, num_of_threads, i, &workers[i].first, &workers[i].last);
+      workers[i].delimiters = delimiters;
+      workers[i].num_of_samples = num_of_samples;
+      workers[i].wordlist = wordlist;
+      workers[i].clusters = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify) cluster_free);
+    }
+  ptz_run_threads(ptz_find_clusters_slct_thread, workers, sizeof(workers[0]), num_of_threads);
+
+  /* the ranges are merged in order, so the loglines and the samples of
+   * the clusters are in the same order as in the input */
+  clusters = workers[0].clusters;
+  merge_state.target = clusters;
+  merge_state.num_of_samples = num_of_samples;
+  for (i = 1; i < num_of_threads; ++i)
+    {
+      g_hash_table_foreach_steal(workers[i].clusters, ptz_merge_cluster_candidates, &merge_state);
+      g_hash_table_destroy(workers[i].clusters);
+    }
+  g_free(workers);
+
   g_hash_table_foreach_remove(clusters, ptz_find_clusters_remove_cluster_predicate, GUINT_TO_POINTER(support));
+  g_hash_table_foreach(clusters, ptz_find_clusters_tag_loglines, NULL);
 
   /* g_hash_table_foreach(clusters, _ptz_debug_print_cluster, NULL); */
 
   g_hash_table_unref(wordlist);
-  g_string_free(cluster_key, TRUE);
 
   return clusters;
 }
@@ -351,7 +540,7 @@ ptz_find_clusters_step(Patternizer *self, GPtrArray *logs, guint support, guint
 {
   msg_progress("Searching clusters", evt_tag_int("input lines", logs->len), NULL);
   if (self->algo == PTZ_ALGO_SLCT)
-    return ptz_find_clusters_slct(logs, support, self->delimiters, num_of_samples);
+    return ptz_find_clusters_slct(logs, support, self->delimiters, num_of_samples, self->num_of_threads);
   else
     {
       msg_error("Unknown clustering algorithm", evt_tag_int("algo_id", self->algo));
@@ -575,6 +764,27 @@ ptz_print_patterndb(GHashTable *clusters, gchar *delimiters, gboolean named_pars
 
 }
 
+/*
+ * Returns the index in self->logs where the next input line is to be
+ * stored, or -1 if it should be dropped. Once sample_size lines are
+ * stored, the Nth input line replaces a random stored line with a
+ * probability of sample_size/N (reservoir sampling), so every input line
+ * has the same chance to end up in the sample, while memory usage stays
+ * bounded.
+ */
+static gint
+ptz_get_sample_slot(Patternizer *self)
+{
+  guint64 slot;
+
+  self->num_of_input_lines++;
+  if (self->sample_size == 0 || self->logs->len < self->sample_size)
+    return self->logs->len;
+
+  slot = (guint64) (g_random_double() * self->num_of_input_lines);
+  return slot < self->sample_size ? (gint) slot : -1;
+}
+
 gboolean
 ptz_load_file(Patternizer *self, gchar *input_file, gboolean no_parse, GError **error)
 {
@@ -583,6 +793,7 @@ ptz_load_file(Patternizer *self, gchar *input_file, gboolean no_parse, GError **
   MsgFormatOptions parse_options;
   gchar line[PTZ_MAXLINELEN];
   LogMessage *msg;
+  gint slot;
 
   if (!input_file)
     {
@@ -613,14 +824,32 @@ ptz_load_file(Patternizer *self, gchar *input_file, gboolean no_parse, GError **
 
   while (fgets(line, PTZ_MAXLINELEN, file))
     {
+      slot = ptz_get_sample_slot(self);
+      if (slot < 0)
+        continue;
+
       len = strlen(line);
       if (line[len-1] == '\n')
         line[len-1] = 0;
 
       msg = log_msg_new(line, len, NULL, &parse_options);
-      g_ptr_array_add(self->logs, msg);
+      if (slot == self->logs->len)
+        {
+          g_ptr_array_add(self->logs, msg);
+        }
+      else
+        {
+          log_msg_unref((LogMessage *) g_ptr_array_index(self->logs, slot));
+          g_ptr_array_index(self->logs, slot) = msg;
+        }
     }
 
+  if (self->sample_size)
+    msg_progress("Sampling input lines",
+                 evt_tag_printf("input_lines", "%" G_GUINT64_FORMAT, self->num_of_input_lines),
+                 evt_tag_int("sample_size", self->logs->len),
+                 NULL);
+
   self->support = (self->logs->len * (self->support_treshold / 100.0));
   msg_format_options_destroy(&parse_options);
   return TRUE;
@@ -637,6 +866,7 @@ ptz_new(gdouble support_treshold, guint algo, guint iterate, guint num_of_sample
   self->support_treshold = support_treshold;
   self->num_of_samples = num_of_samples;
   self->delimiters = delimiters;
+  self->num_of_threads = 1;
   self->logs = g_ptr_array_sized_new(PTZ_LOGTABLE_ALLOC_BASE);
 
   cluster_tag_id = log_tags_get_by_name(".in_patternize_cluster");
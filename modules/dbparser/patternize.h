@@ -47,11 +47,14 @@ typedef struct _Patternizer
   guint num_of_samples;
   gdouble support_treshold;
   gchar *delimiters;
+  guint num_of_threads;
 
-  // NOTE: for now, we store all logs read in in the memory.
-  // This brings in some obvious constraints and should be solved
-  // in a more optimized way later.
+  // NOTE: we store all logs read in in the memory, unless sample_size
+  // is set, in which case only a random sample of at most sample_size
+  // lines is kept.
   GPtrArray *logs;
+  guint sample_size;
+  guint64 num_of_input_lines;
 
 } Patternizer;
 
@@ -63,8 +66,8 @@ typedef struct _Cluster
 } Cluster;
 
 /* only declared for the test program */
-GHashTable *ptz_find_frequent_words(GPtrArray *logs, guint support, gchar *delimiters, gboolean two_pass);
-GHashTable *ptz_find_clusters_slct(GPtrArray *logs, guint support, gchar *delimiters, guint num_of_samples);
+GHashTable *ptz_find_frequent_words(GPtrArray *logs, guint support, gchar *delimiters, gboolean two_pass, guint num_of_threads);
+GHashTable *ptz_find_clusters_slct(GPtrArray *logs, guint support, gchar *delimiters, guint num_of_samples, guint num_of_threads);
 
 
 GHashTable *ptz_find_clusters(Patternizer *self);
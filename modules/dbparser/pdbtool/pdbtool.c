@@ -39,6 +39,7 @@
 #include "logproto/logproto-text-server.h"
 #include "reloc.h"
 #include "pathutils.h"
+#include "timeutils.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -1024,6 +1025,8 @@ static gdouble support_treshold = 4.0;
 static gboolean iterate_outliers = FALSE;
 static gboolean named_parsers = FALSE;
 static gint num_of_samples = 1;
+static gint num_of_threads = 0;
+static gint sample_size = 0;
 static gchar *delimiters = " :&~?![]=,;()'\"";
 
 static gint
@@ -1053,6 +1056,11 @@ pdbtool_patternize(int argc, char *argv[])
       return 1;
     }
 
+  if (num_of_threads <= 0)
+    num_of_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  ptz->num_of_threads = MAX(num_of_threads, 1);
+  ptz->sample_size = MAX(sample_size, 0);
+
   argv[0] = input_logfile;
   for (i = 0; i < argc; i++)
     {
@@ -1090,10 +1098,382 @@ static GOptionEntry patternize_options[] =
     "Set of characters based on which the log messages are tokenized, defaults to :&~?![]=,;()'\"", "<delimiters>" },
   { "samples",           0, 0, G_OPTION_ARG_INT, &num_of_samples,
     "Number of example lines to add for the patterns (default: 1)", "<samples>" },
+  { "threads",          't', 0, G_OPTION_ARG_INT, &num_of_threads,
+    "Number of threads to use for clustering (default: number of CPUs)", "<threads>" },
+  { "sample-size",       0, 0, G_OPTION_ARG_INT, &sample_size,
+    "Only keep a random sample of at most this many lines of the input to bound memory usage (default: 0, keep all)", "<lines>" },
   { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL }
 };
 
 
+static gchar *bench_file = NULL;
+static gint bench_threads = 1;
+static gint bench_iterations = 1;
+static gint bench_top_rules = 10;
+
+typedef struct _PdbtoolBenchThread
+{
+  GThread *thread;
+  PatternDB *patterndb;
+  GPtrArray *messages;
+  gint matched;
+} PdbtoolBenchThread;
+
+typedef struct _PdbtoolBenchRule
+{
+  gchar *rule_id;
+  guint64 hits;
+  guint64 elapsed_nsec;
+} PdbtoolBenchRule;
+
+static void
+pdbtool_bench_rule_free(PdbtoolBenchRule *self)
+{
+  g_free(self->rule_id);
+  g_free(self);
+}
+
+static gint
+pdbtool_bench_rule_cmp_hits(gconstpointer a, gconstpointer b)
+{
+  const PdbtoolBenchRule *r1 = *(const PdbtoolBenchRule **) a;
+  const PdbtoolBenchRule *r2 = *(const PdbtoolBenchRule **) b;
+
+  if (r1->hits == r2->hits)
+    return 0;
+  return r1->hits < r2->hits ? 1 : -1;
+}
+
+static gint
+pdbtool_bench_rule_cmp_avg(gconstpointer a, gconstpointer b)
+{
+  const PdbtoolBenchRule *r1 = *(const PdbtoolBenchRule **) a;
+  const PdbtoolBenchRule *r2 = *(const PdbtoolBenchRule **) b;
+  gdouble avg1 = (gdouble) r1->elapsed_nsec / r1->hits;
+  gdouble avg2 = (gdouble) r2->elapsed_nsec / r2->hits;
+
+  if (avg1 == avg2)
+    return 0;
+  return avg1 < avg2 ? 1 : -1;
+}
+
+/* reads the input file into an array of GStrings, one for each line */
+static GPtrArray *
+pdbtool_bench_read_lines(const gchar *filename)
+{
+  LogProtoServerOptions proto_options;
+  LogProtoServer *proto;
+  GPtrArray *lines;
+  const guchar *buf = NULL;
+  gsize buflen;
+  gboolean may_read = TRUE;
+  gint fd;
+
+  if (strcmp(filename, "-") == 0)
+    {
+      fd = 0;
+    }
+  else
+    {
+      fd = open(filename, O_RDONLY);
+      if (fd < 0)
+        {
+          fprintf(stderr, "Error opening file to be processed: %s\n", g_strerror(errno));
+          return NULL;
+        }
+    }
+
+  log_proto_server_options_defaults(&proto_options);
+  proto_options.max_msg_size = 65536;
+  log_proto_server_options_init(&proto_options, configuration);
+  proto = log_proto_text_server_new(log_transport_file_new(fd), &proto_options);
+
+  lines = g_ptr_array_new();
+  while (log_proto_server_fetch(proto, &buf, &buflen, &may_read, NULL, NULL) == LPS_SUCCESS)
+    {
+      if (buf)
+        g_ptr_array_add(lines, g_string_new_len((const gchar *) buf, buflen));
+      buf = NULL;
+    }
+  log_proto_server_free(proto);
+  log_proto_server_options_destroy(&proto_options);
+  return lines;
+}
+
+static void
+pdbtool_bench_free_lines(GPtrArray *lines)
+{
+  gint i;
+
+  for (i = 0; i < lines->len; i++)
+    g_string_free(g_ptr_array_index(lines, i), TRUE);
+  g_ptr_array_free(lines, TRUE);
+}
+
+static GPtrArray *
+pdbtool_bench_parse_lines(GPtrArray *lines, MsgFormatOptions *parse_options)
+{
+  GPtrArray *messages = g_ptr_array_sized_new(lines->len);
+  gint i;
+
+  for (i = 0; i < lines->len; i++)
+    {
+      GString *line = g_ptr_array_index(lines, i);
+      LogMessage *msg = log_msg_new_empty();
+
+      parse_options->format_handler->parse(parse_options, (const guchar *) line->str, line->len, msg);
+      g_ptr_array_add(messages, msg);
+    }
+  return messages;
+}
+
+static void
+pdbtool_bench_free_messages(GPtrArray *messages)
+{
+  g_ptr_array_foreach(messages, (GFunc) log_msg_unref, NULL);
+  g_ptr_array_free(messages, TRUE);
+}
+
+/*
+ * patterndb only runs the actions of the matching rules if there is an
+ * emit function, the messages they generate are simply discarded.
+ */
+static void
+pdbtool_bench_emit(LogMessage *msg, gboolean synthetic, gpointer user_data)
+{
+}
+
+/*
+ * Every thread processes its own copy of the input, each message is
+ * cloned before processing, as patterndb changes the messages it
+ * classifies.
+ */
+static gpointer
+pdbtool_bench_thread(gpointer user_data)
+{
+  PdbtoolBenchThread *self = (PdbtoolBenchThread *) user_data;
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  gint i, j;
+
+  app_thread_start();
+  for (i = 0; i < bench_iterations; i++)
+    {
+      for (j = 0; j < self->messages->len; j++)
+        {
+          LogMessage *msg = log_msg_clone_cow(g_ptr_array_index(self->messages, j), &path_options);
+
+          if (pattern_db_process(self->patterndb, msg))
+            self->matched++;
+          log_msg_unref(msg);
+        }
+    }
+  app_thread_stop();
+  return NULL;
+}
+
+static void
+pdbtool_bench_throughput(PatternDB *patterndb, GPtrArray *lines, MsgFormatOptions *parse_options)
+{
+  PdbtoolBenchThread *threads = g_new0(PdbtoolBenchThread, bench_threads);
+  struct timespec start, stop;
+  gdouble elapsed;
+  guint64 processed, matched = 0;
+  gint i;
+
+  /* parsing is not part of the measurement */
+  for (i = 0; i < bench_threads; i++)
+    {
+      threads[i].patterndb = patterndb;
+      threads[i].messages = pdbtool_bench_parse_lines(lines, parse_options);
+    }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < bench_threads; i++)
+    threads[i].thread = g_thread_create(pdbtool_bench_thread, &threads[i], TRUE, NULL);
+  for (i = 0; i < bench_threads; i++)
+    {
+      g_thread_join(threads[i].thread);
+      matched += threads[i].matched;
+    }
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+
+  elapsed = timespec_diff_nsec(&stop, &start) / 1e9;
+  processed = (guint64) lines->len * bench_iterations * bench_threads;
+
+  printf("Throughput:\n");
+  printf("  messages:  %" G_GUINT64_FORMAT " (%u lines, %d iterations, %d threads)\n",
+         processed, lines->len, bench_iterations, bench_threads);
+  printf("  matched:   %" G_GUINT64_FORMAT " (%.1f%%)\n", matched, processed ? matched * 100.0 / processed : 0.0);
+  printf("  elapsed:   %.3f sec\n", elapsed);
+  printf("  rate:      %.0f msg/sec, %.0f msg/sec/thread\n",
+         processed / elapsed, processed / elapsed / bench_threads);
+
+  for (i = 0; i < bench_threads; i++)
+    pdbtool_bench_free_messages(threads[i].messages);
+  g_free(threads);
+}
+
+static void
+pdbtool_bench_print_rules(const gchar *title, GPtrArray *rules)
+{
+  gint i;
+
+  printf("\n%s:\n", title);
+  printf("  %-40s %12s %12s %14s\n", "rule_id", "hits", "avg nsec", "total msec");
+  for (i = 0; i < rules->len && i < bench_top_rules; i++)
+    {
+      PdbtoolBenchRule *rule = g_ptr_array_index(rules, i);
+
+      printf("  %-40s %12" G_GUINT64_FORMAT " %12.0f %14.3f\n",
+             rule->rule_id, rule->hits, (gdouble) rule->elapsed_nsec / rule->hits, rule->elapsed_nsec / 1e6);
+    }
+}
+
+static void
+pdbtool_bench_collect_rule(gpointer key, gpointer value, gpointer user_data)
+{
+  g_ptr_array_add((GPtrArray *) user_data, value);
+}
+
+/*
+ * Processes the input once more on a single thread, timing each message
+ * and attributing the time to the rule it matched. The radix lookup
+ * does not know which rule it is going to end up with while its parsers
+ * run, so the whole processing time of a message is charged to the rule.
+ */
+static void
+pdbtool_bench_profile(PatternDB *patterndb, GPtrArray *lines, MsgFormatOptions *parse_options)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  NVHandle rule_id_handle = log_msg_get_value_handle(".classifier.rule_id");
+  GHashTable *rule_stats = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify) pdbtool_bench_rule_free);
+  GPtrArray *messages, *rules;
+  guint64 matched = 0, matched_nsec = 0, unmatched = 0, unmatched_nsec = 0;
+  gint i;
+
+  pattern_db_forget_state(patterndb);
+  messages = pdbtool_bench_parse_lines(lines, parse_options);
+  for (i = 0; i < messages->len; i++)
+    {
+      LogMessage *msg = log_msg_clone_cow(g_ptr_array_index(messages, i), &path_options);
+      struct timespec start, stop;
+      gboolean result;
+      glong elapsed;
+
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      result = pattern_db_process(patterndb, msg);
+      clock_gettime(CLOCK_MONOTONIC, &stop);
+      elapsed = timespec_diff_nsec(&stop, &start);
+
+      if (result)
+        {
+          const gchar *rule_id = log_msg_get_value(msg, rule_id_handle, NULL);
+          PdbtoolBenchRule *rule = g_hash_table_lookup(rule_stats, rule_id);
+
+          if (!rule)
+            {
+              rule = g_new0(PdbtoolBenchRule, 1);
+              rule->rule_id = g_strdup(rule_id);
+              g_hash_table_insert(rule_stats, rule->rule_id, rule);
+            }
+          rule->hits++;
+          rule->elapsed_nsec += elapsed;
+          matched++;
+          matched_nsec += elapsed;
+        }
+      else
+        {
+          unmatched++;
+          unmatched_nsec += elapsed;
+        }
+      log_msg_unref(msg);
+    }
+  pdbtool_bench_free_messages(messages);
+
+  printf("\nUnmatched path:\n");
+  printf("  matched:   %" G_GUINT64_FORMAT " msgs, %.0f nsec/msg\n",
+         matched, matched ? (gdouble) matched_nsec / matched : 0.0);
+  printf("  unmatched: %" G_GUINT64_FORMAT " msgs, %.0f nsec/msg, %.1f%% of the processing time\n",
+         unmatched, unmatched ? (gdouble) unmatched_nsec / unmatched : 0.0,
+         matched_nsec + unmatched_nsec ? unmatched_nsec * 100.0 / (matched_nsec + unmatched_nsec) : 0.0);
+
+  rules = g_ptr_array_sized_new(g_hash_table_size(rule_stats));
+  g_hash_table_foreach(rule_stats, pdbtool_bench_collect_rule, rules);
+
+  g_ptr_array_sort(rules, pdbtool_bench_rule_cmp_hits);
+  pdbtool_bench_print_rules("Most frequently matching rules", rules);
+  g_ptr_array_sort(rules, pdbtool_bench_rule_cmp_avg);
+  pdbtool_bench_print_rules("Slowest rules", rules);
+
+  g_ptr_array_free(rules, TRUE);
+  g_hash_table_destroy(rule_stats);
+}
+
+static gint
+pdbtool_bench(int argc, char *argv[])
+{
+  PatternDB *patterndb;
+  MsgFormatOptions parse_options;
+  GPtrArray *lines;
+  gint ret = 0;
+
+  if (!bench_file)
+    {
+      fprintf(stderr, "The -f option is required to specify the messages to benchmark with\n");
+      return 1;
+    }
+  if (bench_threads < 1 || bench_iterations < 1)
+    {
+      fprintf(stderr, "The number of threads and iterations must be positive\n");
+      return 1;
+    }
+
+  memset(&parse_options, 0, sizeof(parse_options));
+  msg_format_options_defaults(&parse_options);
+  /* the syslog protocol parser automatically falls back to RFC3164 format */
+  parse_options.flags |= LP_SYSLOG_PROTOCOL | LP_EXPECT_HOSTNAME;
+  msg_format_options_init(&parse_options, configuration);
+
+  patterndb = pattern_db_new();
+  if (!pattern_db_reload_ruleset(patterndb, configuration, patterndb_file))
+    {
+      ret = 1;
+      goto error;
+    }
+  pattern_db_set_emit_func(patterndb, pdbtool_bench_emit, NULL);
+
+  lines = pdbtool_bench_read_lines(bench_file);
+  if (!lines)
+    {
+      ret = 1;
+      goto error;
+    }
+
+  pdbtool_bench_throughput(patterndb, lines, &parse_options);
+  pdbtool_bench_profile(patterndb, lines, &parse_options);
+
+  pdbtool_bench_free_lines(lines);
+ error:
+  pattern_db_free(patterndb);
+  msg_format_options_destroy(&parse_options);
+  return ret;
+}
+
+static GOptionEntry bench_options[] =
+{
+  { "pdb",        'p', 0, G_OPTION_ARG_STRING, &patterndb_file,
+    "Name of the patterndb file", "<patterndb_file>" },
+  { "file",       'f', 0, G_OPTION_ARG_STRING, &bench_file,
+    "Read the messages to benchmark with from the file specified, use '-' for stdin", "<path>" },
+  { "threads",    't', 0, G_OPTION_ARG_INT, &bench_threads,
+    "Number of threads processing the messages in parallel (default: 1)", "<threads>" },
+  { "iterations", 'i', 0, G_OPTION_ARG_INT, &bench_iterations,
+    "Number of times each thread processes the whole input (default: 1)", "<iterations>" },
+  { "top",        'n', 0, G_OPTION_ARG_INT, &bench_top_rules,
+    "Number of rules to list in the per-rule statistics (default: 10)", "<rules>" },
+  { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL }
+};
+
 const gchar *
 pdbtool_mode(int *argc, char **argv[])
 {
@@ -1140,6 +1520,7 @@ static struct
   { "test", test_options, "Test pattern databases", pdbtool_test },
   { "patternize", patternize_options, "Create a pattern database from logs", pdbtool_patternize },
   { "dictionary", dictionary_options, "Dump pattern dictionary", pdbtool_dictionary },
+  { "bench", bench_options, "Measure the matching performance of a pattern database", pdbtool_bench },
   { NULL, NULL },
 };
 
@@ -1191,6 +1572,7 @@ main(int argc, char *argv[])
 
   setlocale(LC_ALL, "");
 
+  g_thread_init(NULL);
   msg_init(TRUE);
   stats_init();
   log_msg_global_init();
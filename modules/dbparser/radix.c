@@ -842,10 +842,10 @@ r_find_pchild(RNode *parent, RParserNode *parser_node)
 }
 
 RNode *
-r_find_child_by_first_character(RNode *root, char key)
+r_find_child_by_first_character(RNode *root, guint8 key)
 {
   register gint l, u, idx;
-  register char k = key;
+  register guint8 k = key;
 
   l = 0;
   u = root->num_children;
@@ -1070,6 +1070,7 @@ typedef struct _RFindNodeState
   GArray *stored_matches;
   GArray *dbg_list;
   GPtrArray *applicable_nodes;
+  RCompiledTree *compiled_tree;
 } RFindNodeState;
 
 static RNode *_find_node_recursively(RFindNodeState *state, RNode *root, guint8 *key, gint keylen);
@@ -1431,6 +1432,437 @@ r_find_all_applicable_nodes(RNode *root, guint8 *key, gint keylen, RNodeGetValue
   return (gchar **) g_ptr_array_free(result, FALSE);
 }
 
+/**************************************************************
+ * Compiled trees.
+ **************************************************************/
+
+/* nodes with at least this many literal children get a dispatch table,
+ * below that a linear scan of the first bytes is cheaper */
+#define R_DISPATCH_MIN_CHILDREN 8
+
+typedef struct _RCharSet
+{
+  guint32 bits[8];
+} RCharSet;
+
+typedef struct _RCompiledNode
+{
+  /* the source node, returned to the caller on a match */
+  RNode *node;
+  gpointer value;
+  RParserNode *parser;
+
+  /* offset of the literal key in RCompiledTree->keys */
+  guint32 key;
+  gint32 keylen;
+
+  /* literal and parser children, both stored contiguously in
+   * RCompiledTree->nodes, literal children sorted by their first byte */
+  guint32 children;
+  guint32 num_children;
+  guint32 pchildren;
+  guint32 num_pchildren;
+
+  /* offset of the dispatch table in RCompiledTree->dispatch, or -1 */
+  gint32 dispatch;
+  /* parser nodes: the bytes this parser may start a match with */
+  gint32 charset;
+  /* the union of the charsets of the parser children, or -1 */
+  gint32 pcharset;
+} RCompiledNode;
+
+struct _RCompiledTree
+{
+  RCompiledNode *nodes;
+  guint num_nodes;
+  /* first byte of each node's key, indexed the same way as nodes */
+  guint8 *first_bytes;
+  guint8 *keys;
+  /* 256 entry tables of child index + 1, zero meaning no child */
+  guint16 *dispatch;
+  RCharSet *charsets;
+};
+
+static inline void
+_charset_add(RCharSet *set, guint8 c)
+{
+  set->bits[c >> 5] |= 1U << (c & 31);
+}
+
+static inline void
+_charset_add_string(RCharSet *set, const gchar *chars)
+{
+  for (; chars && *chars; chars++)
+    _charset_add(set, (guint8) *chars);
+}
+
+static inline gboolean
+_charset_contains(const RCharSet *set, guint8 c)
+{
+  return (set->bits[c >> 5] >> (c & 31)) & 1;
+}
+
+static guint
+_charset_hash(gconstpointer s)
+{
+  const RCharSet *set = (const RCharSet *) s;
+  guint hash = 0;
+  gint i;
+
+  for (i = 0; i < 8; i++)
+    hash = hash * 31 + set->bits[i];
+  return hash;
+}
+
+static gboolean
+_charset_equal(gconstpointer a, gconstpointer b)
+{
+  return memcmp(a, b, sizeof(RCharSet)) == 0;
+}
+
+/*
+ * Calculates the set of bytes a parser may accept as the first character
+ * of its match. This has to be a superset of what the parse function
+ * really accepts, as it is used to skip calling it altogether. When in
+ * doubt, accept everything.
+ */
+static void
+_r_parser_first_bytes(RParserNode *parser_node, RCharSet *set)
+{
+  gint c;
+
+  memset(set, 0, sizeof(*set));
+  for (c = 0; c < 256; c++)
+    {
+      gboolean accept;
+
+      switch (parser_node->type)
+        {
+        case RPT_IPV4:
+          accept = g_ascii_isdigit(c);
+          break;
+        case RPT_NUMBER:
+          accept = g_ascii_isdigit(c) || c == '-';
+          break;
+        case RPT_FLOAT:
+          accept = g_ascii_isdigit(c) || c == '-' || c == '.';
+          break;
+        case RPT_IPV6:
+        case RPT_IP:
+          accept = g_ascii_isxdigit(c) || c == ':' || c == '.';
+          break;
+        case RPT_MACADDR:
+        case RPT_LLADDR:
+          accept = g_ascii_isxdigit(c);
+          break;
+        case RPT_HOSTNAME:
+          accept = g_ascii_isalnum(c) || c == '-';
+          break;
+        case RPT_STRING:
+          accept = g_ascii_isalnum(c);
+          break;
+        case RPT_EMAIL:
+          accept = g_ascii_isalnum(c) || c == '@' || strchr("!#$%&'*+-/=?^_`{|}~.", c);
+          break;
+        case RPT_SET:
+          accept = FALSE;
+          break;
+        default:
+          accept = TRUE;
+          break;
+        }
+      if (accept)
+        _charset_add(set, c);
+    }
+
+  if (parser_node->type == RPT_STRING || parser_node->type == RPT_SET || parser_node->type == RPT_EMAIL)
+    _charset_add_string(set, parser_node->param);
+
+  /* strchr() based parsers match the terminating NUL too */
+  _charset_add(set, 0);
+
+  for (c = 0; c < 256; c++)
+    {
+      if (c < parser_node->first || c > parser_node->last)
+        set->bits[c >> 5] &= ~(1U << (c & 31));
+    }
+}
+
+static gint32
+_r_compiled_tree_add_charset(GArray *charsets, GHashTable *charset_index, RCharSet *set)
+{
+  gpointer ndx;
+
+  if (!g_hash_table_lookup_extended(charset_index, set, NULL, &ndx))
+    {
+      g_array_append_val(charsets, *set);
+      ndx = GINT_TO_POINTER(charsets->len - 1);
+      g_hash_table_insert(charset_index, g_memdup(set, sizeof(*set)), ndx);
+    }
+  return GPOINTER_TO_INT(ndx);
+}
+
+static gint32
+_r_compiled_tree_add_dispatch(GArray *dispatch, RNode *src)
+{
+  gint32 base = dispatch->len;
+  guint16 *table;
+  gint i;
+
+  g_array_set_size(dispatch, base + 256);
+  table = &g_array_index(dispatch, guint16, base);
+  for (i = 0; i < src->num_children; i++)
+    {
+      guint8 c = src->children[i]->key[0];
+
+      if (!table[c])
+        table[c] = i + 1;
+    }
+  return base;
+}
+
+RCompiledTree *
+r_compile_tree(RNode *root)
+{
+  RCompiledTree *tree = g_new0(RCompiledTree, 1);
+  GPtrArray *sources = g_ptr_array_new();
+  GArray *nodes = g_array_new(FALSE, TRUE, sizeof(RCompiledNode));
+  GByteArray *keys = g_byte_array_new();
+  GArray *dispatch = g_array_new(FALSE, TRUE, sizeof(guint16));
+  GArray *charsets = g_array_new(FALSE, TRUE, sizeof(RCharSet));
+  GHashTable *charset_index = g_hash_table_new_full(_charset_hash, _charset_equal, g_free, NULL);
+  RCharSet set, pset;
+  gint i, j;
+
+  /* breadth-first, so that the children of a node end up next to each other */
+  g_ptr_array_add(sources, root);
+  for (i = 0; i < sources->len; i++)
+    {
+      RNode *src = (RNode *) g_ptr_array_index(sources, i);
+      RCompiledNode cnode;
+
+      memset(&cnode, 0, sizeof(cnode));
+      cnode.node = src;
+      cnode.value = src->value;
+      cnode.parser = src->parser;
+      cnode.key = keys->len;
+      cnode.keylen = src->keylen;
+      if (src->keylen > 0)
+        g_byte_array_append(keys, src->key, src->keylen);
+
+      cnode.children = sources->len;
+      cnode.num_children = src->num_children;
+      for (j = 0; j < src->num_children; j++)
+        g_ptr_array_add(sources, src->children[j]);
+
+      cnode.pchildren = sources->len;
+      cnode.num_pchildren = src->num_pchildren;
+      for (j = 0; j < src->num_pchildren; j++)
+        g_ptr_array_add(sources, src->pchildren[j]);
+
+      cnode.dispatch = -1;
+      if (src->num_children >= R_DISPATCH_MIN_CHILDREN)
+        cnode.dispatch = _r_compiled_tree_add_dispatch(dispatch, src);
+
+      cnode.charset = -1;
+      if (src->parser)
+        {
+          _r_parser_first_bytes(src->parser, &set);
+          cnode.charset = _r_compiled_tree_add_charset(charsets, charset_index, &set);
+        }
+
+      cnode.pcharset = -1;
+      if (src->num_pchildren)
+        {
+          memset(&pset, 0, sizeof(pset));
+          for (j = 0; j < src->num_pchildren; j++)
+            {
+              gint k;
+
+              _r_parser_first_bytes(src->pchildren[j]->parser, &set);
+              for (k = 0; k < 8; k++)
+                pset.bits[k] |= set.bits[k];
+            }
+          cnode.pcharset = _r_compiled_tree_add_charset(charsets, charset_index, &pset);
+        }
+
+      g_array_append_val(nodes, cnode);
+    }
+
+  tree->num_nodes = nodes->len;
+  tree->nodes = (RCompiledNode *) g_array_free(nodes, FALSE);
+  tree->first_bytes = g_new0(guint8, tree->num_nodes);
+  for (i = 0; i < tree->num_nodes; i++)
+    {
+      if (tree->nodes[i].keylen > 0)
+        tree->first_bytes[i] = keys->data[tree->nodes[i].key];
+    }
+  tree->keys = g_byte_array_free(keys, FALSE);
+  tree->dispatch = (guint16 *) g_array_free(dispatch, FALSE);
+  tree->charsets = (RCharSet *) g_array_free(charsets, FALSE);
+
+  g_hash_table_destroy(charset_index);
+  g_ptr_array_free(sources, TRUE);
+  return tree;
+}
+
+void
+r_free_compiled_tree(RCompiledTree *tree)
+{
+  g_free(tree->nodes);
+  g_free(tree->first_bytes);
+  g_free(tree->keys);
+  g_free(tree->dispatch);
+  g_free(tree->charsets);
+  g_free(tree);
+}
+
+static RCompiledNode *_find_compiled_node_recursively(RFindNodeState *state, RCompiledNode *root, guint8 *key, gint keylen);
+
+/* the same as _find_matching_literal_prefix(), the first byte was
+ * already matched by the dispatch in our parent */
+static gint
+_find_matching_compiled_literal_prefix(RCompiledTree *tree, RCompiledNode *root, guint8 *key, gint keylen)
+{
+  guint8 *root_key = &tree->keys[root->key];
+  gint match_length;
+  gint m;
+
+  if (root->keylen < 1)
+    return 0;
+
+  m = MIN(keylen, root->keylen);
+  match_length = 1;
+  while (match_length < m && key[match_length] == root_key[match_length])
+    match_length++;
+  return match_length;
+}
+
+static RCompiledNode *
+_find_compiled_child_by_first_byte(RCompiledTree *tree, RCompiledNode *root, guint8 c)
+{
+  guint8 *first_bytes;
+  gint i;
+
+  if (root->dispatch >= 0)
+    {
+      guint16 ndx = tree->dispatch[root->dispatch + c];
+
+      return ndx ? &tree->nodes[root->children + ndx - 1] : NULL;
+    }
+
+  first_bytes = &tree->first_bytes[root->children];
+  for (i = 0; i < root->num_children; i++)
+    {
+      if (first_bytes[i] == c)
+        return &tree->nodes[root->children + i];
+    }
+  return NULL;
+}
+
+static RCompiledNode *
+_find_compiled_child_by_parser(RFindNodeState *state, RCompiledNode *root, guint8 *remaining_key, gint remaining_keylen)
+{
+  RCompiledTree *tree = state->compiled_tree;
+  gint matches_slot_index;
+  RCompiledNode *ret = NULL;
+  gint i;
+
+  if (root->pcharset < 0 || !_charset_contains(&tree->charsets[root->pcharset], remaining_key[0]))
+    return NULL;
+
+  matches_slot_index = _alloc_slot_in_matches(state);
+  for (i = 0; !ret && i < root->num_pchildren; i++)
+    {
+      RCompiledNode *child = &tree->nodes[root->pchildren + i];
+      RParserNode *parser_node = child->parser;
+      RParserMatch *match_slot;
+      gint extracted_match_len;
+
+      if (!_charset_contains(&tree->charsets[child->charset], remaining_key[0]))
+        continue;
+
+      match_slot = _clear_match_slot(state, matches_slot_index);
+      if (!parser_node->parse(remaining_key, &extracted_match_len, parser_node->param, parser_node->state, match_slot))
+        continue;
+
+      ret = _find_compiled_node_recursively(state, child, remaining_key + extracted_match_len, remaining_keylen - extracted_match_len);
+
+      match_slot = _get_match_slot(state, matches_slot_index);
+      if (match_slot)
+        {
+          if (ret)
+            _fixup_match_offsets(state, parser_node, extracted_match_len, remaining_key, match_slot);
+          else
+            _clear_match_content(match_slot);
+        }
+    }
+  if (!ret)
+    _reset_matches_to_original_state(state, matches_slot_index);
+  return ret;
+}
+
+/* mirrors _find_node_recursively(), see the comments there */
+static RCompiledNode *
+_find_compiled_node_recursively(RFindNodeState *state, RCompiledNode *root, guint8 *key, gint keylen)
+{
+  RCompiledTree *tree = state->compiled_tree;
+  gint literal_prefix_len;
+
+  literal_prefix_len = _find_matching_compiled_literal_prefix(tree, root, key, keylen);
+
+  if (literal_prefix_len == keylen && (literal_prefix_len == root->keylen || root->keylen == -1))
+    {
+      if (root->value)
+        return root;
+    }
+  else if ((root->keylen < 1) || (literal_prefix_len < keylen && literal_prefix_len >= root->keylen))
+    {
+      RCompiledNode *ret = NULL;
+      RCompiledNode *child;
+      guint8 *remaining_key = key + literal_prefix_len;
+      gint remaining_keylen = keylen - literal_prefix_len;
+
+      child = _find_compiled_child_by_first_byte(tree, root, remaining_key[0]);
+      if (child)
+        ret = _find_compiled_node_recursively(state, child, remaining_key, remaining_keylen);
+
+      if (!ret && root->num_pchildren)
+        ret = _find_compiled_child_by_parser(state, root, remaining_key, remaining_keylen);
+
+      if (!ret && root->value)
+        {
+          if (!state->require_complete_match)
+            return root;
+          state->partial_match_found = TRUE;
+        }
+
+      return ret;
+    }
+
+  return NULL;
+}
+
+RNode *
+r_find_compiled_node(RCompiledTree *tree, guint8 *key, gint keylen, GArray *stored_matches)
+{
+  RFindNodeState state = {
+    .whole_key = key,
+    .stored_matches = stored_matches,
+    .compiled_tree = tree,
+    .require_complete_match = TRUE,
+  };
+  RCompiledNode *ret;
+
+  ret = _find_compiled_node_recursively(&state, &tree->nodes[0], key, keylen);
+  if (!ret && state.partial_match_found)
+    {
+      state.require_complete_match = FALSE;
+      ret = _find_compiled_node_recursively(&state, &tree->nodes[0], key, keylen);
+    }
+  return ret ? ret->node : NULL;
+}
+
 /**
  * r_new_node:
  */
@@ -98,6 +98,15 @@ struct _RNode
   RNode **pchildren;
 };
 
+/* An immutable, flattened copy of an RNode tree built once the tree is
+ * complete, used by r_find_compiled_node() on the hot path. Nodes are laid
+ * out breadth-first, the children of a node are stored contiguously,
+ * nodes with many literal children get a 256 entry first-byte dispatch
+ * table and parser children are prefiltered by the set of bytes their
+ * parser may start with. It references the RNode and RParserNode
+ * instances of the source tree, which must outlive it. */
+typedef struct _RCompiledTree RCompiledTree;
+
 typedef struct _RDebugInfo
 {
   RNode *node;
@@ -152,5 +161,9 @@ RNode *r_find_node(RNode *root, guint8 *key, gint keylen, GArray *matches);
 RNode *r_find_node_dbg(RNode *root, guint8 *key, gint keylen, GArray *matches, GArray *dbg_list);
 gchar **r_find_all_applicable_nodes(RNode *root, guint8 *key, gint keylen, RNodeGetValueFunc value_func);
 
+RCompiledTree *r_compile_tree(RNode *root);
+void r_free_compiled_tree(RCompiledTree *tree);
+RNode *r_find_compiled_node(RCompiledTree *tree, guint8 *key, gint keylen, GArray *matches);
+
 #endif
 
@@ -91,7 +91,7 @@ static void
 _advance_time(gint timeout)
 {
   if (timeout)
-    timer_wheel_set_time(patterndb->timer_wheel, timer_wheel_get_time(patterndb->timer_wheel) + timeout + 1);
+    pattern_db_advance_time(patterndb, timeout + 1);
 }
 
 static LogMessage *
@@ -661,6 +661,86 @@ test_patterndb_tags_outside_of_rule()
   _destroy_pattern_db();
 }
 
+gchar *pdb_multi_threaded_correllation_skeleton = "<patterndb version='3' pub_date='2010-02-22'>\
+ <ruleset name='testset' id='1'>\
+  <patterns>\
+   <pattern>prog1</pattern>\
+  </patterns>\
+  <rule provider='test' id='16' class='system' context-scope='global'\
+        context-id='${session}' context-timeout='60'>\
+   <patterns>\
+    <pattern>session @NUMBER:session@ event</pattern>\
+   </patterns>\
+   <actions>\
+    <action trigger='timeout'>\
+     <message>\
+      <value name='MESSAGE'>session closed</value>\
+     </message>\
+    </action>\
+   </actions>\
+  </rule>\
+ </ruleset>\
+</patterndb>";
+
+#define CORRELLATION_THREADS 4
+#define CORRELLATION_SESSIONS_PER_THREAD 1000
+#define CORRELLATION_MESSAGES_PER_THREAD 5000
+
+gint synthetic_messages;
+
+static void
+_count_synthetic_messages(LogMessage *msg, gboolean synthetic, gpointer user_data)
+{
+  if (synthetic)
+    g_atomic_int_inc(&synthetic_messages);
+}
+
+static gpointer
+_correllation_thread(gpointer user_data)
+{
+  gint thread_index = GPOINTER_TO_INT(user_data);
+  gint matched = 0;
+  gint i;
+
+  app_thread_start();
+  for (i = 0; i < CORRELLATION_MESSAGES_PER_THREAD; i++)
+    {
+      gchar *text = g_strdup_printf("session %d event", thread_index * CORRELLATION_SESSIONS_PER_THREAD + i % CORRELLATION_SESSIONS_PER_THREAD);
+      LogMessage *msg = _construct_message("prog1", text);
+
+      if (pattern_db_process(patterndb, msg))
+        matched++;
+      log_msg_unref(msg);
+      g_free(text);
+    }
+  app_thread_stop();
+  return GINT_TO_POINTER(matched);
+}
+
+void
+test_patterndb_multi_threaded_correllation()
+{
+  GThread *threads[CORRELLATION_THREADS];
+  gint i;
+
+  _load_pattern_db_from_string(pdb_multi_threaded_correllation_skeleton);
+  pattern_db_set_emit_func(patterndb, _count_synthetic_messages, NULL);
+  synthetic_messages = 0;
+
+  for (i = 0; i < CORRELLATION_THREADS; i++)
+    threads[i] = g_thread_create(_correllation_thread, GINT_TO_POINTER(i), TRUE, NULL);
+  for (i = 0; i < CORRELLATION_THREADS; i++)
+    assert_gint(GPOINTER_TO_INT(g_thread_join(threads[i])), CORRELLATION_MESSAGES_PER_THREAD,
+                "Not all messages matched in correllation thread %d", i);
+
+  assert_gint(synthetic_messages, 0, "No context should have timed out yet");
+  pattern_db_expire_state(patterndb);
+  assert_gint(synthetic_messages, CORRELLATION_THREADS * CORRELLATION_SESSIONS_PER_THREAD,
+              "Every session should have a single context");
+
+  _destroy_pattern_db();
+}
+
 #include "test_parsers_e2e.c"
 
 int
@@ -684,6 +764,7 @@ main(int argc, char *argv[])
   test_patterndb_message_property_inheritance();
   test_patterndb_context_length();
   test_patterndb_tags_outside_of_rule();
+  test_patterndb_multi_threaded_correllation();
 
   app_shutdown();
   return 0;
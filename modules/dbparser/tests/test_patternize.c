@@ -7,7 +7,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include <tags.h>
+#include <glib/gstdio.h>
 
 gboolean fail = FALSE;
 
@@ -66,7 +68,7 @@ testcase_get_logmessages(gchar *logs)
 void
 testcase_frequent_words(gchar* logs, guint support, gchar *expected)
 {
-  int i, twopass;
+  int i, twopass, threads;
   gchar **expecteds;
   GHashTable *wordlist;
   loglinesType *logmessages;
@@ -78,44 +80,48 @@ testcase_frequent_words(gchar* logs, guint support, gchar *expected)
 
   for (twopass = 1; twopass <= 2; ++twopass)
     {
-      wordlist = ptz_find_frequent_words(logmessages->logmessages, support, delimiters, twopass == 1);
-
-      for (i = 0; expecteds[i]; ++i)
+      for (threads = 1; threads <= 3; threads += 2)
         {
-          char **expected_item;
-          char *expected_word;
-          int expected_occurance;
-          guint ret;
-          gpointer retp;
-
-          expected_item = g_strsplit(expecteds[i], ":", 2);
-
-          expected_word = expected_item[0];
-          sscanf(expected_item[1], "%d", &expected_occurance);
-
-          retp = g_hash_table_lookup(wordlist, expected_word);
-          if (retp)
-            {
-              ret = *((guint*) retp);
-            }
-          else
-            {
-              ret = 0;
-            }
+          wordlist = ptz_find_frequent_words(logmessages->logmessages, support, delimiters, twopass == 1, threads);
 
-          if (ret != (guint) expected_occurance)
+          for (i = 0; expecteds[i]; ++i)
             {
-              fail = TRUE;
-              fprintf(stderr, "Frequent words test case failed; word: '%s', expected=%d, got=%d, support=%d\n",
-                  expected_word, expected_occurance, ret, support);
-
-              fprintf(stderr, "Input:\n%s\n", logs);
-              fprintf(stderr, "Full results:\n");
-              g_hash_table_foreach(wordlist, _debug_print, NULL);
-
+              char **expected_item;
+              char *expected_word;
+              int expected_occurance;
+              guint ret;
+              gpointer retp;
+
+              expected_item = g_strsplit(expecteds[i], ":", 2);
+
+              expected_word = expected_item[0];
+              sscanf(expected_item[1], "%d", &expected_occurance);
+
+              retp = g_hash_table_lookup(wordlist, expected_word);
+              if (retp)
+                {
+                  ret = *((guint*) retp);
+                }
+              else
+                {
+                  ret = 0;
+                }
+
+              if (ret != (guint) expected_occurance)
+                {
+                  fail = TRUE;
+                  fprintf(stderr, "Frequent words test case failed; word: '%s', expected=%d, got=%d, support=%d\n",
+                      expected_word, expected_occurance, ret, support);
+
+                  fprintf(stderr, "Input:\n%s\n", logs);
+                  fprintf(stderr, "Full results:\n");
+                  g_hash_table_foreach(wordlist, _debug_print, NULL);
+
+                }
+
+              g_free(expected_item);
             }
-
-          g_free(expected_item);
+          g_hash_table_unref(wordlist);
         }
     }
 
@@ -274,7 +280,7 @@ test_clusters_find(gpointer key, gpointer value, gpointer user_data)
 }
 
 void
-testcase_find_clusters_slct(gchar* logs, guint support, gchar *expected)
+testcase_find_clusters_slct_with_threads(gchar* logs, guint support, gchar *expected, guint threads)
 {
   int i,j;
   gchar **expecteds;
@@ -286,7 +292,7 @@ testcase_find_clusters_slct(gchar* logs, guint support, gchar *expected)
 
   logmessages = testcase_get_logmessages(logs);
 
-  clusters = ptz_find_clusters_slct(logmessages->logmessages, support, delimiters, 0);
+  clusters = ptz_find_clusters_slct(logmessages->logmessages, support, delimiters, 0, threads);
 
   expecteds = g_strsplit(expected, "|", 0);
   for (i = 0; expecteds[i]; ++i)
@@ -343,6 +349,13 @@ testcase_find_clusters_slct(gchar* logs, guint support, gchar *expected)
   g_strfreev(expecteds);
 }
 
+void
+testcase_find_clusters_slct(gchar* logs, guint support, gchar *expected)
+{
+  testcase_find_clusters_slct_with_threads(logs, support, expected, 1);
+  testcase_find_clusters_slct_with_threads(logs, support, expected, 3);
+}
+
 void
 find_clusters_slct_tests()
 {
@@ -421,6 +434,63 @@ find_clusters_slct_tests()
       "0,1,2:3");
 }
 
+static void
+_count_cluster_lines(gpointer key, gpointer value, gpointer user_data)
+{
+  *((guint *) user_data) += ((Cluster *) value)->loglines->len;
+}
+
+void
+sampling_tests()
+{
+  Patternizer *ptz;
+  GHashTable *clusters;
+  GError *error = NULL;
+  gchar *filename;
+  GString *contents = g_string_new("");
+  guint clustered_lines = 0;
+  gint fd, i;
+
+  for (i = 0; i < 1000; i++)
+    g_string_append_printf(contents, "alma korte %d\n", i);
+  fd = g_file_open_tmp("patternizeXXXXXX.log", &filename, NULL);
+  close(fd);
+  g_file_set_contents(filename, contents->str, contents->len, NULL);
+
+  ptz = ptz_new(4.0, PTZ_ALGO_SLCT, PTZ_ITERATE_NONE, 1, " ");
+  ptz->sample_size = 100;
+  ptz->num_of_threads = 4;
+  if (!ptz_load_file(ptz, filename, TRUE, &error))
+    {
+      fprintf(stderr, "Error loading the sampling test input: %s\n", error->message);
+      g_clear_error(&error);
+      fail = TRUE;
+    }
+
+  if (ptz->logs->len != 100 || ptz->num_of_input_lines != 1000 || ptz->support != 4)
+    {
+      fprintf(stderr, "Sampling test case failed; sampled=%d, input_lines=%d, support=%d\n",
+              ptz->logs->len, (gint) ptz->num_of_input_lines, ptz->support);
+      fail = TRUE;
+    }
+
+  /* all sampled lines fall into the same cluster */
+  clusters = ptz_find_clusters(ptz);
+  g_hash_table_foreach(clusters, _count_cluster_lines, &clustered_lines);
+  if (g_hash_table_size(clusters) != 1 || clustered_lines != 100)
+    {
+      fprintf(stderr, "Sampling test case failed; clusters=%d, clustered_lines=%d\n",
+              g_hash_table_size(clusters), clustered_lines);
+      fail = TRUE;
+    }
+
+  g_hash_table_unref(clusters);
+  ptz_free(ptz);
+  g_unlink(filename);
+  g_free(filename);
+  g_string_free(contents, TRUE);
+}
+
 int
 main()
 {
@@ -432,6 +502,7 @@ main()
 
   frequent_words_tests();
   find_clusters_slct_tests();
+  sampling_tests();
   log_tags_global_deinit();
 
   return  (fail ? 1 : 0);
@@ -59,11 +59,73 @@ insert_node(RNode *root, gchar *key)
   g_free(dup);
 }
 
+static gboolean
+_parser_matches_equal(RParserMatch *a, RParserMatch *b)
+{
+  if (a->match || b->match)
+    return a->match && b->match && strcmp(a->match, b->match) == 0 &&
+           a->handle == b->handle;
+
+  return a->handle == b->handle && a->type == b->type &&
+         a->ofs == b->ofs && a->len == b->len;
+}
+
+/* the compiled tree has to return the same node and matches as the source tree */
+void
+test_compiled_search(RNode *root, gchar *key, RNode *expected_node, GArray *expected_matches)
+{
+  RCompiledTree *compiled = r_compile_tree(root);
+  GArray *matches = NULL;
+  RNode *ret;
+  gint i;
+
+  if (expected_matches)
+    {
+      matches = g_array_new(FALSE, TRUE, sizeof(RParserMatch));
+      g_array_set_size(matches, 1);
+    }
+
+  ret = r_find_compiled_node(compiled, key, strlen(key), matches);
+  if (ret != expected_node)
+    {
+      printf("FAIL: compiled tree returned a different node: '%s' => '%s' <> '%s'\n", key,
+             ret ? (gchar *) ret->value : "none",
+             expected_node ? (gchar *) expected_node->value : "none");
+      fail = TRUE;
+    }
+  else if (matches && matches->len != expected_matches->len)
+    {
+      printf("FAIL: compiled tree returned a different number of matches: '%s' => %d <> %d\n", key, matches->len, expected_matches->len);
+      fail = TRUE;
+    }
+  else if (matches)
+    {
+      for (i = 0; i < matches->len; i++)
+        {
+          if (!_parser_matches_equal(&g_array_index(matches, RParserMatch, i), &g_array_index(expected_matches, RParserMatch, i)))
+            {
+              printf("FAIL: compiled tree returned a different %d. match: '%s'\n", i, key);
+              fail = TRUE;
+            }
+        }
+    }
+
+  if (matches)
+    {
+      for (i = 0; i < matches->len; i++)
+        g_free(g_array_index(matches, RParserMatch, i).match);
+      g_array_free(matches, TRUE);
+    }
+  r_free_compiled_tree(compiled);
+}
+
 void
 test_search_value(RNode *root, gchar *key, gchar *expected_value)
 {
   RNode *ret = r_find_node(root, key, strlen(key), NULL);
 
+  test_compiled_search(root, key, ret, NULL);
+
   if (ret && expected_value)
     {
       if (strcmp(ret->value, expected_value) != 0)
@@ -108,6 +170,7 @@ test_search_matches(RNode *root, gchar *key, gchar *name1, ...)
   va_start(args, name1);
 
   ret = r_find_node(root, key, strlen(key), matches);
+  test_compiled_search(root, key, ret, matches);
   if (ret && !name1)
     {
       printf("FAIL: found unexpected: '%s' => '%s' matches: ", key, (gchar *) ret->value);
@@ -219,6 +282,8 @@ test_literals(void)
   insert_node(root, "korozott");
   insert_node(root, "al");
   insert_node(root, "all");
+  insert_node(root, "árvíztűrő");
+  insert_node(root, "ártér");
 
   test_search(root, "alma", TRUE);
   test_search(root, "korte", TRUE);
@@ -235,6 +300,8 @@ test_literals(void)
   test_search(root, "korozott", TRUE);
   test_search(root, "al", TRUE);
   test_search(root, "all", TRUE);
+  test_search(root, "árvíztűrő", TRUE);
+  test_search(root, "ártér", TRUE);
 
   test_search(root, "mmm", FALSE);
   test_search_value(root, "kor", "ko");
@@ -251,6 +318,8 @@ test_literals(void)
   test_search_value(root, "koromi", "korom");
 
   test_search(root, "qwqw", FALSE);
+  test_search_value(root, "ártéri", "ártér");
+  test_search(root, "ár", FALSE);
 
   r_free_node(root, NULL);
 }
@@ -662,6 +731,29 @@ test_zorp_logs(void)
 
 }
 
+/* enough literal children for the compiled tree to use a first-byte
+ * dispatch table instead of scanning them */
+void
+test_compiled_tree_with_many_children(void)
+{
+  RNode *root = r_new_node("", NULL);
+  gchar *pattern;
+  gint i;
+
+  for (i = 0; i < 200; i++)
+    {
+      pattern = g_strdup_printf("session @NUMBER:id@ %s%d for user @STRING:user@ from @IPv4:ip@", i % 2 ? "opened" : "failed", i);
+      r_insert_node(root, pattern, g_strdup_printf("session%d", i), NULL);
+      g_free(pattern);
+    }
+
+  test_search_value(root, "session 123 opened17 for user root from 10.0.0.1", "session17");
+  test_search_value(root, "session 123 failed170 for user root from 10.0.0.1", "session170");
+  test_search_value(root, "session 123 closed for user root from 10.0.0.1", NULL);
+  test_search_value(root, "session 123 opened17 for user root from unknown", NULL);
+
+  r_free_node(root, g_free);
+}
 
 int
 main(int argc, char *argv[])
@@ -677,6 +769,7 @@ main(int argc, char *argv[])
   test_parsers();
   test_matches();
   test_zorp_logs();
+  test_compiled_tree_with_many_children();
 
   app_shutdown();
   return  (fail ? 1 : 0);
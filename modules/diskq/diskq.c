@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2002-2015 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2015 Balázs Scheidler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+
+#include "diskq.h"
+#include "logqueue-disk.h"
+#include "logqueue-fifo.h"
+#include "messages.h"
+
+void
+diskq_set_disk_buf_size(LogDriverPlugin *s, gint64 disk_buf_size)
+{
+  DiskQDestPlugin *self = (DiskQDestPlugin *) s;
+
+  self->options.disk_buf_size = disk_buf_size;
+}
+
+void
+diskq_set_segment_size(LogDriverPlugin *s, gint64 segment_size)
+{
+  DiskQDestPlugin *self = (DiskQDestPlugin *) s;
+
+  self->options.segment_size = segment_size;
+}
+
+void
+diskq_set_mem_buf_length(LogDriverPlugin *s, gint mem_buf_length)
+{
+  DiskQDestPlugin *self = (DiskQDestPlugin *) s;
+
+  self->options.mem_buf_length = mem_buf_length;
+}
+
+void
+diskq_set_qout_size(LogDriverPlugin *s, gint qout_size)
+{
+  DiskQDestPlugin *self = (DiskQDestPlugin *) s;
+
+  self->options.qout_size = qout_size;
+}
+
+void
+diskq_set_dir(LogDriverPlugin *s, const gchar *dir)
+{
+  DiskQDestPlugin *self = (DiskQDestPlugin *) s;
+
+  g_free(self->options.dir);
+  self->options.dir = g_strdup(dir);
+}
+
+static LogQueue *
+_fallback_to_memory_queue(LogDestDriver *dd, gchar *persist_name)
+{
+  GlobalConfig *cfg = log_pipe_get_config(&dd->super.super);
+  LogQueue *queue;
+
+  queue = log_queue_fifo_new(dd->log_fifo_size < 0 ? cfg->log_fifo_size : dd->log_fifo_size, persist_name);
+  log_queue_fifo_set_memory_limit(queue, dd->log_fifo_memory_limit < 0 ? cfg->log_fifo_memory_limit : dd->log_fifo_memory_limit);
+  log_queue_fifo_set_lockless(queue, dd->log_fifo_lockless);
+  return queue;
+}
+
+/* returns a reference */
+static LogQueue *
+_acquire_queue(LogDestDriver *dd, gchar *persist_name, gpointer user_data)
+{
+  DiskQDestPlugin *self = (DiskQDestPlugin *) user_data;
+  GlobalConfig *cfg = log_pipe_get_config(&dd->super.super);
+  LogQueue *queue = NULL;
+
+  if (persist_name)
+    queue = cfg_persist_config_fetch(cfg, persist_name);
+
+  if (queue && !log_queue_is_disk(queue))
+    {
+      msg_warning("Destination switched to disk-buffer(), messages in its memory queue are lost",
+                  evt_tag_str("persist_name", persist_name),
+                  evt_tag_int("lost", log_queue_get_length(queue)),
+                  NULL);
+      log_queue_unref(queue);
+      queue = NULL;
+    }
+
+  if (!queue)
+    {
+      if (!persist_name)
+        {
+          msg_error("This destination doesn't support disk-buffer(), using a memory queue instead",
+                    evt_tag_str("driver", dd->super.id),
+                    NULL);
+          queue = _fallback_to_memory_queue(dd, persist_name);
+        }
+      else
+        {
+          queue = log_queue_disk_new(&self->options, persist_name);
+          if (!log_queue_disk_start(queue, cfg->state))
+            {
+              msg_error("Error opening disk-buffer(), using a memory queue instead",
+                        evt_tag_str("persist_name", persist_name),
+                        NULL);
+              log_queue_unref(queue);
+              queue = _fallback_to_memory_queue(dd, persist_name);
+            }
+        }
+    }
+
+  log_queue_set_throttle(queue, dd->throttle);
+  return queue;
+}
+
+static gboolean
+_check_options(DiskQDestPlugin *self)
+{
+  if (self->options.segment_size < 1024 * 1024)
+    {
+      msg_error("The value of segment-size() in disk-buffer() must be at least 1MB",
+                evt_tag_int("segment_size", self->options.segment_size),
+                NULL);
+      return FALSE;
+    }
+  if (self->options.disk_buf_size < self->options.segment_size)
+    {
+      msg_error("The value of disk-buf-size() in disk-buffer() must not be smaller than segment-size()",
+                evt_tag_int("disk_buf_size", self->options.disk_buf_size),
+                evt_tag_int("segment_size", self->options.segment_size),
+                NULL);
+      return FALSE;
+    }
+  if (self->options.qout_size < 1)
+    self->options.qout_size = 1;
+  return TRUE;
+}
+
+static gboolean
+_attach(LogDriverPlugin *s, LogDriver *d)
+{
+  LogDestDriver *dd = (LogDestDriver *) d;
+
+  if (!_check_options((DiskQDestPlugin *) s))
+    return FALSE;
+
+  dd->acquire_queue = _acquire_queue;
+  dd->acquire_queue_data = s;
+  return TRUE;
+}
+
+static void
+_free(LogDriverPlugin *s)
+{
+  DiskQDestPlugin *self = (DiskQDestPlugin *) s;
+
+  qdisk_options_destroy(&self->options);
+  log_driver_plugin_free_method(s);
+}
+
+LogDriverPlugin *
+diskq_dest_plugin_new(void)
+{
+  DiskQDestPlugin *self = g_new0(DiskQDestPlugin, 1);
+
+  log_driver_plugin_init_instance(&self->super);
+  qdisk_options_defaults(&self->options);
+  self->super.attach = _attach;
+  self->super.free_fn = _free;
+  return &self->super;
+}
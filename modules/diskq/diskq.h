@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2002-2015 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2015 Balázs Scheidler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+
+#ifndef DISKQ_H_INCLUDED
+#define DISKQ_H_INCLUDED
+
+#include "driver.h"
+#include "qdisk.h"
+
+typedef struct _DiskQDestPlugin
+{
+  LogDriverPlugin super;
+  QDiskOptions options;
+} DiskQDestPlugin;
+
+void diskq_set_disk_buf_size(LogDriverPlugin *s, gint64 disk_buf_size);
+void diskq_set_segment_size(LogDriverPlugin *s, gint64 segment_size);
+void diskq_set_mem_buf_length(LogDriverPlugin *s, gint mem_buf_length);
+void diskq_set_qout_size(LogDriverPlugin *s, gint qout_size);
+void diskq_set_dir(LogDriverPlugin *s, const gchar *dir);
+
+LogDriverPlugin *diskq_dest_plugin_new(void);
+
+#endif
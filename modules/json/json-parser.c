@@ -23,6 +23,7 @@
 #include "json-parser.h"
 #include "dot-notation.h"
 #include "scratch-buffers.h"
+#include "misc.h"
 
 #include <string.h>
 #include <ctype.h>
@@ -37,6 +38,7 @@ typedef struct _JSONParser
   gchar *marker;
   gint marker_len;
   gchar *extract_prefix;
+  gboolean streaming;
 } JSONParser;
 
 void
@@ -67,6 +69,14 @@ json_parser_set_extract_prefix(LogParser *s, const gchar *extract_prefix)
   self->extract_prefix = g_strdup(extract_prefix);
 }
 
+void
+json_parser_set_streaming(LogParser *s, gboolean streaming)
+{
+  JSONParser *self = (JSONParser *) s;
+
+  self->streaming = streaming;
+}
+
 static void
 json_parser_process_object(struct json_object *jso,
                                 const gchar *prefix,
@@ -194,6 +204,438 @@ json_parser_extract(JSONParser *self, struct json_object *jso, LogMessage *msg)
   return TRUE;
 }
 
+/*
+ * Streaming parser
+ *
+ * Tokenizes the input in a single pass without building a json-c object
+ * tree first. The keys are built incrementally in a single buffer. The
+ * leaf values are collected with their names, and only set in the
+ * LogMessage once the whole object has been parsed, so giving up half
+ * way leaves the message untouched.
+ *
+ * It only accepts standard JSON plus the single quoted strings json-c
+ * also accepts. Values are formatted exactly like the json-c based path
+ * does. For anything else it gives up: json-c extensions, invalid
+ * input, and numbers that json-c would clamp. The caller then parses
+ * the message with json-c. That sets the same values again (and any
+ * others) and reports errors the usual way.
+ */
+
+#define JSON_STREAM_MAX_DEPTH 32
+
+typedef struct _JSONStreamParser
+{
+  const gchar *pos;
+  const gchar *end;
+  /* the name of the value being parsed, prefixed by the prefix() option */
+  GString *key;
+  /* unescaped strings and formatted numbers */
+  GString *value;
+  /* the values found so far, as NUL terminated name and value pairs.
+   * Neither can contain NUL, those are rejected by the parser */
+  GString *values;
+  gint depth;
+} JSONStreamParser;
+
+static gboolean json_stream_parse_object(JSONStreamParser *self);
+static gboolean json_stream_parse_array(JSONStreamParser *self);
+
+static inline void
+json_stream_skip_whitespace(JSONStreamParser *self)
+{
+  while (self->pos < self->end &&
+         (*self->pos == ' ' || *self->pos == '\t' || *self->pos == '\n' || *self->pos == '\r'))
+    self->pos++;
+}
+
+static inline gboolean
+json_stream_consume(JSONStreamParser *self, gchar c)
+{
+  json_stream_skip_whitespace(self);
+  if (self->pos < self->end && *self->pos == c)
+    {
+      self->pos++;
+      return TRUE;
+    }
+  return FALSE;
+}
+
+static gboolean
+json_stream_parse_hex4(JSONStreamParser *self, gunichar *result)
+{
+  gint i, digit;
+
+  if (self->end - self->pos < 4)
+    return FALSE;
+
+  *result = 0;
+  for (i = 0; i < 4; i++)
+    {
+      digit = g_ascii_xdigit_value(self->pos[i]);
+      if (digit < 0)
+        return FALSE;
+      *result = (*result << 4) | digit;
+    }
+  self->pos += 4;
+  return TRUE;
+}
+
+static gboolean
+json_stream_unescape(JSONStreamParser *self, gchar quote, GString *result)
+{
+  gunichar uc;
+
+  switch (*self->pos++)
+    {
+    case '"':
+      g_string_append_c(result, '"');
+      break;
+    case '\'':
+      /* only valid in single quoted strings */
+      if (quote != '\'')
+        return FALSE;
+      g_string_append_c(result, '\'');
+      break;
+    case '\\':
+      g_string_append_c(result, '\\');
+      break;
+    case '/':
+      g_string_append_c(result, '/');
+      break;
+    case 'b':
+      g_string_append_c(result, '\b');
+      break;
+    case 'f':
+      g_string_append_c(result, '\f');
+      break;
+    case 'n':
+      g_string_append_c(result, '\n');
+      break;
+    case 'r':
+      g_string_append_c(result, '\r');
+      break;
+    case 't':
+      g_string_append_c(result, '\t');
+      break;
+    case 'u':
+      /* json-c versions differ in how they treat surrogates and NUL */
+      if (!json_stream_parse_hex4(self, &uc) || uc == 0 || (uc >= 0xD800 && uc <= 0xDFFF))
+        return FALSE;
+      g_string_append_unichar(result, uc);
+      break;
+    default:
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/*
+ * Parses the string at the current position. Strings without escapes
+ * are returned as a pointer into the input. Otherwise the unescaped
+ * string is placed in self->value.
+ */
+static gboolean
+json_stream_parse_string(JSONStreamParser *self, const gchar **str, gsize *str_len)
+{
+  gchar quote = *self->pos++;
+  const gchar *start = self->pos;
+
+  while (self->pos < self->end && *self->pos != quote && *self->pos != '\\' && *self->pos != '\0')
+    self->pos++;
+
+  if (self->pos < self->end && *self->pos == quote)
+    {
+      *str = start;
+      *str_len = self->pos - start;
+      self->pos++;
+      return TRUE;
+    }
+
+  g_string_truncate(self->value, 0);
+  g_string_append_len(self->value, start, self->pos - start);
+  while (self->pos < self->end && *self->pos != quote)
+    {
+      if (*self->pos == '\0')
+        return FALSE;
+
+      if (*self->pos == '\\')
+        {
+          self->pos++;
+          if (self->pos >= self->end || !json_stream_unescape(self, quote, self->value))
+            return FALSE;
+        }
+      else
+        {
+          g_string_append_c(self->value, *self->pos++);
+        }
+    }
+  if (self->pos >= self->end)
+    return FALSE;
+
+  self->pos++;
+  *str = self->value->str;
+  *str_len = self->value->len;
+  return TRUE;
+}
+
+static inline gboolean
+json_stream_is_delimiter(JSONStreamParser *self)
+{
+  return self->pos >= self->end || !(g_ascii_isalnum(*self->pos) || *self->pos == '.');
+}
+
+static gboolean
+json_stream_parse_number(JSONStreamParser *self, const gchar **str, gsize *str_len)
+{
+  const gchar *start = self->pos;
+  const gchar *digits;
+  gboolean is_double = FALSE;
+
+  if (*self->pos == '-')
+    self->pos++;
+
+  digits = self->pos;
+  if (self->pos < self->end && *self->pos == '0')
+    self->pos++;
+  else
+    while (self->pos < self->end && g_ascii_isdigit(*self->pos))
+      self->pos++;
+  if (self->pos == digits)
+    return FALSE;
+
+  if (self->pos < self->end && *self->pos == '.')
+    {
+      is_double = TRUE;
+      self->pos++;
+      if (self->pos >= self->end || !g_ascii_isdigit(*self->pos))
+        return FALSE;
+      while (self->pos < self->end && g_ascii_isdigit(*self->pos))
+        self->pos++;
+    }
+  if (self->pos < self->end && (*self->pos == 'e' || *self->pos == 'E'))
+    {
+      is_double = TRUE;
+      self->pos++;
+      if (self->pos < self->end && (*self->pos == '+' || *self->pos == '-'))
+        self->pos++;
+      if (self->pos >= self->end || !g_ascii_isdigit(*self->pos))
+        return FALSE;
+      while (self->pos < self->end && g_ascii_isdigit(*self->pos))
+        self->pos++;
+    }
+  if (!json_stream_is_delimiter(self))
+    return FALSE;
+
+  if (is_double)
+    {
+      g_string_assign_len(self->value, start, self->pos - start);
+      g_string_printf(self->value, "%f", g_ascii_strtod(self->value->str, NULL));
+      *str = self->value->str;
+      *str_len = self->value->len;
+    }
+  else if (self->pos - start == 2 && start[0] == '-' && start[1] == '0')
+    {
+      *str = "0";
+      *str_len = 1;
+    }
+  else if (self->pos - digits <= 9)
+    {
+      /* fits into an int, so it is formatted the same way by "%i" */
+      *str = start;
+      *str_len = self->pos - start;
+    }
+  else
+    {
+      /* json-c clamps these, in a version dependent way */
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static gboolean
+json_stream_parse_literal(JSONStreamParser *self, const gchar *literal, gsize literal_len)
+{
+  if ((gsize) (self->end - self->pos) < literal_len || memcmp(self->pos, literal, literal_len) != 0)
+    return FALSE;
+
+  self->pos += literal_len;
+  return json_stream_is_delimiter(self);
+}
+
+static gboolean
+json_stream_parse_value(JSONStreamParser *self)
+{
+  const gchar *value;
+  gsize value_len;
+
+  json_stream_skip_whitespace(self);
+  if (self->pos >= self->end)
+    return FALSE;
+
+  switch (*self->pos)
+    {
+    case '{':
+      self->pos++;
+      g_string_append_c(self->key, '.');
+      return json_stream_parse_object(self);
+    case '[':
+      self->pos++;
+      return json_stream_parse_array(self);
+    case '"':
+    case '\'':
+      if (!json_stream_parse_string(self, &value, &value_len))
+        return FALSE;
+      break;
+    case 't':
+      if (!json_stream_parse_literal(self, "true", 4))
+        return FALSE;
+      value = "true";
+      value_len = 4;
+      break;
+    case 'f':
+      if (!json_stream_parse_literal(self, "false", 5))
+        return FALSE;
+      value = "false";
+      value_len = 5;
+      break;
+    case 'n':
+      return json_stream_parse_literal(self, "null", 4);
+    default:
+      if (*self->pos != '-' && !g_ascii_isdigit(*self->pos))
+        return FALSE;
+      if (!json_stream_parse_number(self, &value, &value_len))
+        return FALSE;
+      break;
+    }
+
+  g_string_append_len(self->values, self->key->str, self->key->len + 1);
+  g_string_append_len(self->values, value, value_len);
+  g_string_append_c(self->values, '\0');
+  return TRUE;
+}
+
+static gboolean
+json_stream_parse_array(JSONStreamParser *self)
+{
+  gsize key_len = self->key->len;
+  gint index = 0;
+
+  if (++self->depth > JSON_STREAM_MAX_DEPTH)
+    return FALSE;
+
+  if (!json_stream_consume(self, ']'))
+    {
+      do
+        {
+          g_string_truncate(self->key, key_len);
+          g_string_append_printf(self->key, "[%d]", index++);
+          if (!json_stream_parse_value(self))
+            return FALSE;
+        }
+      while (json_stream_consume(self, ','));
+
+      if (!json_stream_consume(self, ']'))
+        return FALSE;
+    }
+  g_string_truncate(self->key, key_len);
+  self->depth--;
+  return TRUE;
+}
+
+/* the opening brace is already consumed, a trailing '.' is already
+ * appended to the key if this is not the top-level object */
+static gboolean
+json_stream_parse_object(JSONStreamParser *self)
+{
+  gsize key_len = self->key->len;
+  const gchar *name;
+  gsize name_len;
+
+  if (++self->depth > JSON_STREAM_MAX_DEPTH)
+    return FALSE;
+
+  if (!json_stream_consume(self, '}'))
+    {
+      do
+        {
+          json_stream_skip_whitespace(self);
+          if (self->pos >= self->end || (*self->pos != '"' && *self->pos != '\''))
+            return FALSE;
+          if (!json_stream_parse_string(self, &name, &name_len))
+            return FALSE;
+
+          g_string_truncate(self->key, key_len);
+          g_string_append_len(self->key, name, name_len);
+          if (!json_stream_consume(self, ':') || !json_stream_parse_value(self))
+            return FALSE;
+        }
+      while (json_stream_consume(self, ','));
+
+      if (!json_stream_consume(self, '}'))
+        return FALSE;
+    }
+  g_string_truncate(self->key, key_len);
+  self->depth--;
+  return TRUE;
+}
+
+static void
+json_stream_set_values(JSONStreamParser *self, LogMessage *msg)
+{
+  const gchar *name, *value;
+  const gchar *pos = self->values->str;
+  const gchar *end = pos + self->values->len;
+  gsize value_len;
+
+  while (pos < end)
+    {
+      name = pos;
+      value = name + strlen(name) + 1;
+      value_len = strlen(value);
+      log_msg_set_value_by_name(msg, name, value, value_len);
+      pos = value + value_len + 1;
+    }
+}
+
+static gboolean
+json_parser_process_streaming(JSONParser *self, LogMessage **pmsg, const LogPathOptions *path_options,
+                              const gchar *input, gsize input_len)
+{
+  JSONStreamParser parser;
+  SBGString *key, *value, *values;
+  gboolean result;
+
+  parser.pos = input;
+  parser.end = input + input_len;
+  json_stream_skip_whitespace(&parser);
+  if (parser.pos >= parser.end || *parser.pos != '{')
+    return FALSE;
+  parser.pos++;
+
+  key = sb_gstring_acquire();
+  value = sb_gstring_acquire();
+  values = sb_gstring_acquire();
+  if (self->prefix)
+    g_string_assign(sb_gstring_string(key), self->prefix);
+  parser.key = sb_gstring_string(key);
+  parser.value = sb_gstring_string(value);
+  parser.values = sb_gstring_string(values);
+  parser.depth = 0;
+
+  /* anything after the top-level object is ignored, just like json-c does */
+  result = json_stream_parse_object(&parser);
+  if (result)
+    {
+      log_msg_make_writable(pmsg, path_options);
+      json_stream_set_values(&parser, *pmsg);
+    }
+
+  sb_gstring_release(key);
+  sb_gstring_release(value);
+  sb_gstring_release(values);
+  return result;
+}
+
 #ifndef JSON_C_VERSION
 const char *
 json_tokener_error_desc(enum json_tokener_error err)
@@ -206,6 +648,7 @@ static gboolean
 json_parser_process(LogParser *s, LogMessage **pmsg, const LogPathOptions *path_options, const gchar *input, gsize input_len)
 {
   JSONParser *self = (JSONParser *) s;
+  const gchar *input_end = input + input_len;
   struct json_object *jso;
   struct json_tokener *tok;
 
@@ -219,6 +662,10 @@ json_parser_process(LogParser *s, LogMessage **pmsg, const LogPathOptions *path_
         input++;
     }
 
+  if (self->streaming && !self->extract_prefix &&
+      json_parser_process_streaming(self, pmsg, path_options, input, input_end - input))
+    return TRUE;
+
   tok = json_tokener_new();
   jso = json_tokener_parse_ex(tok, input, input_len);
   if (tok->err != json_tokener_success || !jso)
@@ -256,6 +703,7 @@ json_parser_clone(LogPipe *s)
   json_parser_set_prefix(cloned, self->prefix);
   json_parser_set_marker(cloned, self->marker);
   json_parser_set_extract_prefix(cloned, self->extract_prefix);
+  json_parser_set_streaming(cloned, self->streaming);
 
   return &cloned->super;
 }
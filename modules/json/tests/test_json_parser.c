@@ -168,6 +168,83 @@ test_json_parser_extracts_subobjects_if_extract_prefix_is_specified(void)
   assert_log_message_value(msg, log_msg_get_value_handle("foo"), "bar");
 }
 
+static void
+assert_streaming_matches_json_c(const gchar *json, const gchar *names[])
+{
+  LogMessage *dom_msg, *streaming_msg;
+  const gchar *dom_value, *streaming_value;
+  gssize dom_len, streaming_len;
+  gint i;
+
+  json_parser_set_streaming(json_parser, FALSE);
+  dom_msg = parse_json_into_log_message(json);
+  json_parser_set_streaming(json_parser, TRUE);
+  streaming_msg = parse_json_into_log_message(json);
+
+  for (i = 0; names[i]; i++)
+    {
+      dom_value = log_msg_get_value_by_name(dom_msg, names[i], &dom_len);
+      streaming_value = log_msg_get_value_by_name(streaming_msg, names[i], &streaming_len);
+      assert_nstring(streaming_value, streaming_len, dom_value, dom_len,
+                     "streaming parser value mismatch, json=%s, name=%s", json, names[i]);
+    }
+  log_msg_unref(dom_msg);
+  log_msg_unref(streaming_msg);
+}
+
+static void
+test_json_parser_streaming_produces_the_same_values(void)
+{
+  const gchar *names[] =
+  {
+    ".prefix.int", ".prefix.negative", ".prefix.booltrue", ".prefix.boolfalse", ".prefix.double",
+    ".prefix.exp", ".prefix.object.member1", ".prefix.object.nested.member2",
+    ".prefix.array[0]", ".prefix.array[1][0]", ".prefix.array[2].foo", ".prefix.null",
+    ".prefix.escaped", ".prefix.key\"with\\escapes", ".prefix.unicode", NULL
+  };
+
+  json_parser_set_prefix(json_parser, ".prefix.");
+  assert_streaming_matches_json_c("{\"int\": 123, \"negative\": -42, \"booltrue\": true, \"boolfalse\": false, "
+                                  "\"double\": 1.23, \"exp\": -2.5e3, "
+                                  "\"object\": {\"member1\": \"foo\", \"nested\": {\"member2\": \"bar\"}}, "
+                                  "\"array\": [1, [2], {\"foo\": \"bar\"}], \"null\": null, "
+                                  "\"escaped\": \"line1\\nline2\\t\\\"quoted\\\" \\/\", "
+                                  "\"key\\\"with\\\\escapes\": 1, \"unicode\": \"\\u00e1rv\\u00edzt\\u0171r\\u0151\"}",
+                                  names);
+  assert_streaming_matches_json_c("{'int': 123, 'double': 1.23, 'object': {'member1': 'foo'}}", names);
+}
+
+static void
+test_json_parser_streaming_falls_back_to_json_c(void)
+{
+  const gchar *names[] = { "big", "foo", "bar", NULL };
+
+  /* these are handled by json-c, either as extensions or to format the
+   * value the same way */
+  assert_streaming_matches_json_c("{\"big\": 12345678901, \"foo\": \"bar\"}", names);
+  assert_streaming_matches_json_c("{\"foo\": /* comment */ \"bar\", \"bar\": \"foo\"}", names);
+
+  json_parser_set_streaming(json_parser, TRUE);
+  assert_json_parser_fails("not-valid-json");
+  assert_json_parser_fails("[1, 2, 3]");
+  assert_json_parser_fails("");
+}
+
+static void
+test_json_parser_streaming_leaves_message_untouched_on_invalid_input(void)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  const gchar *json = "{\"foo\": \"bar\", \"nested\": {\"baz\": 1}, \"invalid\": }";
+  LogMessage *msg = log_msg_new_empty();
+
+  json_parser_set_streaming(json_parser, TRUE);
+  assert_false(log_parser_process(json_parser, &msg, &path_options, json, strlen(json)),
+               "expected json-parser failure and it returned success, json=%s", json);
+  assert_log_message_value(msg, log_msg_get_value_handle("foo"), NULL);
+  assert_log_message_value(msg, log_msg_get_value_handle("nested.baz"), NULL);
+  log_msg_unref(msg);
+}
+
 static void
 test_json_parser(void)
 {
@@ -179,6 +256,9 @@ test_json_parser(void)
   JSON_PARSER_TESTCASE(test_json_parser_validate_type_representation);
   JSON_PARSER_TESTCASE(test_json_parser_fails_for_non_object_top_element);
   JSON_PARSER_TESTCASE(test_json_parser_extracts_subobjects_if_extract_prefix_is_specified);
+  JSON_PARSER_TESTCASE(test_json_parser_streaming_produces_the_same_values);
+  JSON_PARSER_TESTCASE(test_json_parser_streaming_falls_back_to_json_c);
+  JSON_PARSER_TESTCASE(test_json_parser_streaming_leaves_message_untouched_on_invalid_input);
 }
 
 int
@@ -52,6 +52,8 @@ typedef struct
     PyObject *instance;
     PyObject *is_opened;
     PyObject *send;
+    PyObject *flush;
+    PyObject *discard;
   } py;
 } PythonDestDriver;
 
@@ -277,6 +279,18 @@ _py_invoke_send(PythonDestDriver *self, PyObject *dict)
   return _py_invoke_bool_function(self, self->py.send, dict);
 }
 
+static gboolean
+_py_invoke_flush(PythonDestDriver *self)
+{
+  return _py_invoke_bool_function(self, self->py.flush, NULL);
+}
+
+static void
+_py_invoke_discard(PythonDestDriver *self)
+{
+  _py_invoke_void_function(self, self->py.discard, NULL);
+}
+
 static gboolean
 _py_invoke_init(PythonDestDriver *self)
 {
@@ -322,6 +336,18 @@ _py_init_bindings(PythonDestDriver *self)
   /* these are fast paths, store references to be faster */
   self->py.is_opened = _py_get_attr_or_null(self->py.instance, "is_opened");
   self->py.send = _py_get_attr_or_null(self->py.instance, "send");
+  self->py.flush = _py_get_attr_or_null(self->py.instance, "flush");
+  self->py.discard = _py_get_attr_or_null(self->py.instance, "discard");
+  if (self->py.flush && !self->py.discard)
+    {
+      /* a failed batch is sent again, the class must be able to forget
+       * the messages it holds, otherwise they would be duplicated */
+      msg_warning("Python destination class has a flush() method but no discard(), sending messages one by one",
+                  evt_tag_str("driver", self->super.super.super.id),
+                  evt_tag_str("class", self->class),
+                  NULL);
+      Py_CLEAR(self->py.flush);
+    }
   if (!self->py.send)
     {
       msg_error("Error initializing Python destination, class does not have a send() method",
@@ -339,6 +365,8 @@ _py_free_bindings(PythonDestDriver *self)
   Py_CLEAR(self->py.instance);
   Py_CLEAR(self->py.is_opened);
   Py_CLEAR(self->py.send);
+  Py_CLEAR(self->py.flush);
+  Py_CLEAR(self->py.discard);
 }
 
 static gboolean
@@ -366,11 +394,14 @@ python_dd_insert(LogThrDestDriver *d, LogMessage *msg)
   gstate = PyGILState_Ensure();
   if (!_py_invoke_is_opened(self))
     {
+      if (self->py.flush)
+        _py_invoke_discard(self);
+      PyGILState_Release(gstate);
       return WORKER_INSERT_RESULT_NOT_CONNECTED;
     }
   if (self->vp)
     {
-      success = py_value_pairs_apply(self->vp, &self->template_options, self->super.seq_num, msg, &msg_object);
+      success = py_value_pairs_apply(self->vp, &self->template_options, log_threaded_dest_driver_get_seq_num(&self->super), msg, &msg_object);
       if (!success && (self->template_options.on_error & ON_ERROR_DROP_MESSAGE))
         {
           goto exit;
@@ -393,11 +424,43 @@ python_dd_insert(LogThrDestDriver *d, LogMessage *msg)
   Py_DECREF(msg_object);
 
  exit:
+  /* the whole batch is rewound, the messages sent so far are resent */
+  if (!success && self->py.flush)
+    _py_invoke_discard(self);
   PyGILState_Release(gstate);
-  if (success)
-    return WORKER_INSERT_RESULT_SUCCESS;
-  else
+  if (!success)
     return WORKER_INSERT_RESULT_ERROR;
+
+  /* with a flush() method, send() only adds the message to the batch */
+  if (self->py.flush)
+    return WORKER_INSERT_RESULT_QUEUED;
+  return WORKER_INSERT_RESULT_SUCCESS;
+}
+
+static worker_insert_result_t
+python_dd_flush(LogThrDestDriver *d)
+{
+  PythonDestDriver *self = (PythonDestDriver *)d;
+  gboolean success;
+  PyGILState_STATE gstate;
+
+  if (!self->py.flush)
+    return WORKER_INSERT_RESULT_SUCCESS;
+
+  gstate = PyGILState_Ensure();
+  success = _py_invoke_flush(self);
+  if (!success)
+    {
+      msg_error("Python flush() method returned failure, suspending destination for time_reopen()",
+                evt_tag_str("driver", self->super.super.super.id),
+                evt_tag_str("class", self->class),
+                evt_tag_int("time_reopen", self->super.time_reopen),
+                NULL);
+      _py_invoke_discard(self);
+    }
+  PyGILState_Release(gstate);
+
+  return success ? WORKER_INSERT_RESULT_SUCCESS : WORKER_INSERT_RESULT_ERROR;
 }
 
 static void
@@ -541,6 +604,7 @@ python_dd_new(GlobalConfig *cfg)
   self->super.worker.thread_deinit = python_dd_worker_deinit;
   self->super.worker.disconnect = python_dd_disconnect;
   self->super.worker.insert = python_dd_insert;
+  self->super.worker.flush = python_dd_flush;
 
   self->super.format.stats_instance = python_dd_format_stats_instance;
   self->super.format.persist_name = python_dd_format_persist_name;
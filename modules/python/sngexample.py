@@ -24,7 +24,14 @@ class LogDestination(object):
         """Send a message to the target service
 
         It should return True to indicate success, False will suspend the
-        destination for a period specified by the time-reopen() option."""
+        destination for a period specified by the time-reopen() option.
+
+        If the class also has flush() and discard() methods, send() only adds
+        the message to the current batch: flush() is called after
+        batch-lines() messages or batch-timeout() milliseconds and sends out
+        the whole batch, with the same return value convention as send().
+        When send() or flush() fails, discard() is called to forget the
+        messages of the batch, as they are sent again."""
         pass
 
 
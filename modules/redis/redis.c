@@ -35,6 +35,17 @@
 #include "plugin-types.h"
 #include "logthrdestdrv.h"
 
+/* per-thread state, each worker has its own connection */
+typedef struct
+{
+  redisContext *c;
+  GString *key_str;
+  GString *param1_str;
+  GString *param2_str;
+  /* number of commands appended to the connection, waiting for their reply */
+  gint pending;
+} RedisWorker;
+
 typedef struct
 {
   LogThrDestDriver super;
@@ -46,13 +57,8 @@ typedef struct
 
   GString *command;
   LogTemplate *key;
-  GString *key_str;
   LogTemplate *param1;
-  GString *param1_str;
   LogTemplate *param2;
-  GString *param2_str;
-
-  redisContext *c;
 } RedisDriver;
 
 /*
@@ -129,26 +135,37 @@ redis_dd_format_persist_name(LogThrDestDriver *d)
   return persist_name;
 }
 
+static RedisWorker *
+redis_dd_get_worker(RedisDriver *self)
+{
+  return (RedisWorker *) log_threaded_dest_driver_get_current_worker(&self->super)->user_data;
+}
+
 static gboolean
 redis_dd_connect(RedisDriver *self, gboolean reconnect)
 {
-  if (reconnect && (self->c != NULL))
+  RedisWorker *worker = redis_dd_get_worker(self);
+
+  if (reconnect && (worker->c != NULL))
     {
-      redisCommand(self->c, "ping");
+      redisReply *reply = redisCommand(worker->c, "ping");
 
-      if (!self->c->err)
+      if (reply)
+        freeReplyObject(reply);
+      if (!worker->c->err)
         return TRUE;
-      else
-        self->c = redisConnect(self->host, self->port);
+
+      redisFree(worker->c);
+      worker->c = redisConnect(self->host, self->port);
     }
   else
-    self->c = redisConnect(self->host, self->port);
+    worker->c = redisConnect(self->host, self->port);
 
-  if (self->c->err)
+  if (worker->c->err)
     {
       msg_error("REDIS server error, suspending",
                 evt_tag_str("driver", self->super.super.super.id),
-                evt_tag_str("error", self->c->errstr),
+                evt_tag_str("error", worker->c->errstr),
                 evt_tag_int("time_reopen", self->super.time_reopen),
                 NULL);
       return FALSE;
@@ -164,10 +181,12 @@ static void
 redis_dd_disconnect(LogThrDestDriver *s)
 {
   RedisDriver *self = (RedisDriver *)s;
+  RedisWorker *worker = redis_dd_get_worker(self);
 
-  if (self->c)
-    redisFree(self->c);
-  self->c = NULL;
+  if (worker->c)
+    redisFree(worker->c);
+  worker->c = NULL;
+  worker->pending = 0;
 }
 
 /*
@@ -178,56 +197,98 @@ static worker_insert_result_t
 redis_worker_insert(LogThrDestDriver *s, LogMessage *msg)
 {
   RedisDriver *self = (RedisDriver *)s;
-  redisReply *reply;
+  RedisWorker *worker = redis_dd_get_worker(self);
   const char *argv[5];
   size_t argvlen[5];
   int argc = 2;
 
-  if (!redis_dd_connect(self, TRUE))
+  /* the connection is checked once per batch, a ping in the middle of a
+   * pipeline would read the reply of an earlier command */
+  if (worker->pending == 0 && !redis_dd_connect(self, TRUE))
     return WORKER_INSERT_RESULT_NOT_CONNECTED;
 
-  if (self->c->err)
-    return WORKER_INSERT_RESULT_ERROR;
+  /* the commands appended so far are left in the output buffer of the
+   * context, it is rebuilt so that they are not sent after the rewind */
+  if (worker->c->err)
+    return WORKER_INSERT_RESULT_NOT_CONNECTED;
 
   log_template_format(self->key, msg, &self->template_options, LTZ_SEND,
-                      self->super.seq_num, NULL, self->key_str);
+                      log_threaded_dest_driver_get_seq_num(&self->super), NULL, worker->key_str);
 
   if (self->param1)
     log_template_format(self->param1, msg, &self->template_options, LTZ_SEND,
-                        self->super.seq_num, NULL, self->param1_str);
+                        log_threaded_dest_driver_get_seq_num(&self->super), NULL, worker->param1_str);
   if (self->param2)
     log_template_format(self->param2, msg, &self->template_options, LTZ_SEND,
-                        self->super.seq_num, NULL, self->param2_str);
+                        log_threaded_dest_driver_get_seq_num(&self->super), NULL, worker->param2_str);
 
   argv[0] = self->command->str;
   argvlen[0] = self->command->len;
-  argv[1] = self->key_str->str;
-  argvlen[1] = self->key_str->len;
+  argv[1] = worker->key_str->str;
+  argvlen[1] = worker->key_str->len;
 
   if (self->param1)
     {
-      argv[2] = self->param1_str->str;
-      argvlen[2] = self->param1_str->len;
+      argv[2] = worker->param1_str->str;
+      argvlen[2] = worker->param1_str->len;
       argc++;
     }
 
   if (self->param2)
     {
-      argv[3] = self->param2_str->str;
-      argvlen[3] = self->param2_str->len;
+      argv[3] = worker->param2_str->str;
+      argvlen[3] = worker->param2_str->len;
       argc++;
     }
 
-  reply = redisCommandArgv(self->c, argc, argv, argvlen);
+  if (redisAppendCommandArgv(worker->c, argc, argv, argvlen) != REDIS_OK)
+    return WORKER_INSERT_RESULT_NOT_CONNECTED;
+  worker->pending++;
 
-  msg_debug("REDIS command sent",
+  msg_debug("REDIS command queued",
             evt_tag_str("driver", self->super.super.super.id),
             evt_tag_str("command", self->command->str),
-            evt_tag_str("key", self->key_str->str),
-            evt_tag_str("param1", self->param1_str->str),
-            evt_tag_str("param2", self->param2_str->str),
+            evt_tag_str("key", worker->key_str->str),
+            evt_tag_str("param1", worker->param1_str->str),
+            evt_tag_str("param2", worker->param2_str->str),
             NULL);
-  freeReplyObject(reply);
+
+  return WORKER_INSERT_RESULT_QUEUED;
+}
+
+/*
+ * Sends out the commands queued by redis_worker_insert() and reads their
+ * replies.  Commands rejected by the server are not retried, sending them
+ * again would fail the same way.
+ */
+static worker_insert_result_t
+redis_worker_flush(LogThrDestDriver *s)
+{
+  RedisDriver *self = (RedisDriver *)s;
+  RedisWorker *worker = redis_dd_get_worker(self);
+  redisReply *reply;
+
+  for (; worker->pending > 0; worker->pending--)
+    {
+      if (redisGetReply(worker->c, (void **) &reply) != REDIS_OK)
+        {
+          msg_error("REDIS server error, suspending",
+                    evt_tag_str("driver", self->super.super.super.id),
+                    evt_tag_str("error", worker->c->errstr),
+                    evt_tag_int("time_reopen", self->super.time_reopen),
+                    NULL);
+          worker->pending = 0;
+          return WORKER_INSERT_RESULT_NOT_CONNECTED;
+        }
+
+      if (reply->type == REDIS_REPLY_ERROR)
+        msg_error("REDIS command failed",
+                  evt_tag_str("driver", self->super.super.super.id),
+                  evt_tag_str("command", self->command->str),
+                  evt_tag_str("error", reply->str),
+                  NULL);
+      freeReplyObject(reply);
+    }
 
   return WORKER_INSERT_RESULT_SUCCESS;
 }
@@ -236,14 +297,17 @@ static void
 redis_worker_thread_init(LogThrDestDriver *d)
 {
   RedisDriver *self = (RedisDriver *)d;
+  RedisWorker *worker = g_new0(RedisWorker, 1);
+
+  log_threaded_dest_driver_get_current_worker(d)->user_data = worker;
 
   msg_debug("Worker thread started",
             evt_tag_str("driver", self->super.super.super.id),
             NULL);
 
-  self->key_str = g_string_sized_new(1024);
-  self->param1_str = g_string_sized_new(1024);
-  self->param2_str = g_string_sized_new(1024);
+  worker->key_str = g_string_sized_new(1024);
+  worker->param1_str = g_string_sized_new(1024);
+  worker->param2_str = g_string_sized_new(1024);
 
   redis_dd_connect(self, FALSE);
 }
@@ -252,10 +316,16 @@ static void
 redis_worker_thread_deinit(LogThrDestDriver *d)
 {
   RedisDriver *self = (RedisDriver *)d;
+  RedisWorker *worker = redis_dd_get_worker(self);
+
+  g_string_free(worker->key_str, TRUE);
+  g_string_free(worker->param1_str, TRUE);
+  g_string_free(worker->param2_str, TRUE);
+  if (worker->c)
+    redisFree(worker->c);
+  g_free(worker);
 
-  g_string_free(self->key_str, TRUE);
-  g_string_free(self->param1_str, TRUE);
-  g_string_free(self->param2_str, TRUE);
+  log_threaded_dest_driver_get_current_worker(d)->user_data = NULL;
 }
 
 /*
@@ -294,8 +364,6 @@ redis_dd_free(LogPipe *d)
   log_template_unref(self->key);
   log_template_unref(self->param1);
   log_template_unref(self->param2);
-  if (self->c)
-    redisFree(self->c);
 
   log_threaded_dest_driver_free(d);
 }
@@ -317,10 +385,12 @@ redis_dd_new(GlobalConfig *cfg)
   self->super.worker.thread_deinit = redis_worker_thread_deinit;
   self->super.worker.disconnect = redis_dd_disconnect;
   self->super.worker.insert = redis_worker_insert;
+  self->super.worker.flush = redis_worker_flush;
 
   self->super.format.stats_instance = redis_dd_format_stats_instance;
   self->super.format.persist_name = redis_dd_format_persist_name;
   self->super.stats_source = SCS_REDIS;
+  self->super.supports_multiple_workers = TRUE;
 
   redis_dd_set_host((LogDriver *)self, "127.0.0.1");
   redis_dd_set_port((LogDriver *)self, 6379);
@@ -67,7 +67,6 @@ typedef struct
   {
     riemann_event_t **list;
     gint n;
-    gint batch_size_max;
     GStaticMutex lock;
   } event;
 } RiemannDestDriver;
@@ -164,7 +163,7 @@ riemann_dd_set_flush_lines(LogDriver *d, gint lines)
 {
   RiemannDestDriver *self = (RiemannDestDriver *)d;
 
-  self->event.batch_size_max = lines;
+  log_threaded_dest_driver_set_batch_lines(d, lines);
 }
 
 gboolean
@@ -348,10 +347,10 @@ riemann_worker_init(LogPipe *s)
 
   _value_pairs_always_exclude_properties(self);
 
-  if (self->event.batch_size_max <= 0)
-    self->event.batch_size_max = 1;
+  if (self->super.batch_lines <= 0)
+    self->super.batch_lines = 1;
   self->event.list = (riemann_event_t **)malloc (sizeof (riemann_event_t *) *
-                                                 self->event.batch_size_max);
+                                                 self->super.batch_lines);
 
   msg_verbose("Initializing Riemann destination",
               evt_tag_str("driver", self->super.super.super.id),
@@ -418,7 +417,7 @@ static gboolean
 riemann_add_metric_to_event(RiemannDestDriver *self, riemann_event_t *event, LogMessage *msg, SBGString *str)
 {
   log_template_format(self->fields.metric, msg, &self->template_options,
-		    LTZ_SEND, self->super.seq_num, NULL, sb_gstring_string(str));
+		    LTZ_SEND, log_threaded_dest_driver_get_seq_num(&self->super), NULL, sb_gstring_string(str));
 
   if (sb_gstring_string(str)->len == 0)
     return FALSE;
@@ -465,7 +464,7 @@ riemann_add_ttl_to_event(RiemannDestDriver *self, riemann_event_t *event, LogMes
   gdouble d;
 
   log_template_format(self->fields.ttl, msg, &self->template_options,
-		      LTZ_SEND, self->super.seq_num, NULL,
+		      LTZ_SEND, log_threaded_dest_driver_get_seq_num(&self->super), NULL,
 		      sb_gstring_string(str));
 
   if (sb_gstring_string(str)->len == 0)
@@ -517,19 +516,19 @@ riemann_worker_insert_one(RiemannDestDriver *self, LogMessage *msg)
       riemann_dd_field_maybe_add(event, msg, self->fields.host,
                                  &self->template_options,
                                  RIEMANN_EVENT_FIELD_HOST,
-                                 self->super.seq_num, sb_gstring_string(str));
+                                 log_threaded_dest_driver_get_seq_num(&self->super), sb_gstring_string(str));
       riemann_dd_field_maybe_add(event, msg, self->fields.service,
                                  &self->template_options,
                                  RIEMANN_EVENT_FIELD_SERVICE,
-                                 self->super.seq_num, sb_gstring_string(str));
+                                 log_threaded_dest_driver_get_seq_num(&self->super), sb_gstring_string(str));
       riemann_dd_field_maybe_add(event, msg, self->fields.description,
                                  &self->template_options,
                                  RIEMANN_EVENT_FIELD_DESCRIPTION,
-                                 self->super.seq_num, sb_gstring_string(str));
+                                 log_threaded_dest_driver_get_seq_num(&self->super), sb_gstring_string(str));
       riemann_dd_field_maybe_add(event, msg, self->fields.state,
                                  &self->template_options,
                                  RIEMANN_EVENT_FIELD_STATE,
-                                 self->super.seq_num, sb_gstring_string(str));
+                                 log_threaded_dest_driver_get_seq_num(&self->super), sb_gstring_string(str));
 
       if (self->fields.tags)
         g_list_foreach(self->fields.tags, riemann_dd_field_add_tag,
@@ -541,7 +540,7 @@ riemann_worker_insert_one(RiemannDestDriver *self, LogMessage *msg)
       if (self->fields.attributes)
         value_pairs_foreach(self->fields.attributes,
                             riemann_dd_field_add_attribute_vp,
-                            msg, self->super.seq_num, LTZ_SEND,
+                            msg, log_threaded_dest_driver_get_seq_num(&self->super), LTZ_SEND,
                             &self->template_options, event);
 
       _append_event(self, event);
@@ -558,14 +557,39 @@ riemann_worker_insert_one(RiemannDestDriver *self, LogMessage *msg)
     return WORKER_INSERT_RESULT_ERROR;
 }
 
+/*
+ * The whole batch is rewound by LogThrDestDriver when it could not be
+ * sent, so the events built so far are not needed anymore.
+ */
+static void
+_discard_events(RiemannDestDriver *self)
+{
+  gint i;
+
+  g_static_mutex_lock(&self->event.lock);
+
+  for (i = 0; i < self->event.n; i++)
+    riemann_event_free(self->event.list[i]);
+  self->event.n = 0;
+
+  g_static_mutex_unlock(&self->event.lock);
+}
+
 static worker_insert_result_t
-riemann_worker_batch_flush(RiemannDestDriver *self)
+riemann_worker_batch_flush(LogThrDestDriver *s)
 {
+  RiemannDestDriver *self = (RiemannDestDriver *)s;
   riemann_message_t *message;
   int r;
 
+  if (self->event.n == 0)
+    return WORKER_INSERT_RESULT_SUCCESS;
+
   if (!riemann_dd_connect(self, TRUE))
-    return WORKER_INSERT_RESULT_ERROR;
+    {
+      _discard_events(self);
+      return WORKER_INSERT_RESULT_ERROR;
+    }
 
   message = riemann_message_new();
 
@@ -581,7 +605,7 @@ riemann_worker_batch_flush(RiemannDestDriver *self)
    */
   self->event.n = 0;
   self->event.list = (riemann_event_t **)malloc (sizeof (riemann_event_t *) *
-                                                 self->event.batch_size_max);
+                                                 self->super.batch_lines);
   g_static_mutex_unlock(&self->event.lock);
 
   if (r != 0)
@@ -598,21 +622,17 @@ riemann_worker_insert(LogThrDestDriver *s, LogMessage *msg)
 
   result = riemann_worker_insert_one(self, msg);
 
-  if (self->event.n < self->event.batch_size_max)
+  /* the events queued so far are kept, only this message is dropped */
+  if (result == WORKER_INSERT_RESULT_DROP)
     return result;
 
   if (result != WORKER_INSERT_RESULT_SUCCESS)
-    return result;
-
-  return riemann_worker_batch_flush(self);
-}
-
-static void
-riemann_worker_thread_deinit(LogThrDestDriver *s)
-{
-  RiemannDestDriver *self = (RiemannDestDriver *)s;
+    {
+      _discard_events(self);
+      return result;
+    }
 
-  riemann_worker_batch_flush(self);
+  return WORKER_INSERT_RESULT_QUEUED;
 }
 
 /*
@@ -658,7 +678,7 @@ riemann_dd_new(GlobalConfig *cfg)
 
   self->super.worker.disconnect = riemann_dd_disconnect;
   self->super.worker.insert = riemann_worker_insert;
-  self->super.worker.thread_deinit = riemann_worker_thread_deinit;
+  self->super.worker.flush = riemann_worker_batch_flush;
 
   self->super.format.stats_instance = riemann_dd_format_stats_instance;
   self->super.format.persist_name = riemann_dd_format_persist_name;
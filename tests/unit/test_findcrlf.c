@@ -1,6 +1,10 @@
 #include "misc.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define TEST_BUFFER_SIZE  (64 * 1024)
+#define TEST_LINE_LENGTH  97
 
 static void
 testcase(gchar *msg, gsize msg_len, gsize eom_ofs)
@@ -24,6 +28,38 @@ testcase(gchar *msg, gsize msg_len, gsize eom_ofs)
     }
 }
 
+/* the terminators fall at every alignment relative to the vector width */
+static void
+test_find_cr_or_lf_finds_every_line_in_a_large_buffer(void)
+{
+  gchar *buffer = g_malloc(TEST_BUFFER_SIZE);
+  gchar *p, *eom;
+  gsize pos;
+  gint lines = 0, found = 0;
+
+  memset(buffer, 'x', TEST_BUFFER_SIZE);
+  for (pos = TEST_LINE_LENGTH - 1; pos < TEST_BUFFER_SIZE; pos += TEST_LINE_LENGTH, lines++)
+    buffer[pos] = (lines % 2) ? '\r' : '\n';
+
+  p = buffer;
+  while ((eom = find_cr_or_lf(p, buffer + TEST_BUFFER_SIZE - p)))
+    {
+      if ((eom - buffer) % TEST_LINE_LENGTH != TEST_LINE_LENGTH - 1)
+        {
+          fprintf(stderr, "EOM is at wrong location in a large buffer, ofs=%d\n", (gint) (eom - buffer));
+          exit(1);
+        }
+      found++;
+      p = eom + 1;
+    }
+  if (found != lines)
+    {
+      fprintf(stderr, "EOM count mismatch in a large buffer, found=%d, expected=%d\n", found, lines);
+      exit(1);
+    }
+  g_free(buffer);
+}
+
 int
 main()
 {
@@ -108,5 +144,6 @@ main()
   testcase("abcdefghijklmnopqrstuvwxy", 25, -1);
   testcase("abcdefghijklmnopqrstuvwxyz", 26, -1);
 
+  test_find_cr_or_lf_finds_every_line_in_a_large_buffer();
   return 0;
 }
@@ -0,0 +1,188 @@
+#include "logmsg.h"
+#include "apphook.h"
+#include "stats/stats-registry.h"
+#include "libtest/testutils.h"
+
+#include <string.h>
+
+static gpointer
+unref_message_thread(gpointer data)
+{
+  log_msg_unref((LogMessage *) data);
+  return NULL;
+}
+
+static gpointer
+alloc_message_thread(gpointer data)
+{
+  LogMessage *msg = log_msg_new_empty();
+
+  log_msg_pool_thread_deinit();
+  return msg;
+}
+
+/* frees a message of its own before exiting, returns its address */
+static gpointer
+alloc_and_free_message_thread(gpointer data)
+{
+  LogMessage *msg = log_msg_new_empty();
+
+  log_msg_unref(msg);
+  log_msg_pool_thread_deinit();
+  return msg;
+}
+
+static gpointer
+alloc_many_messages_thread(gpointer data)
+{
+  gint i;
+
+  for (i = 0; i < GPOINTER_TO_INT(data); i++)
+    log_msg_unref(log_msg_new_empty());
+  log_msg_pool_thread_deinit();
+  return NULL;
+}
+
+static void
+test_message_is_reused_by_the_same_thread(void)
+{
+  LogMessage *msg;
+  gpointer freed;
+
+  msg = log_msg_new_empty();
+  freed = msg;
+  log_msg_unref(msg);
+
+  msg = log_msg_new_empty();
+  assert_true(msg == freed, "Freed LogMessage was not reused by the allocating thread");
+  log_msg_unref(msg);
+}
+
+static void
+test_message_freed_by_another_thread_is_returned_to_its_pool(void)
+{
+  LogMessage *msg;
+  GThread *thread;
+  gpointer freed;
+
+  msg = log_msg_new_empty();
+  freed = msg;
+  thread = g_thread_create(unref_message_thread, msg, TRUE, NULL);
+  g_thread_join(thread);
+
+  msg = log_msg_new_empty();
+  assert_true(msg == freed, "LogMessage freed by another thread was not returned to the pool of its owner");
+  log_msg_unref(msg);
+}
+
+static void
+test_pool_of_exited_thread_is_adopted(void)
+{
+  LogMessage *msg;
+  GThread *thread;
+  gpointer freed;
+
+  thread = g_thread_create(alloc_and_free_message_thread, NULL, TRUE, NULL);
+  freed = g_thread_join(thread);
+
+  thread = g_thread_create(alloc_message_thread, NULL, TRUE, NULL);
+  msg = (LogMessage *) g_thread_join(thread);
+  assert_true(msg == freed, "Pool of an exited thread was not adopted by the next thread");
+  log_msg_unref(msg);
+}
+
+static void
+test_message_of_exited_thread_can_be_freed(void)
+{
+  LogMessage *msg;
+  GThread *thread;
+
+  /* the pool is orphaned at this point, the chunk is not kept by it */
+  thread = g_thread_create(alloc_message_thread, NULL, TRUE, NULL);
+  msg = (LogMessage *) g_thread_join(thread);
+  log_msg_unref(msg);
+
+  thread = g_thread_create(alloc_message_thread, NULL, TRUE, NULL);
+  msg = (LogMessage *) g_thread_join(thread);
+  assert_not_null(msg, "Allocation from an adopted pool failed");
+  log_msg_unref(msg);
+}
+
+static void
+test_pool_statistics_are_published_when_the_thread_exits(void)
+{
+  StatsCounterItem *hits = NULL, *misses = NULL;
+  guint32 before;
+  GThread *thread;
+
+  stats_lock();
+  stats_register_counter(0, SCS_GLOBAL, "msg_pool_hits", NULL, SC_TYPE_PROCESSED, &hits);
+  stats_register_counter(0, SCS_GLOBAL, "msg_pool_misses", NULL, SC_TYPE_PROCESSED, &misses);
+  stats_unlock();
+
+  before = stats_counter_get(hits) + stats_counter_get(misses);
+  thread = g_thread_create(alloc_many_messages_thread, GINT_TO_POINTER(10), TRUE, NULL);
+  g_thread_join(thread);
+  assert_gint(stats_counter_get(hits) + stats_counter_get(misses) - before, 10,
+              "Pool statistics of the exited thread were not published");
+
+  stats_lock();
+  stats_unregister_counter(SCS_GLOBAL, "msg_pool_hits", NULL, SC_TYPE_PROCESSED, &hits);
+  stats_unregister_counter(SCS_GLOBAL, "msg_pool_misses", NULL, SC_TYPE_PROCESSED, &misses);
+  stats_unlock();
+}
+
+static void
+test_size_hint_follows_the_final_payload_size(void)
+{
+  LogMessageSizeHint hint = { 0, 0 };
+  LogMessage *msg;
+  gchar name[32];
+  gint i;
+
+  msg = log_msg_new_empty();
+  for (i = 0; i < 40; i++)
+    {
+      g_snprintf(name, sizeof(name), "test.value%d", i);
+      log_msg_set_value_by_name(msg, name, "some value that takes up space", -1);
+    }
+
+  for (i = 0; i < 100; i++)
+    log_msg_size_hint_update(&hint, msg);
+
+  assert_true(hint.payload_size > msg->payload->used / 2 && hint.payload_size <= msg->payload->used,
+              "Size hint did not converge to the payload size; hint=%d, used=%d", hint.payload_size, msg->payload->used);
+  assert_true(hint.num_dyn_entries > 20 && hint.num_dyn_entries <= 40,
+              "Size hint did not converge to the number of dynamic values; hint=%d", hint.num_dyn_entries);
+  log_msg_unref(msg);
+}
+
+static void
+test_new_message_is_allocated_according_to_the_hint(void)
+{
+  LogMessageSizeHint hint = { 8192, 64 };
+  MsgFormatOptions parse_options;
+  LogMessage *msg;
+
+  memset(&parse_options, 0, sizeof(parse_options));
+  msg = log_msg_new_with_size_hint("foo", 3, NULL, &parse_options, &hint);
+  assert_true(msg->payload->size >= 8192, "Payload was not allocated according to the size hint; size=%d", msg->payload->size);
+  log_msg_unref(msg);
+}
+
+int
+main()
+{
+  app_startup();
+
+  test_message_is_reused_by_the_same_thread();
+  test_message_freed_by_another_thread_is_returned_to_its_pool();
+  test_pool_of_exited_thread_is_adopted();
+  test_message_of_exited_thread_can_be_freed();
+  test_pool_statistics_are_published_when_the_thread_exits();
+  test_size_hint_follows_the_final_payload_size();
+  test_new_message_is_allocated_according_to_the_hint();
+
+  app_shutdown();
+  return 0;
+}
@@ -6,6 +6,7 @@
 #include "mainloop.h"
 #include "tls-support.h"
 #include "mainloop-io-worker.h"
+#include "stats/stats-registry.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -127,6 +128,155 @@ testcase_zero_diskbuf_alternating_send_acks()
   log_queue_unref(q);
 }
 
+gint
+pop_and_send_batch(LogQueue *q, gint max_msgs)
+{
+  LogMessage *msgs[64];
+  LogPathOptions path_options[64];
+  gint count, i;
+
+  count = log_queue_pop_batch(q, msgs, path_options, max_msgs);
+  for (i = 0; i < count; i++)
+    {
+      log_msg_ack(msgs[i], &path_options[i], AT_PROCESSED);
+      log_msg_unref(msgs[i]);
+    }
+  return count;
+}
+
+void
+testcase_pop_batch()
+{
+  LogQueue *q;
+  gint count;
+
+  q = log_queue_fifo_new(OVERFLOW_SIZE, NULL);
+  log_queue_set_use_backlog(q, TRUE);
+
+  fed_messages = 0;
+  acked_messages = 0;
+  feed_some_messages(&q, 100);
+
+  count = pop_and_send_batch(q, 64);
+  count += pop_and_send_batch(q, 64);
+  if (count != 100 || pop_and_send_batch(q, 64) != 0 || log_queue_get_length(q) != 0)
+    {
+      fprintf(stderr, "pop_batch returned unexpected number of messages: count=%d\n", count);
+      exit(1);
+    }
+
+  log_queue_rewind_backlog(q, 10);
+  if (log_queue_get_length(q) != 10 || pop_and_send_batch(q, 64) != 10)
+    {
+      fprintf(stderr, "rewound messages are not returned by pop_batch: queue_len=%d\n", (gint) log_queue_get_length(q));
+      exit(1);
+    }
+
+  app_ack_some_messages(q, 100);
+  if (fed_messages != acked_messages)
+    {
+      fprintf(stderr, "did not receive enough acknowledgements: fed_messages=%d, acked_messages=%d\n", fed_messages, acked_messages);
+      exit(1);
+    }
+
+  log_queue_unref(q);
+}
+
+void
+testcase_memory_limit_drops_messages()
+{
+  LogQueue *q;
+  LogMessage *msg;
+  gsize msg_size;
+  GSockAddr *sa;
+  char *msg_str = "<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: árvíztűrőtükörfúrógép";
+
+  sa = g_sockaddr_inet_new("10.10.10.10", 1010);
+  msg = log_msg_new(msg_str, strlen(msg_str), sa, &parse_options);
+  g_sockaddr_unref(sa);
+  msg_size = log_msg_get_size(msg);
+  log_msg_unref(msg);
+
+  q = log_queue_fifo_new(OVERFLOW_SIZE, NULL);
+  log_queue_set_use_backlog(q, TRUE);
+  log_queue_fifo_set_memory_limit(q, 10 * msg_size + msg_size / 2);
+
+  fed_messages = 0;
+  acked_messages = 0;
+  feed_some_messages(&q, 20);
+  if (log_queue_get_length(q) != 10 || acked_messages != 10)
+    {
+      fprintf(stderr, "memory limit was not enforced: queue_len=%d, acked_messages=%d\n", (gint) log_queue_get_length(q), acked_messages);
+      exit(1);
+    }
+
+  send_some_messages(q, 10);
+  app_ack_some_messages(q, 10);
+  feed_some_messages(&q, 5);
+  if (log_queue_get_length(q) != 5)
+    {
+      fprintf(stderr, "memory was not released by pop_head: queue_len=%d\n", (gint) log_queue_get_length(q));
+      exit(1);
+    }
+  send_some_messages(q, 5);
+  app_ack_some_messages(q, 5);
+  if (fed_messages != acked_messages)
+    {
+      fprintf(stderr, "did not receive enough acknowledgements: fed_messages=%d, acked_messages=%d\n", fed_messages, acked_messages);
+      exit(1);
+    }
+
+  log_queue_unref(q);
+}
+
+void
+testcase_memory_usage_counter()
+{
+  LogQueue *q;
+  LogMessage *msg;
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  StatsCounterItem *memory_usage = NULL;
+  gsize msg_size;
+
+  q = log_queue_fifo_new(OVERFLOW_SIZE, NULL);
+  log_queue_set_use_backlog(q, TRUE);
+  stats_lock();
+  log_queue_register_stats_counters(q, 0, SCS_DESTINATION, "test_logqueue", "memory_usage");
+  stats_register_counter(0, SCS_DESTINATION, "test_logqueue", "memory_usage", SC_TYPE_MEMORY_USAGE, &memory_usage);
+  stats_unlock();
+
+  fed_messages = 0;
+  acked_messages = 0;
+  feed_some_messages(&q, 1);
+  msg = log_queue_pop_head(q, &path_options);
+  msg_size = log_msg_get_size(msg);
+  log_queue_rewind_backlog(q, 1);
+  if (stats_counter_get(memory_usage) != msg_size)
+    {
+      fprintf(stderr, "memory_usage mismatch after rewind: memory_usage=%d, msg_size=%d\n", (gint) stats_counter_get(memory_usage), (gint) msg_size);
+      exit(1);
+    }
+
+  /* the message grows while queued, as done by LogMultiplexer once it has been delivered */
+  log_msg_write_unprotect(msg);
+  log_msg_set_value_by_name(msg, "grown.after.queueing", "a value that makes the message larger", -1);
+  log_msg_unref(msg);
+
+  send_some_messages(q, 1);
+  app_ack_some_messages(q, 1);
+  if (stats_counter_get(memory_usage) != 0 || log_queue_get_length(q) != 0)
+    {
+      fprintf(stderr, "memory_usage was not released: memory_usage=%d\n", (gint) stats_counter_get(memory_usage));
+      exit(1);
+    }
+
+  stats_lock();
+  stats_unregister_counter(SCS_DESTINATION, "test_logqueue", "memory_usage", SC_TYPE_MEMORY_USAGE, &memory_usage);
+  log_queue_unregister_stats_counters(q, SCS_DESTINATION, "test_logqueue", "memory_usage");
+  stats_unlock();
+  log_queue_unref(q);
+}
+
 #define FEEDERS 1
 #define MESSAGES_PER_FEEDER 30000
 #define MESSAGES_SUM (FEEDERS * MESSAGES_PER_FEEDER)
@@ -287,8 +437,137 @@ testcase_with_threads()
   fprintf(stderr, "Feed speed: %.2lf\n", (double) TEST_RUNS * MESSAGES_SUM * 1000000 / sum_time);
 }
 
+#define ORDER_FEEDERS 4
+#define ORDER_MESSAGES_PER_FEEDER 10000
+
+typedef struct _OrderFeeder
+{
+  LogQueue *q;
+  gint id;
+} OrderFeeder;
+
+gpointer
+threaded_order_feed(gpointer args)
+{
+  OrderFeeder *feeder = args;
+  char *msg_str = "<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: árvíztűrőtükörfúrógép";
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg, *tmpl;
+  GSockAddr *sa;
+  gchar value[16];
+  gint i;
+
+  iv_init();
+  main_loop_worker_thread_start(NULL);
+
+  sa = g_sockaddr_inet_new("10.10.10.10", 1010);
+  tmpl = log_msg_new(msg_str, strlen(msg_str), sa, &parse_options);
+  g_sockaddr_unref(sa);
+
+  g_snprintf(value, sizeof(value), "%d", feeder->id);
+  log_msg_set_value_by_name(tmpl, "FEEDER", value, -1);
+  for (i = 0; i < ORDER_MESSAGES_PER_FEEDER; i++)
+    {
+      msg = log_msg_clone_cow(tmpl, &path_options);
+      g_snprintf(value, sizeof(value), "%d", i);
+      log_msg_set_value_by_name(msg, "SEQ", value, -1);
+      log_queue_push_tail(feeder->q, msg, &path_options);
+
+      if ((i & 0xFF) == 0)
+        main_loop_worker_invoke_batch_callbacks();
+    }
+  main_loop_worker_invoke_batch_callbacks();
+
+  log_msg_unref(tmpl);
+  main_loop_worker_thread_stop();
+  iv_deinit();
+  return NULL;
+}
+
+/* the messages of each feeder thread must come out in the order they were pushed */
+gpointer
+threaded_order_consume(gpointer args)
+{
+  LogQueue *q = args;
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg;
+  gint next_seq[ORDER_FEEDERS] = { 0 };
+  gint msg_count = 0;
+  gint slept = 0;
+  gint feeder, seq;
+
+  while (msg_count < ORDER_FEEDERS * ORDER_MESSAGES_PER_FEEDER)
+    {
+      msg = log_queue_pop_head(q, &path_options);
+      if (!msg)
+        {
+          struct timespec ns = { 0, 1000000 };
+
+          nanosleep(&ns, NULL);
+          if (++slept > 10000)
+            {
+              fprintf(stderr, "The wait for messages took too much time, msg_count=%d\n", msg_count);
+              return GUINT_TO_POINTER(1);
+            }
+          continue;
+        }
+
+      feeder = atoi(log_msg_get_value_by_name(msg, "FEEDER", NULL));
+      seq = atoi(log_msg_get_value_by_name(msg, "SEQ", NULL));
+      if (feeder < 0 || feeder >= ORDER_FEEDERS || seq != next_seq[feeder])
+        {
+          fprintf(stderr, "Message out of order, feeder=%d, seq=%d, expected=%d\n",
+                  feeder, seq, feeder >= 0 && feeder < ORDER_FEEDERS ? next_seq[feeder] : -1);
+          log_msg_unref(msg);
+          return GUINT_TO_POINTER(1);
+        }
+      next_seq[feeder]++;
+      log_msg_unref(msg);
+      msg_count++;
+    }
+  return NULL;
+}
+
+void
+testcase_order_is_kept_per_feeder_thread(gboolean lockless)
+{
+  OrderFeeder feeders[ORDER_FEEDERS];
+  GThread *thread_feed[ORDER_FEEDERS], *thread_consume;
+  gint saved_max_threads = log_queue_max_threads;
+  LogQueue *q;
+  gint j;
+
+  log_queue_set_max_threads(ORDER_FEEDERS);
+  q = log_queue_fifo_new(ORDER_FEEDERS * ORDER_MESSAGES_PER_FEEDER, NULL);
+  log_queue_fifo_set_lockless(q, lockless);
+
+  thread_consume = g_thread_create(threaded_order_consume, q, TRUE, NULL);
+  for (j = 0; j < ORDER_FEEDERS; j++)
+    {
+      feeders[j].q = q;
+      feeders[j].id = j;
+      thread_feed[j] = g_thread_create(threaded_order_feed, &feeders[j], TRUE, NULL);
+    }
+
+  for (j = 0; j < ORDER_FEEDERS; j++)
+    g_thread_join(thread_feed[j]);
+  if (g_thread_join(thread_consume))
+    {
+      fprintf(stderr, "Messages were lost or reordered, lockless=%d\n", lockless);
+      exit(1);
+    }
+  if (log_queue_get_length(q) != 0)
+    {
+      fprintf(stderr, "Queue is not empty after all messages were consumed, lockless=%d\n", lockless);
+      exit(1);
+    }
+
+  log_queue_unref(q);
+  log_queue_set_max_threads(saved_max_threads);
+}
+
 int
-main()
+main(int argc, char *argv[])
 {
   app_startup();
   putenv("TZ=MET-1METDST");
@@ -308,5 +587,14 @@ main()
   fprintf(stderr,"Start testcase_zero_diskbuf_and_normal_acks\n");
   testcase_zero_diskbuf_and_normal_acks();
 #endif
+  fprintf(stderr,"Start testcase_pop_batch\n");
+  testcase_pop_batch();
+  fprintf(stderr,"Start testcase_memory_limit_drops_messages\n");
+  testcase_memory_limit_drops_messages();
+  fprintf(stderr,"Start testcase_memory_usage_counter\n");
+  testcase_memory_usage_counter();
+  fprintf(stderr,"Start testcase_order_is_kept_per_feeder_thread\n");
+  testcase_order_is_kept_per_feeder_thread(FALSE);
+  testcase_order_is_kept_per_feeder_thread(TRUE);
   return 0;
 }
@@ -0,0 +1,367 @@
+#include "logqueue.h"
+#include "logqueue-disk.h"
+#include "logmsg.h"
+#include "serialize.h"
+#include "apphook.h"
+#include "plugin.h"
+#include "cfg.h"
+#include "libtest/testutils.h"
+#include "libtest/persist_lib.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_PERSIST_FILE "test_logqueue_disk.persist"
+#define TEST_QUEUE_DIR "test_logqueue_disk.d"
+#define TEST_PERSIST_NAME "test_logqueue_disk"
+
+int acked_messages = 0;
+int fed_messages = 0;
+MsgFormatOptions parse_options;
+
+static void
+test_ack(LogMessage *msg, AckType ack_type)
+{
+  acked_messages++;
+}
+
+static LogMessage *
+create_test_message(gint seq)
+{
+  gchar *msg_str;
+  LogMessage *msg;
+  GSockAddr *sa;
+
+  msg_str = g_strdup_printf("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: árvíztűrőtükörfúrógép #%d", seq);
+  sa = g_sockaddr_inet_new("10.10.10.10", 1010);
+  msg = log_msg_new(msg_str, strlen(msg_str), sa, &parse_options);
+  g_sockaddr_unref(sa);
+  g_free(msg_str);
+  return msg;
+}
+
+static void
+feed_some_messages(LogQueue *q, gint n)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg;
+  gint i;
+
+  path_options.ack_needed = TRUE;
+  for (i = 0; i < n; i++)
+    {
+      msg = create_test_message(fed_messages);
+      log_msg_add_ack(msg, &path_options);
+      msg->ack_func = test_ack;
+      log_queue_push_tail(q, msg, &path_options);
+      fed_messages++;
+    }
+}
+
+static void
+send_some_messages(LogQueue *q, gint n, gint first_seq)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg;
+  gchar *expected;
+  gint i;
+
+  for (i = 0; i < n; i++)
+    {
+      msg = log_queue_pop_head(q, &path_options);
+      assert_not_null(msg, "Disk-queue returned less messages than expected; popped=%d", i);
+
+      expected = g_strdup_printf("árvíztűrőtükörfúrógép #%d", first_seq + i);
+      assert_string(log_msg_get_value(msg, LM_V_MESSAGE, NULL), expected, "Message popped out of order");
+      g_free(expected);
+
+      log_msg_ack(msg, &path_options, AT_PROCESSED);
+      log_msg_unref(msg);
+    }
+}
+
+static void
+remove_queue_dirs(void)
+{
+  GDir *dir, *qdir;
+  const gchar *name, *file;
+
+  dir = g_dir_open(TEST_QUEUE_DIR, 0, NULL);
+  if (!dir)
+    return;
+
+  while ((name = g_dir_read_name(dir)))
+    {
+      gchar *qdirname = g_build_filename(TEST_QUEUE_DIR, name, NULL);
+
+      qdir = g_dir_open(qdirname, 0, NULL);
+      if (qdir)
+        {
+          while ((file = g_dir_read_name(qdir)))
+            {
+              gchar *filename = g_build_filename(qdirname, file, NULL);
+
+              unlink(filename);
+              g_free(filename);
+            }
+          g_dir_close(qdir);
+        }
+      rmdir(qdirname);
+      g_free(qdirname);
+    }
+  g_dir_close(dir);
+  rmdir(TEST_QUEUE_DIR);
+}
+
+static LogQueue *
+create_disk_queue(PersistState *state)
+{
+  QDiskOptions options;
+  LogQueue *q;
+
+  qdisk_options_defaults(&options);
+  options.dir = g_strdup(TEST_QUEUE_DIR);
+  options.segment_size = 4096;
+  options.disk_buf_size = 1024 * 1024;
+  options.qout_size = 16;
+
+  q = log_queue_disk_new(&options, TEST_PERSIST_NAME);
+  qdisk_options_destroy(&options);
+
+  assert_true(log_queue_disk_start(q, state), "Error starting disk-queue");
+  log_queue_set_use_backlog(q, TRUE);
+  return q;
+}
+
+static void
+test_log_msg_serialization_roundtrip(void)
+{
+  LogMessage *msg, *read_msg;
+  GString *stream = g_string_new("");
+  SerializeArchive *sa;
+
+  msg = create_test_message(42);
+  log_msg_set_value_by_name(msg, "custom.field", "value", -1);
+  log_msg_set_tag_by_name(msg, "test_tag");
+
+  sa = serialize_string_archive_new(stream);
+  assert_true(log_msg_write(msg, sa), "Error serializing message");
+  serialize_archive_free(sa);
+
+  read_msg = log_msg_new_empty();
+  sa = serialize_string_archive_new(stream);
+  assert_true(log_msg_read(read_msg, sa), "Error deserializing message");
+  serialize_archive_free(sa);
+
+  assert_string(log_msg_get_value(read_msg, LM_V_MESSAGE, NULL), log_msg_get_value(msg, LM_V_MESSAGE, NULL), "MESSAGE mismatch");
+  assert_string(log_msg_get_value(read_msg, LM_V_HOST, NULL), "bzorp", "HOST mismatch");
+  assert_string(log_msg_get_value(read_msg, LM_V_PROGRAM, NULL), "syslog-ng", "PROGRAM mismatch");
+  assert_string(log_msg_get_value(read_msg, LM_V_PID, NULL), "23323", "PID mismatch");
+  assert_string(log_msg_get_value_by_name(read_msg, "custom.field", NULL), "value", "custom value mismatch");
+  assert_true(log_msg_is_tag_by_name(read_msg, "test_tag"), "tag was lost");
+  assert_gint(read_msg->pri, msg->pri, "pri mismatch");
+  assert_gint64(read_msg->timestamps[LM_TS_STAMP].tv_sec, msg->timestamps[LM_TS_STAMP].tv_sec, "timestamp mismatch");
+  assert_gint(read_msg->timestamps[LM_TS_STAMP].zone_offset, msg->timestamps[LM_TS_STAMP].zone_offset, "zone offset mismatch");
+  assert_true(g_sockaddr_inet_check(read_msg->saddr), "source address was lost");
+
+  log_msg_unref(read_msg);
+  log_msg_unref(msg);
+  g_string_free(stream, TRUE);
+}
+
+static void
+test_disk_queue_push_pop_and_ack(void)
+{
+  PersistState *state = clean_and_create_persist_state_for_test(TEST_PERSIST_FILE);
+  LogQueue *q = create_disk_queue(state);
+
+  fed_messages = 0;
+  acked_messages = 0;
+  feed_some_messages(q, 100);
+  assert_gint(acked_messages, fed_messages, "Messages written to disk should be acked towards the source");
+  assert_gint(log_queue_get_length(q), 100, "Disk-queue length mismatch after feeding");
+
+  send_some_messages(q, 100, 0);
+  assert_gint(log_queue_get_length(q), 0, "Disk-queue should be empty after sending");
+
+  log_queue_rewind_backlog_all(q);
+  assert_gint(log_queue_get_length(q), 100, "Rewind should put back unacked messages");
+  send_some_messages(q, 100, 0);
+  log_queue_ack_backlog(q, 100);
+
+  log_queue_unref(q);
+  cancel_and_destroy_persist_state(state);
+}
+
+static void
+test_disk_queue_survives_restart(void)
+{
+  PersistState *state = clean_and_create_persist_state_for_test(TEST_PERSIST_FILE);
+  LogQueue *q = create_disk_queue(state);
+
+  fed_messages = 0;
+  acked_messages = 0;
+  feed_some_messages(q, 100);
+
+  /* 20 messages are acked, 10 are in the backlog at shutdown */
+  send_some_messages(q, 30, 0);
+  log_queue_ack_backlog(q, 20);
+  log_queue_unref(q);
+
+  state = restart_persist_state(state);
+  q = create_disk_queue(state);
+  assert_gint(log_queue_get_length(q), 80, "Unacked messages should be kept on disk across restarts");
+
+  send_some_messages(q, 80, 20);
+  log_queue_ack_backlog(q, 80);
+  assert_gint(log_queue_get_length(q), 0, "Disk-queue should be empty at the end");
+
+  log_queue_unref(q);
+  cancel_and_destroy_persist_state(state);
+}
+
+static void
+test_disk_queue_push_head_without_backlog_survives_restart(void)
+{
+  PersistState *state = clean_and_create_persist_state_for_test(TEST_PERSIST_FILE);
+  LogQueue *q = create_disk_queue(state);
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg;
+
+  log_queue_set_use_backlog(q, FALSE);
+  fed_messages = 0;
+  acked_messages = 0;
+  feed_some_messages(q, 100);
+
+  send_some_messages(q, 10, 0);
+
+  /* the destination fails to send the next message and puts it back */
+  msg = log_queue_pop_head(q, &path_options);
+  assert_not_null(msg, "Disk-queue should not be empty");
+  log_queue_push_head(q, msg, &path_options);
+  assert_gint(log_queue_get_length(q), 90, "Message put back should be counted again");
+  log_queue_unref(q);
+
+  state = restart_persist_state(state);
+  q = create_disk_queue(state);
+  assert_gint(log_queue_get_length(q), 90, "Message put back should still be on disk after a restart");
+  send_some_messages(q, 90, 10);
+  log_queue_ack_backlog(q, 90);
+
+  log_queue_unref(q);
+  cancel_and_destroy_persist_state(state);
+}
+
+static void
+test_disk_queue_recovers_records_written_after_the_last_saved_state(void)
+{
+  PersistState *state = clean_and_create_persist_state_for_test(TEST_PERSIST_FILE);
+  LogQueue *q = create_disk_queue(state);
+
+  fed_messages = 0;
+  acked_messages = 0;
+  feed_some_messages(q, 10);
+
+  /* crash: the queue is not stopped, its state is not saved */
+  state = restart_persist_state(state);
+  q = create_disk_queue(state);
+  assert_gint(log_queue_get_length(q), 10, "Records written after the last saved state were not recovered");
+  send_some_messages(q, 10, 0);
+  log_queue_ack_backlog(q, 10);
+
+  log_queue_unref(q);
+  cancel_and_destroy_persist_state(state);
+}
+
+static void
+test_disk_queue_skips_only_the_damaged_segment(void)
+{
+  PersistState *state = clean_and_create_persist_state_for_test(TEST_PERSIST_FILE);
+  LogQueue *q = create_disk_queue(state);
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  gchar *segment = g_build_filename(TEST_QUEUE_DIR, "syslog-ng-00000.qd", "0000000000000000.seg", NULL);
+  LogMessage *msg, *last = NULL;
+  gint popped = 0;
+
+  fed_messages = 0;
+  acked_messages = 0;
+  feed_some_messages(q, 100);
+  log_queue_unref(q);
+
+  /* the first record of the first segment is cut in half */
+  assert_gint(truncate(segment, 100), 0, "Error truncating the disk-queue segment");
+
+  state = restart_persist_state(state);
+  q = create_disk_queue(state);
+  while ((msg = log_queue_pop_head(q, &path_options)))
+    {
+      if (last)
+        log_msg_unref(last);
+      last = msg;
+      popped++;
+    }
+  assert_true(popped > 0, "The records of the undamaged segments were dropped too");
+  assert_true(popped < 100, "The records of the damaged segment were read");
+  assert_not_null(last, "No message was read");
+  assert_string(log_msg_get_value(last, LM_V_MESSAGE, NULL), "árvíztűrőtükörfúrógép #99", "The last message was not read");
+  assert_gint(log_queue_get_length(q), 0, "Disk-queue should be empty at the end");
+  log_msg_unref(last);
+  log_queue_ack_backlog(q, popped);
+
+  log_queue_unref(q);
+  cancel_and_destroy_persist_state(state);
+  g_free(segment);
+}
+
+static void
+test_disk_queue_reuses_orphaned_dir(void)
+{
+  PersistState *state;
+  LogQueue *q;
+  gchar *orphan = g_build_filename(TEST_QUEUE_DIR, "syslog-ng-00000.qd", NULL);
+  gchar *orphan_file = g_build_filename(orphan, "leftover.seg", NULL);
+
+  g_mkdir_with_parents(orphan, 0700);
+  g_file_set_contents(orphan_file, "garbage", -1, NULL);
+
+  state = clean_and_create_persist_state_for_test(TEST_PERSIST_FILE);
+  q = create_disk_queue(state);
+  assert_false(g_file_test(orphan_file, G_FILE_TEST_EXISTS), "Orphaned disk-queue directory should be cleaned up");
+  assert_true(g_file_test(orphan, G_FILE_TEST_IS_DIR), "Orphaned disk-queue directory id should be reused");
+
+  log_queue_unref(q);
+  cancel_and_destroy_persist_state(state);
+  g_free(orphan_file);
+  g_free(orphan);
+}
+
+int
+main()
+{
+  app_startup();
+  putenv("TZ=MET-1METDST");
+  tzset();
+
+  configuration = cfg_new(0x0302);
+  plugin_load_module("syslogformat", configuration, NULL);
+  msg_format_options_defaults(&parse_options);
+  msg_format_options_init(&parse_options, configuration);
+
+  remove_queue_dirs();
+  test_log_msg_serialization_roundtrip();
+  test_disk_queue_push_pop_and_ack();
+  test_disk_queue_survives_restart();
+  test_disk_queue_push_head_without_backlog_survives_restart();
+  remove_queue_dirs();
+  test_disk_queue_recovers_records_written_after_the_last_saved_state();
+  remove_queue_dirs();
+  test_disk_queue_skips_only_the_damaged_segment();
+  remove_queue_dirs();
+  test_disk_queue_reuses_orphaned_dir();
+  remove_queue_dirs();
+
+  cfg_free(configuration);
+  app_shutdown();
+  return 0;
+}
@@ -0,0 +1,448 @@
+#include "logthrdestdrv.h"
+#include "logqueue-fifo.h"
+#include "logqueue-disk.h"
+#include "mainloop.h"
+#include "mainloop-call.h"
+#include "mainloop-worker.h"
+#include "persist-state.h"
+#include "timeutils.h"
+#include "apphook.h"
+#include "cfg.h"
+#include "libtest/testutils.h"
+#include "libtest/persist_lib.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_PERSIST_FILE "test_logthrdestdrv.persist"
+#define TEST_PERSIST_NAME "test_thrdest"
+#define TEST_QUEUE_DIR "test_logthrdestdrv.d"
+#define TEST_MAX_WORKERS 8
+
+typedef struct _TestThrDestDriver
+{
+  LogThrDestDriver super;
+
+  GStaticMutex lock;
+  gint inserted[TEST_MAX_WORKERS];
+  gint total;
+  /* host -> index of the worker that got it */
+  GHashTable *host_workers;
+  gint partition_violations;
+  /* sequence numbers given to the inserted messages */
+  GHashTable *seq_nums;
+  gint seq_num_duplicates;
+
+  /* batching: total only counts the messages of successful flushes */
+  gint queued;
+  gint flushes;
+  gint inserts;
+  gint flush_rewinds_left;
+} TestThrDestDriver;
+
+static worker_insert_result_t
+test_dd_insert(LogThrDestDriver *s, LogMessage *msg)
+{
+  TestThrDestDriver *self = (TestThrDestDriver *) s;
+  LogThrDestWorker *worker = log_threaded_dest_driver_get_current_worker(s);
+  const gchar *host = log_msg_get_value(msg, LM_V_HOST, NULL);
+  gpointer prev_worker;
+
+  g_static_mutex_lock(&self->lock);
+  self->inserted[worker->worker_index]++;
+  self->total++;
+  if (g_hash_table_lookup(self->seq_nums, GINT_TO_POINTER(log_threaded_dest_driver_get_seq_num(s))))
+    self->seq_num_duplicates++;
+  g_hash_table_insert(self->seq_nums, GINT_TO_POINTER(log_threaded_dest_driver_get_seq_num(s)), GINT_TO_POINTER(TRUE));
+  if (g_hash_table_lookup_extended(self->host_workers, host, NULL, &prev_worker))
+    {
+      if (GPOINTER_TO_INT(prev_worker) != worker->worker_index)
+        self->partition_violations++;
+    }
+  else
+    {
+      g_hash_table_insert(self->host_workers, g_strdup(host), GINT_TO_POINTER(worker->worker_index));
+    }
+  g_static_mutex_unlock(&self->lock);
+  return WORKER_INSERT_RESULT_SUCCESS;
+}
+
+static worker_insert_result_t
+test_dd_insert_queued(LogThrDestDriver *s, LogMessage *msg)
+{
+  TestThrDestDriver *self = (TestThrDestDriver *) s;
+  worker_insert_result_t result = WORKER_INSERT_RESULT_QUEUED;
+
+  g_static_mutex_lock(&self->lock);
+  self->inserts++;
+  if (strcmp(log_msg_get_value(msg, LM_V_HOST, NULL), "drop") == 0)
+    result = WORKER_INSERT_RESULT_DROP;
+  else
+    self->queued++;
+  g_static_mutex_unlock(&self->lock);
+  return result;
+}
+
+static worker_insert_result_t
+test_dd_flush(LogThrDestDriver *s)
+{
+  TestThrDestDriver *self = (TestThrDestDriver *) s;
+  worker_insert_result_t result = WORKER_INSERT_RESULT_SUCCESS;
+
+  g_static_mutex_lock(&self->lock);
+  self->flushes++;
+  if (self->flush_rewinds_left > 0)
+    {
+      self->flush_rewinds_left--;
+      result = WORKER_INSERT_RESULT_REWIND;
+    }
+  else
+    {
+      self->total += self->queued;
+    }
+  self->queued = 0;
+  g_static_mutex_unlock(&self->lock);
+  return result;
+}
+
+static gchar *
+test_dd_format_name(LogThrDestDriver *s)
+{
+  return TEST_PERSIST_NAME;
+}
+
+static gboolean
+test_dd_init(LogPipe *s)
+{
+  if (!log_dest_driver_init_method(s))
+    return FALSE;
+  return log_threaded_dest_driver_start(s);
+}
+
+static void
+test_dd_free(LogPipe *s)
+{
+  TestThrDestDriver *self = (TestThrDestDriver *) s;
+
+  g_hash_table_destroy(self->host_workers);
+  g_hash_table_destroy(self->seq_nums);
+  g_static_mutex_free(&self->lock);
+  log_threaded_dest_driver_free(s);
+}
+
+static TestThrDestDriver *
+test_dd_new(gint num_workers)
+{
+  TestThrDestDriver *self = g_new0(TestThrDestDriver, 1);
+
+  log_threaded_dest_driver_init_instance(&self->super, configuration);
+  self->super.super.super.super.init = test_dd_init;
+  self->super.super.super.super.free_fn = test_dd_free;
+  self->super.super.super.group = g_strdup("test_group");
+  self->super.super.super.id = g_strdup("test_id");
+
+  self->super.worker.insert = test_dd_insert;
+  self->super.format.stats_instance = test_dd_format_name;
+  self->super.format.persist_name = test_dd_format_name;
+  self->super.stats_source = SCS_PROGRAM;
+  self->super.supports_multiple_workers = TRUE;
+  log_threaded_dest_driver_set_num_workers(&self->super.super.super, num_workers);
+
+  g_static_mutex_init(&self->lock);
+  self->host_workers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  self->seq_nums = g_hash_table_new(g_direct_hash, g_direct_equal);
+  return self;
+}
+
+static TestThrDestDriver *
+test_dd_new_batching(gint batch_lines, gint batch_timeout)
+{
+  TestThrDestDriver *self = test_dd_new(1);
+
+  self->super.worker.insert = test_dd_insert_queued;
+  self->super.worker.flush = test_dd_flush;
+  log_threaded_dest_driver_set_batch_lines(&self->super.super.super, batch_lines);
+  log_threaded_dest_driver_set_batch_timeout(&self->super.super.super, batch_timeout);
+  return self;
+}
+
+static LogMessage *
+create_test_message(const gchar *host)
+{
+  LogMessage *msg = log_msg_new_empty();
+
+  log_msg_set_value(msg, LM_V_HOST, host, -1);
+  log_msg_set_value(msg, LM_V_MESSAGE, "test message", -1);
+  return msg;
+}
+
+static void
+send_messages(TestThrDestDriver *self, gint num_hosts, gint msgs_per_host)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  gint i, j;
+
+  for (i = 0; i < msgs_per_host; i++)
+    {
+      for (j = 0; j < num_hosts; j++)
+        {
+          gchar host[32];
+
+          g_snprintf(host, sizeof(host), "host%d", j);
+          log_pipe_queue(&self->super.super.super.super, create_test_message(host), &path_options);
+        }
+    }
+}
+
+static void
+stop_main_loop(void)
+{
+  iv_quit();
+}
+
+typedef struct _WaitState
+{
+  TestThrDestDriver *driver;
+  gint expected;
+  gint polls;
+  struct iv_timer timer;
+} WaitState;
+
+static void
+wait_timer_expired(gpointer cookie)
+{
+  WaitState *state = (WaitState *) cookie;
+  gint total;
+
+  g_static_mutex_lock(&state->driver->lock);
+  total = state->driver->total;
+  g_static_mutex_unlock(&state->driver->lock);
+
+  /* give up after 10 seconds */
+  if (total >= state->expected || ++state->polls > 1000)
+    {
+      main_loop_worker_sync_call(stop_main_loop);
+      return;
+    }
+
+  iv_validate_now();
+  state->timer.expires = iv_now;
+  timespec_add_msec(&state->timer.expires, 10);
+  iv_timer_register(&state->timer);
+}
+
+/* runs the main loop until @expected messages were inserted, then stops the workers */
+static void
+run_workers_until_inserted(TestThrDestDriver *self, gint expected)
+{
+  WaitState state = { 0 };
+
+  state.driver = self;
+  state.expected = expected;
+  IV_TIMER_INIT(&state.timer);
+  state.timer.cookie = &state;
+  state.timer.handler = wait_timer_expired;
+  iv_validate_now();
+  state.timer.expires = iv_now;
+  iv_timer_register(&state.timer);
+
+  iv_main();
+}
+
+static void
+stop_driver(TestThrDestDriver *self)
+{
+  assert_true(log_pipe_deinit(&self->super.super.super.super), "Error deinitializing the destination");
+  log_pipe_unref(&self->super.super.super.super);
+}
+
+static void
+test_messages_are_distributed_round_robin(void)
+{
+  TestThrDestDriver *self = test_dd_new(4);
+  gint i;
+
+  assert_true(log_pipe_init(&self->super.super.super.super), "Error initializing the destination");
+  send_messages(self, 4, 100);
+  run_workers_until_inserted(self, 400);
+
+  assert_gint(self->total, 400, "Not every message was inserted");
+  for (i = 0; i < 4; i++)
+    assert_gint(self->inserted[i], 100, "Messages were not distributed evenly between the workers, worker=%d", i);
+  assert_gint(self->seq_num_duplicates, 0, "The workers gave out the same sequence number more than once");
+  stop_driver(self);
+}
+
+static void
+test_messages_with_the_same_partition_key_go_to_the_same_worker(void)
+{
+  TestThrDestDriver *self = test_dd_new(4);
+  LogTemplate *key = log_template_new(configuration, NULL);
+  gint i, used_workers = 0;
+
+  assert_true(log_template_compile(key, "$HOST", NULL), "Error compiling the partition key");
+  log_threaded_dest_driver_set_worker_partition_key(&self->super.super.super, key);
+  log_template_unref(key);
+
+  assert_true(log_pipe_init(&self->super.super.super.super), "Error initializing the destination");
+  send_messages(self, 16, 20);
+  run_workers_until_inserted(self, 320);
+
+  assert_gint(self->total, 320, "Not every message was inserted");
+  assert_gint(self->partition_violations, 0, "Messages of the same host were processed by different workers");
+  for (i = 0; i < 4; i++)
+    used_workers += (self->inserted[i] > 0);
+  assert_true(used_workers > 1, "The partition key should spread the hosts between the workers");
+  stop_driver(self);
+}
+
+static void
+test_queues_of_removed_workers_are_merged(void)
+{
+  TestThrDestDriver *self = test_dd_new(2);
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogQueue *removed_queue;
+  gchar *workers;
+  gint i;
+
+  /* a previous configuration used 3 workers, the third one left 10 messages behind */
+  persist_state_alloc_string(configuration->state, TEST_PERSIST_NAME ".workers", "3", -1);
+  removed_queue = log_queue_fifo_new(1000, TEST_PERSIST_NAME "#2");
+  for (i = 0; i < 10; i++)
+    log_queue_push_tail(removed_queue, create_test_message("removed"), &path_options);
+  cfg_persist_config_add(configuration, TEST_PERSIST_NAME "#2", removed_queue, (GDestroyNotify) log_queue_unref, FALSE);
+
+  assert_true(log_pipe_init(&self->super.super.super.super), "Error initializing the destination");
+  assert_null(cfg_persist_config_fetch(configuration, TEST_PERSIST_NAME "#2"), "The queue of the removed worker was left behind");
+  run_workers_until_inserted(self, 10);
+
+  assert_gint(self->total, 10, "The messages of the removed worker were not processed");
+  workers = persist_state_lookup_string(configuration->state, TEST_PERSIST_NAME ".workers", NULL, NULL);
+  assert_string(workers, "2", "The number of workers was not saved");
+  g_free(workers);
+  stop_driver(self);
+}
+
+static void
+test_drained_disk_queue_of_removed_worker_is_removed(void)
+{
+  TestThrDestDriver *self = test_dd_new(2);
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  QDiskOptions options;
+  LogQueue *removed_queue;
+  gsize size;
+  guint8 version;
+  gint i;
+
+  qdisk_options_defaults(&options);
+  options.dir = g_strdup(TEST_QUEUE_DIR);
+  persist_state_alloc_string(configuration->state, TEST_PERSIST_NAME ".workers", "3", -1);
+  removed_queue = log_queue_disk_new(&options, TEST_PERSIST_NAME "#2");
+  qdisk_options_destroy(&options);
+  assert_true(log_queue_disk_start(removed_queue, configuration->state), "Error starting disk-queue");
+  for (i = 0; i < 10; i++)
+    log_queue_push_tail(removed_queue, create_test_message("removed"), &path_options);
+  cfg_persist_config_add(configuration, TEST_PERSIST_NAME "#2", removed_queue, (GDestroyNotify) log_queue_unref, FALSE);
+
+  assert_true(log_pipe_init(&self->super.super.super.super), "Error initializing the destination");
+  assert_null(cfg_persist_config_fetch(configuration, TEST_PERSIST_NAME "#2"), "The drained disk-queue was kept");
+  assert_false(persist_state_lookup_entry(configuration->state, TEST_PERSIST_NAME "#2.qdisk", &size, &version),
+               "The persist entry of the drained disk-queue was not removed");
+  assert_false(g_file_test(TEST_QUEUE_DIR "/syslog-ng-00000.qd", G_FILE_TEST_EXISTS),
+               "The files of the drained disk-queue were not removed");
+  run_workers_until_inserted(self, 10);
+
+  assert_gint(self->total, 10, "The messages of the drained disk-queue were not processed");
+  stop_driver(self);
+  rmdir(TEST_QUEUE_DIR);
+}
+
+static void
+test_batch_is_flushed_at_batch_lines(void)
+{
+  /* the timeout is long enough to never expire during the test */
+  TestThrDestDriver *self = test_dd_new_batching(10, 60000);
+
+  assert_true(log_pipe_init(&self->super.super.super.super), "Error initializing the destination");
+  send_messages(self, 1, 100);
+  run_workers_until_inserted(self, 100);
+
+  assert_gint(self->total, 100, "Not every message was flushed");
+  assert_gint(self->flushes, 10, "The batches were not flushed at batch_lines()");
+  stop_driver(self);
+}
+
+static void
+test_rewound_batch_is_retried_after_flush_timeout(void)
+{
+  TestThrDestDriver *self = test_dd_new_batching(100, 10);
+  gint32 seq_num;
+
+  self->flush_rewinds_left = 1;
+  assert_true(log_pipe_init(&self->super.super.super.super), "Error initializing the destination");
+  seq_num = g_atomic_int_get(&self->super.seq_num);
+  send_messages(self, 1, 10);
+  run_workers_until_inserted(self, 10);
+
+  assert_gint(self->total, 10, "The rewound batch was not processed again");
+  assert_gint(self->inserts, 20, "Every message of the rewound batch should be inserted twice");
+  assert_gint(self->flushes, 2, "The batch should be flushed once more after the rewind");
+  assert_gint(g_atomic_int_get(&self->super.seq_num), seq_num + 10,
+              "The sequence numbers of the rewound messages were not given out again");
+  stop_driver(self);
+}
+
+/* the batch is flushed at batch_lines() even if its last message is dropped */
+static void
+test_dropped_message_does_not_drop_the_batch(gint drop_index)
+{
+  TestThrDestDriver *self = test_dd_new_batching(10, 60000);
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  guint32 dropped;
+  gint i;
+
+  assert_true(log_pipe_init(&self->super.super.super.super), "Error initializing the destination");
+  dropped = stats_counter_get(self->super.workers[0].dropped_messages);
+  for (i = 0; i < 10; i++)
+    log_pipe_queue(&self->super.super.super.super, create_test_message(i == drop_index ? "drop" : "host0"), &path_options);
+  run_workers_until_inserted(self, 9);
+
+  assert_gint(self->total, 9, "The messages queued around the dropped one were not flushed");
+  assert_gint(self->flushes, 1, "The batch should be flushed once");
+  assert_gint(stats_counter_get(self->super.workers[0].dropped_messages) - dropped, 1,
+              "Only the dropped message should be counted as dropped");
+  assert_false(self->super.workers[0].suspended, "A dropped message should not suspend a batching destination");
+  stop_driver(self);
+}
+
+int
+main(int argc, char *argv[])
+{
+  app_startup();
+  main_thread_handle = get_thread_id();
+  main_loop_worker_init();
+  main_loop_call_init();
+
+  configuration = cfg_new(0x0302);
+  configuration->state = clean_and_create_persist_state_for_test(TEST_PERSIST_FILE);
+  configuration->persist = persist_config_new();
+
+  test_messages_are_distributed_round_robin();
+  test_messages_with_the_same_partition_key_go_to_the_same_worker();
+  test_queues_of_removed_workers_are_merged();
+  test_drained_disk_queue_of_removed_worker_is_removed();
+  test_batch_is_flushed_at_batch_lines();
+  test_rewound_batch_is_retried_after_flush_timeout();
+  test_dropped_message_does_not_drop_the_batch(4);
+  test_dropped_message_does_not_drop_the_batch(9);
+
+  persist_config_free(configuration->persist);
+  configuration->persist = NULL;
+  cancel_and_destroy_persist_state(configuration->state);
+  configuration->state = NULL;
+  cfg_free(configuration);
+
+  main_loop_call_deinit();
+  app_shutdown();
+  return 0;
+}
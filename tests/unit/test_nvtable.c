@@ -1,6 +1,7 @@
 #include "nvtable.h"
 #include "apphook.h"
 #include "logmsg.h"
+#include "libtest/testutils.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -732,6 +733,74 @@ test_nvtable_lookup()
     }
 }
 
+static NVTable *
+add_dyn_values_with_realloc(NVTable *tab, NVHandle *handles, gint num)
+{
+  gchar name[16];
+  gint i;
+
+  for (i = 0; i < num; i++)
+    {
+      g_snprintf(name, sizeof(name), "VAL%d", handles[i]);
+      while (!nv_table_add_value(tab, handles[i], name, strlen(name), name, strlen(name), NULL))
+        TEST_ASSERT(nv_table_realloc(tab, &tab));
+    }
+  return tab;
+}
+
+static void
+assert_dyn_values(NVTable *tab, NVHandle *handles, gint num)
+{
+  gchar name[16];
+  gint i;
+
+  for (i = 0; i < num; i++)
+    {
+      g_snprintf(name, sizeof(name), "VAL%d", handles[i]);
+      TEST_NVTABLE_ASSERT(tab, handles[i], name, strlen(name));
+    }
+  TEST_ASSERT(nv_table_is_value_set(tab, 0xFE00) == FALSE);
+}
+
+static void
+test_nvtable_dyn_index()
+{
+  NVTable *tab, *tab_clone;
+  NVHandle handles[500];
+  gint i;
+
+  for (i = 0; i < 500; i++)
+    handles[i] = STATIC_VALUES + 1 + ((i * 7919) % 30000);
+
+  tab = nv_table_new(STATIC_VALUES, STATIC_VALUES, 64);
+  tab = add_dyn_values_with_realloc(tab, handles, 500);
+  TEST_ASSERT(tab->num_dyn_entries == 500);
+  TEST_ASSERT(tab->dyn_index_ofs != 0);
+  assert_dyn_values(tab, handles, 500);
+
+  /* the index is stored in the payload area, so clones have it too */
+  tab_clone = nv_table_clone(tab, 64);
+  TEST_ASSERT(tab_clone->dyn_index_ofs == tab->dyn_index_ofs);
+  assert_dyn_values(tab_clone, handles, 500);
+
+  /* overwriting values does not change the index */
+  tab_clone = add_dyn_values_with_realloc(tab_clone, handles, 500);
+  assert_dyn_values(tab_clone, handles, 500);
+  nv_table_unref(tab_clone);
+
+  /* without the index, binary search is used */
+  tab->dyn_index_ofs = 0;
+  assert_dyn_values(tab, handles, 500);
+  nv_table_unref(tab);
+
+  /* the index is not built if it would use up space needed by values */
+  tab = nv_table_new(STATIC_VALUES, 64, 64 * 40);
+  tab = add_dyn_values_with_realloc(tab, handles, 64);
+  TEST_ASSERT(tab->dyn_index_ofs == 0);
+  assert_dyn_values(tab, handles, 64);
+  nv_table_unref(tab);
+}
+
 static void
 test_nvtable_clone_grows_the_cloned_structure(void)
 {
@@ -881,6 +950,7 @@ test_nvtable(void)
   test_nvtable_indirect();
   test_nvtable_others();
   test_nvtable_lookup();
+  test_nvtable_dyn_index();
   test_nvtable_clone();
   test_nvtable_realloc();
 }